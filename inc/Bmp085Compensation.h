@@ -0,0 +1,168 @@
+#pragma once
+
+#include "FixedPt.h"
+
+#include <cstdint>
+
+// BMP085/BMP180 compensation, all in integers (the datasheet's own algorithm, with no
+// floats anywhere, since the nRF51 has no FPU).
+//
+// Compensating a pressure reading needs B5, which comes from a temperature reading, but
+// the temperature changes much more slowly than the pressure. So B5 is kept from one
+// temperature reading for the next few pressure readings (setTemperatureReuse()), and
+// needsTemperature() says when it's time for another one. If the temperature moved by
+// more than half a degree since the last reading, it asks again straight away, until it
+// settles.
+
+struct Bmp085Calibration
+{
+    int16_t ac1, ac2, ac3;
+    uint16_t ac4, ac5, ac6;
+    int16_t b1, b2, mb, mc, md;
+
+    // From the 22 bytes of calibration registers (0xAA to 0xBF), which are big-endian
+    static Bmp085Calibration fromRegisters(const uint8_t* data)
+    {
+        auto word = [data](int index) { return uint16_t((data[2 * index] << 8) | data[2 * index + 1]); };
+        return { int16_t(word(0)), int16_t(word(1)), int16_t(word(2)), word(3), word(4), word(5),
+                 int16_t(word(6)), int16_t(word(7)), int16_t(word(8)), int16_t(word(9)), int16_t(word(10)) };
+    }
+
+    // The worked example in the datasheet
+    static Bmp085Calibration datasheet()
+    {
+        return { 408, -72, -14383, 32741, 32757, 23153, 6190, 4, -32768, -8711, 2868 };
+    }
+};
+
+class Bmp085Compensation
+{
+public:
+    using Temperature = FixedPt<16, 16>; // degrees C
+    using Pressure = FixedPt<24, 8>;     // Pa
+    using Altitude = FixedPt<24, 8>;     // m
+
+    static constexpr int32_t seaLevelPressure = 101325; // Pa
+
+    Bmp085Compensation(const Bmp085Calibration& calibration, int temperatureReuse = 8)
+        : calibration_(calibration)
+    {
+        setTemperatureReuse(temperatureReuse);
+    }
+
+    void setCalibration(const Bmp085Calibration& calibration) { calibration_ = calibration; haveB5_ = false; }
+    void setTemperatureReuse(int numPressureReads) { reuse_ = uint8_t(numPressureReads < 1 ? 1 : numPressureReads > 255 ? 255 : numPressureReads); }
+
+    bool needsTemperature() const { return !haveB5_ || reuseLeft_ == 0; }
+    void setRawTemperature(int32_t ut);
+
+    int32_t getTemperatureTenths() const { return (b5_ + 8) >> 4; } // 0.1 degrees C, as in the datasheet
+    Temperature getTemperature() const { return Temperature(getTemperatureTenths() * 65536 / 10, true); }
+
+    // Compensates a raw pressure reading, taken at the given oversampling mode, with the
+    // last temperature (and counts it against the reuse)
+    int32_t getPressurePa(int32_t up, int mode);
+    Pressure getPressure(int32_t up, int mode) { return Pressure(getPressurePa(up, mode) << 8, true); }
+
+    // Height above the level where the pressure is seaLevel, from the international
+    // barometric formula, h = 44330 m * (1 - (p / p0) ^ (1 / 5.255)). Good to a few cm
+    // near sea level and under a metre at 10 km (the highest it goes).
+    static Altitude getAltitude(Pressure pressure, int32_t seaLevel = seaLevelPressure);
+
+    int32_t getB5() const { return b5_; }
+
+private:
+    static constexpr int32_t stableB5Change = 80; // half a degree
+
+    Bmp085Calibration calibration_;
+    int32_t b5_ = 0;
+    bool haveB5_ = false;
+    uint8_t reuse_ = 1;
+    uint8_t reuseLeft_ = 0;
+};
+
+inline void Bmp085Compensation::setRawTemperature(int32_t ut)
+{
+    int32_t x1 = ((ut - int32_t(calibration_.ac6)) * int32_t(calibration_.ac5)) >> 15;
+    int32_t x2 = (int32_t(calibration_.mc) << 11) / (x1 + int32_t(calibration_.md));
+    int32_t b5 = x1 + x2;
+
+    int32_t change = b5 - b5_;
+    bool stable = haveB5_ && change <= stableB5Change && change >= -stableB5Change;
+    b5_ = b5;
+    haveB5_ = true;
+    reuseLeft_ = stable ? reuse_ : 1;
+}
+
+inline int32_t Bmp085Compensation::getPressurePa(int32_t up, int mode)
+{
+    if (reuseLeft_ > 0)
+    {
+        reuseLeft_--;
+    }
+
+    const auto& c = calibration_;
+    int32_t b6 = b5_ - 4000;
+    int32_t x1 = (c.b2 * ((b6 * b6) >> 12)) >> 11;
+    int32_t x2 = (c.ac2 * b6) >> 11;
+    int32_t x3 = x1 + x2;
+    int32_t b3 = (((int32_t(c.ac1) * 4 + x3) << mode) + 2) >> 2;
+    x1 = (c.ac3 * b6) >> 13;
+    x2 = (c.b1 * ((b6 * b6) >> 12)) >> 16;
+    x3 = ((x1 + x2) + 2) >> 2;
+    uint32_t b4 = (c.ac4 * uint32_t(x3 + 32768)) >> 15;
+    uint32_t b7 = uint32_t(up - b3) * uint32_t(50000 >> mode);
+
+    int32_t p = b7 < 0x80000000 ? int32_t((b7 << 1) / b4) : int32_t((b7 / b4) << 1);
+    x1 = (p >> 8) * (p >> 8);
+    x1 = (x1 * 3038) >> 16;
+    x2 = (-7357 * p) >> 16;
+    return p + ((x1 + x2 + 3791) >> 4);
+}
+
+inline Bmp085Compensation::Altitude Bmp085Compensation::getAltitude(Pressure pressure, int32_t seaLevel)
+{
+    // The formula at 1/128 steps of p / p0 from 0.25 to 1.25, in m with 8 fractional bits
+    static const int32_t altitudeTable[129] =
+        {
+            2631446, 2580252, 2530300, 2481522, 2433861, 2387260, 2341668, 2297037,
+            2253323, 2210485, 2168486, 2127288, 2086859, 2047167, 2008183, 1969879,
+            1932230, 1895210, 1858797, 1822970, 1787706, 1752988, 1718795, 1685112,
+            1651921, 1619207, 1586954, 1555148, 1523776, 1492824, 1462281, 1432133,
+            1402371, 1372983, 1343959, 1315289, 1286963, 1258972, 1231308, 1203963,
+            1176927, 1150193, 1123755, 1097604, 1071734, 1046139, 1020811, 995744,
+            970933, 946372, 922056, 897978, 874134, 850519, 827128, 803956,
+            780998, 758251, 735710, 713371, 691229, 669282, 647525, 625954,
+            604567, 583359, 562328, 541469, 520781, 500259, 479901, 459705,
+            439666, 419783, 400052, 380472, 361039, 341752, 322607, 303602,
+            284736, 266006, 247409, 228944, 210608, 192400, 174318, 156359,
+            138522, 120805, 103207, 85724, 68356, 51102, 33959, 16925,
+            0, -16818, -33532, -50141, -66648, -83054, -99361, -115569,
+            -131681, -147696, -163618, -179446, -195182, -210828, -226384, -241851,
+            -257231, -272525, -287734, -302859, -317900, -332860, -347738, -362536,
+            -377256, -391897, -406460, -420948, -435359, -449697, -463960, -478151,
+            -492269,
+        };
+
+    // p / p0 with 22 fractional bits, in two steps so it doesn't overflow
+    uint32_t p = pressure.value_ < 0 ? 0 : uint32_t(pressure.value_) << 6;
+    uint32_t ratio = p / uint32_t(seaLevel);
+    ratio = (ratio << 8) + (((p % uint32_t(seaLevel)) << 8) / uint32_t(seaLevel));
+
+    // and along the table, linearly between entries
+    const uint32_t start = 1u << 20; // 0.25
+    const int stepBits = 15;
+    if (ratio < start)
+    {
+        return Altitude(altitudeTable[0], true);
+    }
+    uint32_t x = ratio - start;
+    uint32_t index = x >> stepBits;
+    if (index >= 128)
+    {
+        return Altitude(altitudeTable[128], true);
+    }
+    int32_t fraction = int32_t(x & ((1u << stepBits) - 1));
+    int32_t step = altitudeTable[index + 1] - altitudeTable[index];
+    return Altitude(altitudeTable[index] + ((step * fraction) >> stepBits), true);
+}
@@ -0,0 +1,210 @@
+#pragma once
+
+#include "I2CRegisters.h"
+
+#include <cstdint>
+
+// Raw BMP085/BMP180 conversions without blocking. A conversion is a register write to
+// start it, 4.5 ms to 25.5 ms for the chip to do it, and a register read to fetch the
+// result; the old driver sat in wait_ms() in the middle, which stalls the fiber and
+// pushes the 18 ms accelerometer tick around. Here poll() does whichever step is due
+// and returns straight away, saying how long until it wants to be called again, so the
+// caller can sleep (yield) in between, or just poll from a loop that's running anyway.
+//
+// Each measurement is a temperature conversion and then a pressure conversion, at the
+// oversampling mode (0-3) set with setMode(). The last complete pair is kept, with the
+// time it finished, until the next one replaces it. Compensating the raw values is up
+// to the caller (see Bmp085Compensation.h), which can also skip the temperature
+// conversion when it doesn't need a new one (setTemperatureNeeded()).
+//
+// Bus is anything with the MicroBitI2C read/write calls:
+//   int write(int address, const char* data, int length, bool repeated = false);
+//   int read(int address, char* data, int length, bool repeated = false);
+// returning 0 on success.
+
+struct Bmp085RawSample
+{
+    int32_t ut = 0;    // raw temperature
+    bool newTemperature = false; // false: the temperature wasn't read this time, and ut is from before
+    int32_t up = 0;    // raw pressure, already shifted down for the mode
+    uint8_t mode = 0;  // the oversampling mode it was taken with
+    uint32_t time = 0; // ms, when the pressure conversion finished
+};
+
+template <typename Bus>
+class Bmp085Sampler
+{
+public:
+    static constexpr int address = 0x77 << 1;
+    static constexpr int maxMode = 3;
+
+    static constexpr uint8_t controlRegister = 0xF4;
+    static constexpr uint8_t dataRegister = 0xF6; // temperature or pressure, whichever was converted last
+    static constexpr uint8_t temperatureCommand = 0x2E;
+    static constexpr uint8_t pressureCommand = 0x34; // + (mode << 6)
+
+    Bmp085Sampler(Bus& bus, int mode = 1) : bus_(bus), mode_(uint8_t(mode))
+    {
+    }
+
+    void setMode(int mode) { mode_ = uint8_t(mode < 0 ? 0 : mode > maxMode ? maxMode : mode); } // (from the next measurement)
+    int getMode() const { return mode_; }
+    void setInterval(uint32_t intervalMs) { interval_ = intervalMs; } // between the starts of measurements (0: back to back)
+    void setTemperatureNeeded(bool needed) { temperatureNeeded_ = needed; } // (from the next measurement)
+
+    // Does whatever step is due, without waiting. Returns how many ms until the next one.
+    uint32_t poll(uint32_t nowMs);
+
+    bool isBusy() const { return state_ != IDLE; }
+    bool hasSample() const { return numSamples_ > 0; }
+    const Bmp085RawSample& getSample() const { return sample_; }
+    uint32_t getNumSamples() const { return numSamples_; }
+    uint32_t getNumErrors() const { return numErrors_; } // failed I2C transfers (the measurement gets dropped)
+
+    // Worst-case conversion times from the datasheet, rounded up (poll() waits a ms more,
+    // since a ms clock can be up to a ms behind)
+    static uint32_t getTemperatureTime() { return 5; }
+    static uint32_t getPressureTime(int mode)
+    {
+        static const uint8_t times[] = { 5, 8, 14, 26 };
+        return times[mode];
+    }
+
+private:
+    enum State : uint8_t
+    {
+        IDLE,
+        TEMPERATURE, // temperature conversion running
+        PRESSURE,    // pressure conversion running
+    };
+
+    static bool isDue(uint32_t nowMs, uint32_t time) { return int32_t(nowMs - time) >= 0; }
+    static uint32_t timeUntil(uint32_t nowMs, uint32_t time) { return isDue(nowMs, time) ? 0 : time - nowMs; }
+
+    bool startConversion(uint8_t command);
+    void startPressure(uint32_t nowMs);
+    bool readData(uint8_t reg, int numBytes, uint8_t* data);
+    void fail();
+
+    Bus& bus_;
+    uint8_t mode_;
+    uint8_t measurementMode_ = 0; // the mode of the measurement in progress
+    State state_ = IDLE;
+    uint32_t interval_ = 0;
+    uint32_t nextTime_ = 0;  // when the next step is due
+    uint32_t startTime_ = 0; // when the measurement in progress started
+    bool started_ = false;   // (nextTime_ means nothing until the first poll)
+    bool temperatureNeeded_ = true;
+    bool newTemperature_ = false; // (for the measurement in progress)
+    int32_t ut_ = 0;
+
+    Bmp085RawSample sample_;
+    uint32_t numSamples_ = 0;
+    uint32_t numErrors_ = 0;
+};
+
+template <typename Bus>
+uint32_t Bmp085Sampler<Bus>::poll(uint32_t nowMs)
+{
+    if (!started_)
+    {
+        started_ = true;
+        nextTime_ = nowMs;
+    }
+    if (!isDue(nowMs, nextTime_))
+    {
+        return timeUntil(nowMs, nextTime_);
+    }
+
+    switch (state_)
+    {
+    case IDLE:
+        measurementMode_ = mode_;
+        startTime_ = nowMs - nextTime_ < interval_ ? nextTime_ : nowMs; // (stays on the interval if it's only a bit late)
+        newTemperature_ = temperatureNeeded_ || numSamples_ == 0;
+        if (!newTemperature_)
+        {
+            startPressure(nowMs);
+            break;
+        }
+        if (!startConversion(temperatureCommand))
+        {
+            break;
+        }
+        state_ = TEMPERATURE;
+        nextTime_ = nowMs + getTemperatureTime() + 1;
+        break;
+
+    case TEMPERATURE:
+    {
+        uint8_t data[2];
+        if (!readData(dataRegister, 2, data))
+        {
+            break;
+        }
+        ut_ = getBigEndian16(data);
+        startPressure(nowMs);
+        break;
+    }
+
+    case PRESSURE:
+    {
+        uint8_t data[3];
+        if (!readData(dataRegister, 3, data))
+        {
+            break;
+        }
+        sample_.ut = ut_;
+        sample_.newTemperature = newTemperature_;
+        sample_.up = int32_t(getBigEndian24(data)) >> (8 - measurementMode_);
+        sample_.mode = measurementMode_;
+        sample_.time = nowMs;
+        numSamples_++;
+        state_ = IDLE;
+        nextTime_ = isDue(nowMs, startTime_ + interval_) ? nowMs : startTime_ + interval_;
+        break;
+    }
+    }
+    return timeUntil(nowMs, nextTime_);
+}
+
+template <typename Bus>
+bool Bmp085Sampler<Bus>::startConversion(uint8_t command)
+{
+    if (writeRegister(bus_, address, controlRegister, command) != 0)
+    {
+        fail();
+        return false;
+    }
+    return true;
+}
+
+template <typename Bus>
+void Bmp085Sampler<Bus>::startPressure(uint32_t nowMs)
+{
+    if (startConversion(uint8_t(pressureCommand + (measurementMode_ << 6))))
+    {
+        state_ = PRESSURE;
+        nextTime_ = nowMs + getPressureTime(measurementMode_) + 1;
+    }
+}
+
+template <typename Bus>
+bool Bmp085Sampler<Bus>::readData(uint8_t reg, int numBytes, uint8_t* data)
+{
+    if (readRegisters(bus_, address, reg, data, numBytes) != 0)
+    {
+        fail();
+        return false;
+    }
+    return true;
+}
+
+// Drops the measurement in progress, and tries again after the interval
+template <typename Bus>
+void Bmp085Sampler<Bus>::fail()
+{
+    numErrors_++;
+    state_ = IDLE;
+    nextTime_ = startTime_ + (interval_ ? interval_ : getTemperatureTime());
+}
@@ -18,6 +18,12 @@ public:
         return buffer[-delay];
     }
 
+    template <typename Archive>
+    void serialize(Archive& ar)
+    {
+        buffer.serialize(ar);
+    }
+
 private:
     RingBuffer<T, N> buffer;
 };
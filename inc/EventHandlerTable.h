@@ -0,0 +1,348 @@
+#pragma once
+
+#include "SmallVector.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <new>
+#include <utility>
+
+// One event handler: either an action that takes nothing or one that takes the event's
+// value. The function is kept as it was handed over, so calling it goes through one
+// std::function, not a wrapper lambda around another one (and there's no extra closure
+// on the heap to hold the inner one).
+class EventHandler
+{
+public:
+    EventHandler() : kind_(NONE)
+    {
+    }
+
+    EventHandler(std::function<void()> action) : kind_(NONE)
+    {
+        if (action)
+        {
+            new (&action_) std::function<void()>(std::move(action));
+            kind_ = ACTION;
+        }
+    }
+
+    EventHandler(std::function<void(int)> action) : kind_(NONE)
+    {
+        if (action)
+        {
+            new (&actionWithValue_) std::function<void(int)>(std::move(action));
+            kind_ = ACTION_WITH_VALUE;
+        }
+    }
+
+    EventHandler(const EventHandler& other) : kind_(NONE) { assign(other); }
+    EventHandler(EventHandler&& other) : kind_(NONE) { assign(std::move(other)); }
+    EventHandler& operator=(const EventHandler& other) { if (this != &other) { destroy(); assign(other); } return *this; }
+    EventHandler& operator=(EventHandler&& other) { if (this != &other) { destroy(); assign(std::move(other)); } return *this; }
+    ~EventHandler() { destroy(); }
+
+    explicit operator bool() const { return kind_ != NONE; }
+
+    void operator()(int value) const
+    {
+        if (kind_ == ACTION)
+        {
+            action_();
+        }
+        else if (kind_ == ACTION_WITH_VALUE)
+        {
+            actionWithValue_(value);
+        }
+    }
+
+private:
+    enum Kind : uint8_t
+    {
+        NONE,
+        ACTION,
+        ACTION_WITH_VALUE,
+    };
+
+    template <typename Other>
+    void assign(Other&& other)
+    {
+        // (a moved-from handler stays whatever kind it was, holding an empty function)
+        if (other.kind_ == ACTION)
+        {
+            new (&action_) std::function<void()>(std::forward<Other>(other).action_);
+        }
+        else if (other.kind_ == ACTION_WITH_VALUE)
+        {
+            new (&actionWithValue_) std::function<void(int)>(std::forward<Other>(other).actionWithValue_);
+        }
+        kind_ = other.kind_;
+    }
+
+    void destroy()
+    {
+        using Action = std::function<void()>;
+        using ActionWithValue = std::function<void(int)>;
+        if (kind_ == ACTION)
+        {
+            action_.~Action();
+        }
+        else if (kind_ == ACTION_WITH_VALUE)
+        {
+            actionWithValue_.~ActionWithValue();
+        }
+        kind_ = NONE;
+    }
+
+    union
+    {
+        std::function<void()> action_;
+        std::function<void(int)> actionWithValue_;
+    };
+    Kind kind_;
+};
+
+// At most one handler per (source, value) pair. The handlers sit in chunks that never move
+// (the first InlineCount inside the table itself, then chunks on the heap of InlineCount,
+// twice that, and so on), and a small open-addressed hash of the pairs points at them: slots of a key
+// and a pointer (8 bytes on the target), probed linearly from a multiplicative hash, and
+// kept under 3/4 full. Finding the handler for an event is a multiply and usually one
+// compare, and it gets called where it is.
+//
+// A handler can register others while it runs: registering never moves a handler. One
+// that gets replaced while any dispatch is running (itself, say) is left where it is until
+// the dispatches are all done, and then its place gets reused. Handlers get replaced,
+// never removed, so the hash never shrinks. A handler registered for anyValue gets the
+// source's events that don't have a handler of their own.
+template <size_t InlineCount = 4>
+class EventHandlerTable
+{
+public:
+    EventHandlerTable(int anyValue = 0) : anyValue_(uint16_t(anyValue))
+    {
+    }
+
+    EventHandlerTable(const EventHandlerTable&) = delete;
+    EventHandlerTable& operator=(const EventHandlerTable&) = delete;
+    ~EventHandlerTable();
+
+    // Returns false if (source, value) already had a handler (which gets replaced)
+    bool set(int source, int value, EventHandler handler);
+    bool contains(int source, int value) const { return find(makeKey(source, value)) != nullptr; }
+    size_t size() const { return size_; }
+    size_t getNumSlots() const { return slots_ ? size_t(1) << slotBits_ : 0; }
+
+    // Calls the handler for an event, if there is one
+    bool dispatch(int source, int value);
+
+private:
+    struct Slot
+    {
+        uint32_t key;
+        EventHandler* handler;
+    };
+
+    static constexpr uint32_t emptyKey = 0xffffffff; // (source 0xffff, value 0xffff can't have a handler)
+    static constexpr int initialSlotBits = 3;
+
+    static uint32_t makeKey(int source, int value) { return (uint32_t(uint16_t(source)) << 16) | uint16_t(value); }
+    size_t firstSlot(uint32_t key) const { return (key * 2654435769u) >> (32 - slotBits_); } // (Fibonacci hashing)
+    EventHandler* find(uint32_t key) const;
+    Slot* insertSlot(uint32_t key); // the slot with key, or the empty one where it would go
+    void grow();
+    EventHandler* newHandler(EventHandler&& handler); // a place for it that nothing else uses
+    void emptyRetired();
+    static size_t getChunkSize(size_t chunk) { return InlineCount << chunk; } // (heap chunks)
+
+    // (what dispatch() looks at first)
+    Slot* slots_ = nullptr;
+    uint16_t size_ = 0;
+    uint16_t anyValue_;
+    uint8_t slotBits_ = 0;
+    SmallVector<EventHandler*, 2> retired_; // replaced during a dispatch: emptied after it
+    // Dispatches started and finished: any running (nested, or in other fibers) when they
+    // differ. (Two counts rather than one up and down, so back-to-back dispatches don't
+    // each wait on the last one's store.)
+    uint32_t numStarted_ = 0;
+    uint32_t numFinished_ = 0;
+
+    SmallVector<EventHandler*, 2> free_; // emptied handlers, to reuse
+    EventHandler* next_ = inline_; // where the next new handler goes
+    EventHandler* end_ = inline_ + InlineCount; // (of next_'s chunk)
+    SmallVector<EventHandler*, 4> chunks_;
+    EventHandler inline_[InlineCount];
+};
+
+template <size_t InlineCount>
+EventHandlerTable<InlineCount>::~EventHandlerTable()
+{
+    if (slots_)
+    {
+        HeapAllocator::deallocate(slots_, getNumSlots() * sizeof(Slot));
+    }
+    for (size_t chunk = 0; chunk < chunks_.size(); chunk++)
+    {
+        for (size_t index = 0; index < getChunkSize(chunk); index++)
+        {
+            chunks_[chunk][index].~EventHandler();
+        }
+        HeapAllocator::deallocate(chunks_[chunk], getChunkSize(chunk) * sizeof(EventHandler));
+    }
+}
+
+template <size_t InlineCount>
+bool EventHandlerTable<InlineCount>::set(int source, int value, EventHandler handler)
+{
+    uint32_t key = makeKey(source, value);
+    if (key == emptyKey)
+    {
+        return false;
+    }
+
+    if (4 * (size() + 1) > 3 * getNumSlots())
+    {
+        grow();
+    }
+    Slot* slot = insertSlot(key);
+    if (slot->key == key)
+    {
+        if (numStarted_ != numFinished_)
+        {
+            // (it may be the one that's running)
+            retired_.push_back(slot->handler);
+            slot->handler = newHandler(std::move(handler));
+        }
+        else
+        {
+            *slot->handler = std::move(handler);
+        }
+        return false;
+    }
+    slot->key = key;
+    slot->handler = newHandler(std::move(handler));
+    size_++;
+    return true;
+}
+
+template <size_t InlineCount>
+bool EventHandlerTable<InlineCount>::dispatch(int source, int value)
+{
+    EventHandler* handler = find(makeKey(source, value));
+    if (!handler)
+    {
+        handler = find(makeKey(source, anyValue_));
+    }
+    if (!handler)
+    {
+        return false;
+    }
+
+    numStarted_++;
+    (*handler)(value);
+    if (++numFinished_ == numStarted_ && !retired_.empty())
+    {
+        emptyRetired();
+    }
+    return true;
+}
+
+template <size_t InlineCount>
+void EventHandlerTable<InlineCount>::emptyRetired()
+{
+    for (auto retired : retired_)
+    {
+        *retired = EventHandler();
+        free_.push_back(retired);
+    }
+    retired_.clear();
+}
+
+template <size_t InlineCount>
+EventHandler* EventHandlerTable<InlineCount>::find(uint32_t key) const
+{
+    if (!slots_)
+    {
+        return nullptr;
+    }
+
+    size_t mask = getNumSlots() - 1;
+    for (size_t index = firstSlot(key);; index = (index + 1) & mask)
+    {
+        if (slots_[index].key == key)
+        {
+            return slots_[index].handler;
+        }
+        if (slots_[index].key == emptyKey)
+        {
+            return nullptr;
+        }
+    }
+}
+
+template <size_t InlineCount>
+auto EventHandlerTable<InlineCount>::insertSlot(uint32_t key) -> Slot*
+{
+    size_t mask = getNumSlots() - 1;
+    size_t index = firstSlot(key);
+    while (slots_[index].key != key && slots_[index].key != emptyKey)
+    {
+        index = (index + 1) & mask;
+    }
+    return &slots_[index];
+}
+
+template <size_t InlineCount>
+void EventHandlerTable<InlineCount>::grow()
+{
+    Slot* oldSlots = slots_;
+    size_t numOldSlots = getNumSlots();
+
+    slotBits_ = slots_ ? slotBits_ + 1 : initialSlotBits;
+    size_t numSlots = size_t(1) << slotBits_;
+    slots_ = static_cast<Slot*>(HeapAllocator::allocate(numSlots * sizeof(Slot)));
+    for (size_t index = 0; index < numSlots; index++)
+    {
+        slots_[index].key = emptyKey;
+    }
+
+    for (size_t index = 0; index < numOldSlots; index++)
+    {
+        if (oldSlots[index].key != emptyKey)
+        {
+            *insertSlot(oldSlots[index].key) = oldSlots[index];
+        }
+    }
+    if (oldSlots)
+    {
+        HeapAllocator::deallocate(oldSlots, numOldSlots * sizeof(Slot));
+    }
+}
+
+template <size_t InlineCount>
+EventHandler* EventHandlerTable<InlineCount>::newHandler(EventHandler&& handler)
+{
+    EventHandler* place;
+    if (!free_.empty())
+    {
+        place = free_.back();
+        free_.pop_back();
+    }
+    else
+    {
+        if (next_ == end_)
+        {
+            size_t chunkSize = getChunkSize(chunks_.size());
+            next_ = static_cast<EventHandler*>(HeapAllocator::allocate(chunkSize * sizeof(EventHandler)));
+            end_ = next_ + chunkSize;
+            for (EventHandler* p = next_; p != end_; p++)
+            {
+                new (p) EventHandler();
+            }
+            chunks_.push_back(next_);
+        }
+        place = next_++;
+    }
+    *place = std::move(handler);
+    return place;
+}
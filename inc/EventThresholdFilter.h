@@ -1,19 +1,26 @@
 #pragma once
 
+#include <cstdint>
+
 template <typename T>
 class EventThresholdFilter
 {
 public:
-    EventThresholdFilter(T gestureThreshold, int eventCountThreshold, int lowThreshold) : count_(0), gestureThreshold_(gestureThreshold), eventCountThreshold_(eventCountThreshold), lowThreshold_(lowThreshold) {};
+    // (the counts get clamped to 0-127)
+    EventThresholdFilter(T gestureThreshold, int eventCountThreshold, int lowThreshold) : gestureThreshold_(gestureThreshold), count_(0), eventCountThreshold_(clampCount(eventCountThreshold)), lowThreshold_(clampCount(lowThreshold)) {};
 
     bool filterValue(T value)
     {
         if(value >= gestureThreshold_)
         {
-            count_++;
-            if (count_ >= eventCountThreshold_ + lowThreshold_)
+            int maxCount = clampCount(eventCountThreshold_ + lowThreshold_); // (in int, so it can't wrap)
+            if (count_ < maxCount)
+            {
+                count_++;
+            }
+            else
             {
-                count_ = eventCountThreshold_ + lowThreshold_; // avoid overflow
+                count_ = int8_t(maxCount);
             }
         }
         else
@@ -38,10 +45,37 @@ public:
         count_ = 0;
     }
 
+    T getThreshold() const
+    {
+        return gestureThreshold_;
+    }
+
+    int getEventCountThreshold() const
+    {
+        return eventCountThreshold_;
+    }
+
+    int getLowThreshold() const
+    {
+        return lowThreshold_;
+    }
+
+    template <typename Archive>
+    void serialize(Archive& ar)
+    {
+        ar.io(count_);
+    }
+
 private:
-    int count_ = 0;
+    static int8_t clampCount(int count)
+    {
+        return int8_t(count < 0 ? 0 : count > INT8_MAX ? INT8_MAX : count);
+    }
+
+    // counts never exceed eventCountThreshold_ + lowThreshold_ (or 127), so a byte each is plenty
     T gestureThreshold_;
-    int eventCountThreshold_;
-    int lowThreshold_;
+    int8_t count_ = 0;
+    int8_t eventCountThreshold_;
+    int8_t lowThreshold_;
 };
 
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "IntMath.h" // isqrt() and friends
+
 #include <cstdint> // for int8_t, int32_t types
 #include <cmath>
 
@@ -9,6 +11,12 @@ int8_t clampByte(const T& inVal)
     return inVal < -128 ? -128 : inVal > 127 ? 127 : (int8_t)inVal;
 }
 
+// (ints, like the gravity-subtracted samples, take the branch-free way)
+inline int8_t clampByte(int inVal)
+{
+    return (int8_t)iclamp(inVal, -128, 127);
+}
+
 // from http://stackoverflow.com/a/19807644
 template <typename T, typename F>
 struct alias_cast_t
@@ -60,5 +68,3 @@ inline float fast_sqrt(float val)
     y = 0.5f*(y + (val / y)); // yuck! divide
     return y;
 }
-
-
@@ -0,0 +1,145 @@
+#pragma once
+
+#include "FixedBlockPool.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// What a fiber runs: a callable, kept inside the task itself (up to inlineSize bytes: a
+// std::function, or a lambda capturing a few words), so launching a fiber doesn't need a
+// heap copy of the closure just to pass it through create_fiber()'s void*. Bigger
+// callables get wrapped in a std::function first (which puts them on the heap, as before).
+//
+// A task with a period runs forever, on a fixed schedule: each run is due a period after
+// the last one was, however long the runs take. After a run, getSleepTime() says how long
+// until the next one, and if the task has overrun by a whole period or more, it skips the
+// runs it missed rather than trying to catch up. Either way, the sleep is at least minSleep
+// (a scheduler tick, say), so a body that always overruns still gives the other fibers a
+// turn between runs rather than running back to back. (Sleeping a fixed time after each run
+// instead lets the period stretch by however long the run took, plus whatever it takes to
+// get to the next scheduler tick.)
+class FiberTask
+{
+public:
+    static constexpr size_t inlineSize = sizeof(std::function<void()>);
+
+    template <typename F>
+    static constexpr bool fitsInline()
+    {
+        using Callable = typename std::decay<F>::type;
+        return sizeof(Callable) <= inlineSize && alignof(Callable) <= alignof(std::max_align_t);
+    }
+
+    template <typename F, typename std::enable_if<fitsInline<F>(), int>::type = 0>
+    FiberTask(F&& f, uint32_t period = 0) : period_(period)
+    {
+        using Callable = typename std::decay<F>::type;
+        new (storage_) Callable(std::forward<F>(f));
+        invoke_ = [](void* p) { (*static_cast<Callable*>(p))(); };
+        destroy_ = [](void* p) { static_cast<Callable*>(p)->~Callable(); };
+    }
+
+    template <typename F, typename std::enable_if<!fitsInline<F>(), int>::type = 0>
+    FiberTask(F&& f, uint32_t period = 0) : FiberTask(std::function<void()>(std::forward<F>(f)), period)
+    {
+    }
+
+    FiberTask(const FiberTask&) = delete;
+    FiberTask& operator=(const FiberTask&) = delete;
+    ~FiberTask() { destroy_(storage_); }
+
+    bool isPeriodic() const { return period_ != 0; }
+    uint32_t getPeriod() const { return period_; }
+
+    void run(uint32_t now); // (now: when the run started, in ms)
+    uint32_t getSleepTime(uint32_t now, uint32_t minSleep = 0); // (now: after the run)
+    uint32_t getNumSkipped() const { return numSkipped_; }
+
+private:
+    alignas(std::max_align_t) unsigned char storage_[inlineSize];
+    void (*invoke_)(void*);
+    void (*destroy_)(void*);
+    uint32_t period_;
+    uint32_t nextTime_ = 0; // when the next run is due
+    bool started_ = false;
+    uint32_t numSkipped_ = 0;
+};
+
+// Rounds a period up to a whole number of scheduler ticks: the scheduler only wakes fibers
+// on a tick, so that's when the runs will happen anyway, and this way they're all the same
+// distance apart
+inline uint32_t alignToTick(uint32_t period, uint32_t tickPeriod)
+{
+    return (period + tickPeriod - 1) / tickPeriod * tickPeriod;
+}
+
+inline void FiberTask::run(uint32_t now)
+{
+    if (!started_)
+    {
+        started_ = true;
+        nextTime_ = now;
+    }
+    nextTime_ += period_;
+    invoke_(storage_);
+}
+
+inline uint32_t FiberTask::getSleepTime(uint32_t now, uint32_t minSleep)
+{
+    int32_t late = int32_t(now - nextTime_);
+    if (late >= int32_t(period_))
+    {
+        uint32_t numMissed = uint32_t(late) / period_;
+        nextTime_ += numMissed * period_;
+        numSkipped_ += numMissed;
+    }
+    uint32_t sleepTime = late >= 0 ? 0 : uint32_t(-late);
+    return sleepTime < minSleep ? minSleep : sleepTime;
+}
+
+// The tasks for up to NumSlots fibers at a time, in fixed slots; any more go on the heap.
+template <size_t NumSlots>
+class FiberTaskPool
+{
+public:
+    FiberTaskPool() = default;
+    FiberTaskPool(const FiberTaskPool&) = delete;
+    FiberTaskPool& operator=(const FiberTaskPool&) = delete;
+
+    template <typename F>
+    FiberTask* create(F&& f, uint32_t period = 0)
+    {
+        void* p = slots_.allocate();
+        if (!p)
+        {
+            p = ::operator new(sizeof(FiberTask));
+            numOnHeap_++;
+        }
+        return new (p) FiberTask(std::forward<F>(f), period);
+    }
+
+    void destroy(FiberTask* task)
+    {
+        task->~FiberTask();
+        if (slots_.owns(task))
+        {
+            slots_.deallocate(task);
+        }
+        else
+        {
+            ::operator delete(task);
+        }
+    }
+
+    size_t getNumUsed() const { return slots_.getNumUsed(); } // (slots)
+    size_t getPeakUsed() const { return slots_.getPeakUsed(); }
+    uint32_t getNumOnHeap() const { return numOnHeap_; } // tasks that didn't get a slot
+
+private:
+    FixedBlockPool<sizeof(FiberTask), NumSlots> slots_;
+    uint32_t numOnHeap_ = 0;
+};
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// A fixed number of same-sized blocks in one static array, handed out from a free list.
+// allocate() and deallocate() are O(1) and never touch the heap, so small objects that
+// come and go all the time (like script collections) can't fragment it. When the pool is
+// used up, allocate() returns nullptr and it's up to the caller to fall back to the heap.
+//
+// Blocks are only threaded onto the free list once they've been freed: fresh ones come
+// off the end of the array. That way an empty pool is all zeros, and a pool that's a
+// global or a function-level static needs no startup code.
+template <size_t BlockSize, size_t NumBlocks>
+class FixedBlockPool
+{
+public:
+    constexpr FixedBlockPool() : blocks_(), freeList_(nullptr), numFresh_(0), numUsed_(0), peakUsed_(0)
+    {
+    }
+
+    FixedBlockPool(const FixedBlockPool&) = delete;
+    FixedBlockPool& operator=(const FixedBlockPool&) = delete;
+
+    void* allocate();
+    void deallocate(void* p); // p has to be one of ours (see owns())
+    bool owns(const void* p) const;
+
+    static constexpr size_t blockSize() { return sizeof(Block); }
+    static constexpr size_t capacity() { return NumBlocks; }
+    size_t getNumUsed() const { return numUsed_; }
+    size_t getPeakUsed() const { return peakUsed_; }
+
+private:
+    static_assert(NumBlocks > 0 && NumBlocks <= UINT16_MAX, "pool needs between 1 and 65535 blocks");
+
+    union Block
+    {
+        Block* next;
+        alignas(std::max_align_t) unsigned char data[BlockSize];
+    };
+
+    Block blocks_[NumBlocks];
+    Block* freeList_;
+    uint16_t numFresh_; // blocks_[numFresh_...] have never been handed out
+    uint16_t numUsed_;
+    uint16_t peakUsed_;
+};
+
+template <size_t BlockSize, size_t NumBlocks>
+void* FixedBlockPool<BlockSize, NumBlocks>::allocate()
+{
+    Block* block;
+    if (freeList_)
+    {
+        block = freeList_;
+        freeList_ = block->next;
+    }
+    else if (numFresh_ < NumBlocks)
+    {
+        block = &blocks_[numFresh_++];
+    }
+    else
+    {
+        return nullptr;
+    }
+
+    numUsed_++;
+    if (numUsed_ > peakUsed_)
+    {
+        peakUsed_ = numUsed_;
+    }
+    return block->data;
+}
+
+template <size_t BlockSize, size_t NumBlocks>
+void FixedBlockPool<BlockSize, NumBlocks>::deallocate(void* p)
+{
+    Block* block = static_cast<Block*>(p);
+    block->next = freeList_;
+    freeList_ = block;
+    numUsed_--;
+}
+
+template <size_t BlockSize, size_t NumBlocks>
+bool FixedBlockPool<BlockSize, NumBlocks>::owns(const void* p) const
+{
+    auto addr = reinterpret_cast<uintptr_t>(p);
+    return addr >= reinterpret_cast<uintptr_t>(&blocks_[0]) && addr < reinterpret_cast<uintptr_t>(&blocks_[NumBlocks]);
+}
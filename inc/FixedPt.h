@@ -98,7 +98,7 @@ class FixedPt
 {
 public:
     FixedPt() : value_(0) {}
-    FixedPt(const FixedPt<IntBits, FracBits, T>& x) : value_(x.value_) {}
+    FixedPt(const FixedPt<IntBits, FracBits, T>& x) = default; // (so it's trivially copyable)
 
     explicit FixedPt(int val) : value_(::ShiftLeft<FracBits>(val)) {}
 
@@ -112,10 +112,7 @@ public:
         value_ = ShiftValue<FracBits, FracBits2>(x.value_);
     }
 
-    void operator =(const FixedPt<IntBits, FracBits, T>& x)
-    {
-        value_ = x.value_;
-    }
+    FixedPt& operator =(const FixedPt<IntBits, FracBits, T>& x) = default;
 
     bool operator ==(FixedPt<IntBits, FracBits, T> x) const
     {
@@ -137,22 +134,22 @@ public:
         return !(*this == x);
     }
 
-    bool operator <(FixedPt<IntBits, FracBits, T> x)
+    bool operator <(FixedPt<IntBits, FracBits, T> x) const
     {
         return value_ < x.value_;
     }
 
-    bool operator >(FixedPt<IntBits, FracBits, T> x)
+    bool operator >(FixedPt<IntBits, FracBits, T> x) const
     {
         return value_ > x.value_;
     }
 
-    bool operator <=(FixedPt<IntBits, FracBits, T> x)
+    bool operator <=(FixedPt<IntBits, FracBits, T> x) const
     {
         return value_ <= x.value_;
     }
 
-    bool operator >=(FixedPt<IntBits, FracBits, T> x)
+    bool operator >=(FixedPt<IntBits, FracBits, T> x) const
     {
         return value_ >= x.value_;
     }
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+
+// Register access for I2C devices with the usual register-pointer protocol: a write sets
+// the register pointer (and writes from there on), and a read reads from the pointer on,
+// with the device stepping through the registers as it goes. So a run of contiguous
+// registers comes back in one transaction (the pointer write, a repeated start, and one
+// read) rather than a write and a read for each register.
+//
+// Bus is anything with the MicroBitI2C read/write calls (see Bmp085Sampler.h). These all
+// return 0 on success, or the bus's error code.
+
+template <typename Bus>
+int readRegisters(Bus& bus, int address, uint8_t reg, uint8_t* data, int length)
+{
+    char cmd = char(reg);
+    int result = bus.write(address, &cmd, 1, true); // (no stop: the read carries straight on)
+    return result != 0 ? result : bus.read(address, reinterpret_cast<char*>(data), length);
+}
+
+template <typename Bus>
+int writeRegister(Bus& bus, int address, uint8_t reg, uint8_t value)
+{
+    char cmd[] = { char(reg), char(value) };
+    return bus.write(address, cmd, 2);
+}
+
+// Multi-byte registers, most significant byte first
+inline uint16_t getBigEndian16(const uint8_t* data)
+{
+    return uint16_t((data[0] << 8) | data[1]);
+}
+
+inline uint32_t getBigEndian24(const uint8_t* data)
+{
+    return (uint32_t(data[0]) << 16) | (uint32_t(data[1]) << 8) | data[2];
+}
+
+//
+// The micro:bit's MMA8653 accelerometer. (The DAL's driver already reads all three axes
+// in one burst; this is for reading it directly.)
+//
+namespace mma8653
+{
+    const int address = 0x1D << 1;
+    const uint8_t outXMsb = 0x01; // x, y, z, 2 bytes each
+    const uint8_t whoAmI = 0x0D;
+    const uint8_t whoAmIValue = 0x5A;
+
+    // Reads x, y and z in one burst, in mg (roughly: 1024 to the g, as in the DAL), for
+    // the given range (2, 4 or 8 g)
+    template <typename Bus>
+    int readAcceleration(Bus& bus, int range, int16_t* xyz)
+    {
+        uint8_t data[6];
+        int result = readRegisters(bus, address, outXMsb, data, 6);
+        if (result != 0)
+        {
+            return result;
+        }
+        for (int axis = 0; axis < 3; axis++)
+        {
+            // 10 bits, left justified: 512 / range to the g
+            xyz[axis] = int16_t((int16_t(getBigEndian16(data + 2 * axis)) >> 6) * 2 * range);
+        }
+        return 0;
+    }
+}
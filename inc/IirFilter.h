@@ -56,6 +56,12 @@ public:
         return prevVal_;
     }
 
+    template <typename Archive>
+    void serialize(Archive& ar)
+    {
+        ar.io(prevVal_);
+    }
+
 private:
     Tcoeff alpha_;
     Tdata prevVal_;
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// The last few images made from constant bitmaps, keyed on the bitmap's address. The
+// compiler emits a script's LED pictures as constant arrays, and showLeds() and friends
+// used to build a new image from one on every call: a heap allocation and a copy, over and
+// over in an animation loop. Here the image gets built the first time, and after that,
+// showing the same picture is a lookup. When the cache is full, the least recently used
+// image makes way for the new one.
+//
+// The cached images stay on the heap for as long as the program runs, so only small ones
+// get cached (up to MaxPixels: a picture, or an animation a couple of frames long). A
+// bigger one, like a long animation strip, gets built every time, as before, and goes
+// when the display is done with it.
+//
+// The cached images are shared (Image is reference counted, like MicroBitImage), so they
+// mustn't be changed: they're only for showing, never for handing to a script.
+//
+// Image needs a default constructor, and Image(int width, int height, const uint8_t* bitmap).
+template <typename Image, size_t Capacity = 4, size_t MaxPixels = 50>
+class ImageCache
+{
+public:
+    ImageCache() = default;
+    ImageCache(const ImageCache&) = delete;
+    ImageCache& operator=(const ImageCache&) = delete;
+
+    Image get(int width, int height, const uint8_t* bitmap);
+    void clear(); // lets go of all the images
+
+    uint32_t getNumHits() const { return numHits_; }
+    uint32_t getNumMisses() const { return numMisses_; } // (including images too big to cache)
+
+private:
+    static_assert(Capacity > 0 && Capacity <= 255, "cache needs between 1 and 255 entries");
+
+    struct Entry
+    {
+        const uint8_t* bitmap = nullptr;
+        int16_t width = 0;
+        int16_t height = 0;
+        uint32_t lastUsed = 0;
+        Image image;
+    };
+
+    Entry entries_[Capacity];
+    uint32_t numHits_ = 0;
+    uint32_t numMisses_ = 0;
+};
+
+template <typename Image, size_t Capacity, size_t MaxPixels>
+Image ImageCache<Image, Capacity, MaxPixels>::get(int width, int height, const uint8_t* bitmap)
+{
+    if (width < 0 || height < 0 || size_t(width) * size_t(height) > MaxPixels)
+    {
+        numMisses_++;
+        return Image(width, height, bitmap);
+    }
+
+    uint32_t useCount = numHits_ + numMisses_ + 1;
+    Entry* oldest = &entries_[0];
+    for (auto& entry : entries_)
+    {
+        if (entry.bitmap == bitmap && entry.width == width && entry.height == height)
+        {
+            numHits_++;
+            entry.lastUsed = useCount;
+            return entry.image;
+        }
+        if (entry.lastUsed < oldest->lastUsed)
+        {
+            oldest = &entry;
+        }
+    }
+
+    numMisses_++;
+    oldest->image = Image(width, height, bitmap);
+    oldest->bitmap = bitmap;
+    oldest->width = int16_t(width);
+    oldest->height = int16_t(height);
+    oldest->lastUsed = useCount;
+    return oldest->image;
+}
+
+template <typename Image, size_t Capacity, size_t MaxPixels>
+void ImageCache<Image, Capacity, MaxPixels>::clear()
+{
+    for (auto& entry : entries_)
+    {
+        entry = Entry();
+    }
+}
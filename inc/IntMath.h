@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstdint>
+
+// Integer math for the Cortex-M0, which has no FPU and no divide instruction (and no
+// conditional execution, so a mispredicted branch always costs): square roots, powers
+// and random numbers without going through floating point, and min/max/clamp/sign/abs
+// made of shifts and masks rather than compares and branches.
+
+// Integer square root, rounded down (one bit at a time, so no divides or multiplies)
+inline uint32_t isqrt(uint32_t val)
+{
+    uint32_t result = 0;
+    uint32_t bit = 1u << 30;
+    while (bit > val)
+    {
+        bit >>= 2;
+    }
+    while (bit != 0)
+    {
+        if (val >= result + bit)
+        {
+            val -= result + bit;
+            result = (result >> 1) + bit;
+        }
+        else
+        {
+            result >>= 1;
+        }
+        bit >>= 2;
+    }
+    return result;
+}
+
+// base to the power exponent, by squaring, saturating at INT32_MIN/INT32_MAX rather than
+// wrapping. A negative exponent gives the result rounded toward zero (so 0 unless base is
+// 1 or -1).
+inline int32_t ipow(int32_t base, int32_t exponent)
+{
+    bool negative = base < 0 && (exponent & 1);
+    if (exponent < 0)
+    {
+        return base == 1 || base == -1 ? (negative ? -1 : 1) : 0;
+    }
+
+    uint64_t limit = negative ? 0x80000000u : 0x7fffffffu;
+    uint64_t square = base < 0 ? 0u - uint32_t(base) : uint32_t(base);
+    uint64_t result = 1;
+    while (exponent)
+    {
+        if (exponent & 1)
+        {
+            result *= square;
+            if (result > limit)
+            {
+                return negative ? INT32_MIN : INT32_MAX;
+            }
+        }
+        exponent >>= 1;
+        if (exponent)
+        {
+            square *= square;
+            if (square > limit)
+            {
+                square = limit + 1; // (anything more saturates too, without overflowing)
+            }
+        }
+    }
+    return negative ? int32_t(0u - uint32_t(result)) : int32_t(result);
+}
+
+// All ones if a < b, else 0 (without overflowing, from Hacker's Delight 2-12)
+inline uint32_t lessMask(int32_t a, int32_t b)
+{
+    uint32_t ua = uint32_t(a);
+    uint32_t ub = uint32_t(b);
+    uint32_t diff = ua - ub;
+    return uint32_t(int32_t(diff ^ ((ua ^ ub) & (diff ^ ua))) >> 31);
+}
+
+inline int32_t imin(int32_t a, int32_t b)
+{
+    return int32_t(uint32_t(b) ^ ((uint32_t(a) ^ uint32_t(b)) & lessMask(a, b)));
+}
+
+inline int32_t imax(int32_t a, int32_t b)
+{
+    return int32_t(uint32_t(a) ^ ((uint32_t(a) ^ uint32_t(b)) & lessMask(a, b)));
+}
+
+// (lo <= hi)
+inline int32_t iclamp(int32_t val, int32_t lo, int32_t hi)
+{
+    return imin(imax(val, lo), hi);
+}
+
+// -1, 0 or 1
+inline int32_t isign(int32_t val)
+{
+    return int32_t(val >> 31) | int32_t((0u - uint32_t(val)) >> 31);
+}
+
+// (INT32_MIN stays INT32_MIN)
+inline int32_t iabs(int32_t val)
+{
+    uint32_t mask = uint32_t(val >> 31);
+    return int32_t((uint32_t(val) ^ mask) - mask);
+}
+
+// Marsaglia's xorshift32: three shifts and three xors a number, with a period of 2^32 - 1
+// (it never gives 0). nextBelow() scales a number into [0, bound) with a multiply and a
+// shift (Lemire's method, without the rejection step: the bias is at most bound / 2^32,
+// far below anything a script could notice), rather than a divide.
+class XorShift32
+{
+public:
+    static constexpr uint32_t defaultSeed = 2463534242u;
+
+    XorShift32(uint32_t seed = defaultSeed)
+    {
+        setSeed(seed);
+    }
+
+    void setSeed(uint32_t seed) { state_ = seed ? seed : defaultSeed; }
+
+    uint32_t next()
+    {
+        uint32_t x = state_;
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        state_ = x;
+        return x;
+    }
+
+    uint32_t nextBelow(uint32_t bound) { return uint32_t((uint64_t(next()) * bound) >> 32); }
+
+private:
+    uint32_t state_;
+};
@@ -0,0 +1,233 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <utility>
+
+// A script string that's cheap to build a piece at a time. Strings are values, and
+// joining two used to make a new flat string each time, copying both halves: a message
+// built up in a loop (s = s + piece) copied everything so far on every pass, and left a
+// trail of ever-bigger blocks on the heap.
+//
+// Here joining puts the characters in a shared buffer with room to spare, and the result
+// is a run of it (an offset and a length). When the string being added to ends where the
+// buffer's used part ends, the next piece goes straight in after it, so a loop like that
+// appends in place and the buffer only gets copied when it has to grow (by half again).
+// The run belongs to the value, so nothing anyone else holds changes: a string that isn't
+// at the end of its buffer gets a new buffer instead. A substring of a buffer string is
+// another run of the same buffer.
+//
+// The flat string only gets made when something needs one (flatten(), or converting to
+// Flat: for the display, the serial port or the radio), and then the value becomes that
+// flat string, letting go of the buffer.
+//
+// Flat is the DAL's string type, or anything with the same calls:
+//   Flat();                                   // empty
+//   Flat(const char* data, int16_t length);   // a copy
+//   int16_t length() const;
+//   const char* toCharArray() const;
+template <typename Flat>
+class LazyString
+{
+public:
+    static constexpr int minCapacity = 16;
+
+    LazyString() : flat_(), offset_(flatTag), length_(0)
+    {
+    }
+
+    LazyString(const Flat& flat) : flat_(flat), offset_(flatTag), length_(0)
+    {
+    }
+
+    LazyString(const LazyString& other) { assign(other); }
+
+    LazyString& operator=(const LazyString& other)
+    {
+        if (this != &other)
+        {
+            reset();
+            assign(other);
+        }
+        return *this;
+    }
+
+    ~LazyString() { reset(); }
+
+    int length() const { return isFlat() ? flat_.length() : length_; }
+    char charAt(int index) const { return index >= 0 && index < length() ? getData()[index] : 0; }
+    bool isFlat() const { return offset_ == flatTag; }
+
+    LazyString concat(const LazyString& other) const;
+    LazyString substring(int start, int length) const; // (length gets cut down to fit)
+    bool equals(const LazyString& other) const;
+    int toNumber() const; // like atoi()
+
+    const Flat& flatten() const;
+    operator Flat() const { return flatten(); }
+    const char* toCharArray() const { return flatten().toCharArray(); }
+
+private:
+    struct Buffer
+    {
+        uint16_t refCount;
+        uint16_t used;
+        uint16_t capacity;
+        char data[1]; // (really capacity)
+    };
+
+    static constexpr uint16_t flatTag = 0xffff; // in offset_: the value is flat_ (buffers are never that big)
+
+    LazyString(Buffer* buffer, int offset, int length) : buffer_(buffer), offset_(uint16_t(offset)), length_(uint16_t(length))
+    {
+        buffer_->refCount++;
+    }
+
+    static Buffer* allocate(int capacity)
+    {
+        auto buffer = static_cast<Buffer*>(::operator new(offsetof(Buffer, data) + capacity));
+        buffer->refCount = 0;
+        buffer->used = 0;
+        buffer->capacity = uint16_t(capacity);
+        return buffer;
+    }
+
+    const char* getData() const { return isFlat() ? flat_.toCharArray() : buffer_->data + offset_; }
+    bool isAtEnd() const { return !isFlat() && offset_ + length_ == buffer_->used; }
+
+    // (into a value that's been reset, or never set)
+    void assign(const LazyString& other)
+    {
+        if (other.isFlat())
+        {
+            new (&flat_) Flat(other.flat_);
+        }
+        else
+        {
+            buffer_ = other.buffer_;
+            buffer_->refCount++;
+        }
+        offset_ = other.offset_;
+        length_ = other.length_;
+    }
+
+    void reset() const
+    {
+        if (isFlat())
+        {
+            flat_.~Flat();
+        }
+        else if (--buffer_->refCount == 0)
+        {
+            ::operator delete(buffer_);
+        }
+    }
+
+    // A flat string, or a run of a buffer: one or the other, so a string is a pointer and
+    // two shorts, the size of two pointers on the micro:bit. (flatten() turns a run into a
+    // flat string, which is still the same value.)
+    union
+    {
+        mutable Flat flat_;
+        mutable Buffer* buffer_;
+    };
+    mutable uint16_t offset_;
+    uint16_t length_;
+};
+
+template <typename Flat>
+LazyString<Flat> LazyString<Flat>::concat(const LazyString& other) const
+{
+    int length = this->length();
+    int otherLength = other.length();
+    if (otherLength == 0)
+    {
+        return *this;
+    }
+    if (length == 0)
+    {
+        return other;
+    }
+
+    int total = length + otherLength;
+    if (isAtEnd() && buffer_->used + otherLength <= buffer_->capacity)
+    {
+        // (other may be a run of the same buffer, but it's all before the end)
+        memcpy(buffer_->data + buffer_->used, other.getData(), otherLength);
+        buffer_->used = uint16_t(buffer_->used + otherLength);
+        return LazyString(buffer_, offset_, total);
+    }
+
+    int capacity = total + total / 2;
+    Buffer* buffer = allocate(capacity < minCapacity ? minCapacity : capacity);
+    memcpy(buffer->data, getData(), length);
+    memcpy(buffer->data + length, other.getData(), otherLength);
+    buffer->used = uint16_t(total);
+    return LazyString(buffer, 0, total);
+}
+
+template <typename Flat>
+LazyString<Flat> LazyString<Flat>::substring(int start, int length) const
+{
+    int available = this->length() - start;
+    if (start < 0 || available <= 0 || length <= 0)
+    {
+        return LazyString();
+    }
+    if (length > available)
+    {
+        length = available;
+    }
+    if (!isFlat())
+    {
+        return LazyString(buffer_, offset_ + start, length);
+    }
+    return LazyString(Flat(getData() + start, int16_t(length)));
+}
+
+template <typename Flat>
+bool LazyString<Flat>::equals(const LazyString& other) const
+{
+    int length = this->length();
+    return length == other.length() && memcmp(getData(), other.getData(), length) == 0;
+}
+
+template <typename Flat>
+int LazyString<Flat>::toNumber() const
+{
+    const char* data = getData();
+    int length = this->length();
+    int index = 0;
+    while (index < length && (data[index] == ' ' || (data[index] >= '\t' && data[index] <= '\r')))
+    {
+        index++;
+    }
+    bool negative = false;
+    if (index < length && (data[index] == '-' || data[index] == '+'))
+    {
+        negative = data[index] == '-';
+        index++;
+    }
+    unsigned value = 0;
+    while (index < length && data[index] >= '0' && data[index] <= '9')
+    {
+        value = value * 10 + unsigned(data[index] - '0');
+        index++;
+    }
+    return negative ? int(0u - value) : int(value);
+}
+
+template <typename Flat>
+const Flat& LazyString<Flat>::flatten() const
+{
+    if (!isFlat())
+    {
+        Flat flat(getData(), int16_t(length_));
+        reset();
+        new (&flat_) Flat(flat);
+        offset_ = flatTag;
+    }
+    return flat_;
+}
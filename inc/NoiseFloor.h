@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+
+// Tracks the noise floor of a non-negative signal (e.g., a windowed variance): the estimate
+// falls quickly toward smaller values and creeps up slowly toward bigger ones, so it follows
+// the quiet stretches and mostly ignores bursts. It's an asymmetric exponential average,
+// so it's O(1) per sample and needs no history.
+//
+// The state keeps FracBits fractional bits, so the slow rise doesn't round away to nothing.
+// Inputs are saturated to what fits in T with those bits; that's fine for the usual use,
+// where all we care about is how far *below* some level the floor is.
+template <typename T, int RiseShift, int FallShift, int FracBits = RiseShift>
+class NoiseFloorEstimator
+{
+public:
+    static constexpr int maxInput = std::numeric_limits<T>::max() >> FracBits;
+
+    NoiseFloorEstimator(int initVal = maxInput)
+    {
+        init(initVal);
+    }
+
+    void init(int val)
+    {
+        state_ = T(clampInput(val) << FracBits);
+    }
+
+    void addSample(int val)
+    {
+        int32_t target = int32_t(clampInput(val)) << FracBits;
+        int32_t curr = state_;
+        if (target < curr)
+        {
+            curr -= (curr - target + (1 << FallShift) - 1) >> FallShift; // round so we get all the way down
+        }
+        else
+        {
+            curr += (target - curr + (1 << RiseShift) - 1) >> RiseShift; // (and all the way up)
+        }
+        state_ = T(curr);
+    }
+
+    int getFloor() const
+    {
+        return state_ >> FracBits;
+    }
+
+    float getFloorFloat() const
+    {
+        return float(state_) / (1 << FracBits);
+    }
+
+    template <typename Archive>
+    void serialize(Archive& ar)
+    {
+        ar.io(state_);
+    }
+
+private:
+    static int clampInput(int val)
+    {
+        return val < 0 ? 0 : val > maxInput ? maxInput : val;
+    }
+
+    T state_;
+};
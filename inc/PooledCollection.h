@@ -0,0 +1,138 @@
+#pragma once
+
+#include "FixedBlockPool.h"
+#include "SmallVector.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Reference-counted collections for the TouchDevelop runtime that stay off the heap.
+//
+// A collection's control block (its reference count and a SmallVector with the first few
+// elements inline) is one block from a shared FixedBlockPool. Once it outgrows the inline
+// storage, the elements move to another pool block if they fit in one, and only then to
+// the heap. So scripts that build and throw away small collections in a loop don't
+// allocate at all, and the ones that don't fit come back to the heap in the same few
+// sizes. When the pool is used up, everything falls back to the heap.
+
+#ifndef COLLECTION_POOL_BLOCK_SIZE
+#define COLLECTION_POOL_BLOCK_SIZE (8 * sizeof(void*)) // 32 bytes on the micro:bit
+#endif
+#ifndef COLLECTION_POOL_NUM_BLOCKS
+#define COLLECTION_POOL_NUM_BLOCKS 16
+#endif
+
+using CollectionPool = FixedBlockPool<COLLECTION_POOL_BLOCK_SIZE, COLLECTION_POOL_NUM_BLOCKS>;
+
+inline CollectionPool& getCollectionPool()
+{
+    static CollectionPool pool; // (constant-initialized, so no startup code or guard)
+    return pool;
+}
+
+// The pool if it fits and there's room, otherwise the heap
+struct CollectionAllocator
+{
+    static void* allocate(size_t size)
+    {
+        void* p = (size <= CollectionPool::blockSize()) ? getCollectionPool().allocate() : nullptr;
+        return p ? p : HeapAllocator::allocate(size);
+    }
+
+    static void deallocate(void* p, size_t size)
+    {
+        if (getCollectionPool().owns(p))
+        {
+            getCollectionPool().deallocate(p);
+        }
+        else
+        {
+            HeapAllocator::deallocate(p, size);
+        }
+    }
+};
+
+// A collection's control block
+template <typename T, size_t InlineCount>
+struct PooledCollectionBlock
+{
+    SmallVector<T, InlineCount, CollectionAllocator> items;
+    uint16_t refCount = 1;
+};
+
+// As many elements inline as fit in a pool block with the rest of the control block (up to
+// MaxCount, and at least one): 4 ints or pointers, but fewer of anything bigger, like
+// strings, so their collections still come from the pool
+template <typename T, size_t MaxCount = 4, bool Fits = (MaxCount <= 1 || sizeof(PooledCollectionBlock<T, MaxCount>) <= CollectionPool::blockSize())>
+struct PooledInlineCount : std::integral_constant<size_t, MaxCount>
+{
+};
+
+template <typename T, size_t MaxCount>
+struct PooledInlineCount<T, MaxCount, false> : PooledInlineCount<T, MaxCount - 1>
+{
+};
+
+// A handle to a shared collection, like ManagedType<vector<T>>: copies share the same
+// elements, and the last one to go frees them. A default-constructed handle is null.
+template <typename T, size_t InlineCount = PooledInlineCount<T>::value>
+class PooledCollection
+{
+public:
+    using Items = SmallVector<T, InlineCount, CollectionAllocator>;
+
+    PooledCollection() : block_(nullptr)
+    {
+    }
+
+    static PooledCollection create()
+    {
+        PooledCollection result;
+        result.block_ = new (CollectionAllocator::allocate(sizeof(Block))) Block();
+        return result;
+    }
+
+    PooledCollection(const PooledCollection& other) : block_(other.block_)
+    {
+        if (block_)
+        {
+            block_->refCount++;
+        }
+    }
+
+    PooledCollection(PooledCollection&& other) : block_(other.block_)
+    {
+        other.block_ = nullptr;
+    }
+
+    PooledCollection& operator=(PooledCollection other)
+    {
+        std::swap(block_, other.block_);
+        return *this;
+    }
+
+    ~PooledCollection()
+    {
+        if (block_ && --block_->refCount == 0)
+        {
+            block_->~Block();
+            CollectionAllocator::deallocate(block_, sizeof(Block));
+        }
+    }
+
+    Items* get() const { return block_ ? &block_->items : nullptr; }
+    Items* operator->() const { return get(); }
+    Items& operator*() const { return block_->items; }
+    int getReferences() const { return block_ ? block_->refCount : 0; }
+
+    bool operator==(const PooledCollection& other) const { return block_ == other.block_; }
+    bool operator!=(const PooledCollection& other) const { return block_ != other.block_; }
+
+private:
+    using Block = PooledCollectionBlock<T, InlineCount>;
+
+    Block* block_;
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Deferred deletes for reference-counted objects. When an object's count drops to zero,
+// it goes in the queue instead of being deleted on the spot, and the queue deletes them
+// all at once when it fills up or gets flushed. Values often drop to zero for a moment
+// while they move from one place to another (popped off a stack, then stored in a field):
+// if the object has been referenced again by the time the queue gets to it, it's left
+// alone, and it costs a queue slot rather than a delete and a new.
+//
+// T needs
+//
+//   bool releaseQueued;        // true while it's in the queue (starts false)
+//   bool isReferenced() const; // has anything picked it up again?
+//   void destroy();            // delete it (which may release more objects)
+//
+template <typename T, size_t Capacity>
+class ReleaseQueue
+{
+public:
+    constexpr ReleaseQueue() : pending_(), size_(0)
+    {
+    }
+
+    ReleaseQueue(const ReleaseQueue&) = delete;
+    ReleaseQueue& operator=(const ReleaseQueue&) = delete;
+
+    void release(T* obj);
+    void flush(); // deletes everything still unreferenced, including whatever that releases
+    size_t size() const { return size_; }
+
+private:
+    static_assert(Capacity > 0 && Capacity <= UINT16_MAX, "queue needs between 1 and 65535 entries");
+
+    T* pending_[Capacity];
+    uint16_t size_;
+};
+
+template <typename T, size_t Capacity>
+void ReleaseQueue<T, Capacity>::release(T* obj)
+{
+    if (obj->releaseQueued)
+    {
+        return;
+    }
+    if (size_ == Capacity)
+    {
+        flush();
+    }
+    obj->releaseQueued = true;
+    pending_[size_++] = obj;
+}
+
+// Last in, first out, so the objects that destroy() releases get deleted in the same pass
+template <typename T, size_t Capacity>
+void ReleaseQueue<T, Capacity>::flush()
+{
+    while (size_ > 0)
+    {
+        T* obj = pending_[--size_];
+        obj->releaseQueued = false;
+        if (!obj->isReferenced())
+        {
+            obj->destroy();
+        }
+    }
+}
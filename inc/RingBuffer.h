@@ -1,6 +1,9 @@
 #pragma once
 
 #include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
 
 template <typename T, int N>
 class RingBuffer
@@ -11,9 +14,23 @@ public:
     void push_back(const T& val);
     size_t size() const;
 
+    template <typename Archive>
+    void serialize(Archive& ar)
+    {
+        ar.io(arr_);
+        ar.io(curr_pos_);
+        if (!ar.check(curr_pos_ >= 0 && curr_pos_ < N))
+        {
+            curr_pos_ = 0; // (push_back() would write outside arr_)
+        }
+    }
+
 private:    
+    // Short delay lines are common, so keep the write position as narrow as the length allows
+    using index_t = typename std::conditional<(N <= INT8_MAX), int8_t, int>::type;
+
     std::array<T, N> arr_;
-    int curr_pos_ = 0;
+    index_t curr_pos_ = 0;
 };
 
 
@@ -54,6 +71,11 @@ public:
     T operator[](int index) const;
     void push_back(const T& val);
     size_t size() const;
+
+    template <typename Archive>
+    void serialize(Archive&)
+    {
+    }
 };
     
 template <typename T>
@@ -0,0 +1,151 @@
+#pragma once
+
+#include "DelayBuffer.h"
+#include "RunningStats.h" // for IdentityAccessor
+#include "Vector3.h"
+
+#include <array>
+
+// Sliding-window median (or any other rank). The window's values are kept sorted: each new
+// sample takes the slot of the one leaving the window and is then moved into place with an
+// insertion step. That's O(WindowSize) with a tiny constant (a compare and a copy per step,
+// no heap, no second pass over the delay line), which beats O(log W) trees for the short
+// windows used here.
+//
+// Like RunningStats, these read the sample leaving the window from the delay line, so the
+// buffer must be at least WindowSize+1 long, and addSample() must be called right after
+// the sample goes into the delay line. And like RunningStats, assigning one to another
+// copies the window but not the delay line reference.
+
+// Replace oldVal with newVal in a sorted array, keeping it sorted
+template <typename T, size_t N>
+void replaceSorted(std::array<T, N>& sorted, const T& oldVal, const T& newVal)
+{
+    // oldVal is in there somewhere (it went in WindowSize samples ago)
+    size_t pos = 0;
+    while (pos < N-1 && !(sorted[pos] == oldVal))
+    {
+        pos++;
+    }
+
+    // now slide the hole to where newVal goes
+    while (pos > 0 && newVal < sorted[pos-1])
+    {
+        sorted[pos] = sorted[pos-1];
+        pos--;
+    }
+    while (pos < N-1 && sorted[pos+1] < newVal)
+    {
+        sorted[pos] = sorted[pos+1];
+        pos++;
+    }
+    sorted[pos] = newVal;
+}
+
+template <int WindowSize, int BufferSize, typename T, typename S=T, typename Accessor=IdentityAccessor<S>>
+class RunningMedian
+{
+public:
+    static_assert(BufferSize > WindowSize, "delay line too short for window");
+
+    RunningMedian(DelayBuffer<S, BufferSize>& delayLine) : delayLine_(delayLine)
+    {
+        sorted_.fill((T)(Accessor::get_val(S()))); // the delay line starts out full of S()
+    }
+
+    // copies the window, but stays attached to our own delay line
+    RunningMedian& operator=(const RunningMedian& other)
+    {
+        sorted_ = other.sorted_;
+        return *this;
+    }
+
+    template <typename Archive>
+    void serialize(Archive& ar)
+    {
+        ar.io(sorted_);
+    }
+
+    void addSample(const S& val) // must always call this after adding sample to delay buffer
+    {
+        T oldVal = (T)(Accessor::get_val(delayLine_.getDelayedSample(windowSize_)));
+        T newVal = (T)(Accessor::get_val(val));
+        replaceSorted(sorted_, oldVal, newVal);
+    }
+
+    T getMedian() const
+    {
+        return sorted_[windowSize_ / 2];
+    }
+
+    // rank 0 is the smallest value in the window, rank WindowSize-1 the largest
+    T getRank(int rank) const
+    {
+        return sorted_[rank];
+    }
+
+    T getPercentile(int percent) const
+    {
+        return sorted_[(percent * (windowSize_ - 1) + 50) / 100];
+    }
+
+private:
+    static constexpr int windowSize_ = WindowSize;
+    DelayBuffer<S, BufferSize>& delayLine_;
+
+    std::array<T, WindowSize> sorted_;
+};
+
+// Per-axis median of a delay line of vectors. Cheaper than three RunningMedians with GetX
+// etc., since it only holds one reference to the delay line.
+template <int WindowSize, int BufferSize, typename T>
+class RunningVectorMedian
+{
+public:
+    static_assert(BufferSize > WindowSize, "delay line too short for window");
+
+    RunningVectorMedian(DelayBuffer<Vector3<T>, BufferSize>& delayLine) : delayLine_(delayLine)
+    {
+        x_.fill(T(0));
+        y_.fill(T(0));
+        z_.fill(T(0));
+    }
+
+    // copies the windows, but stays attached to our own delay line
+    RunningVectorMedian& operator=(const RunningVectorMedian& other)
+    {
+        x_ = other.x_;
+        y_ = other.y_;
+        z_ = other.z_;
+        return *this;
+    }
+
+    template <typename Archive>
+    void serialize(Archive& ar)
+    {
+        ar.io(x_);
+        ar.io(y_);
+        ar.io(z_);
+    }
+
+    void addSample(const Vector3<T>& val) // must always call this after adding sample to delay buffer
+    {
+        Vector3<T> oldVal = delayLine_.getDelayedSample(windowSize_);
+        replaceSorted(x_, oldVal.x, val.x);
+        replaceSorted(y_, oldVal.y, val.y);
+        replaceSorted(z_, oldVal.z, val.z);
+    }
+
+    Vector3<T> getMedian() const
+    {
+        return Vector3<T>(x_[windowSize_ / 2], y_[windowSize_ / 2], z_[windowSize_ / 2]);
+    }
+
+private:
+    static constexpr int windowSize_ = WindowSize;
+    DelayBuffer<Vector3<T>, BufferSize>& delayLine_;
+
+    std::array<T, WindowSize> x_;
+    std::array<T, WindowSize> y_;
+    std::array<T, WindowSize> z_;
+};
@@ -26,6 +26,19 @@ public:
     {
     }
 
+    // copies the running sums, but stays attached to our own delay line
+    RunningMean& operator=(const RunningMean& other)
+    {
+        accumSum_ = other.accumSum_;
+        return *this;
+    }
+
+    template <typename Archive>
+    void serialize(Archive& ar)
+    {
+        ar.io(accumSum_);
+    }
+
     void addSample(const S& val) // must always call this after adding sample to delay buffer
     {
         // subtract old value
@@ -48,7 +61,7 @@ public:
     }
 
 private:
-    const int windowSize_ = WindowSize;
+    static constexpr int windowSize_ = WindowSize;
     DelayBuffer<S, BufferSize>& delayLine_;
 
     T accumSum_ = S(0);
@@ -63,6 +76,21 @@ public:
     {
     }
 
+    // copies the running sums, but stays attached to our own delay line
+    RunningStats& operator=(const RunningStats& other)
+    {
+        accumSum_ = other.accumSum_;
+        accumSumSq_ = other.accumSumSq_;
+        return *this;
+    }
+
+    template <typename Archive>
+    void serialize(Archive& ar)
+    {
+        ar.io(accumSum_);
+        ar.io(accumSumSq_);
+    }
+
     void addSample(const S& val) // must always call this after adding sample to delay buffer
     {
         // subtract old values
@@ -96,6 +124,17 @@ public:
         return 1.0f / fast_inv_sqrt(getVar());
     }
 
+    // raw accumulators, for callers that want to stay in integers
+    T getSum()
+    {
+        return accumSum_;
+    }
+
+    T getSumSq()
+    {
+        return accumSumSq_;
+    }
+
 /*
     T getMax()
     {
@@ -104,7 +143,7 @@ public:
     */
 
 private:
-    const int windowSize_ = WindowSize;
+    static constexpr int windowSize_ = WindowSize;
     DelayBuffer<S, BufferSize>& delayLine_;
 
     T accumSum_ = 0;
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "FastMath.h"
+#include "Vector3.h"
+
+#include <cstdint>
+
+// The accelerometer, read once per tick and shared. A script that asks for x, y, z and
+// the strength used to make four separate trips to the sensor (six axis reads, with the
+// strength's own three), which could each see a different sample, and the strength went
+// through double and sqrt(). Here a reading is the three axes together, kept along with
+// when it was taken: the gesture detector takes a fresh one every tick (update()), and
+// anyone else calls refresh(), which only goes to the sensor if the last reading is more
+// than maxAge ms old. Everyone in the same tick sees the same sample, and the strength
+// is worked out once per reading, in integers.
+//
+// Accelerometer is the DAL's MicroBitAccelerometer, or anything with the same calls:
+//   int update();  // fetch a new sample
+//   int getX();    // in milli-g
+//   int getY();
+//   int getZ();
+template <typename Accelerometer>
+class SensorFrame
+{
+public:
+    using vector_t = Vector3<int16_t>;
+
+    SensorFrame(Accelerometer& accelerometer, uint32_t maxAge = 18) : accelerometer_(accelerometer), maxAge_(maxAge)
+    {
+    }
+
+    void update(uint32_t now);
+    const SensorFrame& refresh(uint32_t now);
+
+    int getX() const { return acceleration_.x; }
+    int getY() const { return acceleration_.y; }
+    int getZ() const { return acceleration_.z; }
+    const vector_t& getAcceleration() const { return acceleration_; }
+    int getStrength() const;
+
+    // 64 to the g (clamped to a byte), the way the gesture detector takes it
+    byteVector3 getSample() const { return byteVector3(clampByte(getX() >> 4), clampByte(getY() >> 4), clampByte(getZ() >> 4)); }
+
+    uint32_t getTime() const { return time_; }
+    uint32_t getNumReads() const { return numReads_; }
+
+private:
+    Accelerometer& accelerometer_;
+    uint32_t maxAge_;
+    vector_t acceleration_;
+    mutable int32_t strength_ = -1; // (-1: not worked out yet)
+    uint32_t time_ = 0;
+    uint32_t numReads_ = 0;
+};
+
+template <typename Accelerometer>
+void SensorFrame<Accelerometer>::update(uint32_t now)
+{
+    accelerometer_.update();
+    acceleration_ = vector_t(int16_t(accelerometer_.getX()), int16_t(accelerometer_.getY()), int16_t(accelerometer_.getZ()));
+    strength_ = -1;
+    time_ = now;
+    numReads_++;
+}
+
+template <typename Accelerometer>
+const SensorFrame<Accelerometer>& SensorFrame<Accelerometer>::refresh(uint32_t now)
+{
+    if (numReads_ == 0 || now - time_ >= maxAge_)
+    {
+        update(now);
+    }
+    return *this;
+}
+
+template <typename Accelerometer>
+int SensorFrame<Accelerometer>::getStrength() const
+{
+    if (strength_ < 0)
+    {
+        strength_ = int32_t(normInt(acceleration_));
+    }
+    return strength_;
+}
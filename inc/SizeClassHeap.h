@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+// Free lists for small objects, one per size class (Granularity, 2 * Granularity, ...).
+// Blocks come from the heap the first time, but a freed block goes on its class's list
+// rather than back to the heap, and the next allocation of that class takes it straight
+// back off. Objects that are made and dropped all the time then stop churning (and
+// fragmenting) the general heap. Anything bigger than NumClasses * Granularity goes
+// straight to the heap.
+//
+// The lists hold at most MaxCachedBytes between them: past that, deallocate() gives the
+// block back to the heap, so a burst of small objects doesn't keep its memory for good.
+// trim() gives cached blocks back too, the biggest classes first, down to however many
+// bytes the caller wants to keep.
+//
+// If the heap runs out, allocate() gives the cached blocks back and tries again, and only
+// returns nullptr if that doesn't help either.
+//
+// deallocate() has to be told the same size the block was allocated with.
+template <size_t Granularity, size_t NumClasses, size_t MaxCachedBytes = 4 * Granularity * NumClasses>
+class SizeClassHeap
+{
+public:
+    constexpr SizeClassHeap() : freeLists_(), numCached_(0), cachedBytes_(0)
+    {
+    }
+
+    SizeClassHeap(const SizeClassHeap&) = delete;
+    SizeClassHeap& operator=(const SizeClassHeap&) = delete;
+    ~SizeClassHeap() { trim(); }
+
+    void* allocate(size_t size);
+    void deallocate(void* p, size_t size);
+    void trim(size_t keepBytes = 0); // gives cached blocks back to the heap, down to keepBytes
+
+    size_t getNumCached() const { return numCached_; }
+    size_t getCachedBytes() const { return cachedBytes_; }
+    static constexpr size_t maxSize() { return Granularity * NumClasses; }
+    static constexpr size_t maxCachedBytes() { return MaxCachedBytes; }
+
+private:
+    static_assert(Granularity >= sizeof(void*) && Granularity % alignof(void*) == 0, "blocks have to hold a pointer");
+
+    struct FreeBlock
+    {
+        FreeBlock* next;
+    };
+
+    static size_t getClass(size_t size) { return size ? (size - 1) / Granularity : 0; } // (rounded up)
+    void* allocateFromHeap(size_t size);
+
+    FreeBlock* freeLists_[NumClasses];
+    size_t numCached_;
+    size_t cachedBytes_;
+};
+
+template <size_t Granularity, size_t NumClasses, size_t MaxCachedBytes>
+void* SizeClassHeap<Granularity, NumClasses, MaxCachedBytes>::allocate(size_t size)
+{
+    if (size > maxSize())
+    {
+        return allocateFromHeap(size);
+    }
+
+    size_t sizeClass = getClass(size);
+    FreeBlock* block = freeLists_[sizeClass];
+    if (!block)
+    {
+        return allocateFromHeap((sizeClass + 1) * Granularity);
+    }
+    freeLists_[sizeClass] = block->next;
+    numCached_--;
+    cachedBytes_ -= (sizeClass + 1) * Granularity;
+    return block;
+}
+
+template <size_t Granularity, size_t NumClasses, size_t MaxCachedBytes>
+void* SizeClassHeap<Granularity, NumClasses, MaxCachedBytes>::allocateFromHeap(size_t size)
+{
+    void* p = ::operator new(size, std::nothrow);
+    if (!p && numCached_ > 0)
+    {
+        trim();
+        p = ::operator new(size, std::nothrow);
+    }
+    return p;
+}
+
+template <size_t Granularity, size_t NumClasses, size_t MaxCachedBytes>
+void SizeClassHeap<Granularity, NumClasses, MaxCachedBytes>::deallocate(void* p, size_t size)
+{
+    size_t sizeClass = getClass(size);
+    size_t blockSize = (sizeClass + 1) * Granularity;
+    if (size > maxSize() || cachedBytes_ + blockSize > MaxCachedBytes)
+    {
+        ::operator delete(p);
+        return;
+    }
+
+    FreeBlock* block = static_cast<FreeBlock*>(p);
+    block->next = freeLists_[sizeClass];
+    freeLists_[sizeClass] = block;
+    numCached_++;
+    cachedBytes_ += blockSize;
+}
+
+template <size_t Granularity, size_t NumClasses, size_t MaxCachedBytes>
+void SizeClassHeap<Granularity, NumClasses, MaxCachedBytes>::trim(size_t keepBytes)
+{
+    for (size_t sizeClass = NumClasses; sizeClass-- > 0 && cachedBytes_ > keepBytes;)
+    {
+        FreeBlock*& list = freeLists_[sizeClass];
+        while (list && cachedBytes_ > keepBytes)
+        {
+            FreeBlock* block = list;
+            list = block->next;
+            ::operator delete(block);
+            numCached_--;
+            cachedBytes_ -= (sizeClass + 1) * Granularity;
+        }
+    }
+}
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Where a SmallVector's elements go once they don't fit inline
+struct HeapAllocator
+{
+    static void* allocate(size_t size) { return ::operator new(size); }
+    static void deallocate(void* p, size_t) { ::operator delete(p); }
+};
+
+// A vector that keeps its first InlineCount elements inside the object itself, and only
+// goes to the allocator when it grows past that. Most script collections stay small, so
+// most of them never allocate anything for their elements.
+//
+// There are two ways to take an element out: erase() keeps the order and shifts everything
+// after it down, and swapRemove() moves the last element into the hole instead, which is
+// O(1) but changes the order.
+//
+// Sizes are 16 bits: this is for a 16 KB machine.
+template <typename T, size_t InlineCount, typename Allocator = HeapAllocator>
+class SmallVector
+{
+public:
+    SmallVector() : data_(inlineData()), size_(0), capacity_(InlineCount)
+    {
+    }
+
+    SmallVector(const SmallVector& other);
+    SmallVector& operator=(const SmallVector& other);
+    ~SmallVector();
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    size_t capacity() const { return capacity_; }
+    bool isInline() const { return data_ == inlineData(); }
+
+    T& operator[](size_t index) { return data_[index]; }
+    const T& operator[](size_t index) const { return data_[index]; }
+    T& at(size_t index) { return data_[index]; } // (no bounds check: callers check first)
+    const T& at(size_t index) const { return data_[index]; }
+    T& back() { return data_[size_ - 1]; }
+
+    T* begin() { return data_; }
+    T* end() { return data_ + size_; }
+    const T* begin() const { return data_; }
+    const T* end() const { return data_ + size_; }
+
+    void push_back(const T& val);
+    void pop_back();
+    void erase(size_t index);      // keeps the order: O(n)
+    void swapRemove(size_t index); // moves the last element into its place: O(1)
+    void clear();
+    void reserve(size_t newCapacity);
+
+private:
+    static_assert(InlineCount > 0 && InlineCount <= UINT16_MAX, "SmallVector needs some inline storage");
+
+    T* inlineData() { return reinterpret_cast<T*>(inline_); }
+    const T* inlineData() const { return reinterpret_cast<const T*>(inline_); }
+    void grow(size_t newCapacity);
+    void release();
+
+    T* data_;
+    uint16_t size_;
+    uint16_t capacity_;
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type inline_[InlineCount];
+};
+
+template <typename T, size_t InlineCount, typename Allocator>
+SmallVector<T, InlineCount, Allocator>::SmallVector(const SmallVector& other) : SmallVector()
+{
+    reserve(other.size_);
+    for (const auto& val : other)
+    {
+        new (data_ + size_) T(val);
+        size_++;
+    }
+}
+
+template <typename T, size_t InlineCount, typename Allocator>
+SmallVector<T, InlineCount, Allocator>& SmallVector<T, InlineCount, Allocator>::operator=(const SmallVector& other)
+{
+    if (this != &other)
+    {
+        clear();
+        reserve(other.size_);
+        for (const auto& val : other)
+        {
+            new (data_ + size_) T(val);
+            size_++;
+        }
+    }
+    return *this;
+}
+
+template <typename T, size_t InlineCount, typename Allocator>
+SmallVector<T, InlineCount, Allocator>::~SmallVector()
+{
+    clear();
+    release();
+}
+
+template <typename T, size_t InlineCount, typename Allocator>
+void SmallVector<T, InlineCount, Allocator>::push_back(const T& val)
+{
+    if (size_ < capacity_)
+    {
+        new (data_ + size_) T(val);
+        size_++;
+        return;
+    }
+
+    if (size_ == UINT16_MAX)
+    {
+        return; // full
+    }
+
+    // val might be one of our own elements, so copy it across before the old ones move out
+    size_t newCapacity = 2 * size_t(capacity_);
+    if (newCapacity > UINT16_MAX)
+    {
+        newCapacity = UINT16_MAX;
+    }
+    T* newData = static_cast<T*>(Allocator::allocate(newCapacity * sizeof(T)));
+    new (newData + size_) T(val);
+    for (size_t index = 0; index < size_; index++)
+    {
+        new (newData + index) T(std::move(data_[index]));
+        data_[index].~T();
+    }
+    release();
+    data_ = newData;
+    capacity_ = uint16_t(newCapacity);
+    size_++;
+}
+
+template <typename T, size_t InlineCount, typename Allocator>
+void SmallVector<T, InlineCount, Allocator>::pop_back()
+{
+    size_--;
+    data_[size_].~T();
+}
+
+template <typename T, size_t InlineCount, typename Allocator>
+void SmallVector<T, InlineCount, Allocator>::erase(size_t index)
+{
+    for (size_t dest = index; dest + 1 < size_; dest++)
+    {
+        data_[dest] = std::move(data_[dest + 1]);
+    }
+    pop_back();
+}
+
+template <typename T, size_t InlineCount, typename Allocator>
+void SmallVector<T, InlineCount, Allocator>::swapRemove(size_t index)
+{
+    if (index + 1 < size_)
+    {
+        data_[index] = std::move(data_[size_ - 1]);
+    }
+    pop_back();
+}
+
+template <typename T, size_t InlineCount, typename Allocator>
+void SmallVector<T, InlineCount, Allocator>::clear()
+{
+    while (size_ > 0)
+    {
+        pop_back();
+    }
+}
+
+template <typename T, size_t InlineCount, typename Allocator>
+void SmallVector<T, InlineCount, Allocator>::reserve(size_t newCapacity)
+{
+    if (newCapacity > capacity_)
+    {
+        grow(newCapacity);
+    }
+}
+
+template <typename T, size_t InlineCount, typename Allocator>
+void SmallVector<T, InlineCount, Allocator>::grow(size_t newCapacity)
+{
+    T* newData = static_cast<T*>(Allocator::allocate(newCapacity * sizeof(T)));
+    for (size_t index = 0; index < size_; index++)
+    {
+        new (newData + index) T(std::move(data_[index]));
+        data_[index].~T();
+    }
+    release();
+    data_ = newData;
+    capacity_ = uint16_t(newCapacity);
+}
+
+// Gives back the spilled storage, if there is any (the elements have to be gone already)
+template <typename T, size_t InlineCount, typename Allocator>
+void SmallVector<T, InlineCount, Allocator>::release()
+{
+    if (!isInline())
+    {
+        Allocator::deallocate(data_, capacity_ * sizeof(T));
+        data_ = inlineData();
+        capacity_ = InlineCount;
+    }
+}
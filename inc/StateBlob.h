@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// Flattens the state of the filters and windows into a byte buffer and back, e.g., to
+// checkpoint a detector or keep it warm across a sleep. Every stateful class has a
+//
+//   template <typename Archive> void serialize(Archive& ar);
+//
+// that passes each of its state members to ar.io(), in a fixed order. The same function
+// writes (with a StateWriter) and reads (with a StateReader), so the two can't get out of
+// step. Configuration (thresholds, coefficients) and delay-line references aren't state,
+// and aren't included.
+//
+// A class that restores something it relies on (a position in a buffer, say) passes what
+// it read to ar.check(), which fails the read if it's not valid; the class then puts in a
+// safe value rather than keep it.
+//
+// Values are copied as raw bytes: a blob is only good for the build that wrote it.
+
+class StateWriter
+{
+public:
+    // With no buffer, just counts the bytes
+    StateWriter(uint8_t* data = nullptr, size_t capacity = 0) : data_(data), capacity_(capacity)
+    {
+    }
+
+    template <typename T>
+    void io(const T& val)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "state has to be plain data");
+        if (data_ && size_ + sizeof(T) <= capacity_)
+        {
+            memcpy(data_ + size_, &val, sizeof(T));
+        }
+        else if (data_)
+        {
+            overflowed_ = true;
+        }
+        size_ += sizeof(T);
+    }
+
+    bool check(bool valid) const { return valid; } // (the state being written is always valid)
+
+    size_t size() const { return size_; }
+    bool ok() const { return !overflowed_; }
+
+private:
+    uint8_t* data_;
+    size_t capacity_;
+    size_t size_ = 0;
+    bool overflowed_ = false;
+};
+
+class StateReader
+{
+public:
+    StateReader(const uint8_t* data, size_t size) : data_(data), size_(size)
+    {
+    }
+
+    template <typename T>
+    void io(T& val)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "state has to be plain data");
+        if (pos_ + sizeof(T) <= size_)
+        {
+            memcpy(&val, data_ + pos_, sizeof(T));
+        }
+        else
+        {
+            overflowed_ = true;
+        }
+        pos_ += sizeof(T);
+    }
+
+    bool check(bool valid)
+    {
+        if (!valid)
+        {
+            invalid_ = true;
+        }
+        return valid;
+    }
+
+    size_t pos() const { return pos_; }
+    bool ok() const { return !overflowed_ && !invalid_; }
+
+private:
+    const uint8_t* data_;
+    size_t size_;
+    size_t pos_ = 0;
+    bool overflowed_ = false;
+    bool invalid_ = false;
+};
@@ -0,0 +1,336 @@
+#pragma once
+
+#include <cstdint>
+
+// Gesture events and feature summaries for a gateway, batched into as few radio packets as
+// possible: each transmission costs power, and with a classroom full of boards, collisions
+// too. Records go into a bit-packed packet until it's full, or the oldest one has waited
+// maxLatency ms, whichever comes first.
+//
+// A packet is a header (a 4-bit format version, a 4-bit sequence number, and the time of
+// the first record, 32 bits of ms), then the records, each
+//
+//   kind (2 bits: 1 = event, 2 = summary; 0 marks the end)
+//   time since the previous record in ms: bit count (5 bits), then that many bits
+//   event: the event code (4 bits)
+//   summary: the number of values (3 bits), then 8 bits each (see quantize())
+//
+// and zeros to the end of the last byte. All of it's most significant bit first.
+//
+// Transport is anything with a datagram send call, like MicroBitRadioDatagram:
+//   int send(uint8_t* data, int length);
+
+// Reads and writes a byte buffer a few bits at a time
+class BitWriter
+{
+public:
+    BitWriter(uint8_t* data, int size) : data_(data), size_(size)
+    {
+    }
+
+    int getNumBits() const { return numBits_; }
+    int getNumBytes() const { return (numBits_ + 7) / 8; }
+    int getBitsLeft() const { return size_ * 8 - numBits_; }
+
+    // (the caller checks there's room)
+    void write(uint32_t value, int numBits)
+    {
+        for (int bit = numBits - 1; bit >= 0; bit--)
+        {
+            uint8_t& byte = data_[numBits_ / 8];
+            int shift = 7 - numBits_ % 8;
+            byte = uint8_t((byte & ~(1 << shift)) | (((value >> bit) & 1) << shift));
+            numBits_++;
+        }
+    }
+
+    void reset() { numBits_ = 0; }
+
+private:
+    uint8_t* data_;
+    int size_;
+    int numBits_ = 0;
+};
+
+class BitReader
+{
+public:
+    BitReader(const uint8_t* data, int size) : data_(data), size_(size)
+    {
+    }
+
+    int getBitsLeft() const { return size_ * 8 - numBits_; }
+
+    // (returns 0 past the end)
+    uint32_t read(int numBits)
+    {
+        uint32_t value = 0;
+        for (int bit = 0; bit < numBits; bit++)
+        {
+            uint32_t next = numBits_ < size_ * 8 ? (data_[numBits_ / 8] >> (7 - numBits_ % 8)) & 1 : 0;
+            value = (value << 1) | next;
+            numBits_++;
+        }
+        return value;
+    }
+
+private:
+    const uint8_t* data_;
+    int size_;
+    int numBits_ = 0;
+};
+
+enum TelemetryRecordKind : uint8_t
+{
+    TELEMETRY_END = 0,
+    TELEMETRY_EVENT = 1,
+    TELEMETRY_SUMMARY = 2,
+};
+
+struct TelemetryRecord
+{
+    static const int maxValues = 7;
+
+    uint32_t time = 0; // ms
+    TelemetryRecordKind kind = TELEMETRY_END;
+    uint8_t event = 0;
+    uint8_t numValues = 0;
+    uint8_t values[maxValues] = {};
+};
+
+namespace telemetry
+{
+    const int maxPacketSize = 32; // MICROBIT_RADIO_MAX_PACKET_SIZE
+    const int formatVersion = 1;
+    const int headerBits = 4 + 4 + 32;
+    const int maxEvent = 15;
+
+    // Scales value from [minVal, maxVal] to a byte (clamped)
+    inline uint8_t quantize(int32_t value, int32_t minVal, int32_t maxVal)
+    {
+        if (value <= minVal)
+        {
+            return 0;
+        }
+        if (value >= maxVal)
+        {
+            return 255;
+        }
+        return uint8_t((int64_t(value - minVal) * 255 + (maxVal - minVal) / 2) / (maxVal - minVal));
+    }
+
+    inline int32_t dequantize(uint8_t value, int32_t minVal, int32_t maxVal)
+    {
+        return minVal + int32_t((int64_t(value) * (maxVal - minVal) + 127) / 255);
+    }
+
+    inline int getNumBits(uint32_t value)
+    {
+        int numBits = 0;
+        while (value >> numBits)
+        {
+            numBits++;
+        }
+        return numBits;
+    }
+
+    // Unpacks a packet into records (up to maxRecords). Returns how many there were, or -1
+    // if it isn't a telemetry packet.
+    int decodePacket(const uint8_t* data, int length, TelemetryRecord* records, int maxRecords, uint8_t* sequence = nullptr);
+}
+
+template <typename Transport>
+class TelemetryBatcher
+{
+public:
+    TelemetryBatcher(Transport& transport, uint32_t maxLatency = 1000) : transport_(transport), maxLatency_(maxLatency)
+    {
+    }
+
+    void setMaxLatency(uint32_t maxLatency) { maxLatency_ = maxLatency; } // in ms (0: send every record straight away)
+
+    void addEvent(uint32_t time, uint8_t event); // (event codes are 4 bits)
+    void addSummary(uint32_t time, const uint8_t* values, int numValues); // (up to TelemetryRecord::maxValues)
+
+    // Sends the packet if its oldest record has waited long enough. Returns how many ms
+    // until it will have (or maxLatency, if there's nothing waiting).
+    uint32_t poll(uint32_t time);
+    void flush();
+
+    bool isEmpty() const { return numPending_ == 0; }
+    uint32_t getNumRecords() const { return numRecords_; }
+    uint32_t getNumPackets() const { return numPackets_; }
+    uint32_t getNumBytesSent() const { return numBytesSent_; }
+
+private:
+    static int getTimeBits(uint32_t delta) { return 5 + telemetry::getNumBits(delta); }
+
+    // Makes room for a record of numBits (after its time), and writes its kind and time
+    void startRecord(uint32_t time, TelemetryRecordKind kind, int numBits);
+    void finishRecord(uint32_t time);
+
+    Transport& transport_;
+    uint32_t maxLatency_;
+
+    uint8_t packet_[telemetry::maxPacketSize] = {};
+    BitWriter writer_{ packet_, telemetry::maxPacketSize };
+    uint8_t sequence_ = 0;
+    uint8_t numPending_ = 0;
+    uint32_t firstTime_ = 0; // of the records in the packet so far
+    uint32_t lastTime_ = 0;
+
+    uint32_t numRecords_ = 0;
+    uint32_t numPackets_ = 0;
+    uint32_t numBytesSent_ = 0;
+};
+
+template <typename Transport>
+void TelemetryBatcher<Transport>::addEvent(uint32_t time, uint8_t event)
+{
+    startRecord(time, TELEMETRY_EVENT, 4);
+    writer_.write(event & telemetry::maxEvent, 4);
+    finishRecord(time);
+}
+
+template <typename Transport>
+void TelemetryBatcher<Transport>::addSummary(uint32_t time, const uint8_t* values, int numValues)
+{
+    if (numValues > TelemetryRecord::maxValues)
+    {
+        numValues = TelemetryRecord::maxValues;
+    }
+    startRecord(time, TELEMETRY_SUMMARY, 3 + 8 * numValues);
+    writer_.write(uint32_t(numValues), 3);
+    for (int index = 0; index < numValues; index++)
+    {
+        writer_.write(values[index], 8);
+    }
+    finishRecord(time);
+}
+
+template <typename Transport>
+void TelemetryBatcher<Transport>::startRecord(uint32_t time, TelemetryRecordKind kind, int numBits)
+{
+    // (a record that doesn't fit, or that's out of order, starts a new packet)
+    if (numPending_ > 0 && (int32_t(time - lastTime_) < 0 || 2 + getTimeBits(time - lastTime_) + numBits > writer_.getBitsLeft()))
+    {
+        flush();
+    }
+    if (numPending_ == 0)
+    {
+        writer_.reset();
+        writer_.write(telemetry::formatVersion, 4);
+        writer_.write(sequence_, 4);
+        writer_.write(time, 32);
+        firstTime_ = lastTime_ = time;
+    }
+
+    uint32_t delta = time - lastTime_;
+    int deltaBits = telemetry::getNumBits(delta);
+    writer_.write(kind, 2);
+    writer_.write(uint32_t(deltaBits), 5);
+    writer_.write(delta, deltaBits);
+}
+
+template <typename Transport>
+void TelemetryBatcher<Transport>::finishRecord(uint32_t time)
+{
+    lastTime_ = time;
+    numPending_++;
+    numRecords_++;
+    if (maxLatency_ == 0)
+    {
+        flush();
+    }
+}
+
+template <typename Transport>
+uint32_t TelemetryBatcher<Transport>::poll(uint32_t time)
+{
+    if (numPending_ == 0)
+    {
+        return maxLatency_;
+    }
+    uint32_t age = time - firstTime_;
+    if (int32_t(age) >= int32_t(maxLatency_))
+    {
+        flush();
+        return maxLatency_;
+    }
+    return maxLatency_ - age;
+}
+
+template <typename Transport>
+void TelemetryBatcher<Transport>::flush()
+{
+    if (numPending_ == 0)
+    {
+        return;
+    }
+    int length = writer_.getNumBytes();
+    int bitsLeft = length * 8 - writer_.getNumBits();
+    writer_.write(0, bitsLeft); // (the end marker, if there's room for one)
+    transport_.send(packet_, length);
+
+    sequence_ = (sequence_ + 1) & 15;
+    numPending_ = 0;
+    numPackets_++;
+    numBytesSent_ += length;
+}
+
+inline int telemetry::decodePacket(const uint8_t* data, int length, TelemetryRecord* records, int maxRecords, uint8_t* sequence)
+{
+    BitReader reader(data, length);
+    if (length * 8 < headerBits || reader.read(4) != uint32_t(formatVersion))
+    {
+        return -1;
+    }
+    uint8_t packetSequence = uint8_t(reader.read(4));
+    if (sequence)
+    {
+        *sequence = packetSequence;
+    }
+    uint32_t time = reader.read(32);
+
+    int numRecords = 0;
+    while (reader.getBitsLeft() >= 2)
+    {
+        auto kind = TelemetryRecordKind(reader.read(2));
+        if (kind == TELEMETRY_END)
+        {
+            break;
+        }
+        int deltaBits = int(reader.read(5));
+        time += reader.read(deltaBits);
+
+        TelemetryRecord record;
+        record.time = time;
+        record.kind = kind;
+        if (kind == TELEMETRY_EVENT)
+        {
+            record.event = uint8_t(reader.read(4));
+        }
+        else if (kind == TELEMETRY_SUMMARY)
+        {
+            record.numValues = uint8_t(reader.read(3));
+            for (int index = 0; index < record.numValues; index++)
+            {
+                record.values[index] = uint8_t(reader.read(8));
+            }
+        }
+        else
+        {
+            return -1;
+        }
+        if (reader.getBitsLeft() < 0)
+        {
+            return -1; // (cut off)
+        }
+        if (numRecords < maxRecords)
+        {
+            records[numRecords] = record;
+        }
+        numRecords++;
+    }
+    return numRecords;
+}
@@ -23,13 +23,11 @@ public:
         z = T(v.z);
     }
 
+    // defaulted, so vectors of plain types stay trivially copyable
+    Vector3<T>(const Vector3<T>& v) = default;
+    Vector3<T>& operator=(const Vector3<T>& v) = default;
+
     // math
-    void operator=(const Vector3<T>& v)
-    {
-        x = v.x;
-        y = v.y;
-        z = v.z;
-    }
 
     void operator+=(const Vector3<T>& v)
     {
@@ -225,6 +223,17 @@ float norm(const Vector3<T>& v)
     return 1.0 / fast_inv_sqrt(normSq(v));
 }
 
+// The length of an integer vector, rounded down, without going through float (components
+// up to 16 bits, so the squares add up in 32)
+template <typename T>
+uint32_t normInt(const Vector3<T>& v)
+{
+    uint32_t xSq = uint32_t(int32_t(v.x) * int32_t(v.x));
+    uint32_t ySq = uint32_t(int32_t(v.y) * int32_t(v.y));
+    uint32_t zSq = uint32_t(int32_t(v.z) * int32_t(v.z));
+    return isqrt(xSq + ySq + zSq);
+}
+
 template <typename T>
 float dotNorm(const Vector3<T>& a, const Vector3<T>& b)
 {
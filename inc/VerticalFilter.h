@@ -0,0 +1,129 @@
+#pragma once
+
+#include "FastMath.h"
+#include "FixedPt.h"
+#include "Vector3.h"
+
+#include <cstdint>
+
+// Vertical motion from the accelerometer and the barometer together: altitude and vertical
+// velocity at the accelerometer rate.
+//
+// Each tick, the sample is projected onto the gesture detector's gravity estimate, and 1 g
+// taken off, to get the vertical acceleration, which is integrated twice. (Only the
+// direction of the estimate is used: it's a low-pass filter with a time constant of about
+// half a second, so its magnitude soaks up the slow part of any vertical acceleration,
+// and subtracting it would lose that. Vertical acceleration doesn't turn it, though.)
+// The integrals drift, and the barometer doesn't, but it's noisy and slow, so the
+// barometric altitude pulls them back with a third-order complementary filter:
+//
+//   e = baro - h,   h += dt (v + k1 e),   v += dt (a - b + k2 e),   b -= dt k3 e
+//
+// where b is the accelerometer's bias along the vertical (which also takes care of its
+// scale not being exactly 64 to the g). The gains put all three poles at
+// -1 / timeConstant: below that frequency the result follows the barometer, and above it,
+// the accelerometer.
+//
+// Samples that are more than half a g off the gravity estimate (shakes, taps, quick turns
+// the estimate hasn't caught up with, anything clipped at the 2 g range) say more about
+// the estimate than about vertical motion, so those ticks carry the velocity on as it
+// was, and leave it to the barometer.
+//
+// Everything's in 16.16 fixed point (m, m/s, m/s^2), and a tick is a square root and a
+// handful of multiplies.
+class VerticalFilter
+{
+public:
+    using value_t = FixedPt<16, 16>;
+
+    // samplePeriod and timeConstant in seconds
+    VerticalFilter(float samplePeriod = 0.018f, float timeConstant = 1.0f);
+
+    // Starts over, at rest (at the altitude of the next barometer reading)
+    void init();
+
+    // The latest barometric altitude (it stands until the next one)
+    void setBaroAltitude(value_t altitude);
+
+    // One accelerometer tick: the sample (with gravity) and the gravity estimate, both 64 to
+    // the g, as the gesture detector has them
+    void addSample(const byteVector3& sample, const Vector3<fixed_9_7>& gravity);
+
+    value_t getAltitude() const { return altitude_; }
+    value_t getVelocity() const { return velocity_; } // up is positive
+    value_t getAcceleration() const { return acceleration_; } // vertical, less 1 g, from the last sample (bias not removed)
+    value_t getBias() const { return bias_; }
+
+private:
+    static value_t mul(value_t a, value_t b) { return fixMul<16, 16, int32_t>(a, b); }
+
+    // 9.80665 / 64: m/s^2 per unit of the detector's samples
+    static constexpr int32_t unitToMs2 = 10043; // (16.16)
+
+    // below a quarter of a g, there's no telling which way is up (e.g., free-fall)
+    static constexpr int32_t minGravity = 16 << 7;
+
+    // and half a g off the estimate, the sample's no use (see above)
+    static constexpr int32_t maxDeviation = 32;
+
+    value_t dt_, k1dt_, k2dt_, k3dt_;
+
+    value_t altitude_;
+    value_t velocity_;
+    value_t acceleration_;
+    value_t bias_;
+    value_t baroAltitude_;
+    bool haveBaro_ = false;
+};
+
+inline VerticalFilter::VerticalFilter(float samplePeriod, float timeConstant)
+    : dt_(samplePeriod),
+      k1dt_(3 * samplePeriod / timeConstant),
+      k2dt_(3 * samplePeriod / (timeConstant * timeConstant)),
+      k3dt_(samplePeriod / (timeConstant * timeConstant * timeConstant))
+{
+}
+
+inline void VerticalFilter::init()
+{
+    altitude_ = velocity_ = acceleration_ = bias_ = baroAltitude_ = value_t();
+    haveBaro_ = false;
+}
+
+inline void VerticalFilter::setBaroAltitude(value_t altitude)
+{
+    if (!haveBaro_)
+    {
+        altitude_ = altitude; // (start from the first reading, rather than climbing up to it)
+    }
+    baroAltitude_ = altitude;
+    haveBaro_ = true;
+}
+
+inline void VerticalFilter::addSample(const byteVector3& sample, const Vector3<fixed_9_7>& gravity)
+{
+    // acceleration along gravity, less 1 g: (s . g) / |g| - 64, with g in 9.7
+    int32_t gx = gravity.x.value_;
+    int32_t gy = gravity.y.value_;
+    int32_t gz = gravity.z.value_;
+    int32_t magnitude = int32_t(isqrt(uint32_t(gx * gx + gy * gy + gz * gz)));
+    int32_t dx = sample.x - (gx >> 7);
+    int32_t dy = sample.y - (gy >> 7);
+    int32_t dz = sample.z - (gz >> 7);
+    bool isClipped = sample.x == -128 || sample.x == 127 || sample.y == -128 || sample.y == 127 || sample.z == -128 || sample.z == 127;
+    if (magnitude >= minGravity && !isClipped && dx * dx + dy * dy + dz * dz <= maxDeviation * maxDeviation)
+    {
+        int32_t dot = sample.x * gx + sample.y * gy + sample.z * gz;
+        int32_t up = dot * 128 / magnitude - (64 << 7); // 9.7
+        acceleration_ = value_t((up * unitToMs2) >> 7, true);
+    }
+    else
+    {
+        acceleration_ = bias_; // (so the velocity carries on)
+    }
+
+    value_t error = haveBaro_ ? baroAltitude_ - altitude_ : value_t();
+    velocity_ += mul(acceleration_ - bias_, dt_) + mul(error, k2dt_);
+    altitude_ += mul(velocity_, dt_) + mul(error, k1dt_);
+    bias_ -= mul(error, k3dt_);
+}
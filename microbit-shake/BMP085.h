@@ -13,6 +13,8 @@
  ***************************************************************************/
 
 #include "MicroBitTouchDevelop.h"
+#include "Bmp085Compensation.h"
+#include "Bmp085Sampler.h"
 
 namespace bmp085 {
 
@@ -49,86 +51,98 @@ namespace bmp085 {
       BMP085_MODE_ULTRAHIGHRES           = 3
     } bmp085_mode_t;
 
-    typedef struct
-    {
-      int16_t  ac1;
-      int16_t  ac2;
-      int16_t  ac3;
-      uint16_t ac4;
-      uint16_t ac5;
-      uint16_t ac6;
-      int16_t  b1;
-      int16_t  b2;
-      int16_t  mb;
-      int16_t  mc;
-      int16_t  md;
-    } bmp085_calib_data;
-
+    typedef Bmp085Compensation::Temperature temperature_t; // degrees C
+    typedef Bmp085Compensation::Pressure pressure_t;       // Pa
+    typedef Bmp085Compensation::Altitude altitude_t;       // m
 
     static uint8_t _bmp085Mode;
-    static bmp085_calib_data _bmp085_coeffs;
+    static Bmp085Compensation _compensation(Bmp085Calibration::datasheet());
 
-    static uint8_t read8(char i1){
-        char cmd2[] = { i1 };
-        uBit.i2c.write(addr << 1, cmd2, 1);
-        char buf[1];
-        uBit.i2c.read(addr << 1, buf, 1);
+    // Background sampling (see startSampling())
+    static Bmp085Sampler<MicroBitI2C> _sampler(uBit.i2c);
+    static bool _sampling = false;
+    static pressure_t _pressure; // from the latest measurement
 
+    static uint8_t read8(char i1){
+        uint8_t buf[1] = { 0 };
+        readRegisters(uBit.i2c, addr << 1, i1, buf, 1);
         return buf[0];
     }
 
     static uint16_t read16(char i1){
-        char cmd2[] = { i1 };
-        uBit.i2c.write(addr << 1, cmd2, 1);
-        char buf[2];
-        uBit.i2c.read(addr << 1, buf, 2);
-
-        return (((uint16_t) buf[0]) << 8) + buf[1];
+        uint8_t buf[2] = { 0, 0 };
+        readRegisters(uBit.i2c, addr << 1, i1, buf, 2);
+        return getBigEndian16(buf);
     }
 
-    static int readS16(char i2){
-         int16_t i = read16(i2);
-         return (int16_t)i;
-    }
-
-
     static void readCoefficients() {
 #if BMP085_USE_DATASHEET_VALS
-        _bmp085_coeffs.ac1 = 408;
-        _bmp085_coeffs.ac2 = -72;
-        _bmp085_coeffs.ac3 = -14383;
-        _bmp085_coeffs.ac4 = 32741;
-        _bmp085_coeffs.ac5 = 32757;
-        _bmp085_coeffs.ac6 = 23153;
-        _bmp085_coeffs.b1  = 6190;
-        _bmp085_coeffs.b2  = 4;
-        _bmp085_coeffs.mb  = -32768;
-        _bmp085_coeffs.mc  = -8711;
-        _bmp085_coeffs.md  = 2868;
-        _bmp085Mode        = 0;
+        _compensation.setCalibration(Bmp085Calibration::datasheet());
+        _bmp085Mode = 0;
 #else
-        _bmp085_coeffs.ac1 = readS16(BMP085_REGISTER_CAL_AC1);
-        _bmp085_coeffs.ac2 = readS16(BMP085_REGISTER_CAL_AC2);
-        _bmp085_coeffs.ac3 = readS16(BMP085_REGISTER_CAL_AC3);
-        _bmp085_coeffs.ac4 = read16(BMP085_REGISTER_CAL_AC4);
-        _bmp085_coeffs.ac5 = read16(BMP085_REGISTER_CAL_AC5);
-        _bmp085_coeffs.ac6 = read16(BMP085_REGISTER_CAL_AC6);
-        _bmp085_coeffs.b1 = readS16(BMP085_REGISTER_CAL_B1);
-        _bmp085_coeffs.b2 = readS16(BMP085_REGISTER_CAL_B2);
-        _bmp085_coeffs.mb = readS16(BMP085_REGISTER_CAL_MB);
-        _bmp085_coeffs.mc = readS16(BMP085_REGISTER_CAL_MC);
-        _bmp085_coeffs.md = readS16(BMP085_REGISTER_CAL_MD);
+        // all eleven, AC1 to MD, in one read
+        uint8_t coeffs[22];
+        if (readRegisters(uBit.i2c, addr << 1, BMP085_REGISTER_CAL_AC1, coeffs, sizeof(coeffs)) != 0)
+          uBit.panic(12);
+        _compensation.setCalibration(Bmp085Calibration::fromRegisters(coeffs));
 #endif
     }
 
     void setMode(bmp085_mode_t mode) {
         _bmp085Mode = mode;
+        _sampler.setMode(mode);
+    }
+
+    static void samplingLoop() {
+        while (_sampling) {
+            uint32_t numSamples = _sampler.getNumSamples();
+            uint32_t wait = _sampler.poll(uBit.systemTime());
+            if (_sampler.getNumSamples() != numSamples) {
+                const Bmp085RawSample& sample = _sampler.getSample();
+                if (sample.newTemperature)
+                    _compensation.setRawTemperature(sample.ut);
+                _pressure = _compensation.getPressure(sample.up, sample.mode);
+                _sampler.setTemperatureNeeded(_compensation.needsTemperature());
+            }
+            uBit.sleep(wait ? wait : 1);
+        }
+    }
+
+    // Takes measurements in a fiber of its own, sleeping through the conversions instead
+    // of sitting in wait_ms(), so the other fibers (and the gesture detector) keep running.
+    // getPressure() and getTemperature() then return the latest measurement.
+    void startSampling(bmp085_mode_t mode, int intervalMs) {
+        setMode(mode);
+        _sampler.setInterval(intervalMs);
+        if (!_sampling) {
+            _sampling = true;
+            create_fiber(samplingLoop);
+        }
+    }
+
+    void stopSampling() {
+        _sampling = false;
+    }
+
+    // How many background measurements there have been (to tell when there's a new one)
+    uint32_t getNumMeasurements() {
+        return _sampler.getNumSamples();
+    }
+
+    // The latest background measurement (waits for the first one)
+    static const Bmp085RawSample& getSample() {
+        while (!_sampler.hasSample())
+            uBit.sleep(Bmp085Sampler<MicroBitI2C>::getPressureTime(_sampler.getMode()));
+        return _sampler.getSample();
     }
 
     int readRawTemperature() {
 #if BMP085_USE_DATASHEET_VALS
         return 27898;
 #else
+        if (_sampling)
+            return getSample().ut;
+
         char cmd[] = { BMP085_REGISTER_CONTROL, BMP085_REGISTER_READTEMPCMD };
         uBit.i2c.write(addr << 1, cmd, 2);
         wait_ms(5);
@@ -141,9 +155,8 @@ namespace bmp085 {
 #if BMP085_USE_DATASHEET_VALS
         return 23843;
 #else
-        uint8_t  p8;
-        uint16_t p16;
-        int32_t  p32;
+        if (_sampling)
+            return getSample().up;
 
         char cmd[] = { BMP085_REGISTER_CONTROL, BMP085_REGISTER_READPRESSURECMD + (_bmp085Mode << 6)};
         uBit.i2c.write(addr << 1, cmd, 2);
@@ -165,21 +178,13 @@ namespace bmp085 {
             break;
         }
 
-        p16 = read16(BMP085_REGISTER_PRESSUREDATA);
-        p32 = (uint32_t)p16 << 8;
-        p8 = read8(BMP085_REGISTER_PRESSUREDATA+2);
-        p32 += p8;
-        p32 >>= (8 - _bmp085Mode);
-        return p32;
+        // MSB, LSB and XLSB in one read
+        uint8_t data[3] = { 0, 0, 0 };
+        readRegisters(uBit.i2c, addr << 1, BMP085_REGISTER_PRESSUREDATA, data, 3);
+        return int32_t(getBigEndian24(data)) >> (8 - _bmp085Mode);
 #endif
     }
 
-    int32_t computeB5(int32_t ut) {
-      int32_t X1 = (ut - (int32_t)_bmp085_coeffs.ac6) * ((int32_t)_bmp085_coeffs.ac5) >> 15;
-      int32_t X2 = ((int32_t)_bmp085_coeffs.mc << 11) / (X1+(int32_t)_bmp085_coeffs.md);
-      return X1 + X2;
-    }
-
     void begin(bmp085_mode_t mode)
     {
       if (read8(BMP085_REGISTER_CHIPID) != 0x55)
@@ -192,73 +197,40 @@ namespace bmp085 {
       readCoefficients();
     }
 
-    float getPressure()
+    // How many pressure readings one temperature reading does for (see Bmp085Compensation.h)
+    void setTemperatureReuse(int numPressureReads) {
+        _compensation.setTemperatureReuse(numPressureReads);
+    }
+
+    pressure_t getPressure()
     {
-      int32_t  ut = 0, up = 0, compp = 0;
-      int32_t  x1, x2, b5, b6, x3, b3, p;
-      uint32_t b4, b7;
-
-      /* Get the raw pressure and temperature values */
-      ut = readRawTemperature();
-      up = readRawPressure();
-
-      /* Temperature compensation */
-      b5 = computeB5(ut);
-
-      /* Pressure compensation */
-      b6 = b5 - 4000;
-      x1 = (_bmp085_coeffs.b2 * ((b6 * b6) >> 12)) >> 11;
-      x2 = (_bmp085_coeffs.ac2 * b6) >> 11;
-      x3 = x1 + x2;
-      b3 = (((((int32_t) _bmp085_coeffs.ac1) * 4 + x3) << _bmp085Mode) + 2) >> 2;
-      x1 = (_bmp085_coeffs.ac3 * b6) >> 13;
-      x2 = (_bmp085_coeffs.b1 * ((b6 * b6) >> 12)) >> 16;
-      x3 = ((x1 + x2) + 2) >> 2;
-      b4 = (_bmp085_coeffs.ac4 * (uint32_t) (x3 + 32768)) >> 15;
-      b7 = ((uint32_t) (up - b3) * (50000 >> _bmp085Mode));
-
-      if (b7 < 0x80000000)
-      {
-        p = (b7 << 1) / b4;
-      }
-      else
-      {
-        p = (b7 / b4) << 1;
+      if (_sampling) {
+        getSample();
+        return _pressure;
       }
 
-      x1 = (p >> 8) * (p >> 8);
-      x1 = (x1 * 3038) >> 16;
-      x2 = (-7357 * p) >> 16;
-      compp = p + ((x1 + x2 + 3791) >> 4);
-
-      /* Assign compensated pressure value */
-      return compp;
+      if (_compensation.needsTemperature())
+        _compensation.setRawTemperature(readRawTemperature());
+      return _compensation.getPressure(readRawPressure(), _bmp085Mode);
     }
 
-    float getTemperature()
+    temperature_t getTemperature()
     {
-      int32_t UT, X1, X2, B5;     // following ds convention
-      float t;
-
-      UT = readRawTemperature();
-
-#if BMP085_USE_DATASHEET_VALS
-        // use datasheet numbers!
-        UT = 27898;
-        _bmp085_coeffs.ac6 = 23153;
-        _bmp085_coeffs.ac5 = 32757;
-        _bmp085_coeffs.mc = -8711;
-        _bmp085_coeffs.md = 2868;
-#endif
-
-      B5 = computeB5(UT);
-      t = (B5+8) >> 4;
-      t /= 10;
-
-      return t;
+      if (_sampling)
+        getSample();
+      else
+        _compensation.setRawTemperature(readRawTemperature());
+      return _compensation.getTemperature();
     }
 
     int getIntTemperature() {
-        return ((int) getTemperature());
+        getTemperature();
+        return _compensation.getTemperatureTenths() / 10;
+    }
+
+    // Height above the level where the pressure is seaLevel (in Pa)
+    altitude_t getAltitude(int32_t seaLevel = Bmp085Compensation::seaLevelPressure)
+    {
+      return Bmp085Compensation::getAltitude(getPressure(), seaLevel);
     }
 }
@@ -8,6 +8,8 @@
 #include "MicroBitImage.h"
 #include "ManagedString.h"
 #include "ManagedType.h"
+#include "ReleaseQueue.h"
+#include "SizeClassHeap.h"
 #define printf(...) uBit.serial.printf(__VA_ARGS__)
 // #define printf(...)
 
@@ -47,6 +49,8 @@ namespace bitvm {
     if (!cond) error(code, subcode);
   }
 
+  // The interpreter and the function table are defined by the bitvm runtime,
+  // which this module doesn't build; this header only mirrors its object model.
   uint32_t exec_function(const uint16_t *pc, uint32_t *args);
   void exec_binary();
 
@@ -57,21 +61,55 @@ namespace bitvm {
   extern const unsigned short bytecode[];
 
 
-#ifdef DEBUG_MEMLEAKS
   class RefObject;
+
+#ifdef DEBUG_MEMLEAKS
   extern std::set<RefObject*> allptrs;
   void debugMemLeaks();
 #endif
 
+  // Objects whose count drops to zero wait in the release queue and get deleted
+  // in batches, and their memory goes on a size-class free list rather than
+  // back to the heap (see ReleaseQueue.h and SizeClassHeap.h). The queue gets
+  // flushed when it fills up, at the end of every RefAction::run() (so after
+  // each event handler, and each pass of a fiber's loop), and when the heap
+  // runs out. Each flush also hands the free lists' blocks back to the heap,
+  // past what the next action is likely to need. With DEBUG_MEMLEAKS, objects
+  // get deleted straight away, so allptrs only ever holds live ones.
+  typedef SizeClassHeap<8, 8, 256> RefObjectHeap; // objects up to 64 bytes, 256 cached at most
+  const size_t refObjectHeapKeepBytes = 128; // (cached across flushes)
+  typedef ReleaseQueue<RefObject, 32> RefObjectReleaseQueue;
+
+  inline RefObjectHeap& getRefObjectHeap()
+  {
+    static RefObjectHeap heap;
+    return heap;
+  }
+
+  inline RefObjectReleaseQueue& getReleaseQueue()
+  {
+    static RefObjectReleaseQueue queue;
+    return queue;
+  }
+
+  // Deletes everything that's been released and not picked up again
+  inline void flushReleases()
+  {
+    getReleaseQueue().flush();
+    getRefObjectHeap().trim(refObjectHeapKeepBytes);
+  }
+
   // A base abstract class for ref-counted objects.
   class RefObject
   {
   public:
     uint16_t refcnt;
+    bool releaseQueued; // in the release queue, waiting to be deleted
 
     RefObject()
     {
       refcnt = 1;
+      releaseQueued = false;
 #ifdef DEBUG_MEMLEAKS
       allptrs.insert(this);
 #endif
@@ -86,10 +124,40 @@ namespace bitvm {
 #endif
     }
 
-    // Increment/decrement the ref-count. Decrementing to zero deletes the current object.
+    static void *operator new(size_t size)
+    {
+      void *p = getRefObjectHeap().allocate(size);
+      if (!p) {
+        // out of heap: delete what's waiting to be, and try again
+        flushReleases();
+        p = getRefObjectHeap().allocate(size);
+        if (!p) die();
+      }
+      return p;
+    }
+
+    static void operator delete(void *p, size_t size)
+    {
+      getRefObjectHeap().deallocate(p, size);
+    }
+
+    // For the classes with fields[] on the end, which get constructed in memory
+    // the runtime allocates for them
+    static void *operator new(size_t, void *p)
+    {
+      return p;
+    }
+
+    static void operator delete(void *, void *)
+    {
+    }
+
+    // Increment/decrement the ref-count. Decrementing to zero queues the current
+    // object for deletion; it can still be picked up again until the queue is
+    // flushed.
     inline void ref()
     {
-      check(refcnt > 0, ERR_REF_DELETED);
+      check(refcnt > 0 || releaseQueued, ERR_REF_DELETED);
       //printf("INCR "); this->print();
       refcnt++;
     }
@@ -98,10 +166,24 @@ namespace bitvm {
     {
       //printf("DECR "); this->print();
       if (--refcnt == 0) {
-        delete this;
+        getReleaseQueue().release(this);
+#ifdef DEBUG_MEMLEAKS
+        flushReleases();
+#endif
       }
     }
 
+    // For the release queue
+    bool isReferenced() const
+    {
+      return refcnt > 0;
+    }
+
+    void destroy()
+    {
+      delete this;
+    }
+
     virtual void print()
     {
       printf("RefObject %p\n", this);
@@ -245,6 +327,13 @@ namespace bitvm {
     // The object is allocated, so that there is space at the end for the fields.
     uint32_t fields[];
 
+    // Records are allocated with their fields, by the runtime, so they don't go
+    // on the size-class free lists
+    static void operator delete(void *p)
+    {
+      ::operator delete(p);
+    }
+
     virtual ~RefRecord()
     {
       //printf("DELREC: %p\n", this);
@@ -310,6 +399,12 @@ namespace bitvm {
     ActionCB func; // The function pointer
     uint32_t fields[];
 
+    // (allocated with its fields, like RefRecord)
+    static void operator delete(void *p)
+    {
+      ::operator delete(p);
+    }
+
     // fields[] contain captured locals
     virtual ~RefAction()
     {
@@ -337,6 +432,7 @@ namespace bitvm {
       this->ref();
       uint32_t r = this->func(this, &this->fields[0]);
       this->unref();
+      flushReleases(); // (whatever the action dropped, before the next one runs)
       return r;
     }
   };
@@ -0,0 +1,229 @@
+#pragma once
+
+#include "DelayBuffer.h"
+#include "RunningStats.h"
+#include "Vector3.h"
+#include "IirFilter.h"
+#include "FixedPt.h"
+
+#include <algorithm> // for std::max
+#include <cstdint>
+
+// #defines for optional parts
+#define USE_SHAKE_GATE 0
+#define USE_SLOW_SHAKE 0 // second, slower dot feature, toggled at runtime by toggleAlg()
+
+//using filteredComponent_t = float;
+using filteredComponent_t = fixed_9_7;
+using filteredSample_t = Vector3<filteredComponent_t>;
+
+#define FIXED_MATH 1
+#if FIXED_MATH
+using predictionValue_t = fixed_9_7;
+#else
+using predictionValue_t = float;
+#endif
+
+// using filterCoeff_t = float;
+using filterCoeff_t = fixed_2_14;
+
+// The features a gesture can ask the pool for. The pool only maintains the ones that
+// some gesture in the detector's GestureSet asks for.
+enum GestureFeature
+{
+    GESTURE_FEATURE_SAMPLE   = 0x01, // raw and gravity-subtracted sample (always available)
+    GESTURE_FEATURE_GRAVITY  = 0x02, // low-pass gravity estimate (always available)
+    GESTURE_FEATURE_VARIANCE = 0x04, // Z variance over the quiet and impulse windows
+    GESTURE_FEATURE_DOT      = 0x08, // lagged normalized dot products (shake)
+    GESTURE_FEATURE_IMPULSE  = 0x10, // X and Y impulse stats too, for the direction of an impulse
+};
+
+// Which way the board was pushed over the impulse window: the axis with the most energy,
+// and the sign of the acceleration along it
+enum ImpulseDirection
+{
+    IMPULSE_NONE = 0,
+    IMPULSE_X_POS,
+    IMPULSE_X_NEG,
+    IMPULSE_Y_POS,
+    IMPULSE_Y_NEG,
+    IMPULSE_Z_POS,
+    IMPULSE_Z_NEG,
+};
+
+// The impulse direction only needs coarse energies, so the X and Y impulse stats run on
+// samples halved to 7 bits, which keeps their sums of squares inside 16 bits
+template <typename Axis>
+class HalfAxis
+{
+public:
+    static int16_t get_val(const byteVector3& vec)
+    {
+        return int16_t(Axis::get_val(vec) / 2);
+    }
+};
+
+class GestureFeaturePool;
+
+// The per-tick view of the pool handed to each gesture. Lives on the stack, so the
+// values here don't cost any permanent RAM.
+struct GestureFeatures
+{
+    byteVector3 rawSample;
+    byteVector3 sample; // gravity-subtracted
+    filteredSample_t gravity;
+
+    float quietVariance = 0; // over the quiet window, *not* including this sample
+#if USE_SHAKE_GATE
+    float shakeGateVariance = 0; // also not including this sample
+#endif
+
+    GestureFeaturePool* pool = nullptr;
+
+    // These are only computed if someone asks
+    float impulseVariance() const;
+    ImpulseDirection impulseDirection() const; // needs GESTURE_FEATURE_IMPULSE
+    predictionValue_t shakePrediction() const;
+};
+
+// The shared state all the gestures read from: one gravity filter, one delay line
+// of gravity-subtracted samples, and the windowed stats that run over it.
+class GestureFeaturePool
+{
+public:
+    // Compile-time constants (used as template parameters)
+    static constexpr int dotWavelength2 = 5;
+    static constexpr int dotWavelength4 = 8;
+
+    static constexpr int dotMeanWindow2 = dotWavelength2; // / 2;
+    static constexpr int dotMeanWindow4 = dotWavelength4; // / 2;
+
+    static constexpr int shakeStatsBufferSize = 4;
+
+    static constexpr int quietWindowSize = 8; //11; // maybe too big?
+    static constexpr int impulseWindowSize = 2;
+
+    GestureFeaturePool();
+    void init(const byteVector3& sample);
+
+    // The stats objects refer to delay lines inside the pool, so a copy has to point them
+    // at its own delay lines rather than the original's
+    GestureFeaturePool(const GestureFeaturePool& other);
+    GestureFeaturePool& operator=(const GestureFeaturePool& other) = default;
+
+    // Pushes a new accelerometer sample through the pool, updating only the features in
+    // requiredFeatures (a compile-time constant in practice, so the rest compile away)
+    void addSample(const byteVector3& sample, unsigned requiredFeatures, GestureFeatures& features);
+
+    const filteredSample_t& getGravity() const { return gravityFilter.getLastSample(); }
+
+    float getImpulseVariance();
+    ImpulseDirection getImpulseDirection();
+    predictionValue_t getShakePrediction();
+
+    template <typename Archive>
+    void serialize(Archive& ar);
+
+#if USE_SLOW_SHAKE
+    bool toggleSlowGesture();
+#endif
+
+private:
+    friend struct MicroBitGestureDetectorLayout; // host-side layout report
+    friend struct GoldenTraceRecorder; // host-side regression tests
+
+    template<typename MeanDelayType, typename MeanStatsType>
+    void processDotFeature(const byteVector3& currentSample, int dotWavelength, MeanDelayType& meanDelay, MeanStatsType& delayDotStats);
+
+    static_assert(impulseWindowSize * 64 * 64 <= INT16_MAX, "impulse window too long for 16-bit stats");
+
+#if USE_SLOW_SHAKE
+    static constexpr int maxDotWavelength = dotWavelength4;
+#else
+    static constexpr int maxDotWavelength = dotWavelength2;
+#endif
+#if USE_SHAKE_GATE
+    static constexpr int maxStatsWindow = std::max(quietWindowSize, shakeStatsBufferSize);
+#else
+    static constexpr int maxStatsWindow = quietWindowSize;
+#endif
+    // Stats read the sample leaving their window right after it's been pushed, so the
+    // longest delay we ever ask for is the window size itself (or twice the dot wavelength)
+    static constexpr int delayBufferSize = std::max(2*maxDotWavelength, maxStatsWindow) + 1;
+
+    // Data (laid out so there's no padding between members on a 32-bit target)
+
+    // Delay lines come first, since the stats objects below hold references to them.
+    // TODO: quantize these to bytes or something
+    DelayBuffer<predictionValue_t, dotMeanWindow2 + 1> dotDelayBuffer2;
+#if USE_SLOW_SHAKE
+    DelayBuffer<predictionValue_t, dotMeanWindow4 + 1> dotDelayBuffer4;
+#endif
+
+    // Global delay buffer for filtered, gravity-subtracted accel input
+    DelayBuffer<byteVector3, delayBufferSize> sampleDelayBuffer;
+
+    // The filter's state is the gravity estimate, so we don't keep a separate copy
+    SimpleIirFilter<filteredSample_t, filterCoeff_t> gravityFilter;
+
+#if USE_SLOW_SHAKE
+    bool allowSlowGesture = false;
+#endif
+
+    RunningStats<quietWindowSize, delayBufferSize, int32_t, byteVector3, GetZ<int8_t>> quietWindowStats;
+
+    // windowed statistics for detecting high-Z-energy area during tap
+    RunningStats<impulseWindowSize, delayBufferSize, int32_t, byteVector3, GetZ<int8_t>> impulseWindowStats;
+
+    // the same over X and Y, so we can tell which way a tap went (see HalfAxis)
+    RunningStats<impulseWindowSize, delayBufferSize, int16_t, byteVector3, HalfAxis<GetX<int8_t>>> impulseWindowStatsX;
+    RunningStats<impulseWindowSize, delayBufferSize, int16_t, byteVector3, HalfAxis<GetY<int8_t>>> impulseWindowStatsY;
+
+    // Shake gesture stats
+#if USE_SHAKE_GATE
+    RunningStats<shakeStatsBufferSize, delayBufferSize, float, byteVector3, GetMagSq<int8_t, float>> shakeThreshStats;
+#endif
+
+    RunningMean<dotMeanWindow2, dotMeanWindow2+1, predictionValue_t> dot2Stats;
+#if USE_SLOW_SHAKE
+    RunningMean<dotMeanWindow4, dotMeanWindow4+1, predictionValue_t> dot4Stats;
+#endif
+};
+
+template <typename Archive>
+void GestureFeaturePool::serialize(Archive& ar)
+{
+    dotDelayBuffer2.serialize(ar);
+#if USE_SLOW_SHAKE
+    dotDelayBuffer4.serialize(ar);
+    ar.io(allowSlowGesture);
+#endif
+    sampleDelayBuffer.serialize(ar);
+    gravityFilter.serialize(ar);
+    quietWindowStats.serialize(ar);
+    impulseWindowStats.serialize(ar);
+    impulseWindowStatsX.serialize(ar);
+    impulseWindowStatsY.serialize(ar);
+#if USE_SHAKE_GATE
+    shakeThreshStats.serialize(ar);
+#endif
+    dot2Stats.serialize(ar);
+#if USE_SLOW_SHAKE
+    dot4Stats.serialize(ar);
+#endif
+}
+
+inline float GestureFeatures::impulseVariance() const
+{
+    return pool->getImpulseVariance();
+}
+
+inline ImpulseDirection GestureFeatures::impulseDirection() const
+{
+    return pool->getImpulseDirection();
+}
+
+inline predictionValue_t GestureFeatures::shakePrediction() const
+{
+    return pool->getShakePrediction();
+}
@@ -0,0 +1,404 @@
+#pragma once
+
+#include "GestureFeatures.h"
+#include "DelayBuffer.h"
+#include "EventThresholdFilter.h"
+#include "NoiseFloor.h"
+
+#include <cstdint>
+#include <initializer_list>
+
+// #defines for optional parts (see also GestureFeatures.h)
+#define USE_TAP_NOISE_FLOOR 1 // boost taps when the board is sitting on something solid
+
+enum MicroBitAccelerometerEvents
+    {
+        MICROBIT_ACCELEROMETER_SHAKE = 100,
+        MICROBIT_ACCELEROMETER_TAP = 101,
+        MICROBIT_ACCELEROMETER_DOUBLE_TAP = 102,
+        MICROBIT_ACCELEROMETER_FREEFALL = 103,
+        MICROBIT_ACCELEROMETER_FACE_UP = 104,
+        MICROBIT_ACCELEROMETER_FACE_DOWN = 105,
+        MICROBIT_ACCELEROMETER_TILT_UP = 106,
+        MICROBIT_ACCELEROMETER_TILT_DOWN = 107,
+        MICROBIT_ACCELEROMETER_TILT_LEFT = 108,
+        MICROBIT_ACCELEROMETER_TILT_RIGHT = 109,
+    };
+
+// Events are also passed around as bitmasks (one bit per event, starting at SHAKE)
+constexpr uint16_t eventBit(int event)
+{
+    return uint16_t(1 << (event - MICROBIT_ACCELEROMETER_SHAKE));
+}
+
+const char* getGestureName(int event);
+
+//
+// A gesture is a class with:
+//
+//   static constexpr unsigned features;   // GestureFeature bits it reads from the pool
+//   static constexpr uint16_t events;     // eventBit()s of the events it can fire
+//   static constexpr uint16_t suppresses; // events that get cancelled when it fires
+//   static constexpr int priority;        // higher wins when several fire on the same tick
+//
+//   int update(const GestureFeatures& features, uint16_t firedEvents); // returns an event or 0
+//   void reset();                         // forget about any gesture in progress
+//   bool isActive();                      // is the gesture (still) happening?
+//   template <typename Archive>
+//   void serialize(Archive& ar);          // its state, for snapshots (see StateBlob.h)
+//
+// Gestures are updated in the order they're listed in the GestureSet, and each one gets
+// the events fired by the ones before it (so e.g. double-tap can build on tap). A gesture
+// whose events have already been suppressed this tick isn't updated at all.
+//
+
+// Debounces a discrete posture (face up, tilted left, ...): reports a posture once it's
+// been held for holdCount samples in a row, and only when it changes.
+class PostureFilter
+{
+public:
+    PostureFilter(int holdCount) : filter_(1, holdCount, 0) {}
+
+    int filterPosture(int posture)
+    {
+        if (posture != candidate_)
+        {
+            candidate_ = posture;
+            filter_.reset();
+        }
+
+        if (filter_.filterValue(1) && candidate_ != current_)
+        {
+            current_ = candidate_;
+            return current_;
+        }
+        return 0;
+    }
+
+    int currentPosture() const
+    {
+        return current_;
+    }
+
+    void reset()
+    {
+        filter_.reset();
+        candidate_ = 0;
+    }
+
+    template <typename Archive>
+    void serialize(Archive& ar)
+    {
+        filter_.serialize(ar);
+        ar.io(candidate_);
+        ar.io(current_);
+    }
+
+private:
+    EventThresholdFilter<int8_t> filter_;
+    int8_t candidate_ = 0;
+    int8_t current_ = 0;
+};
+
+// Tap: a short burst of Z energy right after a quiet period. Also remembers which way
+// the last tap pushed the board.
+class TapGesture
+{
+public:
+    static constexpr unsigned features = GESTURE_FEATURE_VARIANCE | GESTURE_FEATURE_IMPULSE;
+    static constexpr uint16_t events = eventBit(MICROBIT_ACCELEROMETER_TAP);
+    static constexpr uint16_t suppresses = eventBit(MICROBIT_ACCELEROMETER_SHAKE);
+    static constexpr int priority = 30;
+
+    TapGesture();
+    int update(const GestureFeatures& features, uint16_t firedEvents);
+    void reset() { eventFilter.reset(); }
+    bool isActive() { return eventFilter.currentValue(); }
+    ImpulseDirection getDirection() const { return ImpulseDirection(direction); }
+
+    // threshold is for the (scaled) impulse variance; the quiet window's variance has to be
+    // at most gateThreshold before a tap can happen
+    void setThresholds(int threshold, int eventCount, float gateThreshold);
+    int getThreshold() const { return eventFilter.getThreshold(); }
+    int getEventCount() const { return eventFilter.getEventCountThreshold(); }
+    float getGateThreshold() const { return gateThreshold / quietVarScale; }
+
+    template <typename Archive>
+    void serialize(Archive& ar)
+    {
+        quietVarDelay.serialize(ar);
+#if USE_TAP_NOISE_FLOOR
+        noiseFloor.serialize(ar);
+#endif
+        ar.io(tapCountdown1);
+        ar.io(direction);
+        eventFilter.serialize(ar);
+    }
+
+private:
+    float getTapPrediction(const GestureFeatures& features);
+
+    static constexpr int tapK = 2;
+
+    // quietVarDelay stores 8x the quiet-window variance (exact, since the stats accumulate
+    // integers), saturated to 16 bits. Past the saturation point the tap scale is far too
+    // small for any tap to get through anyway.
+    static constexpr float quietVarScale = GestureFeaturePool::quietWindowSize;
+    using quietVar_t = uint16_t;
+
+    DelayBuffer<quietVar_t, tapK+1> quietVarDelay;
+    quietVar_t gateThreshold; // in the same (scaled) units as quietVarDelay
+
+#if USE_TAP_NOISE_FLOOR
+    float getNoiseFloorBoost();
+
+    // Long-horizon floor of the (scaled) quiet variance: drops within a few samples of
+    // going quiet, takes a few seconds to climb back up
+    NoiseFloorEstimator<uint16_t, 8, 2> noiseFloor;
+#endif
+    int8_t tapCountdown1 = 0;
+    int8_t direction = IMPULSE_NONE;
+
+    // The prediction is never negative, so truncating it to an integer doesn't change
+    // which side of the (integer) threshold it's on
+    EventThresholdFilter<int16_t> eventFilter;
+};
+
+// Double tap: a second tap at least minGap and at most maxGap samples after the first.
+// Builds on TapGesture's events, so it has to come after it in the GestureSet.
+class DoubleTapGesture
+{
+public:
+    static constexpr unsigned features = 0;
+    static constexpr uint16_t events = eventBit(MICROBIT_ACCELEROMETER_DOUBLE_TAP);
+    static constexpr uint16_t suppresses = eventBit(MICROBIT_ACCELEROMETER_SHAKE);
+    static constexpr int priority = 40;
+
+    DoubleTapGesture();
+    int update(const GestureFeatures& features, uint16_t firedEvents);
+    void reset() { eventFilter.reset(); ticksSinceTap = noTap; }
+    bool isActive() { return eventFilter.currentValue(); }
+
+    // in samples; maxGap is clamped to what ticksSinceTap can count to
+    void setWindow(int minGap, int maxGap);
+    int getMinGap() const { return minGap; }
+    int getMaxGap() const { return maxGap; }
+
+    template <typename Archive>
+    void serialize(Archive& ar)
+    {
+        eventFilter.serialize(ar);
+        ar.io(ticksSinceTap);
+    }
+
+private:
+    static constexpr uint8_t noTap = 0xff;
+
+    EventThresholdFilter<int8_t> eventFilter;
+    uint8_t ticksSinceTap = noTap;
+    uint8_t minGap;
+    uint8_t maxGap;
+};
+
+// Shake: the (gravity-subtracted) acceleration keeps reversing direction
+class ShakeGesture
+{
+public:
+    static constexpr unsigned features = GESTURE_FEATURE_DOT;
+    static constexpr uint16_t events = eventBit(MICROBIT_ACCELEROMETER_SHAKE);
+    static constexpr uint16_t suppresses = eventBit(MICROBIT_ACCELEROMETER_TAP) | eventBit(MICROBIT_ACCELEROMETER_DOUBLE_TAP);
+    static constexpr int priority = 20;
+
+    ShakeGesture();
+    int update(const GestureFeatures& features, uint16_t firedEvents);
+    void reset() { eventFilter.reset(); }
+    bool isActive() { return eventFilter.currentValue(); }
+
+    // shake starts after eventCount samples over threshold, and keeps going for up to
+    // lowCount samples under it
+    void setThresholds(predictionValue_t threshold, int eventCount, int lowCount);
+    predictionValue_t getThreshold() const { return eventFilter.getThreshold(); }
+    int getEventCount() const { return eventFilter.getEventCountThreshold(); }
+    int getLowCount() const { return eventFilter.getLowThreshold(); }
+
+    template <typename Archive>
+    void serialize(Archive& ar) { eventFilter.serialize(ar); }
+
+private:
+    EventThresholdFilter<predictionValue_t> eventFilter;
+};
+
+// Free-fall: the raw acceleration (gravity included) is close to zero
+class FreefallGesture
+{
+public:
+    static constexpr unsigned features = GESTURE_FEATURE_SAMPLE;
+    static constexpr uint16_t events = eventBit(MICROBIT_ACCELEROMETER_FREEFALL);
+    static constexpr uint16_t suppresses = 0;
+    static constexpr int priority = 50;
+
+    FreefallGesture();
+    int update(const GestureFeatures& features, uint16_t firedEvents);
+    void reset() { eventFilter.reset(); }
+    bool isActive() { return eventFilter.currentValue(); }
+
+    template <typename Archive>
+    void serialize(Archive& ar) { eventFilter.serialize(ar); }
+
+private:
+    EventThresholdFilter<int8_t> eventFilter;
+};
+
+// Face up / face down, from the gravity estimate
+class FaceGesture
+{
+public:
+    static constexpr unsigned features = GESTURE_FEATURE_GRAVITY;
+    static constexpr uint16_t events = eventBit(MICROBIT_ACCELEROMETER_FACE_UP) | eventBit(MICROBIT_ACCELEROMETER_FACE_DOWN);
+    static constexpr uint16_t suppresses = 0;
+    static constexpr int priority = 10;
+
+    FaceGesture();
+    int update(const GestureFeatures& features, uint16_t firedEvents);
+    void reset() { postureFilter.reset(); }
+    bool isActive() { return postureFilter.currentPosture() != 0; }
+
+    template <typename Archive>
+    void serialize(Archive& ar) { postureFilter.serialize(ar); }
+
+private:
+    PostureFilter postureFilter;
+};
+
+// Tilt up / down / left / right, from the gravity estimate
+class TiltGesture
+{
+public:
+    static constexpr unsigned features = GESTURE_FEATURE_GRAVITY;
+    static constexpr uint16_t events = eventBit(MICROBIT_ACCELEROMETER_TILT_UP) | eventBit(MICROBIT_ACCELEROMETER_TILT_DOWN)
+                                     | eventBit(MICROBIT_ACCELEROMETER_TILT_LEFT) | eventBit(MICROBIT_ACCELEROMETER_TILT_RIGHT);
+    static constexpr uint16_t suppresses = 0;
+    static constexpr int priority = 5;
+
+    TiltGesture();
+    int update(const GestureFeatures& features, uint16_t firedEvents);
+    void reset() { postureFilter.reset(); }
+    bool isActive() { return postureFilter.currentPosture() != 0; }
+
+    template <typename Archive>
+    void serialize(Archive& ar) { postureFilter.serialize(ar); }
+
+private:
+    PostureFilter postureFilter;
+};
+
+// What happened on one tick
+struct GestureResult
+{
+    uint16_t firedEvents = 0;
+    uint16_t suppressedEvents = 0;
+    int event = 0; // the highest-priority event that fired
+    int priority = -1;
+};
+
+constexpr unsigned combineBits(std::initializer_list<unsigned> bits)
+{
+    unsigned result = 0;
+    for (auto b : bits)
+    {
+        result |= b;
+    }
+    return result;
+}
+
+// The set of gestures a detector runs. All of them share one GestureFeaturePool, which
+// only maintains the features at least one of them needs.
+template <typename... Gestures>
+class GestureSet : private Gestures...
+{
+public:
+    static constexpr unsigned requiredFeatures = combineBits({ 0u, Gestures::features... });
+
+    GestureResult update(const GestureFeatures& features)
+    {
+        GestureResult result;
+        int dummy[] = { 0, (updateGesture<Gestures>(features, result), 0)... }; // in order
+        (void)dummy;
+
+        uint16_t toReset = result.suppressedEvents & ~result.firedEvents;
+        int dummy2[] = { 0, (resetGesture<Gestures>(toReset), 0)... };
+        (void)dummy2;
+        return result;
+    }
+
+    template <typename G>
+    G& get()
+    {
+        return static_cast<G&>(*this);
+    }
+
+    // every gesture's state, in update order
+    template <typename Archive>
+    void serialize(Archive& ar)
+    {
+        int dummy[] = { 0, (Gestures::serialize(ar), 0)... };
+        (void)dummy;
+    }
+
+    // The highest-priority event in a set of fired events (each gesture fires at most one
+    // event per sample)
+    static int topEvent(uint16_t firedEvents)
+    {
+        GestureResult result;
+        int dummy[] = { 0, (topGestureEvent<Gestures>(firedEvents, result), 0)... };
+        (void)dummy;
+        return result.event;
+    }
+
+private:
+    template <typename G>
+    void updateGesture(const GestureFeatures& features, GestureResult& result)
+    {
+        if (G::events & result.suppressedEvents)
+        {
+            return;
+        }
+
+        int event = G::update(features, result.firedEvents);
+        if (event != 0)
+        {
+            result.firedEvents |= eventBit(event);
+            result.suppressedEvents |= G::suppresses;
+            if (G::priority > result.priority)
+            {
+                result.event = event;
+                result.priority = G::priority;
+            }
+        }
+    }
+
+    template <typename G>
+    static void topGestureEvent(uint16_t firedEvents, GestureResult& result)
+    {
+        uint16_t bits = G::events & firedEvents;
+        if (bits != 0 && G::priority > result.priority)
+        {
+            int event = MICROBIT_ACCELEROMETER_SHAKE;
+            while (!(bits & eventBit(event)))
+            {
+                event++;
+            }
+            result.event = event;
+            result.priority = G::priority;
+        }
+    }
+
+    template <typename G>
+    void resetGesture(uint16_t toReset)
+    {
+        if (G::events & toReset)
+        {
+            G::reset();
+        }
+    }
+};
@@ -19,6 +19,10 @@
 #include "MicroBitImage.h"
 #include "ManagedString.h"
 #include "ManagedType.h"
+#include "EventHandlerTable.h"
+#include "LazyString.h"
+#include "PooledCollection.h"
+#include "SensorFrame.h"
 
 #define TD_NOOP(...)
 #define TD_ID(x) x
@@ -59,18 +63,18 @@ namespace touch_develop {
   // We maintain a mapping from source/event to the current event handler. In
   // order to implement the TouchDevelop semantics of "at most one event handler
   // per source/event pair", every event is dispatched through [dispatchEvent],
-  // which then does a table lookup to figure out the current handler.
+  // which then does a table lookup to figure out the current handler. The table
+  // is a small hash (see EventHandlerTable.h), and keeps the script's function
+  // as it is, without wrapping it in another one.
 
-  extern map<pair<int, int>, function<void (MicroBitEvent)>> handlersMap;
+  extern EventHandlerTable<> handlers;
   void dispatchEvent(MicroBitEvent e);
-  void registerHandler(pair<int, int>, function<void()>);
-  void registerHandler(pair<int, int>, function<void(int)>);
 
   template <typename T> // T: function<void()> or T: function<void(int)>
   inline void registerWithDal(int id, int event, T f) {
-    if (!handlersMap[{ id, event }])
+    if (!handlers.contains(id, event))
       uBit.MessageBus.listen(id, event, dispatchEvent);
-    registerHandler({ id, event }, f);
+    handlers.set(id, event, std::move(f));
   }
 
 
@@ -80,11 +84,14 @@ namespace touch_develop {
 
   typedef int Number;
   typedef bool Boolean;
-  typedef ManagedString String;
+  // Strings get joined in a shared buffer, and only flattened into a ManagedString when
+  // they go to the display, the serial port or the radio (see LazyString.h)
+  typedef LazyString<ManagedString> String;
   typedef function<void()> Action;
   template <typename T> using Action1 = function<void(T)>;
-  template <typename T> using Collection_of = ManagedType<vector<T>>;
-  template <typename T> using Collection = ManagedType<vector<T>>;
+  // Collections come from a fixed pool, with small ones kept inline (see PooledCollection.h)
+  template <typename T> using Collection_of = PooledCollection<T>;
+  template <typename T> using Collection = PooledCollection<T>;
 
   // A short override of [ManagedType] to make the generated code more compact.
   template <typename T>
@@ -112,25 +119,25 @@ namespace touch_develop {
   }
 
   namespace string {
-    ManagedString concat(ManagedString s1, ManagedString s2);
+    String concat(String s1, String s2);
 
-    ManagedString _(ManagedString s1, ManagedString s2);
+    String _(String s1, String s2);
 
-    ManagedString substring(ManagedString s, int i, int j);
+    String substring(String s, int i, int j);
 
-    bool equals(ManagedString s1, ManagedString s2);
+    bool equals(String s1, String s2);
 
-    int count(ManagedString s);
+    int count(String s);
 
-    ManagedString at(ManagedString s, int i);
+    String at(String s, int i);
 
-    int to_character_code(ManagedString s);
+    int to_character_code(String s);
 
-    int code_at(ManagedString s, int i);
+    int code_at(String s, int i);
 
-    int to_number(ManagedString s);
+    int to_number(String s);
 
-    void post_to_wall(ManagedString s);
+    void post_to_wall(String s);
   }
 
   namespace action {
@@ -214,7 +221,7 @@ namespace touch_develop {
   namespace create {
     template<typename T>
     inline Collection_of<T> collection_of() {
-      return ManagedType<vector<T>>(new vector<T>());
+      return Collection_of<T>::create();
     }
 
     template<typename T>
@@ -263,7 +270,17 @@ namespace touch_develop {
       if (!in_range(c, x))
         return;
 
-      c->erase(c->begin()+x);
+      c->erase(x);
+    }
+
+    // Like [remove_at], but moves the last element into the gap instead of shifting
+    // everything down: O(1), but the order changes.
+    template<typename T>
+    inline void swap_remove_at(Collection_of<T> c, int x) {
+      if (!in_range(c, x))
+        return;
+
+      c->swapRemove(x);
     }
 
     template<typename T>
@@ -323,6 +340,10 @@ namespace touch_develop {
     //  x = 0, y = 1, z = 2, strength = 3
     int getMagneticForce(int dimension);
 
+    // The accelerometer reading for this tick, shared by scripts and the gesture
+    // detector (which takes a new one every sample)
+    SensorFrame<MicroBitAccelerometer>& getAccelerometerFrame();
+
     //  x = 0, y = 1, z = 2, strength = 3
     int getAcceleration(int dimension);
 
@@ -0,0 +1,339 @@
+#include "Bmp085Compensation.h"
+#include "Bmp085Sampler.h"
+#include "MicroBitGestureDetector.h"
+#include "i2c_sim.h"
+#include "motion_generator.h"
+
+#include "catch.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// See catch tutorial: https://github.com/philsquared/Catch/blob/master/docs/tutorial.md
+
+//
+// bmp085Sampler tests
+//
+
+// Polls until the sampler has the next sample (or gives up), sleeping as long as it asks
+static bool pollForSample(Bmp085Sampler<SimulatedI2CBus>& sampler, SimClock& clock)
+{
+    uint32_t numSamples = sampler.getNumSamples();
+    for (int step = 0; step < 100 && sampler.getNumSamples() == numSamples; step++)
+    {
+        clock.us += 1000 * sampler.poll(clock.ms());
+    }
+    return sampler.getNumSamples() > numSamples;
+}
+
+TEST_CASE("bmp085Sampler reads the raw values")
+{
+    SimClock clock;
+    SimulatedI2CBus bus(clock);
+    SimulatedBmp085 chip(clock);
+    bus.attach(SimulatedBmp085::address, &chip);
+    Bmp085Sampler<SimulatedI2CBus> sampler(bus);
+    REQUIRE(!sampler.hasSample());
+
+    for (int mode = 0; mode <= 3; mode++)
+    {
+        sampler.setMode(mode);
+        chip.setRawTemperature(27898 + mode);
+        chip.setRawPressure(23843 + mode);
+        REQUIRE(pollForSample(sampler, clock));
+
+        const auto& sample = sampler.getSample();
+        REQUIRE(sample.mode == mode);
+        REQUIRE(sample.ut == 27898 + mode);
+        REQUIRE(sample.up == (23843 + mode) << mode);
+        REQUIRE(!sampler.isBusy());
+    }
+    REQUIRE(sampler.getNumErrors() == 0);
+    REQUIRE(chip.getNumEarlyReads() == 0);
+    REQUIRE(chip.getNumConversions() == 8);
+
+    sampler.setMode(7);
+    REQUIRE(sampler.getMode() == 3);
+}
+
+TEST_CASE("bmp085Sampler never waits")
+{
+    SimClock clock;
+    SimulatedI2CBus bus(clock);
+    SimulatedBmp085 chip(clock);
+    bus.attach(SimulatedBmp085::address, &chip);
+    Bmp085Sampler<SimulatedI2CBus> sampler(bus, 3);
+    sampler.setInterval(100);
+
+    // each poll is a few I2C transfers at most, and the conversions run in between
+    uint64_t longestPoll = 0;
+    while (sampler.getNumSamples() < 10)
+    {
+        uint64_t start = clock.us;
+        uint32_t sleepTime = sampler.poll(clock.ms());
+        longestPoll = std::max(longestPoll, clock.us - start);
+        clock.us += 1000 * sleepTime;
+    }
+    REQUIRE(longestPoll < 1000);
+    REQUIRE(chip.getNumEarlyReads() == 0);
+
+    // on the interval, measured from start to start (give or take the ms clock)
+    uint32_t lastTime = sampler.getSample().time;
+    REQUIRE(pollForSample(sampler, clock));
+    REQUIRE(sampler.getSample().time - lastTime >= 99);
+    REQUIRE(sampler.getSample().time - lastTime <= 101);
+}
+
+TEST_CASE("bmp085Sampler recovers from bus errors")
+{
+    SimClock clock;
+    SimulatedI2CBus bus(clock);
+    SimulatedBmp085 chip(clock);
+    bus.attach(SimulatedBmp085::address, &chip);
+    Bmp085Sampler<SimulatedI2CBus> sampler(bus, 1);
+
+    REQUIRE(pollForSample(sampler, clock));
+
+    // fail each step in turn: starting the temperature, reading it, reading the pressure
+    for (int numGoodPolls = 0; numGoodPolls < 3; numGoodPolls++)
+    {
+        uint32_t numErrors = sampler.getNumErrors();
+        for (int poll = 0; poll < numGoodPolls; poll++)
+        {
+            clock.us += 1000 * sampler.poll(clock.ms());
+        }
+        bus.failNext(1);
+        clock.us += 1000 * sampler.poll(clock.ms());
+        REQUIRE(sampler.getNumErrors() == numErrors + 1);
+        REQUIRE(!sampler.isBusy());
+
+        chip.setRawPressure(20000 + numGoodPolls);
+        REQUIRE(pollForSample(sampler, clock));
+        REQUIRE(sampler.getSample().up == (20000 + numGoodPolls) << 1);
+    }
+    REQUIRE(chip.getNumEarlyReads() == 0);
+
+    // no chip at all
+    SimulatedI2CBus emptyBus(clock);
+    Bmp085Sampler<SimulatedI2CBus> lost(emptyBus);
+    REQUIRE(!pollForSample(lost, clock));
+    REQUIRE(lost.getNumErrors() > 0);
+}
+
+//
+// bmp085Compensation tests
+//
+TEST_CASE("bmp085Compensation matches the datasheet")
+{
+    // the worked example: UT = 27898, UP = 23843 at mode 0 -> 15.0 C, 69964 Pa
+    Bmp085Compensation compensation(Bmp085Calibration::datasheet());
+    REQUIRE(compensation.needsTemperature());
+    compensation.setRawTemperature(27898);
+    REQUIRE(compensation.getB5() == 2400);
+    REQUIRE(compensation.getTemperatureTenths() == 150);
+    REQUIRE(float(compensation.getTemperature()) == Approx(15.0f).epsilon(1e-4));
+    REQUIRE(compensation.getPressurePa(23843, 0) == 69964);
+    REQUIRE(compensation.getPressure(23843, 0).value_ == Bmp085Compensation::Pressure(69964).value_);
+
+    // the same from the calibration registers
+    SimClock clock;
+    SimulatedI2CBus bus(clock);
+    SimulatedBmp085 chip(clock);
+    bus.attach(SimulatedBmp085::address, &chip);
+    char reg = char(0xAA);
+    uint8_t data[22];
+    bus.write(SimulatedBmp085::address, &reg, 1);
+    bus.read(SimulatedBmp085::address, reinterpret_cast<char*>(data), 22);
+    Bmp085Compensation fromChip(Bmp085Calibration::fromRegisters(data));
+    fromChip.setRawTemperature(27898);
+    REQUIRE(fromChip.getTemperatureTenths() == 150);
+    REQUIRE(fromChip.getPressurePa(23843, 0) == 69964);
+}
+
+TEST_CASE("bmp085Compensation reuses the temperature")
+{
+    Bmp085Compensation compensation(Bmp085Calibration::datasheet(), 4);
+    compensation.setRawTemperature(27898);
+    compensation.getPressurePa(23843, 0);
+    REQUIRE(compensation.needsTemperature()); // (one reading isn't enough to say it's stable)
+
+    compensation.setRawTemperature(27898);
+    for (int read = 0; read < 4; read++)
+    {
+        REQUIRE(!compensation.needsTemperature());
+        REQUIRE(compensation.getPressurePa(23843, 0) == 69964);
+    }
+    REQUIRE(compensation.needsTemperature());
+
+    // a jump of a few degrees: check again after the next read
+    compensation.setRawTemperature(29000);
+    REQUIRE(compensation.getTemperatureTenths() > 170);
+    REQUIRE(!compensation.needsTemperature());
+    compensation.getPressurePa(23843, 0);
+    REQUIRE(compensation.needsTemperature());
+}
+
+TEST_CASE("bmp085Compensation altitude")
+{
+    using Pressure = Bmp085Compensation::Pressure;
+    REQUIRE(float(Bmp085Compensation::getAltitude(Pressure(101325))) == Approx(0.0f).epsilon(0.01));
+
+    for (int32_t seaLevel : { 99000, 101325, 103000 })
+    {
+        float maxError = 0;
+        float maxErrorNearGround = 0; // within ~800 m
+        for (int32_t pa = 30000; pa < 120000; pa += 37)
+        {
+            Pressure pressure(pa);
+            pressure += Pressure(0.75f);
+            double ratio = (pa + 0.75) / seaLevel;
+            double expected = 44330.0 * (1 - std::pow(ratio, 1 / 5.255));
+            float error = float(std::fabs(float(Bmp085Compensation::getAltitude(pressure, seaLevel)) - expected));
+            maxError = std::max(maxError, error);
+            if (ratio > 0.9 && ratio < 1.1)
+            {
+                maxErrorNearGround = std::max(maxErrorNearGround, error);
+            }
+        }
+        REQUIRE(maxError < 1.0f);
+        REQUIRE(maxErrorNearGround < 0.1f);
+    }
+
+    // clamped outside the table
+    REQUIRE(Bmp085Compensation::getAltitude(Pressure(10000)).value_ == Bmp085Compensation::getAltitude(Pressure(25000)).value_);
+    REQUIRE(Bmp085Compensation::getAltitude(Pressure(130000)).value_ == Bmp085Compensation::getAltitude(Pressure(127000)).value_);
+}
+
+TEST_CASE("bmp085Compensation with the sampler")
+{
+    SimClock clock;
+    SimulatedI2CBus bus(clock);
+    SimulatedBmp085 chip(clock);
+    bus.attach(SimulatedBmp085::address, &chip);
+    Bmp085Sampler<SimulatedI2CBus> sampler(bus, 0);
+    Bmp085Compensation compensation(Bmp085Calibration::datasheet(), 8);
+
+    const int numSamples = 50;
+    for (int index = 0; index < numSamples; index++)
+    {
+        REQUIRE(pollForSample(sampler, clock));
+        const auto& sample = sampler.getSample();
+        if (sample.newTemperature)
+        {
+            compensation.setRawTemperature(sample.ut);
+        }
+        REQUIRE(compensation.getPressurePa(sample.up, sample.mode) == 69964);
+        sampler.setTemperatureNeeded(compensation.needsTemperature());
+    }
+    REQUIRE(compensation.getTemperatureTenths() == 150);
+
+    // a temperature conversion for every 8 pressure conversions (after the first two)
+    uint32_t numTemperatureConversions = chip.getNumConversions() - numSamples;
+    REQUIRE(numTemperatureConversions == 2 + (numSamples - 2 + 7) / 8);
+    REQUIRE(chip.getNumEarlyReads() == 0);
+}
+
+//
+// Scheduling: the gesture detector's 18 ms tick and the barometer sharing the processor,
+// run fiber by fiber the way the DAL's scheduler does (whichever is due runs until it
+// sleeps; nothing preempts it)
+//
+
+struct ScheduleResult
+{
+    uint32_t maxLateness = 0; // us
+    uint32_t numMissedTicks = 0;
+    uint32_t numBaroSamples = 0;
+};
+
+// runBaro() runs the barometer fiber until it sleeps, and says for how long (in ms)
+template <typename RunBaro>
+static ScheduleResult runSchedule(SimClock& clock, RunBaro runBaro, uint32_t durationMs)
+{
+    const uint64_t tickPeriod = 18000;
+    MicroBitGestureDetector detector;
+    MotionGenerator generator(MotionConfig::handHeld(), 5);
+    ScheduleResult result;
+
+    uint64_t nextTick = clock.us;
+    uint64_t nextBaro = clock.us;
+    uint64_t endTime = clock.us + 1000 * uint64_t(durationMs);
+    while (clock.us < endTime)
+    {
+        if (clock.us >= nextTick)
+        {
+            uint64_t lateness = clock.us - nextTick;
+            result.maxLateness = std::max(result.maxLateness, uint32_t(lateness));
+            result.numMissedTicks += uint32_t(lateness / tickPeriod);
+            nextTick += tickPeriod * (1 + lateness / tickPeriod);
+
+            byteVector3 sample;
+            generator.generate(&sample, nullptr, 1);
+            detector.processSample(sample);
+        }
+        else if (clock.us >= nextBaro)
+        {
+            uint32_t sleepTime = runBaro(); // (which moves the clock on)
+            nextBaro = clock.us + 1000 * uint64_t(sleepTime);
+        }
+        else
+        {
+            clock.us = std::min(nextTick, nextBaro);
+        }
+    }
+    return result;
+}
+
+TEST_CASE("bmp085Sampler leaves the gesture tick alone")
+{
+    const uint32_t intervalMs = 100;
+    const uint32_t durationMs = 60000;
+    const int mode = 3;
+
+    // The old driver: write, wait_ms(), read, with nothing else running in the waits
+    SimClock blockingClock;
+    SimulatedI2CBus blockingBus(blockingClock);
+    SimulatedBmp085 blockingChip(blockingClock);
+    blockingBus.attach(SimulatedBmp085::address, &blockingChip);
+    uint32_t numBlockingSamples = 0;
+    auto blockingBaro = [&]() -> uint32_t {
+        uint64_t start = blockingClock.us;
+        char cmd[] = { char(0xF4), char(0x2E) };
+        char reg[] = { char(0xF6) };
+        char data[3];
+        blockingBus.write(SimulatedBmp085::address, cmd, 2);
+        blockingClock.us += 5000;
+        blockingBus.write(SimulatedBmp085::address, reg, 1);
+        blockingBus.read(SimulatedBmp085::address, data, 2);
+        cmd[1] = char(0x34 + (mode << 6));
+        blockingBus.write(SimulatedBmp085::address, cmd, 2);
+        blockingClock.us += 26000;
+        blockingBus.write(SimulatedBmp085::address, reg, 1);
+        blockingBus.read(SimulatedBmp085::address, data, 3);
+        numBlockingSamples++;
+        return intervalMs - uint32_t((blockingClock.us - start) / 1000);
+    };
+    ScheduleResult blocking = runSchedule(blockingClock, blockingBaro, durationMs);
+    blocking.numBaroSamples = numBlockingSamples;
+
+    // The sampler, polled from its own fiber
+    SimClock clock;
+    SimulatedI2CBus bus(clock);
+    SimulatedBmp085 chip(clock);
+    bus.attach(SimulatedBmp085::address, &chip);
+    Bmp085Sampler<SimulatedI2CBus> sampler(bus, mode);
+    sampler.setInterval(intervalMs);
+    ScheduleResult async = runSchedule(clock, [&] { return sampler.poll(clock.ms()); }, durationMs);
+    async.numBaroSamples = sampler.getNumSamples();
+
+    std::cout << "blocking driver: ticks up to " << blocking.maxLateness << " us late, " << blocking.numMissedTicks
+              << " missed, " << blocking.numBaroSamples << " samples; sampler: ticks up to " << async.maxLateness
+              << " us late, " << async.numMissedTicks << " missed, " << async.numBaroSamples << " samples" << std::endl;
+
+    REQUIRE(blocking.numMissedTicks > 0);
+    REQUIRE(async.numMissedTicks == 0);
+    REQUIRE(async.maxLateness < 1000); // a few I2C transfers
+    REQUIRE(async.numBaroSamples >= durationMs / intervalMs - 1);
+    REQUIRE(chip.getNumEarlyReads() == 0);
+}
@@ -0,0 +1,125 @@
+#include "capture_file.h"
+
+#include "catch.hpp"
+
+#include <cstdio>
+#include <vector>
+
+// See catch tutorial: https://github.com/philsquared/Catch/blob/master/docs/tutorial.md
+
+//
+// captureFile tests
+//
+
+TEST_CASE("captureFile round trip")
+{
+    const char* filename = "captureFile_test.mbcap";
+    std::vector<byteVector3> samples;
+    std::vector<capture_label_t> labels;
+    std::vector<uint32_t> times;
+    uint32_t time = 0xffffff00; // wraps around partway through
+    for (int index = 0; index < 1000; index++)
+    {
+        samples.push_back(byteVector3(int8_t(index), int8_t(-index), int8_t(index * 7)));
+        labels.push_back(index % 100 == 0 ? 101 : 0);
+        times.push_back(time);
+        time += index % 300 == 0 ? 100000 : 18 + index % 3; // the odd long gap takes a multi-byte delta
+    }
+    REQUIRE(writeCaptureFile(filename, samples, labels, times, 64));
+    REQUIRE(isCaptureFile(filename));
+
+    {
+        MappedCapture capture;
+        REQUIRE(capture.open(filename));
+        REQUIRE(capture.size() == samples.size());
+        for (size_t index = 0; index < samples.size(); index++)
+        {
+            const byteVector3& sample = capture.samples()[index];
+            REQUIRE(sample.x == samples[index].x);
+            REQUIRE(sample.y == samples[index].y);
+            REQUIRE(sample.z == samples[index].z);
+            REQUIRE(capture.labels()[index] == labels[index]);
+        }
+
+        std::vector<uint32_t> decoded;
+        REQUIRE(capture.getTimes(0, samples.size(), decoded));
+        REQUIRE(decoded == times);
+
+        // starting partway into a chunk
+        REQUIRE(capture.getTimes(130, 270, decoded));
+        REQUIRE((decoded == std::vector<uint32_t>(times.begin() + 130, times.begin() + 270)));
+
+        REQUIRE(!capture.getTimes(10, samples.size() + 1, decoded));
+    }
+    remove(filename);
+}
+
+TEST_CASE("captureFile rejects other files")
+{
+    const char* filename = "captureFile_test.csv";
+    FILE* file = fopen(filename, "w");
+    REQUIRE(file);
+    fprintf(file, "0,0,64\n");
+    fclose(file);
+
+    REQUIRE(!isCaptureFile(filename));
+    MappedCapture capture;
+    REQUIRE(!capture.open(filename));
+    REQUIRE(capture.size() == 0);
+    remove(filename);
+}
+
+// Writes a valid capture, then changes its header
+template <typename F>
+static bool openChanged(const char* filename, F change)
+{
+    std::vector<byteVector3> samples(100);
+    std::vector<capture_label_t> labels(100);
+    std::vector<uint32_t> times(100);
+    for (size_t index = 0; index < times.size(); index++)
+    {
+        times[index] = uint32_t(index * 18);
+    }
+    if (!writeCaptureFile(filename, samples, labels, times, 16))
+    {
+        return false;
+    }
+
+    FILE* file = fopen(filename, "r+b");
+    CaptureFileHeader header;
+    bool ok = file && fread(&header, sizeof(header), 1, file) == 1;
+    if (ok)
+    {
+        change(header);
+        ok = fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+    }
+    if (file)
+    {
+        fclose(file);
+    }
+
+    MappedCapture capture;
+    ok = ok && capture.open(filename);
+    remove(filename);
+    return ok;
+}
+
+TEST_CASE("captureFile rejects bad headers")
+{
+    const char* filename = "captureFile_test.mbcap";
+    REQUIRE(openChanged(filename, [](CaptureFileHeader&) {}));
+
+    // the time deltas (100 bytes, after 56 + 300 + 100) got padded for the chunk index
+    REQUIRE(openChanged(filename, [](CaptureFileHeader& header) { REQUIRE(header.chunkIndexOffset == 560); }));
+
+    // a chunk index that isn't on a CaptureChunk boundary
+    REQUIRE(!openChanged(filename, [](CaptureFileHeader& header) { header.chunkIndexOffset -= 4; }));
+
+    // offsets and sizes that only fit if the sums wrap around
+    REQUIRE(!openChanged(filename, [](CaptureFileHeader& header) { header.chunkIndexOffset = UINT64_MAX - 15; }));
+    REQUIRE(!openChanged(filename, [](CaptureFileHeader& header) {
+        header.numSamples = UINT64_MAX / 3 + 1;
+        header.samplesOffset = 0;
+    }));
+    REQUIRE(!openChanged(filename, [](CaptureFileHeader& header) { header.samplesOffset = UINT64_MAX - 200; }));
+}
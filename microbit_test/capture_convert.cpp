@@ -0,0 +1,173 @@
+#include "capture_file.h"
+#include "replay.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// Converts text captures into binary ones (see capture_file.h), so long recordings can be
+// mapped and replayed without parsing them every time.
+//
+// usage: capture_convert [-b event] [-d] [-c chunkSize] -o output input
+//
+// The input is either a text capture (x,y,z[,label], see replay.h), which gets timestamps
+// every replaySamplePeriod, or a serial log from a GESTURE_DIAGNOSTICS build:
+//
+//   gesture  time  buttonA  buttonB  x  y  z  diagnostic     (tab separated)
+//
+// Serial logs are unlabelled unless
+//   -b  labels the sample where button B goes down with the given event (press B as you
+//       do the gesture)
+//   -d  labels samples with the gestures the device detected (a starting point for hand
+//       labelling, not ground truth)
+//
+// Logs from before the raw sample was printed hold gravity-subtracted samples, and won't
+// replay the same way.
+
+static bool readSerialLog(FILE* file, int buttonEvent, bool useDetections,
+                          std::vector<byteVector3>& samples,
+                          std::vector<capture_label_t>& labels,
+                          std::vector<uint32_t>& times)
+{
+    char line[256];
+    int prevButtonB = 0;
+    while (fgets(line, sizeof(line), file))
+    {
+        // the gesture column is empty when nothing fired, so the line can start with a tab
+        const char* fields = line;
+        while (*fields && *fields != '\t')
+        {
+            fields++;
+        }
+        unsigned long time;
+        int buttonA, buttonB, x, y, z;
+        if (*fields != '\t' || sscanf(fields, "%lu %d %d %d %d %d", &time, &buttonA, &buttonB, &x, &y, &z) != 6)
+        {
+            continue;
+        }
+
+        int label = 0;
+        if (buttonEvent > 0 && buttonB && !prevButtonB)
+        {
+            label = buttonEvent;
+        }
+        else if (useDetections && fields != line)
+        {
+            label = std::max(0, parseEvent(line));
+        }
+        prevButtonB = buttonB;
+
+        samples.push_back(byteVector3(clampByte(x), clampByte(y), clampByte(z)));
+        labels.push_back(capture_label_t(label));
+        times.push_back(uint32_t(time));
+    }
+    return !samples.empty();
+}
+
+static bool isSerialLog(const char* filename)
+{
+    FILE* file = fopen(filename, "r");
+    if (!file)
+    {
+        return false;
+    }
+    char line[256];
+    bool result = false;
+    while (fgets(line, sizeof(line), file))
+    {
+        if (line[0] == '\r' || line[0] == '\n' || line[0] == '#')
+        {
+            continue;
+        }
+        result = strchr(line, '\t') != nullptr && strchr(line, ',') == nullptr;
+        break;
+    }
+    fclose(file);
+    return result;
+}
+
+int main(int argc, char* argv[])
+{
+    const char* inputName = nullptr;
+    const char* outputName = nullptr;
+    int buttonEvent = 0;
+    bool useDetections = false;
+    uint32_t chunkSize = defaultCaptureChunkSize;
+
+    for (int argIndex = 1; argIndex < argc; argIndex++)
+    {
+        const char* arg = argv[argIndex];
+        if (strcmp(arg, "-b") == 0 && argIndex + 1 < argc)
+        {
+            buttonEvent = parseEvent(argv[++argIndex]);
+            if (buttonEvent <= 0)
+            {
+                fprintf(stderr, "Unknown event %s\n", argv[argIndex]);
+                return 1;
+            }
+        }
+        else if (strcmp(arg, "-d") == 0)
+        {
+            useDetections = true;
+        }
+        else if (strcmp(arg, "-c") == 0 && argIndex + 1 < argc)
+        {
+            chunkSize = uint32_t(std::max(1, atoi(argv[++argIndex])));
+        }
+        else if (strcmp(arg, "-o") == 0 && argIndex + 1 < argc)
+        {
+            outputName = argv[++argIndex];
+        }
+        else
+        {
+            inputName = arg;
+        }
+    }
+
+    if (!inputName || !outputName)
+    {
+        fprintf(stderr, "usage: capture_convert [-b event] [-d] [-c chunkSize] -o output input\n");
+        return 1;
+    }
+
+    std::vector<byteVector3> samples;
+    std::vector<capture_label_t> labels;
+    std::vector<uint32_t> times;
+    if (isSerialLog(inputName))
+    {
+        FILE* file = fopen(inputName, "r");
+        bool ok = file && readSerialLog(file, buttonEvent, useDetections, samples, labels, times);
+        if (file)
+        {
+            fclose(file);
+        }
+        if (!ok)
+        {
+            fprintf(stderr, "No samples in %s\n", inputName);
+            return 1;
+        }
+    }
+    else
+    {
+        Capture capture;
+        if (!capture.load(inputName))
+        {
+            return 1;
+        }
+        samples.assign(capture.samples(), capture.samples() + capture.size());
+        labels.assign(capture.labels(), capture.labels() + capture.size());
+        for (size_t index = 0; index < capture.size(); index++)
+        {
+            times.push_back(uint32_t(index * replaySamplePeriod * 1000 + 0.5f));
+        }
+    }
+
+    if (!writeCaptureFile(outputName, samples, labels, times, chunkSize))
+    {
+        return 1;
+    }
+    printf("%s: %zu samples\n", outputName, samples.size());
+    return 0;
+}
@@ -0,0 +1,286 @@
+#include "capture_file.h"
+
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char captureMagic[4] = { 'M', 'B', 'C', 'P' };
+
+static void appendVarint(std::vector<uint8_t>& out, uint32_t val)
+{
+    while (val >= 0x80)
+    {
+        out.push_back(uint8_t(val | 0x80));
+        val >>= 7;
+    }
+    out.push_back(uint8_t(val));
+}
+
+// Whether [offset, offset + size) ends by end, without the sum overflowing (the offsets
+// come from the file)
+static bool fitsBefore(uint64_t offset, uint64_t size, uint64_t end)
+{
+    return offset <= end && size <= end - offset;
+}
+
+// Returns the number of bytes read, or 0 if the varint runs off the end
+static size_t readVarint(const uint8_t* data, size_t size, uint32_t& val)
+{
+    val = 0;
+    for (size_t index = 0; index < size && index < 5; index++)
+    {
+        val |= uint32_t(data[index] & 0x7f) << (7 * index);
+        if (!(data[index] & 0x80))
+        {
+            return index + 1;
+        }
+    }
+    return 0;
+}
+
+bool isCaptureFile(const char* filename)
+{
+    FILE* file = fopen(filename, "rb");
+    if (!file)
+    {
+        return false;
+    }
+    char magic[4] = {};
+    bool result = fread(magic, 1, sizeof(magic), file) == sizeof(magic) && memcmp(magic, captureMagic, sizeof(magic)) == 0;
+    fclose(file);
+    return result;
+}
+
+bool writeCaptureFile(const char* filename,
+                      const std::vector<byteVector3>& samples,
+                      const std::vector<capture_label_t>& labels,
+                      const std::vector<uint32_t>& times,
+                      uint32_t chunkSize)
+{
+    if (labels.size() != samples.size() || times.size() != samples.size() || chunkSize == 0)
+    {
+        fprintf(stderr, "Bad capture columns for %s\n", filename);
+        return false;
+    }
+
+    std::vector<uint8_t> timeDeltas;
+    std::vector<CaptureChunk> chunks;
+    for (size_t index = 0; index < samples.size(); index++)
+    {
+        if (index % chunkSize == 0)
+        {
+            chunks.push_back(CaptureChunk{ timeDeltas.size(), times[index], 0 });
+            appendVarint(timeDeltas, 0);
+        }
+        else
+        {
+            appendVarint(timeDeltas, times[index] - times[index-1]); // wraps like the device's clock
+        }
+    }
+
+    CaptureFileHeader header = {};
+    memcpy(header.magic, captureMagic, sizeof(captureMagic));
+    header.version = captureFileVersion;
+    header.headerSize = sizeof(CaptureFileHeader);
+    header.chunkSize = chunkSize;
+    header.numChunks = uint32_t(chunks.size());
+    header.numSamples = samples.size();
+    header.samplesOffset = sizeof(CaptureFileHeader);
+    header.labelsOffset = header.samplesOffset + samples.size() * sizeof(byteVector3);
+    header.timesOffset = header.labelsOffset + labels.size() * sizeof(capture_label_t);
+    // (the chunk index gets mapped in place, so it starts on a CaptureChunk boundary)
+    size_t numPadding = (alignof(CaptureChunk) - (header.timesOffset + timeDeltas.size()) % alignof(CaptureChunk)) % alignof(CaptureChunk);
+    timeDeltas.resize(timeDeltas.size() + numPadding, 0);
+    header.chunkIndexOffset = header.timesOffset + timeDeltas.size();
+
+    FILE* file = fopen(filename, "wb");
+    if (!file)
+    {
+        fprintf(stderr, "Can't create %s\n", filename);
+        return false;
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = ok && fwrite(samples.data(), sizeof(byteVector3), samples.size(), file) == samples.size();
+    ok = ok && fwrite(labels.data(), sizeof(capture_label_t), labels.size(), file) == labels.size();
+    ok = ok && fwrite(timeDeltas.data(), 1, timeDeltas.size(), file) == timeDeltas.size();
+    ok = ok && fwrite(chunks.data(), sizeof(CaptureChunk), chunks.size(), file) == chunks.size();
+    ok = (fclose(file) == 0) && ok;
+    if (!ok)
+    {
+        fprintf(stderr, "Error writing %s\n", filename);
+    }
+    return ok;
+}
+
+MappedCapture::~MappedCapture()
+{
+    close();
+}
+
+bool MappedCapture::open(const char* filename)
+{
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        fprintf(stderr, "Can't open %s\n", filename);
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(file, &fileSize);
+    HANDLE mapping = fileSize.QuadPart > 0 ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+    void* data = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    fileHandle_ = file;
+    mappingHandle_ = mapping;
+    dataSize_ = size_t(fileSize.QuadPart);
+#else
+    int fd = ::open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Can't open %s\n", filename);
+        return false;
+    }
+    struct stat fileStat;
+    void* data = nullptr;
+    if (fstat(fd, &fileStat) == 0 && fileStat.st_size > 0)
+    {
+        data = mmap(nullptr, size_t(fileStat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            data = nullptr;
+        }
+        else
+        {
+            dataSize_ = size_t(fileStat.st_size);
+            madvise(data, dataSize_, MADV_SEQUENTIAL);
+        }
+    }
+    ::close(fd); // the mapping keeps the file alive
+#endif
+
+    if (!data)
+    {
+        fprintf(stderr, "Can't map %s\n", filename);
+        close();
+        return false;
+    }
+    data_ = static_cast<const uint8_t*>(data);
+
+    // Check the header and that all the columns are inside the file
+    header_ = reinterpret_cast<const CaptureFileHeader*>(data_);
+    bool ok = dataSize_ >= sizeof(CaptureFileHeader)
+           && memcmp(header_->magic, captureMagic, sizeof(captureMagic)) == 0
+           && header_->version == captureFileVersion
+           && header_->headerSize >= sizeof(CaptureFileHeader)
+           && header_->chunkSize > 0;
+    if (ok)
+    {
+        uint64_t n = header_->numSamples;
+        ok = n <= dataSize_ // (so the sizes below can't overflow)
+          && fitsBefore(header_->samplesOffset, n * sizeof(byteVector3), header_->labelsOffset)
+          && fitsBefore(header_->labelsOffset, n * sizeof(capture_label_t), header_->timesOffset)
+          && header_->timesOffset <= header_->chunkIndexOffset
+          && header_->chunkIndexOffset % alignof(CaptureChunk) == 0
+          && fitsBefore(header_->chunkIndexOffset, uint64_t(header_->numChunks) * sizeof(CaptureChunk), dataSize_)
+          && uint64_t(header_->numChunks) == (n + header_->chunkSize - 1) / header_->chunkSize;
+    }
+    if (!ok)
+    {
+        fprintf(stderr, "%s isn't a valid capture file\n", filename);
+        close();
+        return false;
+    }
+
+    numSamples_ = size_t(header_->numSamples);
+    samples_ = reinterpret_cast<const byteVector3*>(data_ + header_->samplesOffset);
+    labels_ = data_ + header_->labelsOffset;
+    times_ = data_ + header_->timesOffset;
+    timesSize_ = size_t(header_->chunkIndexOffset - header_->timesOffset);
+    chunks_ = reinterpret_cast<const CaptureChunk*>(data_ + header_->chunkIndexOffset);
+    return true;
+}
+
+void MappedCapture::close()
+{
+#ifdef _WIN32
+    if (data_)
+    {
+        UnmapViewOfFile(data_);
+    }
+    if (mappingHandle_)
+    {
+        CloseHandle(mappingHandle_);
+    }
+    if (fileHandle_)
+    {
+        CloseHandle(fileHandle_);
+    }
+    fileHandle_ = nullptr;
+    mappingHandle_ = nullptr;
+#else
+    if (data_)
+    {
+        munmap(const_cast<uint8_t*>(data_), dataSize_);
+    }
+#endif
+    data_ = nullptr;
+    dataSize_ = 0;
+    header_ = nullptr;
+    numSamples_ = 0;
+    samples_ = nullptr;
+    labels_ = nullptr;
+    times_ = nullptr;
+    timesSize_ = 0;
+    chunks_ = nullptr;
+}
+
+bool MappedCapture::getTimes(size_t begin, size_t end, std::vector<uint32_t>& times) const
+{
+    times.clear();
+    if (begin >= end || end > numSamples_)
+    {
+        return begin == end;
+    }
+
+    // start decoding at the chunk that holds begin
+    size_t chunkIndex = begin / header_->chunkSize;
+    size_t index = chunkIndex * header_->chunkSize;
+    size_t pos = size_t(chunks_[chunkIndex].timesOffset);
+    uint32_t time = chunks_[chunkIndex].startTime;
+    for (; index < end; index++)
+    {
+        uint32_t delta;
+        size_t used = pos < timesSize_ ? readVarint(times_ + pos, timesSize_ - pos, delta) : 0;
+        if (used == 0)
+        {
+            return false;
+        }
+        pos += used;
+
+        if (index % header_->chunkSize == 0)
+        {
+            time = chunks_[index / header_->chunkSize].startTime;
+        }
+        else
+        {
+            time += delta;
+        }
+
+        if (index >= begin)
+        {
+            times.push_back(time);
+        }
+    }
+    return true;
+}
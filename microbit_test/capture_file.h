@@ -0,0 +1,97 @@
+#pragma once
+
+#include "Vector3.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Binary capture format (.mbcap), for replaying long recordings without parsing text.
+// Everything is little-endian:
+//
+//   CaptureFileHeader
+//   samples      numSamples x byteVector3 (x, y, z as int8, 1/64 g)
+//   labels       numSamples x uint8 (the event at that sample, e.g., 101 for Tap, or 0)
+//   time deltas  numSamples x varint (ms since the previous sample, LEB128, usually 1 byte)
+//   (zeros up to the next multiple of alignof(CaptureChunk))
+//   chunk index  numChunks x CaptureChunk
+//
+// Samples and labels are fixed-size columns, so a reader can map the file and hand them to
+// the detector in place. Timestamps are delta coded, so they have to be decoded in order;
+// the chunk index has the absolute time and the offset into the delta column of every
+// chunkSize'th sample, so decoding can start at any chunk.
+
+using capture_label_t = uint8_t;
+
+struct CaptureFileHeader
+{
+    char magic[4];          // "MBCP"
+    uint16_t version;       // captureFileVersion
+    uint16_t headerSize;    // sizeof(CaptureFileHeader), so later versions can add fields
+    uint32_t chunkSize;     // samples per chunk
+    uint32_t numChunks;
+    uint64_t numSamples;
+    uint64_t samplesOffset; // from the start of the file
+    uint64_t labelsOffset;
+    uint64_t timesOffset;
+    uint64_t chunkIndexOffset;
+};
+
+struct CaptureChunk
+{
+    uint64_t timesOffset;   // from the start of the time deltas
+    uint32_t startTime;     // of the chunk's first sample, in ms
+    uint32_t reserved;
+};
+
+static_assert(sizeof(byteVector3) == 3, "byteVector3 has to be exactly x, y, z to be mapped from a file");
+static_assert(sizeof(CaptureFileHeader) == 56, "CaptureFileHeader layout changed");
+static_assert(sizeof(CaptureChunk) == 16, "CaptureChunk layout changed");
+
+const uint16_t captureFileVersion = 1;
+const uint32_t defaultCaptureChunkSize = 4096;
+
+// Returns true if the first bytes of a file look like a binary capture
+bool isCaptureFile(const char* filename);
+
+bool writeCaptureFile(const char* filename,
+                      const std::vector<byteVector3>& samples,
+                      const std::vector<capture_label_t>& labels,
+                      const std::vector<uint32_t>& times,
+                      uint32_t chunkSize = defaultCaptureChunkSize);
+
+// A read-only view of a binary capture, mapped into memory
+class MappedCapture
+{
+public:
+    MappedCapture() = default;
+    MappedCapture(const MappedCapture&) = delete;
+    MappedCapture& operator=(const MappedCapture&) = delete;
+    ~MappedCapture();
+
+    bool open(const char* filename);
+    void close();
+
+    size_t size() const { return numSamples_; }
+    const byteVector3* samples() const { return samples_; }
+    const capture_label_t* labels() const { return labels_; }
+
+    // Decodes the timestamps of samples [begin, end) into times
+    bool getTimes(size_t begin, size_t end, std::vector<uint32_t>& times) const;
+
+private:
+    const uint8_t* data_ = nullptr;
+    size_t dataSize_ = 0;
+#ifdef _WIN32
+    void* fileHandle_ = nullptr;
+    void* mappingHandle_ = nullptr;
+#endif
+
+    const CaptureFileHeader* header_ = nullptr;
+    size_t numSamples_ = 0;
+    const byteVector3* samples_ = nullptr;
+    const capture_label_t* labels_ = nullptr;
+    const uint8_t* times_ = nullptr;
+    size_t timesSize_ = 0;
+    const CaptureChunk* chunks_ = nullptr;
+};
@@ -0,0 +1,121 @@
+#include "MicroBitGestureDetector.h"
+
+#include <cstdio>
+
+// Prints the offset and size of every member of MicroBitGestureDetector (and of its
+// feature pool), along with any padding the compiler inserted. Useful when checking
+// changes against gestureDetectorRamBudget. (Sizes are for the machine this runs on ---
+// see the comment on gestureDetectorHostOverhead for how they differ from the nRF51.)
+
+struct MicroBitGestureDetectorLayout
+{
+    const void* base = nullptr;
+    size_t expectedOffset = 0;
+    const char* indent = "";
+
+    template <typename T>
+    void printMember(const char* name, const T& member)
+    {
+        size_t offset = (const char*)&member - (const char*)base;
+        if (offset > expectedOffset)
+        {
+            printf("%s%6zu %6zu   (padding)\n", indent, expectedOffset, offset - expectedOffset);
+        }
+        printf("%s%6zu %6zu   %s\n", indent, offset, sizeof(T), name);
+        expectedOffset = offset + sizeof(T);
+    }
+
+    void finish(size_t total)
+    {
+        if (total > expectedOffset)
+        {
+            printf("%s%6zu %6zu   (padding)\n", indent, expectedOffset, total - expectedOffset);
+        }
+    }
+
+    template <typename G>
+    void printGesture(const char* name, MicroBitGestureSet& gestures)
+    {
+        printMember(name, gestures.get<G>());
+    }
+
+    void print(MicroBitGestureDetector& detector)
+    {
+        printf("%6s %6s   %s\n", "offset", "size", "member");
+
+#define PRINT_MEMBER(m) printMember(#m, detector.m)
+        PRINT_MEMBER(prevTime);
+        PRINT_MEMBER(features);
+        printFeatures(detector.features);
+        PRINT_MEMBER(gestures);
+        printGestures(detector.gestures);
+#if USE_MEDIAN_PREFILTER
+        PRINT_MEMBER(prefilterDelayBuffer);
+        PRINT_MEMBER(prefilter);
+#endif
+        PRINT_MEMBER(firedGestures);
+#if GESTURE_DIAGNOSTICS
+        PRINT_MEMBER(isPrinting);
+#endif
+#undef PRINT_MEMBER
+        finish(sizeof(MicroBitGestureDetector));
+
+        size_t total = sizeof(MicroBitGestureDetector);
+        printf("\ntotal: %zu bytes (budget: %zu on target, %zu here)\n", total, gestureDetectorRamBudget, gestureDetectorRamBudget + gestureDetectorHostOverhead);
+    }
+
+    void printFeatures(GestureFeaturePool& pool)
+    {
+        MicroBitGestureDetectorLayout inner;
+        inner.base = &pool;
+        inner.indent = "        ";
+
+#define PRINT_MEMBER(m) inner.printMember(#m, pool.m)
+        PRINT_MEMBER(dotDelayBuffer2);
+#if USE_SLOW_SHAKE
+        PRINT_MEMBER(dotDelayBuffer4);
+#endif
+        PRINT_MEMBER(sampleDelayBuffer);
+        PRINT_MEMBER(gravityFilter);
+#if USE_SLOW_SHAKE
+        PRINT_MEMBER(allowSlowGesture);
+#endif
+        PRINT_MEMBER(quietWindowStats);
+        PRINT_MEMBER(impulseWindowStats);
+        PRINT_MEMBER(impulseWindowStatsX);
+        PRINT_MEMBER(impulseWindowStatsY);
+#if USE_SHAKE_GATE
+        PRINT_MEMBER(shakeThreshStats);
+#endif
+        PRINT_MEMBER(dot2Stats);
+#if USE_SLOW_SHAKE
+        PRINT_MEMBER(dot4Stats);
+#endif
+#undef PRINT_MEMBER
+        inner.finish(sizeof(pool));
+    }
+
+    void printGestures(MicroBitGestureSet& gestures)
+    {
+        MicroBitGestureDetectorLayout inner;
+        inner.base = &gestures;
+        inner.indent = "        ";
+
+        inner.printGesture<TapGesture>("TapGesture", gestures);
+        inner.printGesture<DoubleTapGesture>("DoubleTapGesture", gestures);
+        inner.printGesture<ShakeGesture>("ShakeGesture", gestures);
+        inner.printGesture<FreefallGesture>("FreefallGesture", gestures);
+        inner.printGesture<FaceGesture>("FaceGesture", gestures);
+        inner.printGesture<TiltGesture>("TiltGesture", gestures);
+        inner.finish(sizeof(gestures));
+    }
+};
+
+int main()
+{
+    MicroBitGestureDetector detector;
+    MicroBitGestureDetectorLayout layout;
+    layout.base = &detector;
+    layout.print(detector);
+    return 0;
+}
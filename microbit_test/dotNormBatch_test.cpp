@@ -0,0 +1,135 @@
+#include "dot_norm_batch.h"
+#include "motion_generator.h"
+
+#include "catch.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+using std::vector;
+
+// See catch tutorial: https://github.com/philsquared/Catch/blob/master/docs/tutorial.md
+
+//
+// dotNormBatch tests
+//
+
+static bool sameBits(float a, float b)
+{
+    return memcmp(&a, &b, sizeof(float)) == 0;
+}
+
+static vector<byteVector3> randomVectors(size_t count, int seed)
+{
+    srand(seed);
+    vector<byteVector3> vals;
+    for (size_t index = 0; index < count; index++)
+    {
+        vals.push_back(byteVector3(rand() % 256 - 128, rand() % 256 - 128, rand() % 256 - 128));
+    }
+    vals[3] = byteVector3(0, 0, 0); // and some under the length threshold
+    vals[10] = byteVector3(1, 0, 0);
+    return vals;
+}
+
+TEST_CASE("dotNormBatch matches dotNorm")
+{
+    const size_t count = 3001; // not a multiple of the vector width or the block size
+    auto a = randomVectors(count, 1);
+    auto b = randomVectors(count, 2);
+    VectorColumns aColumns(a.data(), a.size());
+    VectorColumns bColumns(b.data(), b.size());
+    const float minLenThresh = 2;
+
+    for (int impl = 0; impl < NUM_DOT_NORM_IMPLS; impl++)
+    {
+        if (!isDotNormImplSupported(DotNormImpl(impl)))
+        {
+            continue;
+        }
+        INFO(getDotNormImplName(DotNormImpl(impl)));
+        vector<float> result(count);
+        dotNormBatch(aColumns, bColumns, minLenThresh, result.data(), DotNormImpl(impl));
+        for (size_t index = 0; index < count; index++)
+        {
+            REQUIRE(sameBits(result[index], dotNorm(a[index], b[index], minLenThresh)));
+        }
+    }
+}
+
+TEST_CASE("lagDotNorm matches dotNorm")
+{
+    const size_t count = 2500;
+    vector<byteVector3> samples(count);
+    MotionGenerator generator(MotionConfig::handHeld(), 11);
+    generator.generate(samples.data(), nullptr, count);
+    VectorColumns columns(samples.data(), samples.size());
+
+    const int lags[] = { 1, 5, 8, 10, 1500 };
+    const size_t numLags = sizeof(lags) / sizeof(lags[0]);
+    const float minLenThresh = 1;
+    for (int impl = 0; impl < NUM_DOT_NORM_IMPLS; impl++)
+    {
+        if (!isDotNormImplSupported(DotNormImpl(impl)))
+        {
+            continue;
+        }
+        INFO(getDotNormImplName(DotNormImpl(impl)));
+        vector<float> result(count * numLags, -99.0f);
+        lagDotNorm(columns, lags, numLags, minLenThresh, result.data(), DotNormImpl(impl));
+        for (size_t lagIndex = 0; lagIndex < numLags; lagIndex++)
+        {
+            for (size_t t = 0; t < count; t++)
+            {
+                float expected = t < size_t(lags[lagIndex]) ? 0.0f : dotNorm(samples[t], samples[t - lags[lagIndex]], minLenThresh);
+                REQUIRE(sameBits(result[lagIndex * count + t], expected));
+            }
+        }
+    }
+}
+
+//
+// benchmarks (hidden: run with microbit_test "[benchmark]")
+//
+
+TEST_CASE("dotNormBatch benchmark", "[.][benchmark]")
+{
+    using clock = std::chrono::steady_clock;
+    const size_t count = 1 << 20;
+    vector<byteVector3> samples(count);
+    MotionGenerator generator(MotionConfig::handHeld(), 12);
+    generator.generate(samples.data(), nullptr, count);
+    VectorColumns columns(samples.data(), samples.size());
+    const int lags[] = { 5, 8, 10, 16 };
+    const size_t numLags = sizeof(lags) / sizeof(lags[0]);
+
+    // the scalar dotNorm(), one pair at a time
+    float checksum = 0;
+    auto start = clock::now();
+    for (int lag : lags)
+    {
+        for (size_t t = size_t(lag); t < count; t++)
+        {
+            checksum += dotNorm(samples[t], samples[t - lag], 1.0f);
+        }
+    }
+    double pairTime = std::chrono::duration<double, std::nano>(clock::now() - start).count() / (count * numLags);
+    std::cout << "dotNorm per pair: " << pairTime << " ns (" << checksum << ")" << std::endl;
+
+    vector<float> result(count * numLags);
+    for (int impl = 0; impl < NUM_DOT_NORM_IMPLS; impl++)
+    {
+        if (!isDotNormImplSupported(DotNormImpl(impl)))
+        {
+            continue;
+        }
+        start = clock::now();
+        lagDotNorm(columns, lags, numLags, 1.0f, result.data(), DotNormImpl(impl));
+        double lagTime = std::chrono::duration<double, std::nano>(clock::now() - start).count() / (count * numLags);
+        std::cout << "lagDotNorm " << getDotNormImplName(DotNormImpl(impl)) << ": " << lagTime << " ns per pair ("
+                  << result[count / 2] << ")" << std::endl;
+    }
+}
@@ -0,0 +1,271 @@
+#include "dot_norm_batch.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define DOT_NORM_X86 1
+#include <immintrin.h>
+#else
+#define DOT_NORM_X86 0
+#endif
+
+// How many samples get processed together: small enough that the columns of a block stay
+// in L1 while all the lags run over it
+static const size_t blockSize = 1024;
+
+VectorColumns::VectorColumns(const byteVector3* samples, size_t numSamples) : x(numSamples), y(numSamples), z(numSamples)
+{
+    for (size_t index = 0; index < numSamples; index++)
+    {
+        x[index] = samples[index].x;
+        y[index] = samples[index].y;
+        z[index] = samples[index].z;
+    }
+}
+
+//
+// The kernels. Each one does
+//   lenSq[i] = x[i]*x[i] + y[i]*y[i] + z[i]*z[i]
+// and
+//   result[i] = dotNorm(a[i], b[i]), given the lengths
+// in the same order of operations as dot() and fast_inv_sqrt().
+//
+
+struct DotNormKernels
+{
+    void (*normSq)(const float* x, const float* y, const float* z, size_t count, float* lenSq);
+    void (*dotNorm)(const float* ax, const float* ay, const float* az, const float* aLenSq,
+                    const float* bx, const float* by, const float* bz, const float* bLenSq,
+                    size_t count, float minLenThresh, float* result);
+};
+
+static void normSqScalar(const float* x, const float* y, const float* z, size_t count, float* lenSq)
+{
+    for (size_t index = 0; index < count; index++)
+    {
+        lenSq[index] = x[index] * x[index] + y[index] * y[index] + z[index] * z[index];
+    }
+}
+
+static void dotNormScalar(const float* ax, const float* ay, const float* az, const float* aLenSq,
+                          const float* bx, const float* by, const float* bz, const float* bLenSq,
+                          size_t count, float minLenThresh, float* result)
+{
+    for (size_t index = 0; index < count; index++)
+    {
+        if (aLenSq[index] < minLenThresh || bLenSq[index] < minLenThresh)
+        {
+            result[index] = 0;
+            continue;
+        }
+        float aDotB = ax[index] * bx[index] + ay[index] * by[index] + az[index] * bz[index];
+        result[index] = aDotB * fast_inv_sqrt(aLenSq[index] * bLenSq[index]);
+    }
+}
+
+#if DOT_NORM_X86
+__attribute__((target("sse4.1")))
+static void normSqSse41(const float* x, const float* y, const float* z, size_t count, float* lenSq)
+{
+    size_t index = 0;
+    for (; index + 4 <= count; index += 4)
+    {
+        __m128 vx = _mm_loadu_ps(x + index);
+        __m128 vy = _mm_loadu_ps(y + index);
+        __m128 vz = _mm_loadu_ps(z + index);
+        __m128 sum = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz));
+        _mm_storeu_ps(lenSq + index, sum);
+    }
+    normSqScalar(x + index, y + index, z + index, count - index, lenSq + index);
+}
+
+__attribute__((target("sse4.1")))
+static void dotNormSse41(const float* ax, const float* ay, const float* az, const float* aLenSq,
+                         const float* bx, const float* by, const float* bz, const float* bLenSq,
+                         size_t count, float minLenThresh, float* result)
+{
+    const __m128 thresh = _mm_set1_ps(minLenThresh);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 threeHalfs = _mm_set1_ps(1.5f);
+    const __m128i magic = _mm_set1_epi32(0x5f3759df);
+
+    size_t index = 0;
+    for (; index + 4 <= count; index += 4)
+    {
+        __m128 aLen = _mm_loadu_ps(aLenSq + index);
+        __m128 bLen = _mm_loadu_ps(bLenSq + index);
+        __m128 aDotB = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(ax + index), _mm_loadu_ps(bx + index)),
+                                             _mm_mul_ps(_mm_loadu_ps(ay + index), _mm_loadu_ps(by + index))),
+                                  _mm_mul_ps(_mm_loadu_ps(az + index), _mm_loadu_ps(bz + index)));
+
+        // fast_inv_sqrt
+        __m128 val = _mm_mul_ps(aLen, bLen);
+        __m128 x2 = _mm_mul_ps(val, half);
+        __m128 inv = _mm_castsi128_ps(_mm_sub_epi32(magic, _mm_srai_epi32(_mm_castps_si128(val), 1)));
+        inv = _mm_mul_ps(inv, _mm_sub_ps(threeHalfs, _mm_mul_ps(_mm_mul_ps(x2, inv), inv)));
+
+        __m128 tooShort = _mm_or_ps(_mm_cmplt_ps(aLen, thresh), _mm_cmplt_ps(bLen, thresh));
+        _mm_storeu_ps(result + index, _mm_blendv_ps(_mm_mul_ps(aDotB, inv), _mm_setzero_ps(), tooShort));
+    }
+    dotNormScalar(ax + index, ay + index, az + index, aLenSq + index, bx + index, by + index, bz + index, bLenSq + index,
+                  count - index, minLenThresh, result + index);
+}
+
+__attribute__((target("avx2")))
+static void normSqAvx2(const float* x, const float* y, const float* z, size_t count, float* lenSq)
+{
+    size_t index = 0;
+    for (; index + 8 <= count; index += 8)
+    {
+        __m256 vx = _mm256_loadu_ps(x + index);
+        __m256 vy = _mm256_loadu_ps(y + index);
+        __m256 vz = _mm256_loadu_ps(z + index);
+        __m256 sum = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vx, vx), _mm256_mul_ps(vy, vy)), _mm256_mul_ps(vz, vz));
+        _mm256_storeu_ps(lenSq + index, sum);
+    }
+    normSqScalar(x + index, y + index, z + index, count - index, lenSq + index);
+}
+
+__attribute__((target("avx2")))
+static void dotNormAvx2(const float* ax, const float* ay, const float* az, const float* aLenSq,
+                        const float* bx, const float* by, const float* bz, const float* bLenSq,
+                        size_t count, float minLenThresh, float* result)
+{
+    const __m256 thresh = _mm256_set1_ps(minLenThresh);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 threeHalfs = _mm256_set1_ps(1.5f);
+    const __m256i magic = _mm256_set1_epi32(0x5f3759df);
+
+    size_t index = 0;
+    for (; index + 8 <= count; index += 8)
+    {
+        __m256 aLen = _mm256_loadu_ps(aLenSq + index);
+        __m256 bLen = _mm256_loadu_ps(bLenSq + index);
+        __m256 aDotB = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(ax + index), _mm256_loadu_ps(bx + index)),
+                                                   _mm256_mul_ps(_mm256_loadu_ps(ay + index), _mm256_loadu_ps(by + index))),
+                                     _mm256_mul_ps(_mm256_loadu_ps(az + index), _mm256_loadu_ps(bz + index)));
+
+        // fast_inv_sqrt
+        __m256 val = _mm256_mul_ps(aLen, bLen);
+        __m256 x2 = _mm256_mul_ps(val, half);
+        __m256 inv = _mm256_castsi256_ps(_mm256_sub_epi32(magic, _mm256_srai_epi32(_mm256_castps_si256(val), 1)));
+        inv = _mm256_mul_ps(inv, _mm256_sub_ps(threeHalfs, _mm256_mul_ps(_mm256_mul_ps(x2, inv), inv)));
+
+        __m256 tooShort = _mm256_or_ps(_mm256_cmp_ps(aLen, thresh, _CMP_LT_OQ), _mm256_cmp_ps(bLen, thresh, _CMP_LT_OQ));
+        _mm256_storeu_ps(result + index, _mm256_blendv_ps(_mm256_mul_ps(aDotB, inv), _mm256_setzero_ps(), tooShort));
+    }
+    dotNormScalar(ax + index, ay + index, az + index, aLenSq + index, bx + index, by + index, bz + index, bLenSq + index,
+                  count - index, minLenThresh, result + index);
+}
+#endif
+
+static const DotNormKernels dotNormKernels[NUM_DOT_NORM_IMPLS] = {
+    { normSqScalar, dotNormScalar },
+#if DOT_NORM_X86
+    { normSqSse41, dotNormSse41 },
+    { normSqAvx2, dotNormAvx2 },
+#else
+    { normSqScalar, dotNormScalar },
+    { normSqScalar, dotNormScalar },
+#endif
+};
+
+bool isDotNormImplSupported(DotNormImpl impl)
+{
+    switch (impl)
+    {
+    case DOT_NORM_SCALAR:
+        return true;
+#if DOT_NORM_X86
+    case DOT_NORM_SSE41:
+        return __builtin_cpu_supports("sse4.1");
+    case DOT_NORM_AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+DotNormImpl getBestDotNormImpl()
+{
+    static const DotNormImpl best = isDotNormImplSupported(DOT_NORM_AVX2) ? DOT_NORM_AVX2
+                                  : isDotNormImplSupported(DOT_NORM_SSE41) ? DOT_NORM_SSE41
+                                  : DOT_NORM_SCALAR;
+    return best;
+}
+
+const char* getDotNormImplName(DotNormImpl impl)
+{
+    switch (impl)
+    {
+    case DOT_NORM_SCALAR:
+        return "scalar";
+    case DOT_NORM_SSE41:
+        return "sse4.1";
+    case DOT_NORM_AVX2:
+        return "avx2";
+    default:
+        return "";
+    }
+}
+
+static const DotNormKernels& getKernels(DotNormImpl impl)
+{
+    return dotNormKernels[isDotNormImplSupported(impl) ? impl : DOT_NORM_SCALAR];
+}
+
+void dotNormBatch(const VectorColumns& a, const VectorColumns& b, float minLenThresh, float* result, DotNormImpl impl)
+{
+    const DotNormKernels& kernels = getKernels(impl);
+    size_t numSamples = std::min(a.size(), b.size());
+    float aLenSq[blockSize];
+    float bLenSq[blockSize];
+    for (size_t begin = 0; begin < numSamples; begin += blockSize)
+    {
+        size_t count = std::min(blockSize, numSamples - begin);
+        kernels.normSq(&a.x[begin], &a.y[begin], &a.z[begin], count, aLenSq);
+        kernels.normSq(&b.x[begin], &b.y[begin], &b.z[begin], count, bLenSq);
+        kernels.dotNorm(&a.x[begin], &a.y[begin], &a.z[begin], aLenSq, &b.x[begin], &b.y[begin], &b.z[begin], bLenSq,
+                        count, minLenThresh, result + begin);
+    }
+}
+
+void lagDotNorm(const VectorColumns& samples, const int* lags, size_t numLags, float minLenThresh, float* result, DotNormImpl impl)
+{
+    const DotNormKernels& kernels = getKernels(impl);
+    size_t numSamples = samples.size();
+    if (numSamples == 0)
+    {
+        return;
+    }
+
+    // every sample's length, once
+    std::vector<float> lenSq(numSamples);
+    kernels.normSq(samples.x.data(), samples.y.data(), samples.z.data(), numSamples, lenSq.data());
+
+    const float* x = samples.x.data();
+    const float* y = samples.y.data();
+    const float* z = samples.z.data();
+    for (size_t begin = 0; begin < numSamples; begin += blockSize)
+    {
+        size_t end = std::min(begin + blockSize, numSamples);
+        for (size_t lagIndex = 0; lagIndex < numLags; lagIndex++)
+        {
+            size_t lag = size_t(std::max(0, lags[lagIndex]));
+            float* row = result + lagIndex * numSamples;
+
+            // the samples with nothing that far back
+            size_t first = std::min(std::max(begin, lag), end);
+            std::fill(row + begin, row + first, 0.0f);
+            if (first < end)
+            {
+                kernels.dotNorm(x + first, y + first, z + first, &lenSq[first],
+                                x + first - lag, y + first - lag, z + first - lag, &lenSq[first - lag],
+                                end - first, minLenThresh, row + first);
+            }
+        }
+    }
+}
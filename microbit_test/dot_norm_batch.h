@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Vector3.h"
+
+#include <cstddef>
+#include <vector>
+
+// Batch versions of the float dotNorm(a, b, minLenThresh) from Vector3.h, for host-side
+// analysis over whole captures. Inputs are in columns (all the x's, then all the y's, ...),
+// and the results match the scalar dotNorm() bit for bit, whichever implementation runs:
+// they use the same fast_inv_sqrt() (magic constant and one Newton step), with the sums
+// done in the same order.
+//
+// On x86 the SSE4.1 or AVX2 version gets picked at run time, depending on the CPU; other
+// hosts get the portable one.
+
+// Vectors stored as columns
+struct VectorColumns
+{
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+
+    VectorColumns() = default;
+    VectorColumns(const byteVector3* samples, size_t numSamples);
+
+    size_t size() const { return x.size(); }
+};
+
+enum DotNormImpl
+{
+    DOT_NORM_SCALAR,
+    DOT_NORM_SSE41,
+    DOT_NORM_AVX2,
+    NUM_DOT_NORM_IMPLS
+};
+
+bool isDotNormImplSupported(DotNormImpl impl);
+DotNormImpl getBestDotNormImpl();
+const char* getDotNormImplName(DotNormImpl impl);
+
+// result[i] = dotNorm(a[i], b[i], minLenThresh)
+void dotNormBatch(const VectorColumns& a, const VectorColumns& b, float minLenThresh, float* result,
+                  DotNormImpl impl = getBestDotNormImpl());
+
+// Lag correlation: result[lagIndex * numSamples + t] = dotNorm(samples[t], samples[t - lags[lagIndex]])
+// for every sample and lag, in one pass over the samples (each sample's length is only
+// worked out once). Where t - lag is before the start, the result is 0.
+void lagDotNorm(const VectorColumns& samples, const int* lags, size_t numLags, float minLenThresh, float* result,
+                DotNormImpl impl = getBestDotNormImpl());
@@ -0,0 +1,290 @@
+#include "EventHandlerTable.h"
+#include "heap_counter.h"
+
+#include "catch.hpp"
+
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <utility>
+#include <vector>
+
+// See catch tutorial: https://github.com/philsquared/Catch/blob/master/docs/tutorial.md
+
+//
+// eventHandlerTable tests
+//
+TEST_CASE("eventHandlerTable dispatch")
+{
+    EventHandlerTable<> table;
+    int lastCalled = 0;
+    int lastValue = -1;
+
+    REQUIRE(table.set(1, 2, std::function<void()>([&] { lastCalled = 12; })));
+    REQUIRE(table.set(3, 4, std::function<void(int)>([&](int value) { lastCalled = 34; lastValue = value; })));
+    REQUIRE(table.set(1, 1, std::function<void()>([&] { lastCalled = 11; })));
+    REQUIRE(table.size() == 3);
+    REQUIRE(table.contains(1, 2));
+    REQUIRE(!table.contains(2, 1));
+
+    REQUIRE(table.dispatch(1, 2));
+    REQUIRE(lastCalled == 12);
+    REQUIRE(table.dispatch(1, 1));
+    REQUIRE(lastCalled == 11);
+    REQUIRE(table.dispatch(3, 4));
+    REQUIRE(lastCalled == 34);
+    REQUIRE(lastValue == 4);
+
+    lastCalled = 0;
+    REQUIRE(!table.dispatch(1, 3));
+    REQUIRE(!table.dispatch(2, 2));
+    REQUIRE(lastCalled == 0);
+
+    // one handler per pair: the new one replaces the old one
+    REQUIRE(!table.set(1, 2, std::function<void()>([&] { lastCalled = 120; })));
+    REQUIRE(table.size() == 3);
+    table.dispatch(1, 2);
+    REQUIRE(lastCalled == 120);
+}
+
+TEST_CASE("eventHandlerTable any value")
+{
+    const int anyValue = 0;
+    EventHandlerTable<> table(anyValue);
+    int lastValue = -1;
+    int numSpecific = 0;
+    table.set(7, anyValue, std::function<void(int)>([&](int value) { lastValue = value; }));
+    table.set(7, 3, std::function<void()>([&] { numSpecific++; }));
+
+    REQUIRE(table.dispatch(7, 5));
+    REQUIRE(lastValue == 5); // the real value, not anyValue
+    REQUIRE(table.dispatch(7, 3));
+    REQUIRE(numSpecific == 1);
+    REQUIRE(lastValue == 5);
+    REQUIRE(!table.dispatch(8, 5));
+}
+
+TEST_CASE("eventHandlerTable many handlers")
+{
+    EventHandlerTable<> table;
+    std::vector<int> counts(200);
+    for (int index = 0; index < 200; index++)
+    {
+        table.set(index % 5, index, std::function<void(int)>([&counts, index](int) { counts[index]++; }));
+    }
+    REQUIRE(table.size() == 200);
+    REQUIRE(table.getNumSlots() == 512); // under 3/4 full
+    for (int index = 0; index < 200; index++)
+    {
+        REQUIRE(table.dispatch(index % 5, index));
+        REQUIRE(counts[index] == 1);
+    }
+}
+
+TEST_CASE("eventHandler doesn't wrap")
+{
+    // Handlers made from small lambdas or plain functions fit in std::function's own
+    // storage, so once the table has its slots, registering one allocates nothing
+    EventHandlerTable<> table;
+    int count = 0;
+    std::function<void()> action([&count] { count++; });
+    table.set(9, 9, action);
+
+    heapCounter.reset();
+    table.set(1, 1, action);
+    table.set(1, 2, std::function<void(int)>([&count](int value) { count += value; }));
+    size_t numAllocations = heapCounter.numAllocations;
+    REQUIRE(numAllocations == 0);
+
+    table.dispatch(1, 1);
+    table.dispatch(1, 2);
+    REQUIRE(count == 3);
+}
+
+TEST_CASE("eventHandlerTable set from a handler")
+{
+    // A handler that registers another one while it runs, just as the table fills up a
+    // chunk of handlers (the inline one, then the first two on the heap), and replaces itself
+    for (int numBefore : { 3, 7, 15 })
+    {
+        EventHandlerTable<> table;
+        int count = 0;
+        for (int index = 0; index < numBefore; index++)
+        {
+            table.set(1, index, std::function<void()>([&count] { count++; }));
+        }
+        std::vector<int> captured(16, 5);
+        table.set(2, 0, std::function<void()>([&table, &count, captured] {
+            table.set(3, 1, std::function<void()>([&count] { count += 100; }));
+            table.set(2, 0, std::function<void()>([] {})); // (and replaces itself)
+            count += captured[15];
+        }));
+        REQUIRE(table.size() == size_t(numBefore + 1));
+
+        REQUIRE(table.dispatch(2, 0));
+        REQUIRE(count == 5);
+        REQUIRE(table.size() == size_t(numBefore + 2));
+        REQUIRE(table.dispatch(3, 1));
+        REQUIRE(count == 105);
+        REQUIRE(table.dispatch(1, 0));
+        REQUIRE(count == 106);
+    }
+}
+
+TEST_CASE("eventHandlerTable replaced while running")
+{
+    // A handler that replaces itself, with its captures inside the std::function (so
+    // anything moving or destroying it would show), and then dispatches another event
+    EventHandlerTable<> table;
+    int count = 0;
+    int* counter = &count;
+    int add = 7;
+    table.set(1, 1, std::function<void()>([&count] { count += 1000; }));
+    table.set(1, 0, std::function<void()>([&table, counter, add] {
+        table.set(1, 0, std::function<void()>([counter] { *counter += 1; }));
+        table.set(1, 1, std::function<void()>([counter] { *counter += 10; }));
+        table.dispatch(1, 1); // (the new one)
+        *counter += add;
+    }));
+
+    REQUIRE(table.dispatch(1, 0));
+    REQUIRE(count == 17);
+    REQUIRE(table.dispatch(1, 0));
+    REQUIRE(count == 18);
+    REQUIRE(table.size() == 2);
+
+    // the two that got replaced make room for the next two
+    heapCounter.reset();
+    table.set(2, 0, std::function<void()>([counter] { *counter += 100; }));
+    table.set(2, 1, std::function<void()>([counter] { *counter += 100; }));
+    size_t numAllocations = heapCounter.numAllocations;
+    REQUIRE(numAllocations == 0); // (still all inline)
+    REQUIRE(table.dispatch(2, 1));
+    REQUIRE(count == 118);
+}
+
+TEST_CASE("eventHandlerTable dispatch doesn't allocate")
+{
+    // however big the closures are
+    EventHandlerTable<> table;
+    int count = 0;
+    std::vector<int> values(8, 1);
+    for (int index = 0; index < 20; index++)
+    {
+        table.set(1, index, std::function<void(int)>([&count, values](int value) { count += values[7] * value; }));
+    }
+
+    heapCounter.reset();
+    for (int index = 0; index < 20; index++)
+    {
+        table.dispatch(1, index);
+    }
+    size_t numAllocations = heapCounter.numAllocations;
+    REQUIRE(numAllocations == 0);
+    REQUIRE(count == 190);
+}
+
+//
+// benchmarks (hidden: run with microbit_test "[benchmark]")
+//
+
+struct BenchmarkEvent
+{
+    int source;
+    int value;
+};
+
+// The way the TouchDevelop runtime used to do it: a map, with each handler wrapped in
+// another std::function that takes the event
+static std::map<std::pair<int, int>, std::function<void(BenchmarkEvent)>> benchmarkHandlersMap;
+
+static void registerMapHandler(std::pair<int, int> k, std::function<void(int)> f)
+{
+    benchmarkHandlersMap[k] = [f](BenchmarkEvent e) { f(e.value); };
+}
+
+static void registerMapHandler(std::pair<int, int> k, std::function<void()> f)
+{
+    benchmarkHandlersMap[k] = [f](BenchmarkEvent) { f(); };
+}
+
+static void dispatchMapEvent(BenchmarkEvent e)
+{
+    benchmarkHandlersMap[{ e.source, e.value }](e);
+}
+
+// Handlers on a few sources (like the buttons, the accelerometer and the radio), with a
+// pointer or two captured, like most script lambdas
+template <typename RegisterFn>
+static void registerBenchmarkHandlers(int numHandlers, int* counter, RegisterFn registerHandler)
+{
+    for (int index = 0; index < numHandlers; index++)
+    {
+        std::pair<int, int> k(1 + index % 4, 1 + index);
+        if (index % 2)
+        {
+            registerHandler(k, std::function<void()>([counter] { (*counter)++; }));
+        }
+        else
+        {
+            registerHandler(k, std::function<void(int)>([counter](int value) { *counter += value; }));
+        }
+    }
+}
+
+TEST_CASE("eventHandlerTable benchmark", "[.][benchmark]")
+{
+    using clock = std::chrono::steady_clock;
+    const int numEvents = 10000000;
+
+    for (int numHandlers : { 10, 25, 50, 100 })
+    {
+        std::vector<BenchmarkEvent> events(1024);
+        uint32_t random = 1;
+        for (auto& e : events)
+        {
+            random = random * 1664525u + 1013904223u;
+            int index = (random >> 16) % numHandlers;
+            e = { 1 + index % 4, 1 + index };
+        }
+        int counter = 0;
+
+        // the map
+        benchmarkHandlersMap.clear();
+        heapCounter.reset();
+        size_t startBytes = heapCounter.bytes;
+        registerBenchmarkHandlers(numHandlers, &counter, [](std::pair<int, int> k, auto f) { registerMapHandler(k, f); });
+        size_t mapAllocations = heapCounter.numAllocations;
+        size_t mapBytes = heapCounter.bytes - startBytes;
+
+        auto start = clock::now();
+        for (int index = 0; index < numEvents; index++)
+        {
+            dispatchMapEvent(events[index & 1023]);
+        }
+        double mapSeconds = std::chrono::duration<double>(clock::now() - start).count();
+
+        // the table
+        EventHandlerTable<> table;
+        heapCounter.reset();
+        startBytes = heapCounter.bytes;
+        registerBenchmarkHandlers(numHandlers, &counter, [&table](std::pair<int, int> k, auto f) { table.set(k.first, k.second, std::move(f)); });
+        size_t tableAllocations = heapCounter.numAllocations;
+        size_t tableBytes = heapCounter.bytes - startBytes + sizeof(table); // (and its inline entries)
+
+        start = clock::now();
+        for (int index = 0; index < numEvents; index++)
+        {
+            const auto& e = events[index & 1023];
+            table.dispatch(e.source, e.value);
+        }
+        double tableSeconds = std::chrono::duration<double>(clock::now() - start).count();
+
+        std::cout << numHandlers << " handlers: map " << (mapSeconds * 1e9 / numEvents) << " ns/event, "
+                  << mapAllocations << " allocations, " << mapBytes << " bytes; table "
+                  << (tableSeconds * 1e9 / numEvents) << " ns/event, " << tableAllocations << " allocations, "
+                  << tableBytes << " bytes (" << counter << ")" << std::endl;
+    }
+    benchmarkHandlersMap.clear();
+}
@@ -52,6 +52,21 @@ TEST_CASE("fast_sqrt test")
     }
 }
 
+TEST_CASE("isqrt test")
+{
+    // rounded down: r * r <= v < (r + 1) * (r + 1)
+    for (uint32_t v = 0; v < 1000000; v++)
+    {
+        uint64_t r = isqrt(v);
+        REQUIRE((r * r <= v && (r + 1) * (r + 1) > v));
+    }
+    for (uint32_t v : { 0xfffffffeu, 0xffffffffu, 0xfffe0001u, 0xfffe0000u, 0x80000000u, 0x40000000u })
+    {
+        uint64_t r = isqrt(v);
+        REQUIRE((r * r <= v && (r + 1) * (r + 1) > v));
+    }
+}
+
 TEST_CASE("timing tests")
 {
 
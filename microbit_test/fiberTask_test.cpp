@@ -0,0 +1,249 @@
+#include "FiberTask.h"
+#include "fiber_sim.h"
+#include "heap_counter.h"
+
+#include "catch.hpp"
+
+#include <iostream>
+#include <memory>
+#include <vector>
+
+// See catch tutorial: https://github.com/philsquared/Catch/blob/master/docs/tutorial.md
+
+//
+// fiberTask tests
+//
+TEST_CASE("fiberTask runs its callable")
+{
+    int count = 0;
+    int step = 2;
+    heapCounter.reset();
+    {
+        FiberTask task([&count, &step] { count += step; });
+        task.run(0);
+        task.run(0);
+    }
+    {
+        // (a std::function holding a small lambda fits too)
+        FiberTask task(std::function<void()>([&count] { count++; }));
+        task.run(0);
+    }
+    size_t numAllocations = heapCounter.numAllocations;
+    REQUIRE(numAllocations == 0);
+    REQUIRE(count == 5);
+}
+
+TEST_CASE("fiberTask destroys its callable")
+{
+    auto shared = std::make_shared<int>(0);
+    {
+        FiberTask task([shared] { (*shared)++; });
+        task.run(0);
+        REQUIRE(shared.use_count() == 2);
+    }
+    REQUIRE(shared.use_count() == 1);
+    REQUIRE(*shared == 1);
+
+    // too big to fit: it goes in a std::function
+    struct Big
+    {
+        std::shared_ptr<int> p;
+        int padding[16];
+        void operator()() { (*p)++; }
+    };
+    REQUIRE(!FiberTask::fitsInline<Big>());
+    {
+        FiberTask task(Big{ shared, {} });
+        task.run(0);
+        REQUIRE(shared.use_count() == 2);
+    }
+    REQUIRE(shared.use_count() == 1);
+    REQUIRE(*shared == 2);
+}
+
+TEST_CASE("fiberTask schedule")
+{
+    REQUIRE(alignToTick(20, 6) == 24);
+    REQUIRE(alignToTick(24, 6) == 24);
+    REQUIRE(alignToTick(1, 6) == 6);
+
+    FiberTask task([] {}, 24);
+    REQUIRE(task.isPeriodic());
+    task.run(0);
+    REQUIRE(task.getSleepTime(3) == 21);
+    task.run(24);
+    REQUIRE(task.getSleepTime(30) == 18); // (on the schedule, however long the run took)
+    task.run(48);
+    REQUIRE(task.getSleepTime(70) == 2);
+
+    // overrun: skip to the run that's due, rather than running again and again
+    REQUIRE(task.getSleepTime(100) == 0);
+    REQUIRE(task.getNumSkipped() == 1);
+    task.run(100);
+    REQUIRE(task.getSleepTime(100) == 20);
+
+    // still a tick's sleep at least, when the run's due now
+    task.run(120);
+    REQUIRE(task.getSleepTime(144, 6) == 6);
+    REQUIRE(task.getNumSkipped() == 1);
+    task.run(150);
+    REQUIRE(task.getSleepTime(150, 6) == 18);
+}
+
+TEST_CASE("fiberTaskPool falls back to the heap")
+{
+    FiberTaskPool<2> pool;
+    int count = 0;
+    heapCounter.reset();
+    FiberTask* a = pool.create([&count] { count++; });
+    FiberTask* b = pool.create([&count] { count += 10; }, 24);
+    size_t numAllocations = heapCounter.numAllocations;
+    REQUIRE(numAllocations == 0);
+    REQUIRE(pool.getNumUsed() == 2);
+
+    FiberTask* c = pool.create([&count] { count += 100; });
+    REQUIRE(pool.getNumOnHeap() == 1);
+    a->run(0);
+    b->run(0);
+    c->run(0);
+    REQUIRE(count == 111);
+
+    pool.destroy(c);
+    pool.destroy(a);
+    REQUIRE(pool.getNumUsed() == 1);
+    pool.destroy(b);
+    REQUIRE(pool.getNumUsed() == 0);
+    REQUIRE(pool.getPeakUsed() == 2);
+}
+
+//
+// fiber simulator tests
+//
+
+// The two ways of launching a fiber: the way the TouchDevelop runtime used to (a heap copy
+// of the closure to pass through create_fiber(), and for forever, a 20 ms pause after each
+// run), and with a FiberTask. Each returns how many heap allocations the launch itself made
+// (not counting the simulated fiber).
+static const uint32_t foreverPause = 20;
+
+static size_t launchWithCopy(FiberSim& sim, const std::function<void()>& f, bool forever)
+{
+    heapCounter.reset();
+    auto f_allocated = new std::function<void()>(f);
+    size_t numAllocations = heapCounter.numAllocations;
+    sim.createFiber([f_allocated, forever]() -> int32_t
+    {
+        (*f_allocated)();
+        if (!forever)
+        {
+            delete f_allocated;
+            return FiberSim::done;
+        }
+        return foreverPause;
+    });
+    return numAllocations;
+}
+
+template <size_t NumSlots>
+static size_t launchWithTask(FiberSim& sim, FiberTaskPool<NumSlots>& pool, const std::function<void()>& f, bool forever)
+{
+    heapCounter.reset();
+    FiberTask* task = pool.create(f, forever ? alignToTick(foreverPause, FiberSim::tickPeriod) : 0);
+    size_t numAllocations = heapCounter.numAllocations;
+    FiberSim* simPtr = &sim;
+    auto poolPtr = &pool;
+    sim.createFiber([simPtr, poolPtr, task]() -> int32_t
+    {
+        task->run(simPtr->systemTime());
+        if (!task->isPeriodic())
+        {
+            poolPtr->destroy(task);
+            return FiberSim::done;
+        }
+        return int32_t(task->getSleepTime(simPtr->systemTime(), FiberSim::tickPeriod));
+    });
+    return numAllocations;
+}
+
+TEST_CASE("fiberSim scheduling")
+{
+    FiberSim sim;
+    std::vector<uint32_t> times;
+    sim.createFiber([&]() -> int32_t
+    {
+        times.push_back(sim.systemTime());
+        sim.spend(7000); // (a tick goes by)
+        return times.size() < 3 ? 0 : FiberSim::done;
+    });
+    sim.runUntil(100);
+    REQUIRE(sim.getNumFibers() == 0);
+    REQUIRE(times.size() == 3);
+    REQUIRE(times[0] == 0);
+    REQUIRE(times[1] == 12); // went to sleep on the 6 ms tick, woke on the next one
+    REQUIRE(times[2] == 24);
+}
+
+struct ForeverResult
+{
+    int numRuns = 0;
+    uint32_t minPeriod = UINT32_MAX;
+    uint32_t maxPeriod = 0;
+    double meanPeriod = 0;
+};
+
+// A forever loop whose body takes bodyUs, alongside another fiber that wakes every 30 ms
+// and runs for 4 ms
+template <typename Launch>
+static ForeverResult runForever(uint32_t bodyUs, Launch launch)
+{
+    const uint32_t duration = 10000;
+    FiberSim sim;
+    std::vector<uint32_t> times;
+    launch(sim, [&] { times.push_back(sim.systemTime()); sim.spend(bodyUs); });
+    sim.createFiber([&]() -> int32_t { sim.spend(4000); return 30; });
+    sim.runUntil(duration);
+
+    ForeverResult result;
+    result.numRuns = int(times.size());
+    for (size_t index = 1; index < times.size(); index++)
+    {
+        uint32_t period = times[index] - times[index - 1];
+        result.minPeriod = std::min(result.minPeriod, period);
+        result.maxPeriod = std::max(result.maxPeriod, period);
+    }
+    result.meanPeriod = double(times.back() - times.front()) / (times.size() - 1);
+    return result;
+}
+
+TEST_CASE("fiberSim old vs new launch")
+{
+    static FiberTaskPool<4> pool;
+    FiberSim sim;
+    int count = 0;
+    std::function<void()> f([&count] { count++; });
+
+    size_t oldAllocations = launchWithCopy(sim, f, false);
+    size_t newAllocations = launchWithTask(sim, pool, f, false);
+    REQUIRE(oldAllocations == 1);
+    REQUIRE(newAllocations == 0);
+    sim.runUntil(10);
+    REQUIRE(count == 2);
+    REQUIRE(sim.getNumFibers() == 0);
+    REQUIRE(pool.getNumUsed() == 0);
+
+    for (uint32_t bodyUs : { 1000u, 8000u, 15000u })
+    {
+        auto old = runForever(bodyUs, [](FiberSim& s, std::function<void()> body) { launchWithCopy(s, body, true); });
+        auto task = runForever(bodyUs, [](FiberSim& s, std::function<void()> body) { launchWithTask(s, pool, body, true); });
+        std::cout << "forever, " << (bodyUs / 1000) << " ms body: pause " << old.numRuns << " runs, period "
+                  << old.minPeriod << "-" << old.maxPeriod << " ms (mean " << old.meanPeriod << "); scheduled "
+                  << task.numRuns << " runs, period " << task.minPeriod << "-" << task.maxPeriod << " ms (mean "
+                  << task.meanPeriod << ")" << std::endl;
+
+        // the scheduled one stays on its 24 ms ticks; the paused one stretches once the
+        // body takes a tick or more
+        REQUIRE(task.meanPeriod == Approx(24).epsilon(0.001));
+        REQUIRE(task.maxPeriod == 24);
+        REQUIRE(old.meanPeriod >= task.meanPeriod + (bodyUs >= 6000 ? 6 : 0));
+    }
+}
@@ -0,0 +1,63 @@
+#include "fiber_sim.h"
+
+#include <utility>
+
+//
+// FiberSim
+//
+
+const uint32_t FiberSim::tickPeriod;
+const int32_t FiberSim::done;
+
+void FiberSim::createFiber(Fiber fiber)
+{
+    fibers_.push_back({ std::move(fiber), 0, 0, false });
+    runQueue_.push_back(std::prev(fibers_.end()));
+}
+
+void FiberSim::runUntil(uint32_t ms)
+{
+    uint64_t endUs = uint64_t(ms) * 1000;
+    while (us_ < endUs)
+    {
+        if (runQueue_.empty())
+        {
+            us_ = uint64_t(systemTime() + tickPeriod) * 1000; // idle until the next tick
+            tick(systemTime());
+            continue;
+        }
+
+        auto entry = runQueue_.front();
+        runQueue_.pop_front();
+        int32_t sleep = entry->fiber();
+        if (sleep == done)
+        {
+            fibers_.erase(entry);
+        }
+        else
+        {
+            entry->sleeping = true;
+            entry->sleepTime = systemTime();
+            entry->wakeTime = entry->sleepTime + uint32_t(sleep);
+        }
+
+        // (the ticks that went by while it ran)
+        for (uint32_t time = lastTick_ + tickPeriod; int32_t(systemTime() - time) >= 0; time += tickPeriod)
+        {
+            tick(time);
+        }
+    }
+}
+
+void FiberSim::tick(uint32_t time)
+{
+    lastTick_ = time;
+    for (auto entry = fibers_.begin(); entry != fibers_.end(); ++entry)
+    {
+        if (entry->sleeping && int32_t(time - entry->sleepTime) > 0 && int32_t(time - entry->wakeTime) >= 0)
+        {
+            entry->sleeping = false;
+            runQueue_.push_back(entry);
+        }
+    }
+}
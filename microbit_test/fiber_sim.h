@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
+
+#ifndef FIBER_TICK_PERIOD_MS
+#define FIBER_TICK_PERIOD_MS 6 // (the DAL's, from MicroBitConfig.h)
+#endif
+
+// A simulated DAL fiber scheduler, for seeing on the host when fibers actually get to run.
+// The DAL keeps time in scheduler ticks: systemTime() only moves on when the tick
+// interrupt fires, and a sleeping fiber wakes on the first tick at or after its wake time
+// (so even a 0 ms sleep waits for the next tick). Woken fibers run one after another, in
+// the order they woke.
+//
+// A fiber here is a function that runs up to its next sleep, spending simulated CPU time
+// with spend(), and returns how long it sleeps for, or done.
+class FiberSim
+{
+public:
+    static const uint32_t tickPeriod = FIBER_TICK_PERIOD_MS;
+    static const int32_t done = -1;
+
+    using Fiber = std::function<int32_t()>;
+
+    uint32_t systemTime() const { return uint32_t(us_ / 1000) / tickPeriod * tickPeriod; }
+    uint64_t getTimeUs() const { return us_; }
+    void spend(uint32_t us) { us_ += us; }
+
+    void createFiber(Fiber fiber); // (it runs as soon as the running fiber sleeps)
+    void runUntil(uint32_t ms);
+    size_t getNumFibers() const { return fibers_.size(); }
+
+private:
+    struct Entry
+    {
+        Fiber fiber;
+        uint32_t sleepTime; // the tick it went to sleep on
+        uint32_t wakeTime;
+        bool sleeping;
+    };
+    using EntryList = std::list<Entry>;
+
+    void tick(uint32_t time);
+
+    EntryList fibers_;
+    std::deque<EntryList::iterator> runQueue_;
+    uint64_t us_ = 0;
+    uint32_t lastTick_ = 0;
+};
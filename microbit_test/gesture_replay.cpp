@@ -0,0 +1,116 @@
+#include "replay.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// Replays recorded accelerometer captures through MicroBitGestureDetector and scores the
+// detections against labels in the capture (see replay.h for the format and the rules).
+//
+// usage: gesture_replay [-t tolerance] [-e event]... [-v] [-x sample] capture...
+//   -t  how many samples a detection can be off from its label (default 5)
+//   -e  an event to score (default: Tap); may be given more than once
+//   -v  print every detection and miss
+//   -x  print the samples around this one and what fired on each (resumed from a
+//       checkpoint, so it's cheap to poke around a long capture)
+
+static const size_t checkpointInterval = 1000;
+static const int traceRadius = 20;
+
+static void printScore(const char* name, const char* eventName, const Score& score, size_t numSamples)
+{
+    float rate = score.labelled > 0 ? 100.0f * score.hits / score.labelled : 0.0f;
+    float minutes = numSamples * replaySamplePeriod / 60;
+    printf("%-32s %-10s %6d %6d %7.1f%% %6d %8.2f\n", name, eventName, score.labelled, score.hits, rate, score.falsePositives,
+           minutes > 0 ? score.falsePositives / minutes : 0.0f);
+}
+
+int main(int argc, char* argv[])
+{
+    int tolerance = 5;
+    bool verbose = false;
+    long traceSample = -1;
+    std::vector<int> events;
+    std::vector<const char*> filenames;
+
+    for (int argIndex = 1; argIndex < argc; argIndex++)
+    {
+        const char* arg = argv[argIndex];
+        if (strcmp(arg, "-t") == 0 && argIndex + 1 < argc)
+        {
+            tolerance = atoi(argv[++argIndex]);
+        }
+        else if (strcmp(arg, "-e") == 0 && argIndex + 1 < argc)
+        {
+            int event = parseEvent(argv[++argIndex]);
+            if (event <= 0)
+            {
+                fprintf(stderr, "Unknown event %s\n", argv[argIndex]);
+                return 1;
+            }
+            events.push_back(event);
+        }
+        else if (strcmp(arg, "-v") == 0)
+        {
+            verbose = true;
+        }
+        else if (strcmp(arg, "-x") == 0 && argIndex + 1 < argc)
+        {
+            traceSample = atol(argv[++argIndex]);
+        }
+        else
+        {
+            filenames.push_back(arg);
+        }
+    }
+
+    if (filenames.empty())
+    {
+        fprintf(stderr, "usage: gesture_replay [-t tolerance] [-e event]... [-v] [-x sample] capture...\n");
+        return 1;
+    }
+    if (events.empty())
+    {
+        events.push_back(MICROBIT_ACCELEROMETER_TAP);
+    }
+
+    printf("%-32s %-10s %6s %6s %8s %6s %8s\n", "capture", "event", "labels", "hits", "rate", "false", "false/min");
+
+    MicroBitGestureDetector prototype;
+    std::vector<Score> totals(events.size());
+    size_t totalSamples = 0;
+    for (auto filename : filenames)
+    {
+        Capture capture;
+        if (!capture.load(filename))
+        {
+            return 1;
+        }
+
+        DetectorCheckpoints checkpoints;
+        auto onsets = runDetector(prototype, capture, traceSample >= 0 ? checkpointInterval : 0, checkpoints);
+        if (traceSample >= 0)
+        {
+            size_t begin = size_t(std::max(0L, traceSample - traceRadius));
+            traceDetector(prototype, capture, checkpointInterval, checkpoints, begin, size_t(traceSample + traceRadius + 1), stdout);
+        }
+        totalSamples += capture.size();
+        for (size_t eventIndex = 0; eventIndex < events.size(); eventIndex++)
+        {
+            Score score = scoreEvent(capture, onsets, events[eventIndex], tolerance, verbose ? stdout : nullptr);
+            printScore(filename, getGestureName(events[eventIndex]), score, capture.size());
+            totals[eventIndex] += score;
+        }
+    }
+
+    if (filenames.size() > 1)
+    {
+        for (size_t eventIndex = 0; eventIndex < events.size(); eventIndex++)
+        {
+            printScore("total", getGestureName(events[eventIndex]), totals[eventIndex], totalSamples);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,362 @@
+#include "replay.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Grid search over the detector's thresholds. Every combination of the given parameter
+// values is run over a labelled corpus (see replay.h for the capture format), and scored for
+// precision, recall and latency. The configurations that nothing else beats on all three
+// (the Pareto frontier) are marked with a '*'.
+//
+// The corpus is read once and shared by all the workers; each configuration clones a
+// prototype detector with its thresholds set.
+//
+// usage: gesture_sweep [-p name=values]... [-e event]... [-t tolerance] [-j threads] capture...
+//   -p  values for a parameter, either a list (200,250,300) or a range (start:stop:step);
+//       parameters that aren't given keep their default
+//   -e  an event to score (default: Tap); may be given more than once
+//   -t  how many samples a detection can be off from its label (default 5)
+//   -j  number of worker threads (default: one per core)
+//
+// The window sizes are template parameters, so sweeping them means rebuilding with
+// different values in GestureFeatures.h.
+
+struct Parameter
+{
+    const char* name;
+    const char* description;
+    std::vector<float> values;
+};
+
+enum ParameterIndex
+{
+    SHAKE_THRESHOLD,
+    SHAKE_COUNT,
+    SHAKE_LOW_COUNT,
+    TAP_THRESHOLD,
+    TAP_COUNT,
+    TAP_GATE,
+    NUM_PARAMETERS
+};
+
+static std::vector<Parameter> getDefaultParameters()
+{
+    MicroBitGestureDetector detector;
+    auto& shake = detector.getGesture<ShakeGesture>();
+    auto& tap = detector.getGesture<TapGesture>();
+    return {
+        { "shakeThreshold", "shake prediction threshold", { float(shake.getThreshold()) } },
+        { "shakeCount", "samples over threshold to start a shake", { float(shake.getEventCount()) } },
+        { "shakeLowCount", "samples under threshold to end a shake", { float(shake.getLowCount()) } },
+        { "tapThreshold", "tap prediction threshold", { float(tap.getThreshold()) } },
+        { "tapCount", "samples over threshold to fire a tap", { float(tap.getEventCount()) } },
+        { "tapGate", "max quiet-window variance before a tap", { tap.getGateThreshold() } },
+    };
+}
+
+static void applyParameters(MicroBitGestureDetector& detector, const std::vector<float>& config)
+{
+    detector.getGesture<ShakeGesture>().setThresholds(predictionValue_t(config[SHAKE_THRESHOLD]), int(config[SHAKE_COUNT]), int(config[SHAKE_LOW_COUNT]));
+    detector.getGesture<TapGesture>().setThresholds(int(config[TAP_THRESHOLD]), int(config[TAP_COUNT]), config[TAP_GATE]);
+}
+
+static bool parseValues(const char* str, std::vector<float>& values)
+{
+    values.clear();
+    float start, stop, step;
+    if (sscanf(str, "%f:%f:%f", &start, &stop, &step) == 3)
+    {
+        if (step <= 0)
+        {
+            return false;
+        }
+        for (float val = start; val <= stop + step * 1e-3f; val += step)
+        {
+            values.push_back(val);
+        }
+        return !values.empty();
+    }
+
+    while (*str)
+    {
+        char* end = nullptr;
+        values.push_back(strtof(str, &end));
+        if (end == str || (*end != ',' && *end != '\0'))
+        {
+            return false;
+        }
+        str = *end == ',' ? end + 1 : end;
+    }
+    return !values.empty();
+}
+
+// Runs numTasks tasks over numThreads threads. Each thread starts with its own share of the
+// tasks and, when it runs out, steals from the others (from the other end of their queues,
+// so the owners and the thieves don't fight over the same tasks).
+class WorkStealingPool
+{
+public:
+    void run(size_t numTasks, int numThreads, const std::function<void(size_t)>& task)
+    {
+        std::vector<Queue> queues(numThreads);
+        for (size_t index = 0; index < numTasks; index++)
+        {
+            queues[index % numThreads].tasks.push_back(index);
+        }
+
+        std::vector<std::thread> threads;
+        for (int threadIndex = 0; threadIndex < numThreads; threadIndex++)
+        {
+            threads.emplace_back([&queues, &task, threadIndex, numThreads]()
+            {
+                size_t taskIndex;
+                while (popOwn(queues[threadIndex], taskIndex) || steal(queues, threadIndex, numThreads, taskIndex))
+                {
+                    task(taskIndex);
+                }
+            });
+        }
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+    }
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<size_t> tasks;
+    };
+
+    static bool popOwn(Queue& queue, size_t& taskIndex)
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty())
+        {
+            return false;
+        }
+        taskIndex = queue.tasks.back();
+        queue.tasks.pop_back();
+        return true;
+    }
+
+    static bool steal(std::vector<Queue>& queues, int thief, int numThreads, size_t& taskIndex)
+    {
+        // no new tasks ever get added, so if every queue is empty we're done
+        for (int offset = 1; offset < numThreads; offset++)
+        {
+            Queue& victim = queues[(thief + offset) % numThreads];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty())
+            {
+                taskIndex = victim.tasks.front();
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+struct ConfigResult
+{
+    std::vector<float> config;
+    std::vector<Score> scores; // one per scored event
+    Score total;
+    bool onFrontier = true;
+};
+
+static bool dominates(const Score& a, const Score& b)
+{
+    bool noWorse = a.precision() >= b.precision() && a.recall() >= b.recall() && a.meanLatency() <= b.meanLatency();
+    bool better = a.precision() > b.precision() || a.recall() > b.recall() || a.meanLatency() < b.meanLatency();
+    return noWorse && better;
+}
+
+int main(int argc, char* argv[])
+{
+    auto parameters = getDefaultParameters();
+    int tolerance = 5;
+    int numThreads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<int> events;
+    std::vector<const char*> filenames;
+
+    for (int argIndex = 1; argIndex < argc; argIndex++)
+    {
+        const char* arg = argv[argIndex];
+        if (strcmp(arg, "-p") == 0 && argIndex + 1 < argc)
+        {
+            const char* spec = argv[++argIndex];
+            const char* equals = strchr(spec, '=');
+            auto param = std::find_if(parameters.begin(), parameters.end(), [&](const Parameter& p)
+            {
+                return equals && strlen(p.name) == size_t(equals - spec) && strncmp(p.name, spec, equals - spec) == 0;
+            });
+            if (param == parameters.end() || !parseValues(equals + 1, param->values))
+            {
+                fprintf(stderr, "Bad parameter %s. Parameters are:\n", spec);
+                for (const auto& p : parameters)
+                {
+                    fprintf(stderr, "  %-16s %s (default %g)\n", p.name, p.description, p.values[0]);
+                }
+                return 1;
+            }
+        }
+        else if (strcmp(arg, "-e") == 0 && argIndex + 1 < argc)
+        {
+            int event = parseEvent(argv[++argIndex]);
+            if (event <= 0)
+            {
+                fprintf(stderr, "Unknown event %s\n", argv[argIndex]);
+                return 1;
+            }
+            events.push_back(event);
+        }
+        else if (strcmp(arg, "-t") == 0 && argIndex + 1 < argc)
+        {
+            tolerance = atoi(argv[++argIndex]);
+        }
+        else if (strcmp(arg, "-j") == 0 && argIndex + 1 < argc)
+        {
+            numThreads = std::max(1, atoi(argv[++argIndex]));
+        }
+        else
+        {
+            filenames.push_back(arg);
+        }
+    }
+
+    if (filenames.empty())
+    {
+        fprintf(stderr, "usage: gesture_sweep [-p name=values]... [-e event]... [-t tolerance] [-j threads] capture...\n");
+        return 1;
+    }
+    if (events.empty())
+    {
+        events.push_back(MICROBIT_ACCELEROMETER_TAP);
+    }
+
+    std::vector<Capture> corpus(filenames.size());
+    for (size_t fileIndex = 0; fileIndex < filenames.size(); fileIndex++)
+    {
+        if (!corpus[fileIndex].load(filenames[fileIndex]))
+        {
+            return 1;
+        }
+    }
+
+    // Enumerate the grid
+    size_t numConfigs = 1;
+    for (const auto& param : parameters)
+    {
+        numConfigs *= param.values.size();
+    }
+    std::vector<ConfigResult> results(numConfigs);
+    for (size_t configIndex = 0; configIndex < numConfigs; configIndex++)
+    {
+        size_t rest = configIndex;
+        for (const auto& param : parameters)
+        {
+            results[configIndex].config.push_back(param.values[rest % param.values.size()]);
+            rest /= param.values.size();
+        }
+    }
+
+    const MicroBitGestureDetector prototype;
+    std::atomic<size_t> numDone(0);
+    WorkStealingPool pool;
+    pool.run(numConfigs, numThreads, [&](size_t configIndex)
+    {
+        ConfigResult& result = results[configIndex];
+        MicroBitGestureDetector detector(prototype);
+        applyParameters(detector, result.config);
+
+        result.scores.resize(events.size());
+        for (const auto& capture : corpus)
+        {
+            auto onsets = runDetector(detector, capture);
+            for (size_t eventIndex = 0; eventIndex < events.size(); eventIndex++)
+            {
+                result.scores[eventIndex] += scoreEvent(capture, onsets, events[eventIndex], tolerance);
+            }
+        }
+        for (const auto& score : result.scores)
+        {
+            result.total += score;
+        }
+
+        size_t done = ++numDone;
+        if (done % 100 == 0)
+        {
+            fprintf(stderr, "\r%zu/%zu", done, numConfigs);
+        }
+    });
+    if (numConfigs >= 100)
+    {
+        fprintf(stderr, "\n");
+    }
+
+    for (auto& result : results)
+    {
+        for (const auto& other : results)
+        {
+            if (dominates(other.total, result.total))
+            {
+                result.onFrontier = false;
+                break;
+            }
+        }
+    }
+
+    // Best recall first, then best precision, then lowest latency
+    std::stable_sort(results.begin(), results.end(), [](const ConfigResult& a, const ConfigResult& b)
+    {
+        if (a.total.recall() != b.total.recall())
+        {
+            return a.total.recall() > b.total.recall();
+        }
+        if (a.total.precision() != b.total.precision())
+        {
+            return a.total.precision() > b.total.precision();
+        }
+        return a.total.meanLatency() < b.total.meanLatency();
+    });
+
+    printf("  ");
+    for (const auto& param : parameters)
+    {
+        printf(" %14s", param.name);
+    }
+    for (auto event : events)
+    {
+        printf("  %10s prec recall latency", getGestureName(event));
+    }
+    printf("\n");
+
+    for (const auto& result : results)
+    {
+        printf("%c ", result.onFrontier ? '*' : ' ');
+        for (auto val : result.config)
+        {
+            printf(" %14g", val);
+        }
+        for (const auto& score : result.scores)
+        {
+            printf("  %10s %4.2f %6.2f %5.0fms", "", score.precision(), score.recall(), score.meanLatency() * replaySamplePeriod * 1000);
+        }
+        printf("\n");
+    }
+
+    size_t numOnFrontier = std::count_if(results.begin(), results.end(), [](const ConfigResult& r) { return r.onFrontier; });
+    printf("\n%zu configurations, %zu on the Pareto frontier (*), %d threads\n", numConfigs, numOnFrontier, numThreads);
+    return 0;
+}
@@ -0,0 +1,297 @@
+#include "Gestures.h"
+#include "MicroBitGestureDetector.h"
+
+#include "catch.hpp"
+
+#include <vector>
+
+// See catch tutorial: https://github.com/philsquared/Catch/blob/master/docs/tutorial.md
+
+//
+// gesture framework tests
+//
+
+// A gesture that fires whenever it's told to
+template <int Event, int Priority, uint16_t Suppresses = 0>
+class FakeGesture
+{
+public:
+    static constexpr unsigned features = 0;
+    static constexpr uint16_t events = eventBit(Event);
+    static constexpr uint16_t suppresses = Suppresses;
+    static constexpr int priority = Priority;
+
+    int update(const GestureFeatures&, uint16_t firedEvents)
+    {
+        numUpdates++;
+        lastFiredEvents = firedEvents;
+        return fire ? Event : 0;
+    }
+    void reset() { numResets++; }
+    bool isActive() { return fire; }
+
+    bool fire = false;
+    int numUpdates = 0;
+    int numResets = 0;
+    uint16_t lastFiredEvents = 0;
+};
+
+using FakeTap = FakeGesture<MICROBIT_ACCELEROMETER_TAP, 30, eventBit(MICROBIT_ACCELEROMETER_SHAKE)>;
+using FakeDoubleTap = FakeGesture<MICROBIT_ACCELEROMETER_DOUBLE_TAP, 40>;
+using FakeShake = FakeGesture<MICROBIT_ACCELEROMETER_SHAKE, 20, eventBit(MICROBIT_ACCELEROMETER_TAP)>;
+using FakeFace = FakeGesture<MICROBIT_ACCELEROMETER_FACE_UP, 10>;
+
+TEST_CASE("gestureSet priority and suppression")
+{
+    GestureSet<FakeTap, FakeDoubleTap, FakeShake, FakeFace> gestures;
+    GestureFeatures features;
+
+    auto result = gestures.update(features);
+    REQUIRE(result.event == 0);
+    REQUIRE(result.firedEvents == 0);
+
+    // lower-priority gestures still report their events
+    gestures.get<FakeShake>().fire = true;
+    gestures.get<FakeFace>().fire = true;
+    result = gestures.update(features);
+    REQUIRE(result.event == MICROBIT_ACCELEROMETER_SHAKE);
+    REQUIRE(result.firedEvents == (eventBit(MICROBIT_ACCELEROMETER_SHAKE) | eventBit(MICROBIT_ACCELEROMETER_FACE_UP)));
+    REQUIRE(gestures.get<FakeTap>().numResets == 1); // shake cancels tap
+
+    // tap suppresses shake, which then isn't even updated
+    gestures.get<FakeTap>().fire = true;
+    int shakeUpdates = gestures.get<FakeShake>().numUpdates;
+    result = gestures.update(features);
+    REQUIRE(result.event == MICROBIT_ACCELEROMETER_TAP);
+    REQUIRE(gestures.get<FakeShake>().numUpdates == shakeUpdates);
+    REQUIRE(gestures.get<FakeShake>().numResets == 1);
+
+    // later gestures see what earlier ones fired
+    REQUIRE(gestures.get<FakeDoubleTap>().lastFiredEvents == eventBit(MICROBIT_ACCELEROMETER_TAP));
+    gestures.get<FakeDoubleTap>().fire = true;
+    result = gestures.update(features);
+    REQUIRE(result.event == MICROBIT_ACCELEROMETER_DOUBLE_TAP);
+}
+
+TEST_CASE("gestureSet topEvent")
+{
+    using Set = GestureSet<FakeTap, FakeDoubleTap, FakeShake, FakeFace>;
+    REQUIRE(Set::topEvent(0) == 0);
+    REQUIRE(Set::topEvent(eventBit(MICROBIT_ACCELEROMETER_FACE_UP)) == MICROBIT_ACCELEROMETER_FACE_UP);
+    REQUIRE(Set::topEvent(eventBit(MICROBIT_ACCELEROMETER_FACE_UP) | eventBit(MICROBIT_ACCELEROMETER_SHAKE)) == MICROBIT_ACCELEROMETER_SHAKE);
+    REQUIRE(Set::topEvent(eventBit(MICROBIT_ACCELEROMETER_TAP) | eventBit(MICROBIT_ACCELEROMETER_DOUBLE_TAP)) == MICROBIT_ACCELEROMETER_DOUBLE_TAP);
+}
+
+TEST_CASE("gestureSet required features")
+{
+    REQUIRE((GestureSet<TapGesture>::requiredFeatures == (GESTURE_FEATURE_VARIANCE | GESTURE_FEATURE_IMPULSE)));
+    REQUIRE((GestureSet<FaceGesture, TiltGesture>::requiredFeatures == GESTURE_FEATURE_GRAVITY));
+    REQUIRE((GestureSet<DoubleTapGesture, ShakeGesture>::requiredFeatures == GESTURE_FEATURE_DOT));
+}
+
+TEST_CASE("postureFilter test")
+{
+    PostureFilter filter(3);
+
+    REQUIRE(filter.filterPosture(MICROBIT_ACCELEROMETER_FACE_UP) == 0);
+    REQUIRE(filter.filterPosture(MICROBIT_ACCELEROMETER_FACE_UP) == 0);
+    REQUIRE(filter.filterPosture(MICROBIT_ACCELEROMETER_FACE_UP) == MICROBIT_ACCELEROMETER_FACE_UP);
+    REQUIRE(filter.filterPosture(MICROBIT_ACCELEROMETER_FACE_UP) == 0); // only reported on change
+    REQUIRE(filter.currentPosture() == MICROBIT_ACCELEROMETER_FACE_UP);
+
+    // a brief wobble doesn't count
+    REQUIRE(filter.filterPosture(MICROBIT_ACCELEROMETER_FACE_DOWN) == 0);
+    REQUIRE(filter.filterPosture(MICROBIT_ACCELEROMETER_FACE_UP) == 0);
+    REQUIRE(filter.currentPosture() == MICROBIT_ACCELEROMETER_FACE_UP);
+
+    for (int index = 0; index < 2; index++)
+    {
+        REQUIRE(filter.filterPosture(MICROBIT_ACCELEROMETER_FACE_DOWN) == 0);
+    }
+    REQUIRE(filter.filterPosture(MICROBIT_ACCELEROMETER_FACE_DOWN) == MICROBIT_ACCELEROMETER_FACE_DOWN);
+}
+
+TEST_CASE("doubleTap window test")
+{
+    DoubleTapGesture doubleTap;
+    GestureFeatures features;
+    const uint16_t tap = eventBit(MICROBIT_ACCELEROMETER_TAP);
+
+    doubleTap.setWindow(2, 4);
+    REQUIRE(doubleTap.getMinGap() == 2);
+    REQUIRE(doubleTap.getMaxGap() == 4);
+
+    // taps too close together don't count (the second one doesn't restart the window either)
+    REQUIRE(doubleTap.update(features, tap) == 0);
+    REQUIRE(doubleTap.update(features, tap) == 0);
+    REQUIRE(doubleTap.update(features, 0) == 0);
+    REQUIRE(doubleTap.update(features, tap) == MICROBIT_ACCELEROMETER_DOUBLE_TAP);
+
+    // too far apart
+    doubleTap.reset();
+    REQUIRE(doubleTap.update(features, tap) == 0);
+    for (int index = 0; index < 5; index++)
+    {
+        REQUIRE(doubleTap.update(features, 0) == 0);
+    }
+    REQUIRE(doubleTap.update(features, tap) == 0); // this one starts a new window
+    REQUIRE(doubleTap.update(features, 0) == 0);
+    REQUIRE(doubleTap.update(features, 0) == 0);
+    REQUIRE(doubleTap.update(features, tap) == MICROBIT_ACCELEROMETER_DOUBLE_TAP);
+
+    // nonsense windows get clamped
+    doubleTap.setWindow(10, 1000);
+    REQUIRE(doubleTap.getMaxGap() == 254);
+    doubleTap.setWindow(10, 5);
+    REQUIRE(doubleTap.getMinGap() == 5);
+}
+
+TEST_CASE("impulse direction test")
+{
+    GestureFeaturePool pool;
+    GestureFeatures features;
+    const unsigned required = GESTURE_FEATURE_VARIANCE | GESTURE_FEATURE_IMPULSE;
+
+    byteVector3 rest(0, 0, -64);
+    pool.init(rest);
+    for (int index = 0; index < 20; index++)
+    {
+        pool.addSample(rest, required, features);
+    }
+    REQUIRE(pool.getImpulseDirection() == IMPULSE_NONE);
+
+    pool.addSample(byteVector3(-90, 10, -64), required, features);
+    REQUIRE(features.impulseDirection() == IMPULSE_X_NEG);
+
+    for (int index = 0; index < 20; index++)
+    {
+        pool.addSample(rest, required, features);
+    }
+    pool.addSample(byteVector3(5, 80, -50), required, features);
+    REQUIRE(features.impulseDirection() == IMPULSE_Y_POS);
+
+    for (int index = 0; index < 20; index++)
+    {
+        pool.addSample(rest, required, features);
+    }
+    pool.addSample(byteVector3(5, -10, 40), required, features);
+    REQUIRE(features.impulseDirection() == IMPULSE_Z_POS);
+}
+
+// A made-up but busy signal: noise, shaking and the odd spike
+static byteVector3 testSample(int t)
+{
+    int shake = (t / 200) % 2 ? int(80 * ((t % 8) < 4 ? 1 : -1)) : 0;
+    int spike = (t % 37) == 0 ? 70 : 0;
+    return byteVector3(clampByte(shake + (t * 7) % 5 - 2), clampByte((t * 3) % 7 - 3), clampByte(-64 + spike + (t * 11) % 3));
+}
+
+TEST_CASE("detector clone test")
+{
+    MicroBitGestureDetector detector;
+    detector.init(testSample(0));
+    for (int t = 1; t < 500; t++)
+    {
+        detector.processSample(testSample(t));
+    }
+
+    // the clones have to carry on exactly where the original was, without sharing anything
+    // with it (so run the original all the way first)
+    MicroBitGestureDetector clone(detector);
+    MicroBitGestureDetector assigned;
+    assigned = detector;
+
+    std::vector<uint16_t> fired;
+    for (int t = 500; t < 1500; t++)
+    {
+        detector.processSample(testSample(t));
+        fired.push_back(detector.getFiredGestures());
+    }
+
+    int numFired = 0;
+    for (int t = 500; t < 1500; t++)
+    {
+        clone.processSample(testSample(t));
+        assigned.processSample(testSample(t));
+        REQUIRE(clone.getFiredGestures() == fired[t - 500]);
+        REQUIRE(assigned.getFiredGestures() == fired[t - 500]);
+        numFired += fired[t - 500] != 0;
+    }
+    REQUIRE(numFired > 0);
+}
+
+TEST_CASE("gesture thresholds")
+{
+    MicroBitGestureDetector detector;
+    auto& tap = detector.getGesture<TapGesture>();
+    tap.setThresholds(150, 2, 12.5f);
+    REQUIRE(tap.getThreshold() == 150);
+    REQUIRE(tap.getEventCount() == 2);
+    REQUIRE(tap.getGateThreshold() == 12.5f);
+
+    auto& shake = detector.getGesture<ShakeGesture>();
+    shake.setThresholds(predictionValue_t(0.25f), 4, 2);
+    REQUIRE((shake.getThreshold() == predictionValue_t(0.25f)));
+    REQUIRE(shake.getEventCount() == 4);
+    REQUIRE(shake.getLowCount() == 2);
+}
+
+TEST_CASE("eventThresholdFilter counts clamp to a byte")
+{
+    EventThresholdFilter<int> filter(10, 200, 100);
+    REQUIRE(filter.getEventCountThreshold() == 127);
+    REQUIRE(filter.getLowThreshold() == 100);
+
+    // the count tops out at 127 rather than wrapping round to negative
+    for (int index = 0; index < 300; index++)
+    {
+        filter.filterValue(10);
+    }
+    REQUIRE(filter.currentValue());
+    REQUIRE(!filter.filterValue(0));
+
+    EventThresholdFilter<int> negative(10, -5, -5);
+    REQUIRE(negative.getEventCountThreshold() == 0);
+    REQUIRE(negative.getLowThreshold() == 0);
+}
+
+TEST_CASE("detector snapshot test")
+{
+    MicroBitGestureDetector detector;
+    detector.init(testSample(0));
+    for (int t = 1; t < 500; t++)
+    {
+        detector.processSample(testSample(t));
+    }
+
+    std::vector<uint8_t> snapshot(detector.getStateSize());
+    REQUIRE(detector.saveState(snapshot.data(), snapshot.size() - 1) == 0); // too small
+    REQUIRE(detector.saveState(snapshot.data(), snapshot.size()) == snapshot.size());
+
+    std::vector<uint16_t> fired;
+    for (int t = 500; t < 1500; t++)
+    {
+        detector.processSample(testSample(t));
+        fired.push_back(detector.getFiredGestures());
+    }
+
+    // a fresh detector picks up exactly where the snapshot was taken, with no warm-up
+    MicroBitGestureDetector restored;
+    restored.init(byteVector3(0, 0, 0));
+    REQUIRE(restored.restoreState(snapshot.data(), snapshot.size()));
+    int numFired = 0;
+    for (int t = 500; t < 1500; t++)
+    {
+        restored.processSample(testSample(t));
+        REQUIRE(restored.getFiredGestures() == fired[t - 500]);
+        numFired += fired[t - 500] != 0;
+    }
+    REQUIRE(numFired > 0);
+
+    // and bad snapshots are turned away
+    MicroBitGestureDetector other;
+    REQUIRE(!other.restoreState(snapshot.data(), snapshot.size() - 1));
+    std::vector<uint8_t> badVersion = snapshot;
+    badVersion[0]++;
+    REQUIRE(!other.restoreState(badVersion.data(), badVersion.size()));
+}
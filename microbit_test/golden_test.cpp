@@ -0,0 +1,323 @@
+#include "MicroBitGestureDetector.h"
+
+#include "catch.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// See catch tutorial: https://github.com/philsquared/Catch/blob/master/docs/tutorial.md
+
+//
+// golden-vector tests
+//
+// Runs a few synthetic traces through the detector and compares every intermediate value
+// (gravity, the gravity-subtracted sample, the dot feature and its mean, the variances,
+// the impulse direction and the fired events) with golden/detector_golden.txt, bit for bit.
+// The first value that's different gets reported, along with the sample that caused it.
+//
+// When a change is *supposed* to change the output, regenerate the file with
+//   microbit_test "[update-golden]"
+// and check the diff in with the change.
+
+#ifndef GOLDEN_DIR
+#define GOLDEN_DIR "golden"
+#endif
+
+static const char* goldenFilename = GOLDEN_DIR "/detector_golden.txt";
+
+// The goldens only hold for the build options they were made with
+static std::string getGoldenConfig()
+{
+    char config[128];
+    snprintf(config, sizeof(config), "shakeGate=%d slowShake=%d fixedMath=%d tapNoiseFloor=%d medianPrefilter=%d",
+             USE_SHAKE_GATE, USE_SLOW_SHAKE, FIXED_MATH, USE_TAP_NOISE_FLOOR, USE_MEDIAN_PREFILTER);
+    return config;
+}
+
+// A little LCG, so the traces come out the same everywhere
+class TraceRandom
+{
+public:
+    TraceRandom(uint32_t seed) : state_(seed) {}
+
+    // in [-range, range]
+    int next(int range)
+    {
+        state_ = state_ * 1664525u + 1013904223u;
+        return int((state_ >> 16) % uint32_t(2 * range + 1)) - range;
+    }
+
+private:
+    uint32_t state_;
+};
+
+// Integer triangle wave in [-amplitude, amplitude]
+static int triangle(int t, int period, int amplitude)
+{
+    int phase = t % period;
+    int half = period / 2;
+    int ramp = phase < half ? phase : period - phase;
+    return (4 * amplitude * ramp) / period - amplitude;
+}
+
+static void addSample(std::vector<byteVector3>& trace, int x, int y, int z)
+{
+    trace.push_back(byteVector3(clampByte(x), clampByte(y), clampByte(z)));
+}
+
+// Slowly turning through face up, the four tilts and face down
+static std::vector<byteVector3> makeOrientationTrace()
+{
+    static const int poses[][3] = { { 0, 0, -64 }, { -64, 0, 0 }, { 0, -64, 0 }, { 64, 0, 0 }, { 0, 64, 0 }, { 0, 0, 64 }, { 0, 0, -64 } };
+    const int holdTime = 60;
+    const int turnTime = 25;
+    TraceRandom random(1);
+    std::vector<byteVector3> trace;
+    for (size_t pose = 0; pose + 1 < sizeof(poses) / sizeof(poses[0]); pose++)
+    {
+        for (int t = 0; t < holdTime + turnTime; t++)
+        {
+            int blend = t < holdTime ? 0 : t - holdTime;
+            int v[3];
+            for (int axis = 0; axis < 3; axis++)
+            {
+                v[axis] = (poses[pose][axis] * (turnTime - blend) + poses[pose + 1][axis] * blend) / turnTime + random.next(2);
+            }
+            addSample(trace, v[0], v[1], v[2]);
+        }
+    }
+    return trace;
+}
+
+// A slow shake and a fast, hard one
+static std::vector<byteVector3> makeShakeTrace()
+{
+    TraceRandom random(2);
+    std::vector<byteVector3> trace;
+    for (int t = 0; t < 600; t++)
+    {
+        int shake = 0;
+        if (t >= 100 && t < 250)
+        {
+            shake = triangle(t, 18, 60); // ~3 Hz
+        }
+        else if (t >= 350 && t < 500)
+        {
+            shake = triangle(t, 9, 110); // ~6 Hz
+        }
+        addSample(trace, shake + random.next(2), shake / 3 + random.next(2), -64 + random.next(2));
+    }
+    return trace;
+}
+
+// Single and double taps, first held in the hand (damped quickly) then on a table (rings)
+static std::vector<byteVector3> makeTapTrace()
+{
+    static const int tapTimes[] = { 40, 100, 160, 172, 240, 320, 380, 392, 460, 530 };
+    TraceRandom random(3);
+    std::vector<byteVector3> trace;
+    int ring = 0;
+    size_t nextTap = 0;
+    for (int t = 0; t < 600; t++)
+    {
+        bool onTable = t >= 300;
+        if (nextTap < sizeof(tapTimes) / sizeof(tapTimes[0]) && t == tapTimes[nextTap])
+        {
+            ring = onTable ? -48 : -70;
+            nextTap++;
+        }
+        int noise = onTable ? 0 : random.next(3);
+        addSample(trace, noise + ring / 8, random.next(1), -64 + ring + noise);
+        ring = onTable ? -(ring * 3) / 4 : -ring / 3;
+    }
+    return trace;
+}
+
+// A drop, the landing, and an I2C read glitch or two
+static std::vector<byteVector3> makeFreefallTrace()
+{
+    TraceRandom random(4);
+    std::vector<byteVector3> trace;
+    for (int t = 0; t < 400; t++)
+    {
+        int z = -64;
+        if (t >= 150 && t < 175)
+        {
+            z = -4;
+        }
+        else if (t >= 175 && t < 180)
+        {
+            z = t % 2 ? -127 : 40;
+        }
+        if (t == 90 || t == 300)
+        {
+            addSample(trace, 127, -128, 127);
+            continue;
+        }
+        addSample(trace, random.next(2), random.next(2), z + random.next(2));
+    }
+    return trace;
+}
+
+struct GoldenTrace
+{
+    const char* name;
+    std::vector<byteVector3> samples;
+};
+
+static std::vector<GoldenTrace> makeGoldenTraces()
+{
+    return {
+        { "orientation", makeOrientationTrace() },
+        { "shake", makeShakeTrace() },
+        { "tap", makeTapTrace() },
+        { "freefall", makeFreefallTrace() },
+    };
+}
+
+static const char* goldenFieldNames[] = { "input", "gravity", "sample", "dot", "shakePrediction",
+                                          "quietVariance", "impulseVariance", "impulseDirection", "fired" };
+
+// Raw bytes as hex, so floats and fixed-point values both compare exactly
+template <typename T>
+static std::string toHex(const T& val)
+{
+    unsigned char bytes[sizeof(T)];
+    memcpy(bytes, &val, sizeof(T));
+    std::string result;
+    char digits[3];
+    for (size_t index = 0; index < sizeof(T); index++)
+    {
+        snprintf(digits, sizeof(digits), "%02x", bytes[index]);
+        result += digits;
+    }
+    return result;
+}
+
+// Runs a trace through a detector, recording the intermediate values after each sample
+struct GoldenTraceRecorder
+{
+    static std::vector<std::vector<std::string>> record(const std::vector<byteVector3>& samples)
+    {
+        std::vector<std::vector<std::string>> rows;
+        MicroBitGestureDetector detector;
+        detector.init(samples[0]);
+        for (const auto& input : samples)
+        {
+            detector.processSample(input);
+            GestureFeaturePool& pool = detector.features;
+            rows.push_back({
+                toHex(input),
+                toHex(pool.gravityFilter.getLastSample()),
+                toHex(pool.sampleDelayBuffer.getDelayedSample(0)),
+                toHex(pool.dotDelayBuffer2.getDelayedSample(0)),
+                toHex(pool.getShakePrediction()),
+                toHex(pool.quietWindowStats.getVar()),
+                toHex(pool.getImpulseVariance()),
+                toHex(int8_t(pool.getImpulseDirection())),
+                toHex(detector.getFiredGestures()),
+            });
+        }
+        return rows;
+    }
+};
+
+static std::string joinRow(const std::vector<std::string>& row)
+{
+    std::string line;
+    for (const auto& field : row)
+    {
+        line += (line.empty() ? "" : " ") + field;
+    }
+    return line;
+}
+
+TEST_CASE("detector golden vectors")
+{
+    std::ifstream file(goldenFilename);
+    if (!file)
+    {
+        FAIL("can't open " << goldenFilename << " (make it with microbit_test \"[update-golden]\")");
+    }
+
+    std::string line;
+    std::string config;
+    std::vector<std::pair<std::string, std::vector<std::string>>> golden; // trace name, rows
+    while (std::getline(file, line))
+    {
+        if (line.compare(0, 9, "# config ") == 0)
+        {
+            config = line.substr(9);
+        }
+        else if (line.compare(0, 6, "trace ") == 0)
+        {
+            golden.push_back({ line.substr(6), {} });
+        }
+        else if (!line.empty() && line[0] != '#' && !golden.empty())
+        {
+            golden.back().second.push_back(line);
+        }
+    }
+
+    if (config != getGoldenConfig())
+    {
+        WARN("golden vectors are for " << config << ", skipping");
+        return;
+    }
+
+    auto traces = makeGoldenTraces();
+    REQUIRE(golden.size() == traces.size());
+    for (size_t traceIndex = 0; traceIndex < traces.size(); traceIndex++)
+    {
+        const auto& trace = traces[traceIndex];
+        const auto& expected = golden[traceIndex].second;
+        REQUIRE(golden[traceIndex].first == trace.name);
+        REQUIRE(expected.size() == trace.samples.size());
+
+        auto rows = GoldenTraceRecorder::record(trace.samples);
+        for (size_t index = 0; index < rows.size(); index++)
+        {
+            std::istringstream expectedFields(expected[index]);
+            for (size_t fieldIndex = 0; fieldIndex < rows[index].size(); fieldIndex++)
+            {
+                std::string expectedField;
+                expectedFields >> expectedField;
+                if (expectedField != rows[index][fieldIndex])
+                {
+                    FAIL("first divergence: trace " << trace.name << ", sample " << index << ", "
+                         << goldenFieldNames[fieldIndex] << " is " << rows[index][fieldIndex]
+                         << ", expected " << expectedField << "\n  got:      " << joinRow(rows[index])
+                         << "\n  expected: " << expected[index]);
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("update golden vectors", "[.][update-golden]")
+{
+    FILE* file = fopen(goldenFilename, "w");
+    REQUIRE(file);
+    fprintf(file, "# Golden vectors for golden_test.cpp (regenerate with microbit_test \"[update-golden]\")\n");
+    fprintf(file, "# config %s\n", getGoldenConfig().c_str());
+    fprintf(file, "# fields (raw bytes, in hex):");
+    for (auto name : goldenFieldNames)
+    {
+        fprintf(file, " %s", name);
+    }
+    fprintf(file, "\n");
+
+    for (const auto& trace : makeGoldenTraces())
+    {
+        fprintf(file, "trace %s\n", trace.name);
+        for (const auto& row : GoldenTraceRecorder::record(trace.samples))
+        {
+            fprintf(file, "%s\n", joinRow(row).c_str());
+        }
+    }
+    REQUIRE(fclose(file) == 0);
+}
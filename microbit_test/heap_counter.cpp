@@ -0,0 +1,57 @@
+#include "heap_counter.h"
+
+#include <cstdlib>
+#include <new>
+
+HeapCounter heapCounter;
+
+static const size_t heapHeaderSize = 16; // keeps the size, and the alignment
+
+void* operator new(size_t size)
+{
+    char* p = heapCounter.bytes + size <= heapCounter.limitBytes ? static_cast<char*>(malloc(size + heapHeaderSize)) : nullptr;
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    *reinterpret_cast<size_t*>(p) = size;
+    heapCounter.numAllocations++;
+    heapCounter.bytes += size;
+    if (heapCounter.bytes > heapCounter.peakBytes)
+    {
+        heapCounter.peakBytes = heapCounter.bytes;
+    }
+    return p + heapHeaderSize;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    try
+    {
+        return operator new(size);
+    }
+    catch (const std::bad_alloc&)
+    {
+        return nullptr;
+    }
+}
+
+void operator delete(void* p) noexcept
+{
+    if (p)
+    {
+        char* block = static_cast<char*>(p) - heapHeaderSize;
+        heapCounter.bytes -= *reinterpret_cast<size_t*>(block);
+        free(block);
+    }
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+    operator delete(p);
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+
+// Heap accounting for the tests: every operator new in the test program goes through
+// heap_counter.cpp, so a test can see exactly how many allocations (and how many bytes) a
+// piece of code makes. (Read the numbers into locals before REQUIRE()ing on them: Catch
+// allocates too.)
+struct HeapCounter
+{
+    size_t numAllocations = 0;
+    size_t bytes = 0;     // live right now
+    size_t peakBytes = 0; // since the last reset()
+    size_t limitBytes = size_t(-1); // an allocation that would go over this fails (to test running out)
+
+    void reset()
+    {
+        numAllocations = 0;
+        peakBytes = bytes;
+    }
+};
+
+extern HeapCounter heapCounter;
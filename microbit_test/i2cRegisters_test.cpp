@@ -0,0 +1,162 @@
+#include "Bmp085Compensation.h"
+#include "I2CRegisters.h"
+#include "i2c_sim.h"
+
+#include "catch.hpp"
+
+#include <iostream>
+
+// See catch tutorial: https://github.com/philsquared/Catch/blob/master/docs/tutorial.md
+
+// The old way: a write and a read (each with its own stop) for every register
+static uint16_t readOneRegister16(SimulatedI2CBus& bus, int address, uint8_t reg)
+{
+    char cmd = char(reg);
+    char buf[2];
+    bus.write(address, &cmd, 1);
+    bus.read(address, buf, 2);
+    return uint16_t((uint8_t(buf[0]) << 8) | uint8_t(buf[1]));
+}
+
+static uint8_t readOneRegister8(SimulatedI2CBus& bus, int address, uint8_t reg)
+{
+    char cmd = char(reg);
+    char buf[1];
+    bus.write(address, &cmd, 1);
+    bus.read(address, buf, 1);
+    return uint8_t(buf[0]);
+}
+
+struct I2CCounts
+{
+    uint32_t numTransactions;
+    uint32_t numBytes;
+    uint64_t time; // us
+};
+
+template <typename Fn>
+static I2CCounts countTransactions(SimulatedI2CBus& bus, SimClock& clock, Fn fn)
+{
+    bus.resetCounts();
+    uint64_t start = clock.us;
+    fn();
+    return { bus.getNumTransactions(), bus.getNumBytes(), clock.us - start };
+}
+
+static void printCounts(const char* name, const I2CCounts& before, const I2CCounts& after)
+{
+    std::cout << name << ": " << before.numTransactions << " -> " << after.numTransactions << " transactions, "
+              << before.numBytes << " -> " << after.numBytes << " bytes, " << before.time << " -> " << after.time
+              << " us at 100 kHz" << std::endl;
+}
+
+//
+// i2cRegisters tests
+//
+TEST_CASE("i2cRegisters burst reads")
+{
+    SimClock clock;
+    SimulatedI2CBus bus(clock);
+    SimulatedBmp085 chip(clock);
+    bus.attach(SimulatedBmp085::address, &chip);
+
+    uint8_t data[4];
+    REQUIRE(readRegisters(bus, SimulatedBmp085::address, 0xAA, data, 4) == 0);
+    REQUIRE(int16_t(getBigEndian16(data)) == 408);     // AC1
+    REQUIRE(int16_t(getBigEndian16(data + 2)) == -72); // AC2
+    REQUIRE(bus.getNumTransactions() == 1);
+    REQUIRE(bus.getNumTransfers() == 2);
+
+    REQUIRE(readRegisters(bus, SimulatedBmp085::address, 0xD0, data, 1) == 0);
+    REQUIRE(data[0] == 0x55);
+
+    // and a failed pointer write skips the read
+    bus.resetCounts();
+    bus.failNext(1);
+    REQUIRE(readRegisters(bus, SimulatedBmp085::address, 0xAA, data, 4) == SimulatedI2CBus::errorCode);
+    REQUIRE(bus.getNumTransfers() == 1);
+
+    REQUIRE(writeRegister(bus, SimulatedBmp085::address, 0xF4, 0x2E) == 0);
+    REQUIRE(chip.getNumConversions() == 0);
+    clock.us += 5000;
+    REQUIRE(readRegisters(bus, SimulatedBmp085::address, 0xF6, data, 2) == 0);
+    REQUIRE(getBigEndian16(data) == 27898);
+
+    const uint8_t bytes[] = { 0x12, 0x34, 0x56 };
+    REQUIRE(getBigEndian24(bytes) == 0x123456);
+}
+
+TEST_CASE("i2cRegisters saves transactions")
+{
+    SimClock clock;
+    SimulatedI2CBus bus(clock);
+    SimulatedBmp085 chip(clock);
+    SimulatedMma8653 accelerometer;
+    bus.attach(SimulatedBmp085::address, &chip);
+    bus.attach(SimulatedMma8653::address, &accelerometer);
+
+    // BMP085 calibration: eleven 16-bit registers from 0xAA
+    uint16_t oneByOne[11];
+    auto calibrationBefore = countTransactions(bus, clock, [&] {
+        for (int index = 0; index < 11; index++)
+        {
+            oneByOne[index] = readOneRegister16(bus, SimulatedBmp085::address, uint8_t(0xAA + 2 * index));
+        }
+    });
+    uint8_t coeffs[22];
+    auto calibrationAfter = countTransactions(bus, clock, [&] {
+        readRegisters(bus, SimulatedBmp085::address, 0xAA, coeffs, 22);
+    });
+    for (int index = 0; index < 11; index++)
+    {
+        REQUIRE(getBigEndian16(coeffs + 2 * index) == oneByOne[index]);
+    }
+    auto calibration = Bmp085Calibration::fromRegisters(coeffs);
+    REQUIRE(calibration.ac4 == 32741);
+    REQUIRE(calibration.md == 2868);
+    REQUIRE(calibrationBefore.numTransactions == 22);
+    REQUIRE(calibrationAfter.numTransactions == 1);
+
+    // BMP085 pressure: 16 bits and then the extra 8
+    writeRegister(bus, SimulatedBmp085::address, 0xF4, 0x34 + (3 << 6));
+    clock.us += 26000;
+    uint32_t up = 0;
+    auto pressureBefore = countTransactions(bus, clock, [&] {
+        up = (uint32_t(readOneRegister16(bus, SimulatedBmp085::address, 0xF6)) << 8) | readOneRegister8(bus, SimulatedBmp085::address, 0xF8);
+    });
+    uint8_t pressure[3];
+    auto pressureAfter = countTransactions(bus, clock, [&] {
+        readRegisters(bus, SimulatedBmp085::address, 0xF6, pressure, 3);
+    });
+    REQUIRE(getBigEndian24(pressure) == up);
+    REQUIRE((up >> 5) == 23843 << 3);
+    REQUIRE(pressureBefore.numTransactions == 4);
+    REQUIRE(pressureAfter.numTransactions == 1);
+
+    // Accelerometer: x, y and z one at a time, or all together
+    accelerometer.setAcceleration(100, -1024, 2000);
+    int16_t axes[3];
+    auto accelBefore = countTransactions(bus, clock, [&] {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            axes[axis] = int16_t(readOneRegister16(bus, SimulatedMma8653::address, uint8_t(mma8653::outXMsb + 2 * axis)));
+        }
+    });
+    int16_t xyz[3];
+    auto accelAfter = countTransactions(bus, clock, [&] {
+        REQUIRE(mma8653::readAcceleration(bus, 2, xyz) == 0);
+    });
+    for (int axis = 0; axis < 3; axis++)
+    {
+        REQUIRE(xyz[axis] == (axes[axis] >> 6) * 4);
+    }
+    REQUIRE(xyz[0] == 100);
+    REQUIRE(xyz[1] == -1024);
+    REQUIRE(xyz[2] == 2000);
+    REQUIRE(accelBefore.numTransactions == 6);
+    REQUIRE(accelAfter.numTransactions == 1);
+
+    printCounts("BMP085 calibration", calibrationBefore, calibrationAfter);
+    printCounts("BMP085 pressure", pressureBefore, pressureAfter);
+    printCounts("accelerometer x, y, z", accelBefore, accelAfter);
+}
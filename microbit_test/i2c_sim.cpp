@@ -0,0 +1,168 @@
+#include "i2c_sim.h"
+
+#include <algorithm>
+
+//
+// SimulatedI2CBus
+//
+
+const int SimulatedI2CBus::errorCode;
+
+// Start, address byte, data bytes (9 bits each with the ack), stop, at 100 kHz
+static uint64_t getTransferTime(int length)
+{
+    return 10 * (2 + 9 * (1 + uint64_t(length)));
+}
+
+auto SimulatedI2CBus::startTransfer(int address, int length, bool repeated) -> Attached*
+{
+    numTransactions_ += !held_;
+    held_ = repeated;
+    numTransfers_++;
+    numBytes_ += length;
+    clock_.us += getTransferTime(length);
+
+    auto it = devices_.find(address);
+    if (it == devices_.end() || numFailures_ > 0)
+    {
+        numFailures_ -= (numFailures_ > 0);
+        return nullptr;
+    }
+    return &it->second;
+}
+
+int SimulatedI2CBus::write(int address, const char* data, int length, bool repeated)
+{
+    Attached* attached = startTransfer(address, length, repeated);
+    if (!attached)
+    {
+        return errorCode;
+    }
+    if (length > 0)
+    {
+        attached->reg = uint8_t(data[0]);
+        attached->device->writeRegisters(attached->reg, reinterpret_cast<const uint8_t*>(data) + 1, length - 1);
+    }
+    return 0;
+}
+
+int SimulatedI2CBus::read(int address, char* data, int length, bool repeated)
+{
+    Attached* attached = startTransfer(address, length, repeated);
+    if (!attached)
+    {
+        return errorCode;
+    }
+    attached->device->readRegisters(attached->reg, reinterpret_cast<uint8_t*>(data), length);
+    return 0;
+}
+
+//
+// SimulatedBmp085
+//
+
+static const int16_t datasheetCoefficients[] = { 408, -72, -14383, 32741, 32757, 23153, 6190, 4, -32768, -8711, 2868 };
+
+SimulatedBmp085::SimulatedBmp085(SimClock& clock) : clock_(clock)
+{
+    for (size_t index = 0; index < sizeof(datasheetCoefficients) / sizeof(datasheetCoefficients[0]); index++)
+    {
+        uint16_t val = uint16_t(datasheetCoefficients[index]);
+        registers_[0xAA + 2 * index] = uint8_t(val >> 8);
+        registers_[0xAB + 2 * index] = uint8_t(val);
+    }
+    registers_[0xD0] = 0x55; // chip id
+}
+
+void SimulatedBmp085::writeRegisters(uint8_t reg, const uint8_t* data, int length)
+{
+    update();
+    for (int index = 0; index < length; index++)
+    {
+        registers_[uint8_t(reg + index)] = data[index];
+    }
+
+    if (reg == 0xF4 && length > 0)
+    {
+        // temperature 4.5 ms, pressure 4.5, 7.5, 13.5 or 25.5 ms
+        static const uint32_t pressureTimes[] = { 4500, 7500, 13500, 25500 };
+        command_ = data[0];
+        converting_ = true;
+        readyTime_ = clock_.us + (command_ == 0x2E ? 4500 : pressureTimes[(command_ >> 6) & 3]);
+    }
+}
+
+void SimulatedBmp085::readRegisters(uint8_t reg, uint8_t* data, int length)
+{
+    update();
+    if (converting_ && reg >= 0xF6 && reg <= 0xF8)
+    {
+        numEarlyReads_++;
+    }
+    for (int index = 0; index < length; index++)
+    {
+        data[index] = registers_[uint8_t(reg + index)];
+    }
+}
+
+void SimulatedBmp085::update()
+{
+    if (!converting_ || clock_.us < readyTime_)
+    {
+        return;
+    }
+
+    converting_ = false;
+    numConversions_++;
+    uint32_t result;
+    if (command_ == 0x2E)
+    {
+        result = uint32_t(ut_) << 8;
+    }
+    else
+    {
+        int mode = (command_ >> 6) & 3;
+        result = uint32_t(up_ << mode) << (8 - mode);
+    }
+    registers_[0xF6] = uint8_t(result >> 16);
+    registers_[0xF7] = uint8_t(result >> 8);
+    registers_[0xF8] = uint8_t(result);
+}
+
+//
+// SimulatedMma8653
+//
+
+SimulatedMma8653::SimulatedMma8653()
+{
+    registers_[0x0D] = 0x5A; // who am i
+}
+
+void SimulatedMma8653::setAcceleration(int x, int y, int z)
+{
+    int values[] = { x, y, z };
+    for (int axis = 0; axis < 3; axis++)
+    {
+        // 256 to the g at 2 g, in the top 10 bits
+        int counts = std::max(-512, std::min(511, values[axis] / 4));
+        uint16_t reg = uint16_t(counts * 64);
+        registers_[1 + 2 * axis] = uint8_t(reg >> 8);
+        registers_[2 + 2 * axis] = uint8_t(reg);
+    }
+}
+
+void SimulatedMma8653::writeRegisters(uint8_t reg, const uint8_t* data, int length)
+{
+    for (int index = 0; index < length; index++)
+    {
+        registers_[(reg + index) % sizeof(registers_)] = data[index];
+    }
+}
+
+void SimulatedMma8653::readRegisters(uint8_t reg, uint8_t* data, int length)
+{
+    for (int index = 0; index < length; index++)
+    {
+        data[index] = registers_[(reg + index) % sizeof(registers_)];
+    }
+}
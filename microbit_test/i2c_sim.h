@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+
+// A simulated I2C bus and the devices on it, for testing drivers on the host. The bus has
+// the same write()/read() calls as the DAL's MicroBitI2C, so a driver templated on its bus
+// takes either. Every transfer takes as long as it would at 100 kHz (on the simulated
+// clock), and gets counted. A transaction runs from a start to a stop: transfers made with
+// repeated set leave the bus held for the next one, which is part of the same transaction.
+
+struct SimClock
+{
+    uint64_t us = 0;
+
+    uint32_t ms() const { return uint32_t(us / 1000); }
+};
+
+// A device is a bank of registers, with the usual register-pointer protocol: a write
+// starts with the register number, and a read carries on from the last one written.
+class SimulatedI2CDevice
+{
+public:
+    virtual ~SimulatedI2CDevice() {}
+    virtual void writeRegisters(uint8_t reg, const uint8_t* data, int length) = 0;
+    virtual void readRegisters(uint8_t reg, uint8_t* data, int length) = 0;
+};
+
+class SimulatedI2CBus
+{
+public:
+    static const int errorCode = -1010; // MICROBIT_I2C_ERROR
+
+    SimulatedI2CBus(SimClock& clock) : clock_(clock)
+    {
+    }
+
+    void attach(int address, SimulatedI2CDevice* device) { devices_[address] = { device, 0 }; } // (8-bit address)
+
+    int write(int address, const char* data, int length, bool repeated = false);
+    int read(int address, char* data, int length, bool repeated = false);
+
+    void failNext(int numTransfers) { numFailures_ = numTransfers; } // NACK the next few transfers
+
+    uint32_t getNumTransactions() const { return numTransactions_; }
+    uint32_t getNumTransfers() const { return numTransfers_; }
+    uint32_t getNumBytes() const { return numBytes_; }
+    void resetCounts() { numTransactions_ = numTransfers_ = numBytes_ = 0; }
+
+private:
+    struct Attached
+    {
+        SimulatedI2CDevice* device;
+        uint8_t reg;
+    };
+
+    Attached* startTransfer(int address, int length, bool repeated);
+
+    SimClock& clock_;
+    std::map<int, Attached> devices_;
+    int numFailures_ = 0;
+    bool held_ = false; // (by a transfer with repeated set)
+    uint32_t numTransactions_ = 0;
+    uint32_t numTransfers_ = 0;
+    uint32_t numBytes_ = 0;
+};
+
+// A BMP085/BMP180 with the calibration coefficients and raw readings from the datasheet's
+// worked example, and the datasheet's worst-case conversion times. Reading the result
+// before a conversion is done gets the previous result, as on the real chip.
+class SimulatedBmp085 : public SimulatedI2CDevice
+{
+public:
+    static const int address = 0x77 << 1;
+
+    SimulatedBmp085(SimClock& clock);
+
+    void setRawTemperature(int32_t ut) { ut_ = ut; }
+    void setRawPressure(int32_t up) { up_ = up; } // at oversampling mode 0 (the chip shifts it up for the others)
+
+    void writeRegisters(uint8_t reg, const uint8_t* data, int length) override;
+    void readRegisters(uint8_t reg, uint8_t* data, int length) override;
+
+    uint32_t getNumConversions() const { return numConversions_; }
+    uint32_t getNumEarlyReads() const { return numEarlyReads_; } // data reads while a conversion was running
+
+private:
+    void update(); // finishes the conversion in progress, if it's time
+
+    SimClock& clock_;
+    uint8_t registers_[256] = {};
+    int32_t ut_ = 27898;
+    int32_t up_ = 23843;
+
+    bool converting_ = false;
+    uint8_t command_ = 0;
+    uint64_t readyTime_ = 0; // in us
+    uint32_t numConversions_ = 0;
+    uint32_t numEarlyReads_ = 0;
+};
+
+// The MMA8653 accelerometer, at the 2 g range: x, y and z (10 bits each, left justified)
+// from 0x01, and the id in 0x0D
+class SimulatedMma8653 : public SimulatedI2CDevice
+{
+public:
+    static const int address = 0x1D << 1;
+
+    SimulatedMma8653();
+
+    void setAcceleration(int x, int y, int z); // in mg (1024 to the g)
+
+    void writeRegisters(uint8_t reg, const uint8_t* data, int length) override;
+    void readRegisters(uint8_t reg, uint8_t* data, int length) override;
+
+private:
+    uint8_t registers_[64] = {};
+};
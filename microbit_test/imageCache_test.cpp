@@ -0,0 +1,132 @@
+#include "ImageCache.h"
+#include "heap_counter.h"
+
+#include "catch.hpp"
+
+#include <memory>
+#include <vector>
+
+// See catch tutorial: https://github.com/philsquared/Catch/blob/master/docs/tutorial.md
+
+// Stands in for MicroBitImage: building one from a bitmap allocates and copies, and
+// copies share the pixels
+struct TestImage
+{
+    std::shared_ptr<std::vector<uint8_t>> pixels;
+    int width = 0;
+
+    TestImage()
+    {
+    }
+
+    TestImage(int w, int h, const uint8_t* bitmap) : pixels(std::make_shared<std::vector<uint8_t>>(bitmap, bitmap + w * h)), width(w)
+    {
+    }
+};
+
+// LED pictures, the way the compiler emits them
+static const uint8_t heart[] = { 0, 1, 0, 1, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 1, 1, 0, 0, 0, 1, 0, 0 };
+static const uint8_t square[] = { 1, 1, 1, 1, 1, 1, 0, 0, 0, 1, 1, 0, 0, 0, 1, 1, 0, 0, 0, 1, 1, 1, 1, 1, 1 };
+static const uint8_t dot[] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+static const uint8_t frames[] = { 1, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 1,
+                                  0, 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0, 0 };
+
+//
+// imageCache tests
+//
+TEST_CASE("imageCache hits and misses")
+{
+    ImageCache<TestImage, 4> cache;
+    TestImage first = cache.get(5, 5, heart);
+    REQUIRE(first.width == 5);
+    REQUIRE((*first.pixels)[1] == 1);
+    REQUIRE(cache.get(5, 5, heart).pixels == first.pixels);
+    REQUIRE(cache.getNumMisses() == 1);
+    REQUIRE(cache.getNumHits() == 1);
+
+    // same bitmap, different shape: a different image
+    REQUIRE(cache.get(10, 5, frames).width == 10);
+    REQUIRE(cache.get(5, 5, frames).width == 5);
+    REQUIRE(cache.getNumMisses() == 3);
+
+    cache.clear();
+    cache.get(5, 5, heart);
+    REQUIRE(cache.getNumMisses() == 4);
+}
+
+TEST_CASE("imageCache drops the least recently used")
+{
+    ImageCache<TestImage, 2> cache;
+    TestImage kept = cache.get(5, 5, heart); // (like an animation that's still running)
+    cache.get(5, 5, square);
+    cache.get(5, 5, heart);
+    cache.get(5, 5, dot); // square goes
+    REQUIRE(cache.getNumMisses() == 3);
+
+    cache.get(5, 5, heart);
+    REQUIRE(cache.getNumMisses() == 3);
+    cache.get(5, 5, square); // dot goes
+    cache.get(5, 5, dot); // heart goes
+    REQUIRE(cache.getNumMisses() == 5);
+    REQUIRE(kept.pixels->size() == 25);
+    REQUIRE((*kept.pixels)[1] == 1);
+    REQUIRE(kept.pixels.use_count() == 1);
+}
+
+TEST_CASE("imageCache doesn't keep big images")
+{
+    ImageCache<TestImage, 4, 25> cache;
+    cache.get(5, 5, heart);
+    {
+        TestImage animation = cache.get(10, 5, frames);
+        REQUIRE(animation.pixels.use_count() == 1); // (the cache doesn't hold it)
+        REQUIRE(animation.width == 10);
+    }
+    cache.get(10, 5, frames);
+    REQUIRE(cache.getNumMisses() == 3);
+    cache.get(5, 5, heart);
+    REQUIRE(cache.getNumHits() == 1);
+}
+
+TEST_CASE("imageCache animation loop doesn't allocate")
+{
+    // a forever loop flipping through a few pictures, and an animation now and then
+    const uint8_t* pictures[] = { heart, square, dot };
+    const int numIterations = 100;
+    size_t uncachedAllocations = 0;
+    size_t cachedAllocations = 0;
+    size_t warmAllocations = 0;
+    ImageCache<TestImage, 4> cache;
+
+    for (int pass = 0; pass < 3; pass++)
+    {
+        heapCounter.reset();
+        int checksum = 0;
+        for (int iteration = 0; iteration < numIterations; iteration++)
+        {
+            for (auto bitmap : pictures)
+            {
+                if (pass == 0)
+                {
+                    TestImage image(5, 5, bitmap);
+                    checksum += (*image.pixels)[12];
+                }
+                else
+                {
+                    checksum += (*cache.get(5, 5, bitmap).pixels)[12];
+                }
+            }
+            if (iteration % 10 == 0)
+            {
+                TestImage animation = pass == 0 ? TestImage(10, 5, frames) : cache.get(10, 5, frames);
+                checksum += animation.width;
+            }
+        }
+        size_t numAllocations = heapCounter.numAllocations;
+        (pass == 0 ? uncachedAllocations : pass == 1 ? cachedAllocations : warmAllocations) = numAllocations;
+        REQUIRE(checksum == numIterations * 2 + numIterations / 10 * 10);
+    }
+    REQUIRE(uncachedAllocations >= size_t(numIterations * 3));
+    REQUIRE(cachedAllocations <= 4 * 2); // (TestImage allocates twice)
+    REQUIRE(warmAllocations == 0);
+}
@@ -0,0 +1,283 @@
+#include "IntMath.h"
+
+#include "catch.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+// See catch tutorial: https://github.com/philsquared/Catch/blob/master/docs/tutorial.md
+
+static const int32_t edgeValues[] = { INT32_MIN, INT32_MIN + 1, -65536, -32769, -32768, -129, -128, -2, -1, 0, 1, 2,
+                                      127, 128, 32767, 32768, 65536, INT32_MAX - 1, INT32_MAX };
+
+// The obvious way, to check against
+static int64_t referencePow(int64_t base, int exponent)
+{
+    int64_t result = 1;
+    for (int index = 0; index < exponent; index++)
+    {
+        result *= base;
+        if (result > INT32_MAX || result < INT32_MIN)
+        {
+            return base < 0 && (exponent & 1) ? INT32_MIN : INT32_MAX;
+        }
+    }
+    return result;
+}
+
+//
+// intMath tests
+//
+TEST_CASE("isqrt squares")
+{
+    // every square and its neighbours, all the way up
+    for (uint64_t r = 1; r <= 65535; r++)
+    {
+        uint32_t square = uint32_t(r * r);
+        REQUIRE(isqrt(square) == r);
+        REQUIRE(isqrt(square - 1) == r - 1);
+        REQUIRE(isqrt(square + uint32_t(r)) == r);
+        REQUIRE(isqrt(square + uint32_t(2 * r)) == r);
+    }
+    REQUIRE(isqrt(0) == 0);
+    REQUIRE(isqrt(0xffffffffu) == 65535);
+}
+
+TEST_CASE("ipow")
+{
+    for (int32_t base = -300; base <= 300; base++)
+    {
+        for (int exponent = 0; exponent <= 40; exponent++)
+        {
+            REQUIRE(ipow(base, exponent) == referencePow(base, exponent));
+        }
+    }
+    for (int32_t base : edgeValues)
+    {
+        for (int exponent = 0; exponent <= 3; exponent++)
+        {
+            REQUIRE(ipow(base, exponent) == referencePow(base, exponent));
+        }
+        REQUIRE(ipow(base, INT32_MAX) == (base >= -1 && base <= 1 ? base : base < 0 ? INT32_MIN : INT32_MAX));
+    }
+    REQUIRE(ipow(2, 30) == (1 << 30));
+    REQUIRE(ipow(2, 31) == INT32_MAX);
+    REQUIRE(ipow(-2, 31) == INT32_MIN);
+    REQUIRE(ipow(-2, 32) == INT32_MAX);
+    REQUIRE(ipow(46340, 2) == 46340 * 46340);
+    REQUIRE(ipow(46341, 2) == INT32_MAX);
+
+    // negative exponents, rounded toward zero
+    REQUIRE(ipow(1, -3) == 1);
+    REQUIRE(ipow(-1, -3) == -1);
+    REQUIRE(ipow(-1, -2) == 1);
+    REQUIRE(ipow(2, -1) == 0);
+    REQUIRE(ipow(0, -1) == 0);
+}
+
+TEST_CASE("imin, imax, iclamp")
+{
+    for (int32_t a : edgeValues)
+    {
+        for (int32_t b : edgeValues)
+        {
+            REQUIRE(imin(a, b) == std::min(a, b));
+            REQUIRE(imax(a, b) == std::max(a, b));
+            REQUIRE(lessMask(a, b) == (a < b ? 0xffffffffu : 0u));
+            for (int32_t val : edgeValues)
+            {
+                if (a <= b)
+                {
+                    REQUIRE(iclamp(val, a, b) == std::min(std::max(val, a), b));
+                }
+            }
+        }
+    }
+
+    // every pair of 12-bit values
+    for (int32_t a = -2048; a < 2048; a++)
+    {
+        for (int32_t b = -2048; b < 2048; b++)
+        {
+            if (imin(a, b) != std::min(a, b) || imax(a, b) != std::max(a, b))
+            {
+                FAIL("a = " << a << ", b = " << b);
+            }
+        }
+    }
+}
+
+TEST_CASE("isign, iabs")
+{
+    for (int32_t val : edgeValues)
+    {
+        REQUIRE(isign(val) == (val > 0 ? 1 : val < 0 ? -1 : 0));
+        if (val != INT32_MIN)
+        {
+            REQUIRE(iabs(val) == std::abs(val));
+        }
+    }
+    REQUIRE(iabs(INT32_MIN) == INT32_MIN);
+    for (int32_t val = -1000000; val <= 1000000; val++)
+    {
+        if (isign(val) != (val > 0) - (val < 0) || iabs(val) != std::abs(val))
+        {
+            FAIL("val = " << val);
+        }
+    }
+}
+
+TEST_CASE("xorShift32")
+{
+    XorShift32 random(0); // (0 would get stuck, so it's swapped for the default)
+    REQUIRE(random.next() != 0);
+
+    // the same sequence from the same seed
+    XorShift32 a(12345);
+    XorShift32 b(12345);
+    for (int index = 0; index < 100; index++)
+    {
+        REQUIRE(a.next() == b.next());
+    }
+
+    // bounded numbers are in range, and about evenly spread
+    for (uint32_t bound : { 1u, 2u, 3u, 6u, 10u, 100u, 1000u })
+    {
+        std::vector<int> counts(bound);
+        const int numPerBucket = 2000;
+        for (uint32_t index = 0; index < bound * numPerBucket; index++)
+        {
+            uint32_t val = random.nextBelow(bound);
+            REQUIRE(val < bound);
+            counts[val]++;
+        }
+        for (int count : counts)
+        {
+            REQUIRE(std::abs(count - numPerBucket) < numPerBucket / 5);
+        }
+    }
+    REQUIRE(random.nextBelow(0) == 0);
+    for (int index = 0; index < 1000; index++)
+    {
+        REQUIRE(random.nextBelow(0x80000000u) < 0x80000000u);
+    }
+}
+
+// The full 32-bit range (hidden: run with microbit_test "[exhaustive]", preferably from an
+// optimised build)
+TEST_CASE("intMath exhaustive", "[.][exhaustive]")
+{
+    uint32_t v = 0;
+    do
+    {
+        uint64_t r = isqrt(v);
+        int32_t s = int32_t(v);
+        if (!(r * r <= v && (r + 1) * (r + 1) > v) || isign(s) != (s > 0) - (s < 0) || (s != INT32_MIN && iabs(s) != std::abs(s)))
+        {
+            FAIL("v = " << v);
+        }
+    } while (++v != 0);
+
+    // xorshift32 goes through every number but 0 before it repeats
+    XorShift32 random(1);
+    uint64_t period = 1;
+    while (random.next() != 1)
+    {
+        period++;
+    }
+    REQUIRE(period == 0xffffffffu);
+}
+
+//
+// benchmarks (hidden: run with microbit_test "[benchmark]")
+//
+template <typename F>
+static double timeNs(int count, F f)
+{
+    using clock = std::chrono::steady_clock;
+    auto start = clock::now();
+    f();
+    return std::chrono::duration<double>(clock::now() - start).count() * 1e9 / count;
+}
+
+TEST_CASE("intMath benchmark", "[.][benchmark]")
+{
+    const int count = 10000000;
+    std::vector<int32_t> values(4096);
+    XorShift32 random(7);
+    for (auto& val : values)
+    {
+        val = int32_t(random.next() >> 1) >> (random.next() % 31);
+    }
+
+    volatile uint32_t sink = 0;
+    double isqrtNs = timeNs(count, [&] {
+        uint32_t sum = 0;
+        for (int index = 0; index < count; index++)
+        {
+            sum += isqrt(uint32_t(values[index & 4095]));
+        }
+        sink = sink + sum;
+    });
+    double sqrtNs = timeNs(count, [&] {
+        uint32_t sum = 0;
+        for (int index = 0; index < count; index++)
+        {
+            sum += uint32_t(::sqrt(double(values[index & 4095])));
+        }
+        sink = sink + sum;
+    });
+    std::cout << "isqrt " << isqrtNs << " ns, (int)sqrt(double) " << sqrtNs << " ns" << std::endl;
+
+    double ipowNs = timeNs(count, [&] {
+        uint32_t sum = 0;
+        for (int index = 0; index < count; index++)
+        {
+            sum += uint32_t(ipow(values[index & 4095] & 15, index & 31));
+        }
+        sink = sink + sum;
+    });
+    std::cout << "ipow " << ipowNs << " ns" << std::endl;
+
+    double nextBelowNs = timeNs(count, [&] {
+        uint32_t sum = 0;
+        for (int index = 0; index < count; index++)
+        {
+            sum += random.nextBelow(uint32_t(index & 1023) + 1);
+        }
+        sink = sink + sum;
+    });
+    double randNs = timeNs(count, [&] {
+        uint32_t sum = 0;
+        for (int index = 0; index < count; index++)
+        {
+            sum += uint32_t(rand()) % (uint32_t(index & 1023) + 1);
+        }
+        sink = sink + sum;
+    });
+    std::cout << "xorShift32::nextBelow " << nextBelowNs << " ns, rand() % n " << randNs << " ns" << std::endl;
+
+    double iclampNs = timeNs(count, [&] {
+        uint32_t sum = 0;
+        for (int index = 0; index < count; index++)
+        {
+            sum += uint32_t(iclamp(values[index & 4095] >> 20, -128, 127) + isign(values[(index + 1) & 4095]));
+        }
+        sink = sink + sum;
+    });
+    double branchyNs = timeNs(count, [&] {
+        uint32_t sum = 0;
+        for (int index = 0; index < count; index++)
+        {
+            int32_t val = values[index & 4095] >> 20;
+            int32_t next = values[(index + 1) & 4095];
+            sum += uint32_t((val < -128 ? -128 : val > 127 ? 127 : val) + (next > 0 ? 1 : next == 0 ? 0 : -1));
+        }
+        sink = sink + sum;
+    });
+    std::cout << "iclamp + isign " << iclampNs << " ns, with branches " << branchyNs << " ns" << std::endl;
+}
@@ -0,0 +1,264 @@
+#include "LazyString.h"
+#include "PooledCollection.h"
+#include "heap_counter.h"
+
+#include "catch.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+// See catch tutorial: https://github.com/philsquared/Catch/blob/master/docs/tutorial.md
+
+// Stands in for ManagedString: reference counted, and every new string is one heap block
+// (except the empty one)
+class TestFlat
+{
+public:
+    TestFlat() : ptr_(&empty)
+    {
+    }
+
+    TestFlat(const char* s) : TestFlat(s, int16_t(strlen(s)))
+    {
+    }
+
+    TestFlat(const char* data, int16_t length) : TestFlat(length)
+    {
+        memcpy(ptr_->data, data, length);
+    }
+
+    TestFlat(const TestFlat& other) : ptr_(other.ptr_) { ptr_->refCount++; }
+    TestFlat& operator=(const TestFlat& other)
+    {
+        other.ptr_->refCount++;
+        release();
+        ptr_ = other.ptr_;
+        return *this;
+    }
+    ~TestFlat() { release(); }
+
+    // what ManagedString::operator+ does
+    TestFlat operator+(const TestFlat& other) const
+    {
+        TestFlat result(int16_t(ptr_->length + other.ptr_->length));
+        memcpy(result.ptr_->data, ptr_->data, ptr_->length);
+        memcpy(result.ptr_->data + ptr_->length, other.ptr_->data, other.ptr_->length);
+        return result;
+    }
+
+    int16_t length() const { return ptr_->length; }
+    const char* toCharArray() const { return ptr_->data; }
+
+private:
+    // (with room for length characters, not filled in)
+    explicit TestFlat(int16_t length)
+    {
+        ptr_ = static_cast<Data*>(::operator new(sizeof(Data) + length));
+        ptr_->refCount = 1;
+        ptr_->length = length;
+        ptr_->data[length] = 0;
+    }
+
+    struct Data
+    {
+        int refCount;
+        int16_t length;
+        char data[1];
+    };
+
+    static Data empty;
+
+    void release()
+    {
+        if (--ptr_->refCount == 0 && ptr_ != &empty)
+        {
+            ::operator delete(ptr_);
+        }
+    }
+
+    Data* ptr_;
+};
+
+TestFlat::Data TestFlat::empty = { 1, 0, { 0 } };
+
+using TestString = LazyString<TestFlat>;
+
+static std::string toStd(const TestString& s)
+{
+    std::string result;
+    for (int index = 0; index < s.length(); index++)
+    {
+        result += s.charAt(index);
+    }
+    return result;
+}
+
+//
+// lazyString tests
+//
+TEST_CASE("lazyString concat")
+{
+    TestString empty;
+    TestString hello(TestFlat("hello"));
+    TestString world(TestFlat(" world"));
+    REQUIRE(empty.length() == 0);
+    REQUIRE(hello.isFlat());
+
+    TestString both = hello.concat(world);
+    REQUIRE(!both.isFlat());
+    REQUIRE(toStd(both) == "hello world");
+    REQUIRE(toStd(hello) == "hello");
+    REQUIRE(toStd(hello.concat(empty)) == "hello");
+    REQUIRE(toStd(empty.concat(world)) == " world");
+
+    // appending to a string that isn't at the end of its buffer leaves the one that is alone
+    TestString a = both.concat(TestString(TestFlat("!")));
+    TestString b = both.concat(TestString(TestFlat("?")));
+    REQUIRE(toStd(a) == "hello world!");
+    REQUIRE(toStd(b) == "hello world?");
+    REQUIRE(toStd(both) == "hello world");
+
+    // with itself
+    TestString twice = a.concat(a);
+    REQUIRE(toStd(twice) == "hello world!hello world!");
+    REQUIRE(toStd(twice.concat(twice.substring(0, 5))) == "hello world!hello world!hello");
+
+    REQUIRE(std::string(twice.toCharArray()) == "hello world!hello world!");
+    REQUIRE(twice.isFlat());
+    REQUIRE(toStd(twice.concat(hello)) == "hello world!hello world!hello");
+}
+
+TEST_CASE("lazyString substring, equals and toNumber")
+{
+    TestString s = TestString(TestFlat("abc")).concat(TestString(TestFlat("def")));
+    REQUIRE(toStd(s.substring(2, 3)) == "cde");
+    REQUIRE(toStd(s.substring(4, 10)) == "ef");
+    REQUIRE(s.substring(6, 1).length() == 0);
+    REQUIRE(s.substring(-1, 1).length() == 0);
+    REQUIRE(s.substring(1, 0).length() == 0);
+    REQUIRE(toStd(TestString(TestFlat("flat")).substring(1, 2)) == "la");
+    REQUIRE(s.charAt(6) == 0);
+    REQUIRE(s.charAt(-1) == 0);
+
+    REQUIRE(s.equals(TestString(TestFlat("abcdef"))));
+    REQUIRE(!s.equals(TestString(TestFlat("abcdeg"))));
+    REQUIRE(!s.equals(TestString(TestFlat("abcde"))));
+    REQUIRE(TestString().equals(TestString(TestFlat(""))));
+
+    const char* numbers[] = { "42", "-17", "  +8x", "x8", "", "2147483647", "-2147483648", "\t12 3" };
+    for (auto number : numbers)
+    {
+        TestString built = TestString(TestFlat("")).concat(TestString(TestFlat(number)));
+        REQUIRE(built.toNumber() == atoi(number));
+    }
+}
+
+TEST_CASE("lazyString flattens once")
+{
+    TestString s(TestFlat("a"));
+    for (int index = 0; index < 20; index++)
+    {
+        s = s.concat(TestString(TestFlat("b")));
+    }
+    heapCounter.reset();
+    TestFlat flat = s;
+    TestFlat again = s;
+    size_t numAllocations = heapCounter.numAllocations;
+    REQUIRE(numAllocations == 1);
+    REQUIRE(std::string(flat.toCharArray()) == "a" + std::string(20, 'b'));
+    REQUIRE(again.toCharArray() == flat.toCharArray());
+}
+
+TEST_CASE("lazyString loop appends in place")
+{
+    const int numPieces = 1000;
+    TestString piece(TestFlat("12345"));
+    TestString s;
+    heapCounter.reset();
+    for (int index = 0; index < numPieces; index++)
+    {
+        s = s.concat(piece);
+    }
+    size_t numAllocations = heapCounter.numAllocations;
+    REQUIRE(s.length() == 5 * numPieces);
+    REQUIRE(s.charAt(5 * numPieces - 1) == '5');
+    REQUIRE(numAllocations < 20); // (the buffer grows by half each time)
+}
+
+TEST_CASE("lazyString collections come from the pool")
+{
+    // two pointers on the micro:bit, so a collection of them keeps two inline
+    REQUIRE(sizeof(TestString) <= 2 * sizeof(void*));
+    REQUIRE(PooledInlineCount<TestString>::value >= 2);
+
+    TestString hello(TestFlat("hello"));
+    heapCounter.reset();
+    size_t numUsed = getCollectionPool().getNumUsed();
+    size_t numUsedWith;
+    {
+        auto c = PooledCollection<TestString>::create();
+        c->push_back(hello);
+        c->push_back(hello);
+        numUsedWith = getCollectionPool().getNumUsed();
+    }
+    size_t numAllocations = heapCounter.numAllocations;
+    REQUIRE(numAllocations == 0);
+    REQUIRE(numUsedWith == numUsed + 1);
+    REQUIRE(getCollectionPool().getNumUsed() == numUsed);
+}
+
+//
+// benchmarks (hidden: run with microbit_test "[benchmark]")
+//
+TEST_CASE("lazyString benchmark", "[.][benchmark]")
+{
+    using clock = std::chrono::steady_clock;
+    const TestFlat pieces[] = { "x=", "12", ", ", "temp ", "-3", "; " };
+    const TestString lazyPieces[] = { pieces[0], pieces[1], pieces[2], pieces[3], pieces[4], pieces[5] };
+
+    for (int numPieces : { 10, 100, 1000 })
+    {
+        int numRuns = 100000 / numPieces;
+
+        // the old way: a new flat string per join
+        heapCounter.reset();
+        size_t startBytes = heapCounter.bytes;
+        auto start = clock::now();
+        size_t checksum = 0;
+        for (int run = 0; run < numRuns; run++)
+        {
+            TestFlat s;
+            for (int index = 0; index < numPieces; index++)
+            {
+                s = s + pieces[index % 6];
+            }
+            checksum += s.length();
+        }
+        double flatSeconds = std::chrono::duration<double>(clock::now() - start).count();
+        double flatAllocations = double(heapCounter.numAllocations) / numRuns;
+        size_t flatPeak = heapCounter.peakBytes - startBytes;
+
+        heapCounter.reset();
+        startBytes = heapCounter.bytes;
+        start = clock::now();
+        for (int run = 0; run < numRuns; run++)
+        {
+            TestString s;
+            for (int index = 0; index < numPieces; index++)
+            {
+                s = s.concat(lazyPieces[index % 6]);
+            }
+            TestFlat flat = s; // (on its way to the display)
+            checksum += flat.length();
+        }
+        double lazySeconds = std::chrono::duration<double>(clock::now() - start).count();
+        double lazyAllocations = double(heapCounter.numAllocations) / numRuns;
+        size_t lazyPeak = heapCounter.peakBytes - startBytes;
+
+        std::cout << numPieces << " pieces: flat " << (flatSeconds * 1e6 / numRuns) << " us, " << flatAllocations
+                  << " allocations, peak " << flatPeak << " bytes; lazy " << (lazySeconds * 1e6 / numRuns) << " us, "
+                  << lazyAllocations << " allocations, peak " << lazyPeak << " bytes (" << checksum << ")" << std::endl;
+    }
+}
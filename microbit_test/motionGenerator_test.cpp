@@ -0,0 +1,148 @@
+#include "motion_generator.h"
+#include "Gestures.h"
+
+#include "catch.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+using std::vector;
+
+// See catch tutorial: https://github.com/philsquared/Catch/blob/master/docs/tutorial.md
+
+//
+// motionGenerator tests
+//
+
+TEST_CASE("motionGenerator is deterministic across batch sizes")
+{
+    const size_t numSamples = 100000;
+    vector<byteVector3> whole(numSamples), pieces(numSamples);
+    vector<capture_label_t> wholeLabels(numSamples), pieceLabels(numSamples);
+
+    MotionGenerator generator1(MotionConfig::handHeld(), 7);
+    generator1.generate(whole.data(), wholeLabels.data(), numSamples);
+
+    MotionGenerator generator2(MotionConfig::handHeld(), 7);
+    for (size_t begin = 0; begin < numSamples; begin += 777)
+    {
+        size_t count = std::min<size_t>(777, numSamples - begin);
+        generator2.generate(pieces.data() + begin, pieceLabels.data() + begin, count);
+    }
+
+    for (size_t index = 0; index < numSamples; index++)
+    {
+        REQUIRE(whole[index].x == pieces[index].x);
+        REQUIRE(whole[index].y == pieces[index].y);
+        REQUIRE(whole[index].z == pieces[index].z);
+        REQUIRE(wholeLabels[index] == pieceLabels[index]);
+    }
+
+    // a different seed gives a different stream
+    MotionGenerator generator3(MotionConfig::handHeld(), 8);
+    generator3.generate(pieces.data(), nullptr, 1000);
+    int numSame = 0;
+    for (size_t index = 0; index < 1000; index++)
+    {
+        numSame += whole[index].x == pieces[index].x && whole[index].y == pieces[index].y && whole[index].z == pieces[index].z;
+    }
+    REQUIRE(numSame < 500);
+}
+
+TEST_CASE("motionGenerator labels")
+{
+    const size_t numSamples = 200000;
+    vector<byteVector3> samples(numSamples);
+    vector<capture_label_t> labels(numSamples);
+    MotionGenerator generator(MotionConfig::handHeld(), 1);
+    generator.generate(samples.data(), labels.data(), numSamples);
+
+    int counts[256] = {};
+    for (auto label : labels)
+    {
+        counts[label]++;
+    }
+    REQUIRE(counts[MICROBIT_ACCELEROMETER_TAP] > 100);
+    REQUIRE(counts[MICROBIT_ACCELEROMETER_SHAKE] > 10);
+    REQUIRE(counts[MICROBIT_ACCELEROMETER_FACE_DOWN] > 0);
+    REQUIRE(counts[MICROBIT_ACCELEROMETER_TILT_LEFT] > 0);
+    REQUIRE(counts[0] + counts[MICROBIT_ACCELEROMETER_TAP] + counts[MICROBIT_ACCELEROMETER_SHAKE]
+            + counts[MICROBIT_ACCELEROMETER_FACE_UP] + counts[MICROBIT_ACCELEROMETER_FACE_DOWN]
+            + counts[MICROBIT_ACCELEROMETER_TILT_UP] + counts[MICROBIT_ACCELEROMETER_TILT_DOWN]
+            + counts[MICROBIT_ACCELEROMETER_TILT_LEFT] + counts[MICROBIT_ACCELEROMETER_TILT_RIGHT] == int(numSamples));
+}
+
+TEST_CASE("motionGenerator on a table")
+{
+    MotionConfig config = MotionConfig::onTable();
+    config.glitchRate = 0;
+    const size_t numSamples = 20000;
+    vector<byteVector3> samples(numSamples);
+    vector<capture_label_t> labels(numSamples);
+    MotionGenerator generator(config, 3);
+    generator.generate(samples.data(), labels.data(), numSamples);
+
+    // face up the whole time: only taps get labelled, and between them it's 1g down Z
+    int numTaps = 0;
+    size_t sinceTap = numSamples;
+    for (size_t index = 0; index < numSamples; index++)
+    {
+        REQUIRE((labels[index] == 0 || labels[index] == MICROBIT_ACCELEROMETER_TAP));
+        if (labels[index] == MICROBIT_ACCELEROMETER_TAP)
+        {
+            numTaps++;
+            sinceTap = 0;
+        }
+        else if (++sinceTap > 25)
+        {
+            REQUIRE(std::abs(samples[index].x) <= 2);
+            REQUIRE(std::abs(samples[index].y) <= 2);
+            REQUIRE(std::abs(samples[index].z + 64) <= 2);
+        }
+    }
+    REQUIRE(numTaps > 50);
+}
+
+TEST_CASE("motionGenerator glitches")
+{
+    MotionConfig config = MotionConfig::onTable();
+    config.maxTapAmplitude = 0;
+    config.glitchRate = 0.01f;
+    const size_t numSamples = 100000;
+    vector<byteVector3> samples(numSamples);
+    MotionGenerator generator(config, 4);
+    generator.generate(samples.data(), nullptr, numSamples);
+
+    int numGlitches = 0;
+    for (const auto& sample : samples)
+    {
+        numGlitches += std::abs(sample.z + 64) > 4 || std::abs(sample.x) > 4;
+    }
+    REQUIRE(numGlitches > 800);
+    REQUIRE(numGlitches < 1200);
+}
+
+//
+// benchmarks (hidden: run with microbit_test "[benchmark]")
+//
+
+TEST_CASE("motionGenerator benchmark", "[.][benchmark]")
+{
+    using clock = std::chrono::steady_clock;
+    const size_t batchSize = 1 << 16;
+    const int numBatches = 1000;
+    vector<byteVector3> samples(batchSize);
+    vector<capture_label_t> labels(batchSize);
+    MotionGenerator generator(MotionConfig::handHeld(), 42);
+
+    int checksum = 0;
+    auto start = clock::now();
+    for (int batch = 0; batch < numBatches; batch++)
+    {
+        generator.generate(samples.data(), labels.data(), batchSize);
+        checksum += samples[batch % batchSize].z + labels[batch % batchSize];
+    }
+    double seconds = std::chrono::duration<double>(clock::now() - start).count();
+    std::cout << "motionGenerator: " << (batchSize * numBatches / seconds / 1e6) << " M samples/s (" << checksum << ")" << std::endl;
+}
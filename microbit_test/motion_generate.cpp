@@ -0,0 +1,95 @@
+#include "capture_file.h"
+#include "motion_generator.h"
+#include "replay.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// Writes a synthetic, labelled capture (see motion_generator.h) for the replay tools.
+//
+// usage: motion_generate [-p hand|table] [-n samples] [-s seed] [-g glitchRate] -o output.mbcap
+//   -p  preset (default: hand)
+//   -n  number of samples (default 1000000, about 5 hours at the detector's rate)
+//   -s  random seed (default 1)
+//   -g  chance of any one sample being an I2C glitch
+
+int main(int argc, char* argv[])
+{
+    MotionConfig config = MotionConfig::handHeld();
+    size_t numSamples = 1000000;
+    uint64_t seed = 1;
+    float glitchRate = -1;
+    const char* outputName = nullptr;
+
+    for (int argIndex = 1; argIndex < argc; argIndex++)
+    {
+        const char* arg = argv[argIndex];
+        if (strcmp(arg, "-p") == 0 && argIndex + 1 < argc)
+        {
+            const char* preset = argv[++argIndex];
+            if (strcmp(preset, "hand") == 0)
+            {
+                config = MotionConfig::handHeld();
+            }
+            else if (strcmp(preset, "table") == 0)
+            {
+                config = MotionConfig::onTable();
+            }
+            else
+            {
+                fprintf(stderr, "Unknown preset %s (hand or table)\n", preset);
+                return 1;
+            }
+        }
+        else if (strcmp(arg, "-n") == 0 && argIndex + 1 < argc)
+        {
+            numSamples = size_t(strtoull(argv[++argIndex], nullptr, 10));
+        }
+        else if (strcmp(arg, "-s") == 0 && argIndex + 1 < argc)
+        {
+            seed = strtoull(argv[++argIndex], nullptr, 10);
+        }
+        else if (strcmp(arg, "-g") == 0 && argIndex + 1 < argc)
+        {
+            glitchRate = float(atof(argv[++argIndex]));
+        }
+        else if (strcmp(arg, "-o") == 0 && argIndex + 1 < argc)
+        {
+            outputName = argv[++argIndex];
+        }
+        else
+        {
+            fprintf(stderr, "usage: motion_generate [-p hand|table] [-n samples] [-s seed] [-g glitchRate] -o output.mbcap\n");
+            return 1;
+        }
+    }
+
+    if (!outputName || numSamples == 0)
+    {
+        fprintf(stderr, "usage: motion_generate [-p hand|table] [-n samples] [-s seed] [-g glitchRate] -o output.mbcap\n");
+        return 1;
+    }
+    if (glitchRate >= 0)
+    {
+        config.glitchRate = glitchRate;
+    }
+
+    std::vector<byteVector3> samples(numSamples);
+    std::vector<capture_label_t> labels(numSamples);
+    std::vector<uint32_t> times(numSamples);
+    MotionGenerator generator(config, seed);
+    generator.generate(samples.data(), labels.data(), numSamples);
+    for (size_t index = 0; index < numSamples; index++)
+    {
+        times[index] = uint32_t(index * config.samplePeriod * 1000 + 0.5f);
+    }
+
+    if (!writeCaptureFile(outputName, samples, labels, times))
+    {
+        return 1;
+    }
+    printf("%s: %zu samples\n", outputName, numSamples);
+    return 0;
+}
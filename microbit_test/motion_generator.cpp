@@ -0,0 +1,244 @@
+#include "motion_generator.h"
+#include "Gestures.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+static constexpr double pi = 3.14159265358979323846; // (M_PI isn't standard)
+
+struct MotionPose
+{
+    int16_t gravity[3]; // mg
+    capture_label_t event;
+};
+
+static const MotionPose motionPoses[] = {
+    { { 0, 0, -1024 }, MICROBIT_ACCELEROMETER_FACE_UP },
+    { { 0, 0, 1024 }, MICROBIT_ACCELEROMETER_FACE_DOWN },
+    { { -1024, 0, 0 }, MICROBIT_ACCELEROMETER_TILT_LEFT },
+    { { 1024, 0, 0 }, MICROBIT_ACCELEROMETER_TILT_RIGHT },
+    { { 0, -1024, 0 }, MICROBIT_ACCELEROMETER_TILT_DOWN },
+    { { 0, 1024, 0 }, MICROBIT_ACCELEROMETER_TILT_UP },
+};
+static const int numMotionPoses = sizeof(motionPoses) / sizeof(motionPoses[0]);
+
+MotionConfig MotionConfig::handHeld()
+{
+    return MotionConfig();
+}
+
+MotionConfig MotionConfig::onTable()
+{
+    MotionConfig config;
+    config.noise = 6;
+    config.poseChangeRate = 0;
+    config.maxShakeAmplitude = 0;
+    config.minTapAmplitude = 150;
+    config.maxTapAmplitude = 450;
+    config.tapDamping = 0.6f;
+    return config;
+}
+
+MotionGenerator::MotionGenerator(const MotionConfig& config, uint64_t seed) : config_(config),
+                                                                              random_(seed * 0x9E3779B97F4A7C15ull + 1)
+{
+    // Noise: the sum of 4 uniforms is close enough to a gaussian, and costs nothing at
+    // generation time since it's all in the table
+    const float noiseScale = config_.noise * std::sqrt(3.0f) / (1 << 16);
+    for (auto& val : noiseTable_)
+    {
+        uint64_t r = nextRandom();
+        int32_t sum = 0;
+        for (int part = 0; part < 4; part++)
+        {
+            sum += int32_t((r >> (16 * part)) & 0xffff) - 0x8000;
+        }
+        val = int16_t(std::lround(sum * noiseScale));
+    }
+
+    for (int index = 0; index < (1 << sineTableBits); index++)
+    {
+        sineTable_[index] = int16_t(std::lround(32767 * std::sin(2 * pi * index / (1 << sineTableBits))));
+    }
+
+    glitchThreshold_ = uint32_t(std::min(1.0f, std::max(0.0f, config_.glitchRate)) * (1 << 24));
+    tapDamping_ = int32_t(config_.tapDamping * (1 << 15));
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        gravity_[axis] = int32_t(motionPoses[pose_].gravity[axis]) << 16;
+    }
+    startHold();
+}
+
+uint64_t MotionGenerator::nextRandom()
+{
+    // xorshift64*
+    random_ ^= random_ >> 12;
+    random_ ^= random_ << 25;
+    random_ ^= random_ >> 27;
+    return random_ * 0x2545F4914F6CDD1Dull;
+}
+
+int MotionGenerator::randomRange(int minVal, int maxVal)
+{
+    if (maxVal <= minVal)
+    {
+        return minVal;
+    }
+    return minVal + int((nextRandom() >> 32) % uint32_t(maxVal - minVal + 1));
+}
+
+void MotionGenerator::startSegment()
+{
+    bool canTurn = config_.poseChangeRate > 0 && config_.maxTurn > 0;
+    bool canShake = config_.maxShakeAmplitude > 0 && config_.maxShakeLength > 0;
+    if (segment_ != SEGMENT_HOLD || (!canTurn && !canShake))
+    {
+        startHold();
+    }
+    else if (canTurn && (!canShake || (nextRandom() >> 40) < uint64_t(config_.poseChangeRate * (1 << 24))))
+    {
+        startTurn();
+    }
+    else
+    {
+        startShake();
+    }
+}
+
+void MotionGenerator::startHold()
+{
+    if (segment_ == SEGMENT_TURN)
+    {
+        // land exactly on the pose, whatever the rounding did on the way
+        for (int axis = 0; axis < 3; axis++)
+        {
+            gravity_[axis] = int32_t(motionPoses[pose_].gravity[axis]) << 16;
+        }
+        pendingLabel_ = motionPoses[pose_].event;
+    }
+
+    segment_ = SEGMENT_HOLD;
+    segmentLeft_ = size_t(std::max(1, randomRange(config_.minHold, config_.maxHold)));
+    untilTap_ = config_.maxTapAmplitude > 0 ? size_t(randomRange(config_.minTapGap, config_.maxTapGap))
+                                            : std::numeric_limits<size_t>::max();
+    std::fill(gravityStep_, gravityStep_ + 3, 0);
+    std::fill(shakeAmplitude_, shakeAmplitude_ + 3, 0);
+}
+
+void MotionGenerator::startTurn()
+{
+    segment_ = SEGMENT_TURN;
+    segmentLeft_ = size_t(std::max(1, randomRange(config_.minTurn, config_.maxTurn)));
+    pose_ = (pose_ + randomRange(1, numMotionPoses - 1)) % numMotionPoses;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        int32_t target = int32_t(motionPoses[pose_].gravity[axis]) << 16;
+        gravityStep_[axis] = (target - gravity_[axis]) / int32_t(segmentLeft_);
+    }
+}
+
+void MotionGenerator::startShake()
+{
+    segment_ = SEGMENT_SHAKE;
+    segmentLeft_ = size_t(std::max(1, randomRange(config_.minShakeLength, config_.maxShakeLength)));
+    pendingLabel_ = MICROBIT_ACCELEROMETER_SHAKE;
+
+    float frequency = config_.minShakeFrequency + (config_.maxShakeFrequency - config_.minShakeFrequency) * (nextRandom() >> 40) / float(1 << 24);
+    shakePhaseStep_ = uint32_t(frequency * config_.samplePeriod * 4294967296.0);
+    shakePhase_ = 0;
+
+    // along a random direction, mostly in the plane of the board
+    float dir[3] = { float(randomRange(-1024, 1024)), float(randomRange(-1024, 1024)), float(randomRange(-256, 256)) };
+    float len = std::sqrt(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+    int amplitude = randomRange(config_.minShakeAmplitude, config_.maxShakeAmplitude);
+    for (int axis = 0; axis < 3; axis++)
+    {
+        shakeAmplitude_[axis] = len > 0 ? int32_t(amplitude * dir[axis] / len) : (axis == 0 ? amplitude : 0);
+    }
+}
+
+void MotionGenerator::startTap()
+{
+    // mostly into the board, with a bit of sideways push
+    int amplitude = randomRange(config_.minTapAmplitude, config_.maxTapAmplitude);
+    int sign = (nextRandom() >> 63) ? 1 : -1;
+    ring_[0] += randomRange(-amplitude / 4, amplitude / 4) * (1 << 15);
+    ring_[1] += randomRange(-amplitude / 4, amplitude / 4) * (1 << 15);
+    ring_[2] += sign * amplitude * (1 << 15);
+    pendingLabel_ = MICROBIT_ACCELEROMETER_TAP;
+    untilTap_ = size_t(std::max(1, randomRange(config_.minTapGap, config_.maxTapGap)));
+}
+
+void MotionGenerator::generate(byteVector3* samples, capture_label_t* labels, size_t numSamples)
+{
+    while (numSamples > 0)
+    {
+        if (segmentLeft_ == 0)
+        {
+            startSegment();
+        }
+        if (segment_ == SEGMENT_HOLD && untilTap_ == 0)
+        {
+            startTap();
+        }
+
+        size_t count = std::min(numSamples, segmentLeft_);
+        if (segment_ == SEGMENT_HOLD)
+        {
+            count = std::min(count, untilTap_);
+        }
+
+        if (labels)
+        {
+            labels[0] = pendingLabel_;
+            memset(labels + 1, 0, (count - 1) * sizeof(capture_label_t));
+            labels += count;
+        }
+        pendingLabel_ = 0;
+
+        run(samples, count);
+        samples += count;
+        numSamples -= count;
+        segmentLeft_ -= count;
+        if (segment_ == SEGMENT_HOLD)
+        {
+            untilTap_ -= count;
+        }
+    }
+}
+
+void MotionGenerator::run(byteVector3* samples, size_t count)
+{
+    const int32_t noiseMask = (1 << noiseTableBits) - 1;
+    for (size_t index = 0; index < count; index++)
+    {
+        uint64_t r = nextRandom();
+        int32_t sine = sineTable_[shakePhase_ >> (32 - sineTableBits)];
+        shakePhase_ += shakePhaseStep_;
+
+        int32_t mg[3];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            gravity_[axis] += gravityStep_[axis];
+            mg[axis] = (gravity_[axis] >> 16)
+                     + ((sine * shakeAmplitude_[axis]) >> 15)
+                     + (ring_[axis] >> 15)
+                     + noiseTable_[(r >> (noiseTableBits * axis)) & noiseMask];
+            ring_[axis] = -int32_t((int64_t(ring_[axis]) * tapDamping_) >> 15);
+        }
+
+        // same scaling as getAccelData()
+        samples[index] = byteVector3(clampByte(mg[0] >> 4), clampByte(mg[1] >> 4), clampByte(mg[2] >> 4));
+
+        if (uint32_t(r >> 40) < glitchThreshold_)
+        {
+            // (fresh bits: the ones that decided this is a glitch are mostly zeros)
+            uint64_t garbage = nextRandom();
+            samples[index] = byteVector3(int8_t(garbage >> 40), int8_t(garbage >> 48), int8_t(garbage >> 56));
+        }
+    }
+}
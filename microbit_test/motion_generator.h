@@ -0,0 +1,117 @@
+#pragma once
+
+#include "Vector3.h"
+#include "capture_file.h" // for capture_label_t
+
+#include <cstddef>
+#include <cstdint>
+
+// Synthetic accelerometer streams with ground-truth labels, for stress tests and benchmarks
+// that need more data than we'll ever record.
+//
+// The board alternates between holding a pose (face up, face down or one of the tilts),
+// turning to the next one, and shaking. Taps happen while it's holding still, and ring
+// down as fast as the surface lets them. Everything is worked out in milli-g, like the
+// DAL's accelerometer, with sensor noise added, and then scaled down with the same >> 4
+// (1024 mg -> 64) and clamp that getAccelData() does. Now and then an I2C read glitch
+// replaces a whole sample with garbage.
+//
+// Labels mark where each gesture starts: the first sample of a tap or a shake, and the
+// sample where a turn reaches its pose (as the matching face/tilt event). Glitches aren't
+// labelled.
+//
+// The inner loop is all integer adds, shifts and table lookups, with the scheduling done
+// once per segment rather than per sample, so it runs at a few hundred million samples a
+// second and never holds up the replay or the benchmarks.
+
+struct MotionConfig
+{
+    float samplePeriod = 0.018f; // seconds
+
+    int noise = 24;              // sensor noise, standard deviation in mg
+    float glitchRate = 1e-4f;    // chance of any one sample being a glitch
+
+    // Holding still (with taps), in samples
+    int minHold = 100;
+    int maxHold = 600;
+    int minTurn = 20;
+    int maxTurn = 60;
+    float poseChangeRate = 0.5f; // chance that a hold ends in a turn to a new pose (otherwise it's a shake)
+
+    // Shakes
+    float minShakeFrequency = 2.5f; // Hz
+    float maxShakeFrequency = 6.0f;
+    int minShakeAmplitude = 600;    // mg
+    int maxShakeAmplitude = 2000;
+    int minShakeLength = 40;        // samples
+    int maxShakeLength = 200;
+
+    // Taps, while holding
+    int minTapGap = 30;             // samples between taps
+    int maxTapGap = 200;
+    int minTapAmplitude = 400;      // mg
+    int maxTapAmplitude = 1100;
+    float tapDamping = 0.3f;        // how much of the ring is left after each sample: ~0.3 in the hand, ~0.6 on a table
+
+    static MotionConfig handHeld();
+    static MotionConfig onTable(); // quieter, harder taps that ring longer, no turns or shakes
+};
+
+class MotionGenerator
+{
+public:
+    MotionGenerator(const MotionConfig& config, uint64_t seed);
+
+    // Fills the next numSamples samples and labels (labels can be null). Streams carry on
+    // across calls, so generating in one big batch or lots of small ones gives the same data.
+    void generate(byteVector3* samples, capture_label_t* labels, size_t numSamples);
+
+private:
+    enum SegmentType
+    {
+        SEGMENT_HOLD,
+        SEGMENT_TURN,
+        SEGMENT_SHAKE,
+    };
+
+    static constexpr int noiseTableBits = 12;
+    static constexpr int sineTableBits = 8;
+
+    uint64_t nextRandom();
+    int randomRange(int minVal, int maxVal); // inclusive
+    void startSegment();
+    void startHold();
+    void startTurn();
+    void startShake();
+    void startTap();
+    void run(byteVector3* samples, size_t count);
+
+    MotionConfig config_;
+    uint64_t random_;
+
+    int16_t noiseTable_[1 << noiseTableBits]; // ~N(0, noise), in mg
+    int16_t sineTable_[1 << sineTableBits];   // Q15
+    uint32_t glitchThreshold_;               // against 24 random bits
+    int32_t tapDamping_;                     // Q15
+
+    // The current segment
+    SegmentType segment_ = SEGMENT_HOLD;
+    size_t segmentLeft_ = 0;
+    size_t untilTap_ = 0;                   // in a hold
+    int pose_ = 0;
+
+    // Gravity, in mg with 16 fractional bits, and how much it moves each sample
+    int32_t gravity_[3];
+    int32_t gravityStep_[3] = { 0, 0, 0 };
+
+    // Shake: a sine along shakeAmplitude_ (mg, per axis)
+    uint32_t shakePhase_ = 0;
+    uint32_t shakePhaseStep_ = 0;
+    int32_t shakeAmplitude_[3] = { 0, 0, 0 };
+
+    // Tap ring-down, in mg with 15 fractional bits, changing sign every sample
+    int32_t ring_[3] = { 0, 0, 0 };
+
+    // The label for the next sample generated
+    capture_label_t pendingLabel_ = 0;
+};
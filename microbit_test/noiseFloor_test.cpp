@@ -0,0 +1,63 @@
+#include "NoiseFloor.h"
+
+#include "catch.hpp"
+
+// See catch tutorial: https://github.com/philsquared/Catch/blob/master/docs/tutorial.md
+
+//
+// noiseFloor tests
+//
+
+TEST_CASE("noiseFloor falls fast, rises slow")
+{
+    NoiseFloorEstimator<uint16_t, 8, 2> floor;
+    REQUIRE(floor.getFloor() == 255);
+
+    for (int index = 0; index < 40; index++)
+    {
+        floor.addSample(10);
+    }
+    REQUIRE(floor.getFloor() == 10);
+
+    // a short burst barely moves it
+    for (int index = 0; index < 5; index++)
+    {
+        floor.addSample(200);
+    }
+    REQUIRE(floor.getFloorFloat() < 30);
+
+    // ... and it comes right back down
+    for (int index = 0; index < 20; index++)
+    {
+        floor.addSample(10);
+    }
+    REQUIRE(floor.getFloor() == 10);
+
+    // but a sustained rise gets through eventually
+    for (int index = 0; index < 2000; index++)
+    {
+        floor.addSample(100);
+    }
+    REQUIRE(floor.getFloorFloat() == Approx(100).epsilon(0.02));
+    for (int index = 0; index < 2000; index++)
+    {
+        floor.addSample(100);
+    }
+    REQUIRE(floor.getFloor() == 100); // (all the way, not just close)
+}
+
+TEST_CASE("noiseFloor saturates")
+{
+    NoiseFloorEstimator<uint16_t, 8, 2> floor(0);
+    REQUIRE(floor.getFloor() == 0);
+
+    floor.addSample(-10);
+    REQUIRE(floor.getFloor() == 0);
+
+    for (int index = 0; index < 5000; index++)
+    {
+        floor.addSample(100000);
+    }
+    REQUIRE(floor.getFloor() == 255);
+    REQUIRE(floor.getFloorFloat() <= 255);
+}
@@ -0,0 +1,321 @@
+#include "PooledCollection.h"
+#include "heap_counter.h"
+
+#include "catch.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// See catch tutorial: https://github.com/philsquared/Catch/blob/master/docs/tutorial.md
+
+// Counts live objects, to check SmallVector constructs and destroys the right ones
+struct Tracked
+{
+    static int numLive;
+    int val;
+
+    Tracked(int v = 0) : val(v) { numLive++; }
+    Tracked(const Tracked& other) : val(other.val) { numLive++; }
+    ~Tracked() { numLive--; }
+    Tracked& operator=(const Tracked& other) = default;
+};
+
+int Tracked::numLive = 0;
+
+//
+// fixedBlockPool tests
+//
+TEST_CASE("fixedBlockPool test")
+{
+    FixedBlockPool<24, 3> pool;
+    void* a = pool.allocate();
+    void* b = pool.allocate();
+    void* c = pool.allocate();
+    REQUIRE(a != nullptr);
+    REQUIRE(b != nullptr);
+    REQUIRE(c != nullptr);
+    REQUIRE(pool.allocate() == nullptr);
+    REQUIRE(pool.owns(a));
+    REQUIRE(pool.owns(c));
+    REQUIRE(pool.getNumUsed() == 3);
+
+    int notOurs;
+    REQUIRE(!pool.owns(&notOurs));
+
+    // freed blocks come back first, last in first out
+    pool.deallocate(b);
+    pool.deallocate(a);
+    REQUIRE(pool.getNumUsed() == 1);
+    REQUIRE(pool.allocate() == a);
+    REQUIRE(pool.allocate() == b);
+    REQUIRE(pool.getPeakUsed() == 3);
+    REQUIRE(pool.blockSize() >= 24);
+}
+
+//
+// smallVector tests
+//
+TEST_CASE("smallVector inline and spilled")
+{
+    SmallVector<int, 4> vec;
+    for (int index = 0; index < 4; index++)
+    {
+        vec.push_back(index);
+    }
+    REQUIRE(vec.isInline());
+
+    heapCounter.reset();
+    vec.push_back(4);
+    size_t numAllocations = heapCounter.numAllocations;
+    REQUIRE(!vec.isInline());
+    REQUIRE(numAllocations == 1);
+    REQUIRE(vec.size() == 5);
+    for (int index = 0; index < 5; index++)
+    {
+        REQUIRE(vec[index] == index);
+    }
+
+    // pushing one of its own elements while it grows
+    for (int index = 0; index < 10; index++)
+    {
+        vec.push_back(vec[0]);
+    }
+    REQUIRE(vec.size() == 15);
+    REQUIRE(vec.back() == 0);
+}
+
+TEST_CASE("smallVector erase and swapRemove")
+{
+    SmallVector<int, 2> vec;
+    for (int index = 0; index < 6; index++)
+    {
+        vec.push_back(index);
+    }
+
+    vec.erase(1); // 0 2 3 4 5
+    REQUIRE(vec.size() == 5);
+    REQUIRE(vec[1] == 2);
+    REQUIRE(vec[4] == 5);
+
+    vec.swapRemove(1); // 0 5 3 4
+    REQUIRE(vec.size() == 4);
+    REQUIRE(vec[1] == 5);
+    REQUIRE(vec[3] == 4);
+
+    vec.swapRemove(3); // the last one: 0 5 3
+    REQUIRE(vec.size() == 3);
+    REQUIRE(vec[2] == 3);
+}
+
+TEST_CASE("smallVector element lifetimes")
+{
+    {
+        SmallVector<Tracked, 3> vec;
+        for (int index = 0; index < 10; index++)
+        {
+            vec.push_back(Tracked(index));
+        }
+        REQUIRE(Tracked::numLive == 10);
+
+        SmallVector<Tracked, 3> copy(vec);
+        REQUIRE(Tracked::numLive == 20);
+        copy.erase(0);
+        copy.swapRemove(0);
+        REQUIRE(Tracked::numLive == 18);
+        REQUIRE(copy[0].val == 9);
+
+        vec = copy;
+        REQUIRE(Tracked::numLive == 16);
+        REQUIRE(vec.size() == 8);
+    }
+    REQUIRE(Tracked::numLive == 0);
+}
+
+TEST_CASE("smallVector with strings")
+{
+    SmallVector<std::string, 2> vec;
+    vec.push_back("a fairly long string, so it's on the heap");
+    vec.push_back("b");
+    vec.push_back("c");
+    vec.erase(0);
+    REQUIRE(vec[0] == "b");
+    REQUIRE(vec[1] == "c");
+}
+
+//
+// pooledCollection tests
+//
+TEST_CASE("pooledCollection sharing")
+{
+    PooledCollection<int> empty;
+    REQUIRE(empty.get() == nullptr);
+
+    size_t numUsed = getCollectionPool().getNumUsed();
+    {
+        auto c = PooledCollection<int>::create();
+        REQUIRE(getCollectionPool().getNumUsed() == numUsed + 1);
+        c->push_back(3);
+
+        auto d = c;
+        REQUIRE(d == c);
+        REQUIRE(c.getReferences() == 2);
+        d->push_back(4);
+        REQUIRE(c->size() == 2);
+
+        d = PooledCollection<int>::create();
+        REQUIRE(d != c);
+        REQUIRE(c.getReferences() == 1);
+    }
+    REQUIRE(getCollectionPool().getNumUsed() == numUsed);
+}
+
+TEST_CASE("pooledCollection control blocks fit the pool")
+{
+    // The common element types, on the target and the host
+    REQUIRE(sizeof(SmallVector<int, 4>) + sizeof(uint16_t) <= CollectionPool::blockSize());
+    REQUIRE(sizeof(SmallVector<void*, 4>) + sizeof(uint16_t) <= CollectionPool::blockSize());
+}
+
+TEST_CASE("pooledCollection small churn doesn't touch the heap")
+{
+    heapCounter.reset();
+    for (int iteration = 0; iteration < 1000; iteration++)
+    {
+        auto c = PooledCollection<int>::create();
+        for (int index = 0; index < iteration % 8; index++) // spills to a second pool block past 4
+        {
+            c->push_back(index);
+        }
+        if (!c->empty())
+        {
+            c->swapRemove(0);
+        }
+    }
+    size_t numAllocations = heapCounter.numAllocations;
+    REQUIRE(numAllocations == 0);
+}
+
+TEST_CASE("pooledCollection falls back to the heap")
+{
+    std::vector<PooledCollection<int>> collections;
+    for (size_t index = 0; index < CollectionPool::capacity() + 4; index++)
+    {
+        collections.push_back(PooledCollection<int>::create());
+        collections.back()->push_back(int(index));
+    }
+    for (size_t index = 0; index < collections.size(); index++)
+    {
+        REQUIRE(collections[index]->at(0) == int(index));
+    }
+
+    // a big one
+    auto big = PooledCollection<int>::create();
+    for (int index = 0; index < 1000; index++)
+    {
+        big->push_back(index);
+    }
+    REQUIRE(big->at(999) == 999);
+
+    collections.clear();
+    big = PooledCollection<int>();
+    REQUIRE(getCollectionPool().getNumUsed() == 0);
+}
+
+//
+// benchmarks (hidden: run with microbit_test "[benchmark]")
+//
+
+// What create::collection_of() used to hand out: a ManagedType<vector<T>>, with the
+// reference count in a separate allocation
+template <typename T>
+class VectorHandle
+{
+public:
+    static VectorHandle create()
+    {
+        VectorHandle result;
+        result.object_ = new std::vector<T>();
+        result.ref_ = new int(1);
+        return result;
+    }
+
+    VectorHandle() = default;
+    VectorHandle(const VectorHandle& other) : object_(other.object_), ref_(other.ref_)
+    {
+        if (ref_)
+        {
+            (*ref_)++;
+        }
+    }
+    VectorHandle& operator=(VectorHandle other)
+    {
+        std::swap(object_, other.object_);
+        std::swap(ref_, other.ref_);
+        return *this;
+    }
+    ~VectorHandle()
+    {
+        if (ref_ && --(*ref_) == 0)
+        {
+            delete object_;
+            delete ref_;
+        }
+    }
+
+    std::vector<T>* operator->() const { return object_; }
+
+private:
+    std::vector<T>* object_ = nullptr;
+    int* ref_ = nullptr;
+};
+
+// A script that builds and throws away small collections in a loop, with a few kept
+// alive at a time
+template <typename Handle, typename RemoveFn>
+static void runChurn(const char* name, RemoveFn remove)
+{
+    using clock = std::chrono::steady_clock;
+    const int numIterations = 2000000;
+    const int numLive = 8;
+    uint32_t random = 1;
+
+    heapCounter.reset();
+    size_t startBytes = heapCounter.bytes;
+    int checksum = 0;
+    auto start = clock::now();
+    {
+        std::vector<Handle> live(numLive);
+        for (int iteration = 0; iteration < numIterations; iteration++)
+        {
+            random = random * 1664525u + 1013904223u;
+            auto c = Handle::create();
+            int numItems = (random >> 16) % 12;
+            for (int index = 0; index < numItems; index++)
+            {
+                c->push_back(index);
+            }
+            while (c->size() > 2)
+            {
+                remove(*c.operator->(), (random >> 8) % c->size());
+            }
+            checksum += int(c->size());
+            live[iteration % numLive] = c;
+        }
+    }
+    double seconds = std::chrono::duration<double>(clock::now() - start).count();
+    std::cout << name << ": " << (seconds * 1e9 / numIterations) << " ns/iteration, "
+              << (double(heapCounter.numAllocations) / numIterations) << " heap allocations/iteration, peak heap "
+              << (heapCounter.peakBytes - startBytes) << " bytes (" << checksum << ")" << std::endl;
+}
+
+TEST_CASE("pooledCollection benchmark", "[.][benchmark]")
+{
+    runChurn<VectorHandle<int>>("vector + erase", [](std::vector<int>& v, size_t index) { v.erase(v.begin() + index); });
+    runChurn<PooledCollection<int>>("pooled + erase", [](PooledCollection<int>::Items& v, size_t index) { v.erase(index); });
+    runChurn<PooledCollection<int>>("pooled + swapRemove", [](PooledCollection<int>::Items& v, size_t index) { v.swapRemove(index); });
+    std::cout << "collection pool: " << getCollectionPool().getPeakUsed() << " of " << CollectionPool::capacity()
+              << " blocks of " << CollectionPool::blockSize() << " bytes at peak" << std::endl;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Stands in for the radio (MicroBitRadioDatagram): keeps every packet sent, so a test can
+// check them and count them. On the air, each packet also carries a preamble (1 byte), an
+// address (5), the DAL's radio header (4, with the length) and a CRC (2).
+class RadioLoopback
+{
+public:
+    static constexpr int overheadBytes = 12;
+
+    int send(uint8_t* data, int length)
+    {
+        packets.emplace_back(data, data + length);
+        return 0;
+    }
+
+    int getNumPackets() const { return int(packets.size()); }
+
+    int getNumBytesOnAir() const
+    {
+        int numBytes = 0;
+        for (const auto& packet : packets)
+        {
+            numBytes += int(packet.size()) + overheadBytes;
+        }
+        return numBytes;
+    }
+
+    std::vector<std::vector<uint8_t>> packets;
+};
@@ -0,0 +1,408 @@
+#include "ReleaseQueue.h"
+#include "SizeClassHeap.h"
+#include "heap_counter.h"
+
+#include "catch.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <new>
+
+// See catch tutorial: https://github.com/philsquared/Catch/blob/master/docs/tutorial.md
+
+//
+// A cut-down copy of the BitVM object model (BitVM.h needs the DAL), with the old
+// delete-right-away reference counting and the deferred, free-listed kind side by side
+//
+template <bool Deferred>
+class TestObject
+{
+public:
+    static int numLive;
+
+    uint16_t refcnt = 1;
+    bool releaseQueued = false;
+
+    TestObject() { numLive++; }
+    virtual ~TestObject() { numLive--; }
+
+    static SizeClassHeap<8, 8>& getHeap()
+    {
+        static SizeClassHeap<8, 8> heap;
+        return heap;
+    }
+
+    static ReleaseQueue<TestObject, 32>& getQueue()
+    {
+        static ReleaseQueue<TestObject, 32> queue;
+        return queue;
+    }
+
+    static void* operator new(size_t size)
+    {
+        if (!Deferred)
+        {
+            return ::operator new(size);
+        }
+        void* p = getHeap().allocate(size);
+        if (!p)
+        {
+            getQueue().flush();
+            p = getHeap().allocate(size);
+            if (!p)
+            {
+                throw std::bad_alloc();
+            }
+        }
+        return p;
+    }
+
+    static void operator delete(void* p, size_t size)
+    {
+        if (Deferred)
+        {
+            getHeap().deallocate(p, size);
+        }
+        else
+        {
+            ::operator delete(p);
+        }
+    }
+
+    void ref() { refcnt++; }
+
+    void unref()
+    {
+        if (--refcnt == 0)
+        {
+            if (Deferred)
+            {
+                getQueue().release(this);
+            }
+            else
+            {
+                delete this;
+            }
+        }
+    }
+
+    bool isReferenced() const { return refcnt > 0; }
+    void destroy() { delete this; }
+};
+
+template <bool Deferred>
+int TestObject<Deferred>::numLive = 0;
+
+template <bool Deferred>
+static void decr(TestObject<Deferred>* obj)
+{
+    if (obj)
+    {
+        obj->unref();
+    }
+}
+
+// A record with two reference fields and two plain ones
+template <bool Deferred>
+class TestRecord : public TestObject<Deferred>
+{
+public:
+    TestObject<Deferred>* refs[2] = { nullptr, nullptr };
+    uint32_t vals[2] = { 0, 0 };
+
+    ~TestRecord()
+    {
+        decr(refs[0]);
+        decr(refs[1]);
+    }
+};
+
+// A collection of references
+template <bool Deferred>
+class TestCollection : public TestObject<Deferred>
+{
+public:
+    static const int capacity = 8;
+    TestObject<Deferred>* items[capacity] = {};
+
+    ~TestCollection()
+    {
+        for (auto item : items)
+        {
+            decr(item);
+        }
+    }
+
+    // Takes over the caller's reference
+    void set(int index, TestObject<Deferred>* item)
+    {
+        decr(items[index]);
+        items[index] = item;
+    }
+};
+
+using DeferredObject = TestObject<true>;
+using DeferredRecord = TestRecord<true>;
+using DeferredCollection = TestCollection<true>;
+
+//
+// sizeClassHeap tests
+//
+TEST_CASE("sizeClassHeap reuses blocks")
+{
+    SizeClassHeap<8, 4> heap;
+    void* a = heap.allocate(12);
+    void* b = heap.allocate(16);
+    heap.deallocate(a, 12);
+    heap.deallocate(b, 16);
+    REQUIRE(heap.getNumCached() == 2);
+
+    // same class, last in first out
+    REQUIRE(heap.allocate(9) == b);
+    REQUIRE(heap.allocate(16) == a);
+    REQUIRE(heap.getNumCached() == 0);
+
+    // too big for a class
+    void* big = heap.allocate(100);
+    heap.deallocate(big, 100);
+    REQUIRE(heap.getNumCached() == 0);
+
+    heap.deallocate(a, 16);
+    heap.deallocate(b, 16);
+    heap.trim();
+    REQUIRE(heap.getNumCached() == 0);
+}
+
+TEST_CASE("sizeClassHeap trims when the heap runs out")
+{
+    SizeClassHeap<8, 4> heap;
+    heap.deallocate(heap.allocate(8), 8);
+    heap.deallocate(heap.allocate(16), 16);
+    REQUIRE(heap.getNumCached() == 2);
+
+    // no room for a 24-byte block until the cached ones go back, and then room for one
+    heapCounter.limitBytes = heapCounter.bytes;
+    void* p = heap.allocate(24);
+    size_t numCached = heap.getNumCached();
+    void* q = heap.allocate(24);
+    heapCounter.limitBytes = size_t(-1);
+
+    REQUIRE(p);
+    REQUIRE(numCached == 0);
+    REQUIRE(!q);
+    heap.deallocate(p, 24);
+}
+
+TEST_CASE("sizeClassHeap caps what it caches")
+{
+    SizeClassHeap<8, 4, 32> heap;
+    void* blocks[6];
+    for (auto& block : blocks)
+    {
+        block = heap.allocate(8);
+    }
+    size_t bytes = heapCounter.bytes;
+    for (auto block : blocks)
+    {
+        heap.deallocate(block, 8);
+    }
+    size_t bytesFreed = bytes - heapCounter.bytes;
+
+    // four fit, the other two go back to the heap
+    REQUIRE(heap.getNumCached() == 4);
+    REQUIRE(heap.getCachedBytes() == 32);
+    REQUIRE(bytesFreed == 16);
+
+    // a bigger class doesn't fit either
+    heap.deallocate(heap.allocate(16), 16);
+    REQUIRE(heap.getCachedBytes() == 32);
+}
+
+TEST_CASE("sizeClassHeap trims the biggest classes first")
+{
+    SizeClassHeap<8, 4> heap;
+    void* small = heap.allocate(8);
+    void* medium = heap.allocate(16);
+    void* big = heap.allocate(32);
+    heap.deallocate(small, 8);
+    heap.deallocate(medium, 16);
+    heap.deallocate(big, 32);
+    REQUIRE(heap.getCachedBytes() == 56);
+
+    heap.trim(30);
+    REQUIRE(heap.getCachedBytes() == 24);
+    heap.trim(10);
+    REQUIRE(heap.getCachedBytes() == 8);
+    REQUIRE(heap.allocate(8) == small);
+    heap.deallocate(small, 8);
+    heap.trim();
+    REQUIRE(heap.getNumCached() == 0);
+}
+
+//
+// releaseQueue tests
+//
+TEST_CASE("releaseQueue deletes on flush")
+{
+    auto& queue = DeferredObject::getQueue();
+    int numLive = DeferredObject::numLive;
+
+    auto obj = new DeferredObject();
+    obj->unref();
+    REQUIRE(DeferredObject::numLive == numLive + 1);
+    REQUIRE(queue.size() == 1);
+
+    queue.flush();
+    REQUIRE(DeferredObject::numLive == numLive);
+    REQUIRE(queue.size() == 0);
+}
+
+TEST_CASE("releaseQueue leaves objects that were picked up again")
+{
+    auto& queue = DeferredObject::getQueue();
+    int numLive = DeferredObject::numLive;
+
+    auto obj = new DeferredObject();
+    obj->unref();
+    obj->ref(); // e.g., popped off the stack and stored somewhere
+    queue.flush();
+    REQUIRE(DeferredObject::numLive == numLive + 1);
+
+    obj->unref();
+    obj->ref();
+    obj->unref(); // queued once, not twice
+    REQUIRE(queue.size() == 1);
+    queue.flush();
+    REQUIRE(DeferredObject::numLive == numLive);
+}
+
+TEST_CASE("releaseQueue follows the references")
+{
+    auto& queue = DeferredObject::getQueue();
+    int numLive = DeferredObject::numLive;
+
+    auto collection = new DeferredCollection();
+    for (int index = 0; index < DeferredCollection::capacity; index++)
+    {
+        auto record = new DeferredRecord();
+        record->refs[0] = new DeferredObject();
+        record->refs[1] = new DeferredObject();
+        collection->set(index, record);
+    }
+    REQUIRE(DeferredObject::numLive == numLive + 1 + 3 * DeferredCollection::capacity);
+
+    collection->unref();
+    queue.flush();
+    REQUIRE(DeferredObject::numLive == numLive);
+    REQUIRE(queue.size() == 0);
+}
+
+TEST_CASE("releaseQueue flushes when it fills up")
+{
+    auto& queue = DeferredObject::getQueue();
+    int numLive = DeferredObject::numLive;
+    for (int index = 0; index < 100; index++)
+    {
+        (new DeferredObject())->unref();
+        REQUIRE(queue.size() <= 32);
+    }
+    REQUIRE(DeferredObject::numLive - numLive == int(queue.size()));
+    queue.flush();
+    REQUIRE(DeferredObject::numLive == numLive);
+}
+
+TEST_CASE("releaseQueue flushes when the heap runs out")
+{
+    auto& queue = DeferredObject::getQueue();
+    int numLive = DeferredObject::numLive;
+    queue.flush();
+    DeferredObject::getHeap().trim();
+
+    // records waiting to be deleted, and no room for anything else
+    for (int index = 0; index < 8; index++)
+    {
+        (new DeferredRecord())->unref();
+    }
+    REQUIRE(queue.size() == 8);
+    heapCounter.limitBytes = heapCounter.bytes;
+
+    // (the records go on their size class's list, and then back to the heap)
+    auto obj = new DeferredObject();
+    size_t queueSize = queue.size();
+    heapCounter.limitBytes = size_t(-1);
+
+    REQUIRE(queueSize == 0);
+    REQUIRE(DeferredObject::numLive == numLive + 1);
+    obj->unref();
+    queue.flush();
+}
+
+//
+// benchmarks (hidden: run with microbit_test "[benchmark]")
+//
+
+// A script that keeps a few collections of records, and keeps replacing them
+template <bool Deferred>
+static void runRefCountWorkload(const char* name)
+{
+    using clock = std::chrono::steady_clock;
+    const int numIterations = 2000000;
+    const int numCollections = 4;
+    uint32_t random = 1;
+
+    heapCounter.reset();
+    size_t startBytes = heapCounter.bytes;
+    auto start = clock::now();
+    {
+        TestCollection<Deferred>* collections[numCollections];
+        for (auto& collection : collections)
+        {
+            collection = new TestCollection<Deferred>();
+        }
+
+        for (int iteration = 0; iteration < numIterations; iteration++)
+        {
+            random = random * 1664525u + 1013904223u;
+            auto record = new TestRecord<Deferred>();
+            record->refs[0] = new TestObject<Deferred>();
+            record->vals[0] = random;
+
+            // share it with another collection now and then
+            auto collection = collections[(random >> 8) % numCollections];
+            if ((random >> 12) % 4 == 0)
+            {
+                record->ref();
+                collections[(random >> 16) % numCollections]->set((random >> 20) % TestCollection<Deferred>::capacity, record);
+            }
+            collection->set((random >> 24) % TestCollection<Deferred>::capacity, record); // (drops what was there)
+
+            // and now and then, start a collection over
+            if ((random >> 4) % 64 == 0)
+            {
+                auto& old = collections[(random >> 10) % numCollections];
+                old->unref();
+                old = new TestCollection<Deferred>();
+            }
+        }
+
+        for (auto collection : collections)
+        {
+            collection->unref();
+        }
+        if (Deferred)
+        {
+            TestObject<Deferred>::getQueue().flush();
+        }
+    }
+    double seconds = std::chrono::duration<double>(clock::now() - start).count();
+    std::cout << name << ": " << (seconds * 1e9 / numIterations) << " ns/iteration, "
+              << (double(heapCounter.numAllocations) / numIterations) << " heap allocations/iteration, peak heap "
+              << (heapCounter.peakBytes - startBytes) << " bytes (" << TestObject<Deferred>::numLive << " left)" << std::endl;
+    TestObject<Deferred>::getHeap().trim();
+}
+
+TEST_CASE("releaseQueue benchmark", "[.][benchmark]")
+{
+    runRefCountWorkload<false>("delete right away");
+    runRefCountWorkload<true>("release queue + size classes");
+}
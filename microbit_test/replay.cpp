@@ -0,0 +1,274 @@
+#include "replay.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+void Score::operator+=(const Score& other)
+{
+    labelled += other.labelled;
+    hits += other.hits;
+    detections += other.detections;
+    falsePositives += other.falsePositives;
+    totalLatency += other.totalLatency;
+}
+
+float Score::precision() const
+{
+    return detections > 0 ? float(detections - falsePositives) / detections : 1.0f;
+}
+
+float Score::recall() const
+{
+    return labelled > 0 ? float(hits) / labelled : 1.0f;
+}
+
+float Score::meanLatency() const
+{
+    return hits > 0 ? float(totalLatency) / hits : 0.0f;
+}
+
+int parseEvent(const char* str)
+{
+    while (*str == ' ' || *str == '\t')
+    {
+        str++;
+    }
+    if (*str == '\0' || *str == '\r' || *str == '\n')
+    {
+        return 0;
+    }
+
+    char* end = nullptr;
+    long val = strtol(str, &end, 10);
+    if (end != str)
+    {
+        return (int)val;
+    }
+
+    size_t len = strcspn(str, " \t\r\n,");
+    for (int event = MICROBIT_ACCELEROMETER_SHAKE; event <= MICROBIT_ACCELEROMETER_TILT_RIGHT; event++)
+    {
+        const char* name = getGestureName(event);
+        if (strlen(name) == len && strncmp(name, str, len) == 0)
+        {
+            return event;
+        }
+    }
+    return -1;
+}
+
+bool Capture::load(const char* filename)
+{
+    name_ = filename;
+    if (isCaptureFile(filename))
+    {
+        if (!mapped_.open(filename))
+        {
+            return false;
+        }
+        size_ = mapped_.size();
+        samples_ = mapped_.samples();
+        labels_ = mapped_.labels();
+        return true;
+    }
+    return loadText(filename);
+}
+
+bool Capture::loadText(const char* filename)
+{
+    FILE* file = fopen(filename, "r");
+    if (!file)
+    {
+        fprintf(stderr, "Can't open %s\n", filename);
+        return false;
+    }
+
+    char line[256];
+    int lineNum = 0;
+    while (fgets(line, sizeof(line), file))
+    {
+        lineNum++;
+        int x, y, z, used = 0;
+        if (line[0] == '#' || sscanf(line, " %d , %d , %d%n", &x, &y, &z, &used) != 3)
+        {
+            continue;
+        }
+
+        int label = 0;
+        const char* rest = line + used;
+        while (*rest == ' ' || *rest == '\t')
+        {
+            rest++;
+        }
+        if (*rest == ',')
+        {
+            label = parseEvent(rest + 1);
+            if (label < 0 || label > 255)
+            {
+                fprintf(stderr, "%s:%d: unknown label\n", filename, lineNum);
+                label = 0;
+            }
+        }
+
+        textSamples_.push_back(byteVector3(clampByte(x), clampByte(y), clampByte(z)));
+        textLabels_.push_back(capture_label_t(label));
+    }
+    fclose(file);
+
+    size_ = textSamples_.size();
+    samples_ = textSamples_.data();
+    labels_ = textLabels_.data();
+    return true;
+}
+
+std::vector<uint16_t> runDetector(const MicroBitGestureDetector& prototype, const Capture& capture)
+{
+    DetectorCheckpoints noCheckpoints;
+    return runDetector(prototype, capture, 0, noCheckpoints);
+}
+
+std::vector<uint16_t> runDetector(const MicroBitGestureDetector& prototype, const Capture& capture,
+                                  size_t checkpointInterval, DetectorCheckpoints& checkpoints)
+{
+    std::vector<uint16_t> onsets(capture.size(), 0);
+    checkpoints.clear();
+    if (capture.size() == 0)
+    {
+        return onsets;
+    }
+
+    MicroBitGestureDetector detector(prototype);
+    const byteVector3* samples = capture.samples();
+    detector.init(samples[0]);
+
+    uint16_t prevFired = 0;
+    for (size_t index = 0; index < capture.size(); index++)
+    {
+        if (checkpointInterval > 0 && index % checkpointInterval == 0)
+        {
+            checkpoints.emplace_back(detector.getStateSize());
+            detector.saveState(checkpoints.back().data(), checkpoints.back().size());
+        }
+        detector.processSample(samples[index]);
+        uint16_t fired = detector.getFiredGestures();
+        onsets[index] = fired & ~prevFired;
+        prevFired = fired;
+    }
+    return onsets;
+}
+
+void traceDetector(const MicroBitGestureDetector& prototype, const Capture& capture,
+                   size_t checkpointInterval, const DetectorCheckpoints& checkpoints,
+                   size_t begin, size_t end, FILE* log)
+{
+    end = std::min(end, capture.size());
+    if (begin >= end || checkpointInterval == 0 || checkpoints.empty())
+    {
+        return;
+    }
+
+    size_t checkpointIndex = std::min(begin / checkpointInterval, checkpoints.size() - 1);
+    MicroBitGestureDetector detector(prototype);
+    const auto& checkpoint = checkpoints[checkpointIndex];
+    if (!detector.restoreState(checkpoint.data(), checkpoint.size()))
+    {
+        fprintf(stderr, "Bad checkpoint for %s\n", capture.name().c_str());
+        return;
+    }
+
+    for (size_t index = checkpointIndex * checkpointInterval; index < end; index++)
+    {
+        const byteVector3& sample = capture.samples()[index];
+        detector.processSample(sample);
+        if (index < begin)
+        {
+            continue;
+        }
+
+        fprintf(log, "%s:%zu: %4d %4d %4d  %-10s", capture.name().c_str(), index, sample.x, sample.y, sample.z,
+                getGestureName(capture.labels()[index]));
+        uint16_t fired = detector.getFiredGestures();
+        for (int event = MICROBIT_ACCELEROMETER_SHAKE; event <= MICROBIT_ACCELEROMETER_TILT_RIGHT; event++)
+        {
+            if (fired & eventBit(event))
+            {
+                fprintf(log, " %s", getGestureName(event));
+            }
+        }
+        fprintf(log, "\n");
+    }
+}
+
+static void window(size_t index, size_t size, int tolerance, size_t& begin, size_t& end)
+{
+    begin = index >= (size_t)tolerance ? index - tolerance : 0;
+    end = std::min(size, index + tolerance + 1);
+}
+
+static bool labelNear(const capture_label_t* labels, size_t size, size_t index, int event, int tolerance)
+{
+    size_t begin, end;
+    window(index, size, tolerance, begin, end);
+    for (size_t other = begin; other < end; other++)
+    {
+        if (labels[other] == event)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Returns the offset of the first detection near index, or a value past the tolerance if there isn't one
+static int firstOnsetNear(const std::vector<uint16_t>& onsets, size_t index, int event, int tolerance)
+{
+    size_t begin, end;
+    window(index, onsets.size(), tolerance, begin, end);
+    for (size_t other = begin; other < end; other++)
+    {
+        if (onsets[other] & eventBit(event))
+        {
+            return int(other) - int(index);
+        }
+    }
+    return tolerance + 1;
+}
+
+Score scoreEvent(const Capture& capture, const std::vector<uint16_t>& onsets, int event, int tolerance, FILE* log)
+{
+    Score score;
+    const capture_label_t* labels = capture.labels();
+    for (size_t index = 0; index < capture.size(); index++)
+    {
+        if (labels[index] == event)
+        {
+            score.labelled++;
+            int latency = firstOnsetNear(onsets, index, event, tolerance);
+            if (latency <= tolerance)
+            {
+                score.hits++;
+                score.totalLatency += latency;
+            }
+            else if (log)
+            {
+                fprintf(log, "%s:%zu: missed %s\n", capture.name().c_str(), index, getGestureName(event));
+            }
+        }
+
+        if (onsets[index] & eventBit(event))
+        {
+            score.detections++;
+            bool isHit = labelNear(labels, capture.size(), index, event, tolerance);
+            if (!isHit)
+            {
+                score.falsePositives++;
+            }
+            if (log)
+            {
+                fprintf(log, "%s:%zu: %s%s\n", capture.name().c_str(), index, getGestureName(event), isHit ? "" : " (false positive)");
+            }
+        }
+    }
+    return score;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "MicroBitGestureDetector.h"
+#include "capture_file.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Shared bits of the host replay tools (gesture_replay, gesture_sweep): reading labelled
+// accelerometer captures, running a detector over them, and scoring the detections.
+//
+// A capture is either a binary capture file (see capture_file.h), which gets mapped and
+// replayed in place, or a text file with one sample per line, at the detector's sample rate:
+//
+//   x,y,z[,label]
+//
+// where x, y, z are the raw accelerometer bytes (1/64 g), and label (optional) is the gesture
+// that happens at that sample, as an event number (e.g., 101) or a name from getGestureName()
+// (e.g., Tap). Blank lines, lines starting with '#' and anything else that doesn't start
+// with a number (like a header row) are skipped. capture_convert turns these (and serial
+// logs) into binary captures.
+//
+// A detection is the first sample of a run of samples on which the detector fired an event.
+// It's a hit if there's a label for the same event within the tolerance, otherwise it's a
+// false positive. Runs of the same event right next to each other count once.
+
+const float replaySamplePeriod = 0.018f; // in seconds
+
+class Capture
+{
+public:
+    bool load(const char* filename);
+
+    const std::string& name() const { return name_; }
+    size_t size() const { return size_; }
+    const byteVector3* samples() const { return samples_; }
+    const capture_label_t* labels() const { return labels_; }
+
+private:
+    bool loadText(const char* filename);
+
+    std::string name_;
+    size_t size_ = 0;
+    const byteVector3* samples_ = nullptr;
+    const capture_label_t* labels_ = nullptr;
+
+    // where the samples and labels live
+    MappedCapture mapped_;
+    std::vector<byteVector3> textSamples_;
+    std::vector<capture_label_t> textLabels_;
+};
+
+struct Score
+{
+    int labelled = 0;
+    int hits = 0;           // labels with a detection near them
+    int detections = 0;
+    int falsePositives = 0; // detections with no label near them
+    int totalLatency = 0;   // in samples, from each hit label to its first detection
+
+    void operator+=(const Score& other);
+
+    float precision() const;
+    float recall() const;
+    float meanLatency() const; // in samples
+};
+
+// Returns an event number, 0 for an empty string, or -1 if it's not an event
+int parseEvent(const char* str);
+
+// Runs a copy of prototype over the capture, and returns the events that started firing on
+// each sample (as eventBit()s)
+std::vector<uint16_t> runDetector(const MicroBitGestureDetector& prototype, const Capture& capture);
+
+// The same, also saving a snapshot of the detector (see saveState()) before every
+// checkpointInterval'th sample, so a stretch of the capture can be re-run without
+// replaying everything before it
+using DetectorCheckpoints = std::vector<std::vector<uint8_t>>;
+std::vector<uint16_t> runDetector(const MicroBitGestureDetector& prototype, const Capture& capture,
+                                  size_t checkpointInterval, DetectorCheckpoints& checkpoints);
+
+// Re-runs samples [begin, end) from the nearest checkpoint, printing each sample, its
+// label and whatever fired on it
+void traceDetector(const MicroBitGestureDetector& prototype, const Capture& capture,
+                   size_t checkpointInterval, const DetectorCheckpoints& checkpoints,
+                   size_t begin, size_t end, FILE* log);
+
+// If log isn't null, every detection and miss gets printed to it
+Score scoreEvent(const Capture& capture, const std::vector<uint16_t>& onsets, int event, int tolerance, FILE* log = nullptr);
@@ -0,0 +1,197 @@
+#include "DelayBuffer.h"
+#include "RunningMedian.h"
+#include "FixedPt.h"
+#include "Vector3.h"
+
+#include "catch.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+using std::vector;
+
+// See catch tutorial: https://github.com/philsquared/Catch/blob/master/docs/tutorial.md
+
+//
+// runningMedian tests
+//
+
+// The slow way: sort a copy of the last windowSize values (with zeros before the start)
+template <typename T>
+T naiveMedian(const vector<T>& vals, int end, int windowSize)
+{
+    vector<T> window;
+    for (int index = end - windowSize; index < end; index++)
+    {
+        window.push_back(index >= 0 ? vals[index] : T(0));
+    }
+    std::sort(window.begin(), window.end());
+    return window[windowSize / 2];
+}
+
+TEST_CASE("runningMedian test")
+{
+    vector<int> vals{ 5, 1, 9, 3, 3, 7, -2, 8, 8, 8, 0, 4, 6, -5, 2 };
+    DelayBuffer<int, 6> delayBuf;
+    RunningMedian<5, 6, int> median(delayBuf);
+
+    for (size_t index = 0; index < vals.size(); index++)
+    {
+        delayBuf.addSample(vals[index]);
+        median.addSample(vals[index]);
+        REQUIRE(median.getMedian() == naiveMedian(vals, index + 1, 5));
+    }
+
+    // last 5: 0, 4, 6, -5, 2
+    REQUIRE(median.getRank(0) == -5);
+    REQUIRE(median.getRank(4) == 6);
+    REQUIRE(median.getPercentile(0) == -5);
+    REQUIRE(median.getPercentile(50) == 2);
+    REQUIRE(median.getPercentile(100) == 6);
+}
+
+TEST_CASE("runningMedian rejects spikes")
+{
+    DelayBuffer<int, 4> delayBuf;
+    RunningMedian<3, 4, int> median(delayBuf);
+
+    vector<int> vals{ 10, 10, 10, 120, 10, 10, -100, 10, 11, 12 };
+    for (auto val : vals)
+    {
+        delayBuf.addSample(val);
+        median.addSample(val);
+        if (delayBuf.getDelayedSample(2) != 0) // once the window's full
+        {
+            REQUIRE(median.getMedian() >= 10);
+            REQUIRE(median.getMedian() <= 12);
+        }
+    }
+}
+
+TEST_CASE("runningMedian fixed")
+{
+    srand(1234);
+    vector<fixed_9_7> vals;
+    for (int index = 0; index < 200; index++)
+    {
+        vals.push_back(fixed_9_7((rand() % 2000 - 1000) / 16.0f));
+    }
+
+    DelayBuffer<fixed_9_7, 8> delayBuf;
+    RunningMedian<7, 8, fixed_9_7> median(delayBuf);
+    for (size_t index = 0; index < vals.size(); index++)
+    {
+        delayBuf.addSample(vals[index]);
+        median.addSample(vals[index]);
+        REQUIRE((median.getMedian() == naiveMedian(vals, index + 1, 7)));
+    }
+}
+
+TEST_CASE("runningVectorMedian test")
+{
+    srand(5678);
+    vector<byteVector3> vals;
+    vector<int8_t> xs, ys, zs;
+    for (int index = 0; index < 200; index++)
+    {
+        byteVector3 v(rand() % 256 - 128, rand() % 256 - 128, rand() % 256 - 128);
+        vals.push_back(v);
+        xs.push_back(v.x);
+        ys.push_back(v.y);
+        zs.push_back(v.z);
+    }
+
+    DelayBuffer<byteVector3, 6> delayBuf;
+    RunningVectorMedian<5, 6, int8_t> median(delayBuf);
+    RunningMedian<5, 6, int8_t, byteVector3, GetY<int8_t>> yMedian(delayBuf);
+    for (size_t index = 0; index < vals.size(); index++)
+    {
+        delayBuf.addSample(vals[index]);
+        median.addSample(vals[index]);
+        yMedian.addSample(vals[index]);
+        auto m = median.getMedian();
+        REQUIRE(m.x == naiveMedian(xs, index + 1, 5));
+        REQUIRE(m.y == naiveMedian(ys, index + 1, 5));
+        REQUIRE(m.z == naiveMedian(zs, index + 1, 5));
+        REQUIRE(yMedian.getMedian() == m.y);
+    }
+}
+
+//
+// benchmarks (hidden: run with microbit_test "[benchmark]")
+//
+
+template <int WindowSize>
+void benchmarkMedian(const vector<byteVector3>& vals)
+{
+    using clock = std::chrono::steady_clock;
+
+    DelayBuffer<byteVector3, WindowSize+1> vectorBuf;
+    RunningVectorMedian<WindowSize, WindowSize+1, int8_t> vectorMedian(vectorBuf);
+    int checksum = 0;
+    auto start = clock::now();
+    for (const auto& v : vals)
+    {
+        vectorBuf.addSample(v);
+        vectorMedian.addSample(v);
+        checksum += vectorMedian.getMedian().x;
+    }
+    auto vectorTime = std::chrono::duration<double, std::nano>(clock::now() - start).count() / vals.size();
+
+    DelayBuffer<fixed_9_7, WindowSize+1> fixedBuf;
+    RunningMedian<WindowSize, WindowSize+1, fixed_9_7> fixedMedian(fixedBuf);
+    start = clock::now();
+    for (const auto& v : vals)
+    {
+        fixed_9_7 f(v.x);
+        fixedBuf.addSample(f);
+        fixedMedian.addSample(f);
+        checksum += (int)fixedMedian.getMedian();
+    }
+    auto fixedTime = std::chrono::duration<double, std::nano>(clock::now() - start).count() / vals.size();
+
+    // the naive version: copy the window and partially sort it, per axis
+    DelayBuffer<byteVector3, WindowSize+1> naiveBuf;
+    start = clock::now();
+    for (const auto& v : vals)
+    {
+        naiveBuf.addSample(v);
+        int8_t window[3][WindowSize];
+        for (int index = 0; index < WindowSize; index++)
+        {
+            auto s = naiveBuf.getDelayedSample(index);
+            window[0][index] = s.x;
+            window[1][index] = s.y;
+            window[2][index] = s.z;
+        }
+        for (auto& axis : window)
+        {
+            std::nth_element(axis, axis + WindowSize/2, axis + WindowSize);
+        }
+        checksum += window[0][WindowSize/2];
+    }
+    auto naiveTime = std::chrono::duration<double, std::nano>(clock::now() - start).count() / vals.size();
+
+    std::cout << "window " << WindowSize << ": byteVector3 " << vectorTime << " ns, fixed_9_7 " << fixedTime
+              << " ns, naive byteVector3 " << naiveTime << " ns (" << checksum << ")" << std::endl;
+}
+
+TEST_CASE("runningMedian benchmark", "[.][benchmark]")
+{
+    srand(42);
+    vector<byteVector3> vals;
+    for (int index = 0; index < 1000000; index++)
+    {
+        vals.push_back(byteVector3(rand() % 256 - 128, rand() % 256 - 128, rand() % 256 - 128));
+    }
+
+    benchmarkMedian<3>(vals);
+    benchmarkMedian<5>(vals);
+    benchmarkMedian<7>(vals);
+    benchmarkMedian<9>(vals);
+    benchmarkMedian<11>(vals);
+    benchmarkMedian<13>(vals);
+    benchmarkMedian<15>(vals);
+}
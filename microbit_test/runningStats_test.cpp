@@ -36,4 +36,6 @@ TEST_CASE("runningStats test")
     REQUIRE(stats.getMean() == (4 + 5 + 6 + 7) / 4.0);
     REQUIRE(stats.getVar() == Approx(1.25));
     REQUIRE(stats.getStdDev() == Approx(1.1180339887498949).epsilon(0.001));
+    REQUIRE(stats.getSum() == 4 + 5 + 6 + 7);
+    REQUIRE(stats.getSumSq() == 16 + 25 + 36 + 49);
 }
@@ -0,0 +1,135 @@
+#include "SensorFrame.h"
+
+#include "catch.hpp"
+
+#include <cmath>
+
+// See catch tutorial: https://github.com/philsquared/Catch/blob/master/docs/tutorial.md
+
+// Stands in for MicroBitAccelerometer, counting trips to the sensor
+class FakeAccelerometer
+{
+public:
+    int update()
+    {
+        numUpdates++;
+        return 0;
+    }
+    int getX() { numAxisReads++; return x; }
+    int getY() { numAxisReads++; return y; }
+    int getZ() { numAxisReads++; return z; }
+
+    int x = 0;
+    int y = 0;
+    int z = 0;
+    int numUpdates = 0;
+    int numAxisReads = 0;
+};
+
+//
+// sensorFrame tests
+//
+TEST_CASE("sensorFrame one read per frame")
+{
+    FakeAccelerometer accelerometer;
+    accelerometer.x = 300;
+    accelerometer.y = -400;
+    accelerometer.z = 1200;
+    SensorFrame<FakeAccelerometer> frame(accelerometer);
+
+    // what a script asking for x, y, z and the strength does in one tick
+    int x = frame.refresh(100).getX();
+    int y = frame.refresh(100).getY();
+    int z = frame.refresh(100).getZ();
+    int strength = frame.refresh(101).getStrength();
+    REQUIRE(x == 300);
+    REQUIRE(y == -400);
+    REQUIRE(z == 1200);
+    REQUIRE(strength == 1300);
+    REQUIRE(accelerometer.numUpdates == 1);
+    REQUIRE(accelerometer.numAxisReads == 3); // (was 6: one per axis, and three more for the strength)
+    REQUIRE(frame.getNumReads() == 1);
+    REQUIRE(frame.getTime() == 100);
+}
+
+TEST_CASE("sensorFrame refresh after maxAge")
+{
+    FakeAccelerometer accelerometer;
+    SensorFrame<FakeAccelerometer> frame(accelerometer, 18);
+    frame.refresh(1000);
+    accelerometer.x = 64;
+    REQUIRE(frame.refresh(1017).getX() == 0);
+    REQUIRE(frame.refresh(1018).getX() == 64);
+    REQUIRE(frame.getNumReads() == 2);
+    REQUIRE(frame.getTime() == 1018);
+
+    // the ms clock wrapping around
+    SensorFrame<FakeAccelerometer> wrapFrame(accelerometer, 18);
+    wrapFrame.refresh(UINT32_MAX - 5);
+    wrapFrame.refresh(5);
+    REQUIRE(wrapFrame.getNumReads() == 1);
+    wrapFrame.refresh(12);
+    REQUIRE(wrapFrame.getNumReads() == 2);
+}
+
+TEST_CASE("sensorFrame shared with the detector")
+{
+    FakeAccelerometer accelerometer;
+    SensorFrame<FakeAccelerometer> frame(accelerometer);
+
+    // the detector takes a new sample every 18 ms tick, and scripts in between use it
+    for (uint32_t time = 0; time < 1800; time += 18)
+    {
+        accelerometer.x = int(time);
+        frame.update(time);
+        for (uint32_t scriptTime = time; scriptTime < time + 18; scriptTime += 3)
+        {
+            REQUIRE(frame.refresh(scriptTime).getX() == int(time));
+        }
+    }
+    REQUIRE(frame.getNumReads() == 100);
+    REQUIRE(accelerometer.numUpdates == 100);
+}
+
+TEST_CASE("sensorFrame strength")
+{
+    FakeAccelerometer accelerometer;
+    SensorFrame<FakeAccelerometer> frame(accelerometer);
+    const int values[] = { -2048, -2047, -1500, -1000, -999, -64, -1, 0, 1, 63, 64, 1000, 1023, 2047 };
+    for (int x : values)
+    {
+        for (int y : values)
+        {
+            for (int z : values)
+            {
+                accelerometer.x = x;
+                accelerometer.y = y;
+                accelerometer.z = z;
+                frame.update(0);
+                REQUIRE(frame.getStrength() == int(std::sqrt(double(x * x + y * y + z * z))));
+            }
+        }
+    }
+
+    // the biggest vector there is
+    REQUIRE(normInt(Vector3<int16_t>(-32768, -32768, -32768)) == 56755);
+}
+
+TEST_CASE("sensorFrame sample")
+{
+    FakeAccelerometer accelerometer;
+    SensorFrame<FakeAccelerometer> frame(accelerometer);
+    const int values[] = { -3000, -2048, -100, -17, -16, -1, 0, 1, 15, 16, 1000, 2032, 2047, 3000 };
+    for (int val : values)
+    {
+        accelerometer.x = val;
+        accelerometer.y = -val;
+        accelerometer.z = val / 2;
+        frame.update(0);
+        byteVector3 sample = frame.getSample();
+        // what getAccelData() used to do
+        REQUIRE(sample.x == clampByte(val >> 4));
+        REQUIRE(sample.y == clampByte(-val >> 4));
+        REQUIRE(sample.z == clampByte((val / 2) >> 4));
+    }
+}
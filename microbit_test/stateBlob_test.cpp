@@ -0,0 +1,99 @@
+#include "StateBlob.h"
+#include "DelayBuffer.h"
+#include "RingBuffer.h"
+#include "RunningStats.h"
+
+#include "catch.hpp"
+
+#include <vector>
+
+// See catch tutorial: https://github.com/philsquared/Catch/blob/master/docs/tutorial.md
+
+//
+// stateBlob tests
+//
+
+TEST_CASE("stateBlob round trip")
+{
+    DelayBuffer<int, 5> delay;
+    RunningStats<4, 5, int> stats(delay);
+    for (int index = 0; index < 7; index++)
+    {
+        delay.addSample(index * index);
+        stats.addSample(index * index);
+    }
+
+    StateWriter sizer;
+    delay.serialize(sizer);
+    stats.serialize(sizer);
+    std::vector<uint8_t> blob(sizer.size());
+
+    StateWriter writer(blob.data(), blob.size());
+    delay.serialize(writer);
+    stats.serialize(writer);
+    REQUIRE(writer.ok());
+    REQUIRE(writer.size() == blob.size());
+
+    DelayBuffer<int, 5> delay2;
+    RunningStats<4, 5, int> stats2(delay2);
+    StateReader reader(blob.data(), blob.size());
+    delay2.serialize(reader);
+    stats2.serialize(reader);
+    REQUIRE(reader.ok());
+    for (int index = 0; index < 5; index++)
+    {
+        REQUIRE(delay2.getDelayedSample(index) == delay.getDelayedSample(index));
+    }
+    REQUIRE(stats2.getSum() == stats.getSum());
+    REQUIRE(stats2.getSumSq() == stats.getSumSq());
+
+    // and they keep going the same way
+    delay.addSample(100);
+    stats.addSample(100);
+    delay2.addSample(100);
+    stats2.addSample(100);
+    REQUIRE(stats2.getVar() == stats.getVar());
+}
+
+TEST_CASE("stateBlob overflow")
+{
+    uint8_t buffer[6];
+    StateWriter writer(buffer, sizeof(buffer));
+    writer.io(int32_t(1));
+    REQUIRE(writer.ok());
+    writer.io(int32_t(2));
+    REQUIRE(!writer.ok());
+
+    StateReader reader(buffer, sizeof(buffer));
+    int32_t val = 0;
+    reader.io(val);
+    REQUIRE(reader.ok());
+    REQUIRE(val == 1);
+    reader.io(val);
+    REQUIRE(!reader.ok());
+    REQUIRE(val == 1); // untouched
+}
+
+TEST_CASE("stateBlob rejects a bad ring buffer position")
+{
+    RingBuffer<int, 5> ring;
+    StateWriter sizer;
+    ring.serialize(sizer);
+    std::vector<uint8_t> blob(sizer.size());
+    StateWriter writer(blob.data(), blob.size());
+    ring.serialize(writer);
+    REQUIRE(writer.ok());
+
+    for (int8_t pos : { int8_t(5), int8_t(-1), int8_t(100) })
+    {
+        blob.back() = uint8_t(pos); // (the position comes last)
+        RingBuffer<int, 5> restored;
+        StateReader reader(blob.data(), blob.size());
+        restored.serialize(reader);
+        REQUIRE(!reader.ok());
+
+        // and it's still safe to use
+        restored.push_back(7);
+        REQUIRE(restored[0] == 7);
+    }
+}
@@ -0,0 +1,242 @@
+#include "TelemetryBatcher.h"
+#include "radio_loopback.h"
+
+#include "catch.hpp"
+
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+// See catch tutorial: https://github.com/philsquared/Catch/blob/master/docs/tutorial.md
+
+static std::vector<TelemetryRecord> decodeAll(const RadioLoopback& radio)
+{
+    std::vector<TelemetryRecord> records;
+    for (const auto& packet : radio.packets)
+    {
+        TelemetryRecord packetRecords[64];
+        int numRecords = telemetry::decodePacket(packet.data(), int(packet.size()), packetRecords, 64);
+        REQUIRE(numRecords > 0);
+        REQUIRE(numRecords <= 64);
+        records.insert(records.end(), packetRecords, packetRecords + numRecords);
+    }
+    return records;
+}
+
+//
+// bit reader/writer tests
+//
+TEST_CASE("bitWriter round trip")
+{
+    uint8_t data[8] = {};
+    BitWriter writer(data, sizeof(data));
+    writer.write(5, 3);
+    writer.write(0x1234, 16);
+    writer.write(1, 1);
+    writer.write(0xdeadbeef, 32);
+    REQUIRE(writer.getNumBits() == 52);
+    REQUIRE(writer.getNumBytes() == 7);
+    REQUIRE(writer.getBitsLeft() == 12);
+    REQUIRE(data[0] == 0xa2); // 101 00010...
+
+    BitReader reader(data, sizeof(data));
+    REQUIRE(reader.read(3) == 5);
+    REQUIRE(reader.read(16) == 0x1234);
+    REQUIRE(reader.read(1) == 1);
+    REQUIRE(reader.read(32) == 0xdeadbeef);
+    REQUIRE(reader.getBitsLeft() == 12);
+    REQUIRE(reader.read(0) == 0);
+}
+
+//
+// telemetry tests
+//
+TEST_CASE("telemetry quantize")
+{
+    REQUIRE(telemetry::quantize(-128, -128, 128) == 0);
+    REQUIRE(telemetry::quantize(-1000, -128, 128) == 0);
+    REQUIRE(telemetry::quantize(127, -128, 128) == 254);
+    REQUIRE(telemetry::quantize(1000, -128, 128) == 255);
+    for (int value = -256; value <= 256; value++)
+    {
+        int back = telemetry::dequantize(telemetry::quantize(value, -256, 256), -256, 256);
+        REQUIRE(std::abs(back - value) <= 1); // (half a step: 512 / 255 / 2)
+    }
+}
+
+TEST_CASE("telemetry round trip")
+{
+    RadioLoopback radio;
+    TelemetryBatcher<RadioLoopback> batcher(radio, 1000);
+    const uint8_t summary[] = { 1, 128, 255, 7 };
+
+    batcher.addEvent(123456, 0);
+    batcher.addEvent(123456, 3); // (same time)
+    batcher.addSummary(123500, summary, 4);
+    batcher.addEvent(123800, 9);
+    batcher.addSummary(123900, summary, 0);
+    REQUIRE(radio.getNumPackets() == 0);
+    REQUIRE(!batcher.isEmpty());
+    batcher.flush();
+    REQUIRE(batcher.isEmpty());
+    REQUIRE(radio.getNumPackets() == 1);
+    REQUIRE(batcher.getNumRecords() == 5);
+
+    // a 5-byte header, then 11 + 11 + 48 + 20 + 17 bits
+    REQUIRE(radio.packets[0].size() == 5 + 14);
+
+    auto records = decodeAll(radio);
+    REQUIRE(records.size() == 5);
+    REQUIRE(records[0].kind == TELEMETRY_EVENT);
+    REQUIRE(records[0].time == 123456);
+    REQUIRE(records[0].event == 0);
+    REQUIRE(records[1].time == 123456);
+    REQUIRE(records[1].event == 3);
+    REQUIRE(records[2].kind == TELEMETRY_SUMMARY);
+    REQUIRE(records[2].time == 123500);
+    REQUIRE(records[2].numValues == 4);
+    for (int index = 0; index < 4; index++)
+    {
+        REQUIRE(records[2].values[index] == summary[index]);
+    }
+    REQUIRE(records[3].time == 123800);
+    REQUIRE(records[3].event == 9);
+    REQUIRE(records[4].kind == TELEMETRY_SUMMARY);
+    REQUIRE(records[4].numValues == 0);
+
+    // not a telemetry packet
+    uint8_t junk[] = { 0x70, 0, 0, 0, 0, 0 };
+    TelemetryRecord record;
+    REQUIRE(telemetry::decodePacket(junk, sizeof(junk), &record, 1) == -1);
+    REQUIRE(telemetry::decodePacket(radio.packets[0].data(), 3, &record, 1) == -1);
+}
+
+TEST_CASE("telemetry fills packets")
+{
+    RadioLoopback radio;
+    TelemetryBatcher<RadioLoopback> batcher(radio, 1000000);
+    const int numEvents = 200;
+    uint32_t time = 0xfffff000; // (wraps around)
+    for (int index = 0; index < numEvents; index++)
+    {
+        time += 18 * (1 + index % 5);
+        batcher.addEvent(time, uint8_t(index % 10));
+    }
+    batcher.flush();
+
+    int numPackets = radio.getNumPackets();
+    REQUIRE(numPackets == int(batcher.getNumPackets()));
+    REQUIRE(numPackets <= numEvents / 10);
+    uint8_t sequence = 0;
+    for (int index = 0; index < numPackets; index++)
+    {
+        const auto& packet = radio.packets[index];
+        REQUIRE(packet.size() <= size_t(telemetry::maxPacketSize));
+        TelemetryRecord record;
+        uint8_t packetSequence = 0xff;
+        REQUIRE(telemetry::decodePacket(packet.data(), int(packet.size()), &record, 1, &packetSequence) > 0);
+        REQUIRE(packetSequence == sequence);
+        sequence = (sequence + 1) % 16;
+    }
+
+    auto records = decodeAll(radio);
+    REQUIRE(records.size() == size_t(numEvents));
+    time = 0xfffff000;
+    for (int index = 0; index < numEvents; index++)
+    {
+        time += 18 * (1 + index % 5);
+        REQUIRE(records[index].time == time);
+        REQUIRE(records[index].event == index % 10);
+    }
+}
+
+TEST_CASE("telemetry latency")
+{
+    RadioLoopback radio;
+    TelemetryBatcher<RadioLoopback> batcher(radio, 500);
+    REQUIRE(batcher.poll(1000) == 500);
+
+    batcher.addEvent(1000, 1);
+    batcher.addEvent(1300, 2);
+    REQUIRE(batcher.poll(1300) == 200); // (the oldest one sets the time)
+    REQUIRE(batcher.poll(1499) == 1);
+    REQUIRE(radio.getNumPackets() == 0);
+    REQUIRE(batcher.poll(1500) == 500);
+    REQUIRE(radio.getNumPackets() == 1);
+    REQUIRE(batcher.poll(1600) == 500);
+    REQUIRE(radio.getNumPackets() == 1);
+
+    // going back in time starts a new packet
+    batcher.addEvent(2000, 1);
+    batcher.addEvent(1900, 2);
+    REQUIRE(radio.getNumPackets() == 2);
+
+    // and no latency at all sends every record
+    // (along with the one that was waiting)
+    batcher.setMaxLatency(0);
+    batcher.addEvent(2100, 3);
+    REQUIRE(radio.getNumPackets() == 3);
+    REQUIRE(batcher.isEmpty());
+    batcher.addEvent(2200, 4);
+    REQUIRE(radio.getNumPackets() == 4);
+
+    auto records = decodeAll(radio);
+    REQUIRE(records.size() == 6);
+    REQUIRE(records[2].time == 2000);
+    REQUIRE(records[3].time == 1900);
+    REQUIRE(records[4].event == 3);
+}
+
+// 10 minutes of a board in use: a gesture every few seconds, often a few together (a
+// shake, or a tap and then a double tap), and a summary of the features every second
+TEST_CASE("telemetry session")
+{
+    const uint32_t duration = 10 * 60 * 1000;
+    const uint32_t summaryPeriod = 1000;
+    const uint8_t summary[] = { 128, 120, 200, 10 };
+
+    const uint32_t latencies[] = { 0, 500, 2000 };
+    int numPackets[3];
+    int numBytes[3];
+    for (int run = 0; run < 3; run++)
+    {
+        uint32_t latency = latencies[run];
+        RadioLoopback radio;
+        TelemetryBatcher<RadioLoopback> batcher(radio, latency);
+        uint32_t random = 1;
+        uint32_t nextSummary = 0;
+        int numEvents = 0;
+        for (uint32_t time = 0; time < duration; time += 18)
+        {
+            random = random * 1664525u + 1013904223u;
+            if ((random >> 16) % 150 == 0)
+            {
+                int burst = 1 + (random >> 8) % 4;
+                for (int index = 0; index < burst; index++)
+                {
+                    batcher.addEvent(time + 18 * index, uint8_t((random >> 4) % 10));
+                    numEvents++;
+                }
+            }
+            if (time >= nextSummary)
+            {
+                batcher.addSummary(time, summary, 4);
+                nextSummary += summaryPeriod;
+            }
+            batcher.poll(time);
+        }
+        batcher.flush();
+
+        auto records = decodeAll(radio);
+        REQUIRE(records.size() == batcher.getNumRecords());
+        numPackets[run] = radio.getNumPackets();
+        numBytes[run] = radio.getNumBytesOnAir();
+        std::cout << "latency " << latency << " ms: " << numEvents << " events, " << radio.getNumPackets()
+                  << " packets, " << radio.getNumBytesOnAir() << " bytes on the air" << std::endl;
+    }
+
+    // (with no latency, it's a packet per record)
+    REQUIRE(numPackets[1] < numPackets[0] * 2 / 3);
+    REQUIRE(numPackets[2] < numPackets[0] / 4);
+    REQUIRE(numBytes[2] < numBytes[0] / 2);
+}
@@ -0,0 +1,280 @@
+#include "VerticalFilter.h"
+#include "MicroBitGestureDetector.h"
+#include "motion_generator.h"
+
+#include "catch.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// See catch tutorial: https://github.com/philsquared/Catch/blob/master/docs/tutorial.md
+
+static const float samplePeriod = 0.018f;
+static const float gravityMs2 = 9.80665f;
+
+//
+// A ride up and down: the true altitude and velocity, the accelerometer samples a board
+// lying face up would see (through the same mg -> 64 to the g scaling as getAccelData()),
+// and barometer readings every ~100 ms with 0.25 m of noise (about what the BMP085's
+// highest-resolution mode gives)
+//
+struct VerticalTrace
+{
+    std::vector<float> altitude;
+    std::vector<float> velocity;
+    std::vector<byteVector3> samples;
+    std::vector<float> baro; // NAN where there's no reading
+};
+
+// The vertical acceleration at time t, in m/s^2
+static float getProfileAcceleration(float t)
+{
+    // an elevator up, a pause, one down, then a walk up stairs (bobbing at each step)
+    struct Segment
+    {
+        float start, end, acceleration;
+    };
+    static const Segment segments[] = {
+        { 5, 7, 0.6f }, { 17, 19, -0.6f },   // up 12 m
+        { 25, 27, -0.8f }, { 32, 34, 0.8f }, // down 11.2 m
+        { 40, 41, 0.25f }, { 60, 61, -0.25f },
+    };
+    float acceleration = 0;
+    for (const auto& segment : segments)
+    {
+        if (t >= segment.start && t < segment.end)
+        {
+            acceleration += segment.acceleration;
+        }
+    }
+    if (t >= 40 && t < 61)
+    {
+        const float w = 2 * 3.14159265f * 1.5f;
+        acceleration += -0.03f * w * w * std::sin(w * (t - 40));
+    }
+    return acceleration;
+}
+
+static VerticalTrace makeVerticalTrace(float seconds, uint32_t seed)
+{
+    std::mt19937 random(seed);
+    std::normal_distribution<float> accelNoise(0.0f, 24.0f); // mg
+    std::normal_distribution<float> baroNoise(0.0f, 0.25f);  // m
+
+    VerticalTrace trace;
+    float altitude = 100.0f;
+    float velocity = 0.0f;
+    size_t numSamples = size_t(seconds / samplePeriod);
+    for (size_t index = 0; index < numSamples; index++)
+    {
+        float acceleration = getProfileAcceleration(index * samplePeriod);
+        velocity += acceleration * samplePeriod;
+        altitude += velocity * samplePeriod;
+        trace.altitude.push_back(altitude);
+        trace.velocity.push_back(velocity);
+
+        // face up: z reads -1 g at rest
+        int x = int(std::lround(accelNoise(random)));
+        int y = int(std::lround(accelNoise(random)));
+        int z = int(std::lround(-1024.0f * (1 + acceleration / gravityMs2) + accelNoise(random)));
+        trace.samples.push_back(byteVector3(clampByte(x >> 4), clampByte(y >> 4), clampByte(z >> 4)));
+
+        trace.baro.push_back(index % 6 == 0 ? altitude + baroNoise(random) : NAN);
+    }
+    return trace;
+}
+
+struct VerticalErrors
+{
+    float altitudeRms = 0;
+    float velocityRms = 0;
+    float maxVelocityError = 0;
+};
+
+// Runs samples through the detector, and them and its gravity estimate through the
+// filter, the way the tick does on the device
+static void runVertical(const std::vector<byteVector3>& samples, const std::vector<float>& baro, VerticalFilter& filter,
+                        std::vector<float>& altitude, std::vector<float>& velocity)
+{
+    MicroBitGestureDetector detector;
+    detector.init(samples[0]);
+    filter.init();
+    for (size_t index = 0; index < samples.size(); index++)
+    {
+        detector.processSample(samples[index]);
+        if (!std::isnan(baro[index]))
+        {
+            filter.setBaroAltitude(VerticalFilter::value_t(baro[index]));
+        }
+        filter.addSample(samples[index], detector.getGravity());
+        altitude.push_back(float(filter.getAltitude()));
+        velocity.push_back(float(filter.getVelocity()));
+    }
+}
+
+static VerticalErrors getErrors(const VerticalTrace& trace, const std::vector<float>& altitude, const std::vector<float>& velocity,
+                                size_t skip)
+{
+    VerticalErrors errors;
+    double altitudeSum = 0, velocitySum = 0;
+    for (size_t index = skip; index < trace.altitude.size(); index++)
+    {
+        float altitudeError = altitude[index] - trace.altitude[index];
+        float velocityError = velocity[index] - trace.velocity[index];
+        altitudeSum += altitudeError * altitudeError;
+        velocitySum += velocityError * velocityError;
+        errors.maxVelocityError = std::max(errors.maxVelocityError, std::fabs(velocityError));
+    }
+    size_t count = trace.altitude.size() - skip;
+    errors.altitudeRms = float(std::sqrt(altitudeSum / count));
+    errors.velocityRms = float(std::sqrt(velocitySum / count));
+    return errors;
+}
+
+//
+// verticalFilter tests
+//
+TEST_CASE("verticalFilter at rest")
+{
+    VerticalFilter filter;
+    filter.init();
+    filter.setBaroAltitude(VerticalFilter::value_t(250.0f));
+    REQUIRE(float(filter.getAltitude()) == 250.0f);
+
+    // face up, face down, on its side: no vertical acceleration, and the altitude stays put
+    Vector3<fixed_9_7> poses[] = { { fixed_9_7(0), fixed_9_7(0), fixed_9_7(-64) },
+                                   { fixed_9_7(0), fixed_9_7(0), fixed_9_7(64) },
+                                   { fixed_9_7(45), fixed_9_7(-45), fixed_9_7(0) } };
+    byteVector3 samples[] = { byteVector3(0, 0, -64), byteVector3(0, 0, 64), byteVector3(45, -45, 0) };
+    for (int pose = 0; pose < 3; pose++)
+    {
+        for (int tick = 0; tick < 1000; tick++)
+        {
+            filter.addSample(samples[pose], poses[pose]);
+        }
+        REQUIRE(float(filter.getAltitude()) == Approx(250.0f).epsilon(1e-4));
+        REQUIRE(std::fabs(float(filter.getVelocity())) < 0.001f);
+    }
+
+    // pushed upwards (along gravity) and downwards, whichever way up the board is
+    filter.addSample(byteVector3(0, 0, -72), poses[0]);
+    REQUIRE(float(filter.getAcceleration()) == Approx(gravityMs2 / 8).epsilon(0.01));
+    filter.addSample(byteVector3(0, 0, 56), poses[1]);
+    REQUIRE(float(filter.getAcceleration()) == Approx(-gravityMs2 / 8).epsilon(0.01));
+    filter.addSample(byteVector3(53, -53, 0), poses[2]);
+    REQUIRE(float(filter.getAcceleration()) == Approx(gravityMs2 * 8 * std::sqrt(2.0f) / 64 + (45 * std::sqrt(2.0f) - 64) * gravityMs2 / 64).epsilon(0.01));
+
+    // no gravity to speak of (free-fall): no idea which way is up, so the velocity carries on
+    float velocity = float(filter.getVelocity());
+    auto bias = filter.getBias();
+    filter.addSample(byteVector3(0, 0, 2), Vector3<fixed_9_7>(fixed_9_7(0), fixed_9_7(0), fixed_9_7(4)));
+    REQUIRE(filter.getAcceleration().value_ == bias.value_);
+
+    // and the same for a sample that's way off the estimate (or clipped)
+    bias = filter.getBias();
+    filter.addSample(byteVector3(60, 0, -64), poses[0]);
+    REQUIRE(filter.getAcceleration().value_ == bias.value_);
+    bias = filter.getBias();
+    filter.addSample(byteVector3(0, 0, -128), poses[0]);
+    REQUIRE(filter.getAcceleration().value_ == bias.value_);
+    REQUIRE(float(filter.getVelocity()) == Approx(velocity).epsilon(0.05));
+}
+
+TEST_CASE("verticalFilter follows a synthetic ride")
+{
+    VerticalTrace trace = makeVerticalTrace(70.0f, 1);
+
+    VerticalFilter filter(samplePeriod, 1.0f);
+    std::vector<float> altitude, velocity;
+    runVertical(trace.samples, trace.baro, filter, altitude, velocity);
+
+    // against the barometer alone (holding the last reading, and differencing a 1 s average of them)
+    std::vector<float> baroAltitude, baroVelocity;
+    float held = trace.baro[0];
+    float smoothed = held;
+    float previousSmoothed = held;
+    for (size_t index = 0; index < trace.baro.size(); index++)
+    {
+        if (!std::isnan(trace.baro[index]))
+        {
+            held = trace.baro[index];
+        }
+        previousSmoothed = smoothed;
+        smoothed += (held - smoothed) * samplePeriod;
+        baroAltitude.push_back(held);
+        baroVelocity.push_back((smoothed - previousSmoothed) / samplePeriod);
+    }
+
+    size_t skip = size_t(5.0f / samplePeriod); // (the gravity estimate and the filter settling)
+    VerticalErrors fused = getErrors(trace, altitude, velocity, skip);
+    VerticalErrors baroOnly = getErrors(trace, baroAltitude, baroVelocity, skip);
+    std::cout << "vertical filter: altitude " << fused.altitudeRms << " m rms, velocity " << fused.velocityRms
+              << " m/s rms (max " << fused.maxVelocityError << "); barometer alone: altitude " << baroOnly.altitudeRms
+              << " m rms, velocity " << baroOnly.velocityRms << " m/s rms (max " << baroOnly.maxVelocityError << ")" << std::endl;
+
+    REQUIRE(fused.altitudeRms < 0.2f);
+    REQUIRE(fused.altitudeRms < baroOnly.altitudeRms);
+    REQUIRE(fused.velocityRms < 0.15f);
+    REQUIRE(fused.velocityRms < baroOnly.velocityRms / 2);
+    REQUIRE(std::fabs(altitude.back() - trace.altitude.back()) < 0.5f);
+}
+
+TEST_CASE("verticalFilter stays put through gestures")
+{
+    // Turns, shakes and taps from the motion generator, with the barometer saying nothing
+    // changed: the altitude shouldn't wander off
+    const size_t numSamples = size_t(600 / samplePeriod);
+    std::vector<byteVector3> samples(numSamples);
+    MotionGenerator generator(MotionConfig::handHeld(), 11);
+    generator.generate(samples.data(), nullptr, numSamples);
+
+    std::mt19937 random(2);
+    std::normal_distribution<float> baroNoise(0.0f, 0.25f);
+    std::vector<float> baro(numSamples, NAN);
+    for (size_t index = 0; index < numSamples; index += 6)
+    {
+        baro[index] = 100.0f + baroNoise(random);
+    }
+
+    VerticalFilter filter;
+    std::vector<float> altitude, velocity;
+    runVertical(samples, baro, filter, altitude, velocity);
+
+    float maxError = 0;
+    double sum = 0;
+    for (float a : altitude)
+    {
+        maxError = std::max(maxError, std::fabs(a - 100.0f));
+        sum += (a - 100.0f) * (a - 100.0f);
+    }
+    float rms = float(std::sqrt(sum / numSamples));
+    std::cout << "vertical filter through gestures: altitude " << rms << " m rms, " << maxError << " m at most" << std::endl;
+    REQUIRE(rms < 0.25f);
+    REQUIRE(maxError < 1.0f);
+}
+
+//
+// benchmarks (hidden: run with microbit_test "[benchmark]")
+//
+TEST_CASE("verticalFilter benchmark", "[.][benchmark]")
+{
+    using clock = std::chrono::steady_clock;
+    const int numIterations = 10000000;
+    VerticalFilter filter;
+    filter.init();
+    filter.setBaroAltitude(VerticalFilter::value_t(100));
+    Vector3<fixed_9_7> gravity(fixed_9_7(3), fixed_9_7(-5), fixed_9_7(-63));
+    int32_t check = 0;
+
+    auto start = clock::now();
+    for (int index = 0; index < numIterations; index++)
+    {
+        filter.addSample(byteVector3(int8_t(3 + (index & 3)), int8_t(-5), int8_t(-66 + ((index >> 2) & 7))), gravity);
+        check += filter.getVelocity().value_;
+    }
+    double seconds = std::chrono::duration<double>(clock::now() - start).count();
+    std::cout << "vertical filter: " << (seconds * 1e9 / numIterations) << " ns/tick (" << check << ")" << std::endl;
+}
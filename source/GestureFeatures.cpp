@@ -0,0 +1,199 @@
+#include "Vector3.h"
+#include "DelayBuffer.h"
+#include "RunningStats.h"
+#include "IirFilter.h"
+#include "FixedPt.h"
+#include "GestureFeatures.h"
+
+#include <algorithm> // for std::max
+
+#define QUANTIZE_SAMPLE 0
+
+const filterCoeff_t gravityFilterCoeff = filterCoeff_t(1/32.0);
+
+const float minLenThresh = 1; 
+
+// TODO:
+// * Maybe modulate the shake output slightly by the amount of energy? --- soft shakes
+//     return a very large prediction value --- often higher than a strong shake
+// * Maybe tune shake frequency by energy? hard shakes are somewhat slower (are they?)
+// * Maybe use max over some window instead of mean for shake pred value? (though this
+//     risks making transitory spikes last longer and be harder to filter out
+
+GestureFeaturePool::GestureFeaturePool() : gravityFilter(gravityFilterCoeff),
+                                           quietWindowStats(sampleDelayBuffer),
+                                           impulseWindowStats(sampleDelayBuffer),
+                                           impulseWindowStatsX(sampleDelayBuffer),
+                                           impulseWindowStatsY(sampleDelayBuffer),
+#if USE_SHAKE_GATE
+                                           shakeThreshStats(sampleDelayBuffer),
+#endif
+                                           dot2Stats(dotDelayBuffer2)
+#if USE_SLOW_SHAKE
+                                         , dot4Stats(dotDelayBuffer4)
+#endif
+{
+}
+
+GestureFeaturePool::GestureFeaturePool(const GestureFeaturePool& other) : GestureFeaturePool()
+{
+    *this = other;
+}
+
+void GestureFeaturePool::init(const byteVector3& sample)
+{
+    // init gravity
+    filteredSample_t initFilterSample = filteredSample_t(sample);
+    gravityFilter.init(initFilterSample);
+}
+
+#if QUANTIZE_SAMPLE
+byteVector3 quantizeSample(const byteVector3& b, int factor)
+{
+    // TODO: round appropriately, be more efficient
+    return byteVector3(b / float(factor))*factor;
+}
+#endif
+
+// For some reason, this kills the micro:bit for a while
+template<typename MeanDelayType, typename MeanStatsType>
+void GestureFeaturePool::processDotFeature(const byteVector3& currentSample, int dotWavelength, MeanDelayType& meanDelay, MeanStatsType& delayDotStats)
+{
+#if QUANTIZE_SAMPLE    
+    // TODO: investigate if this really helps like it appears to do in the python version
+    int quantRate = 16;
+    byteVector3 quantizedCurrentSample = quantizeSample(currentSample, quantRate);
+
+    float dot1a = dotNorm(quantizedCurrentSample, quantizeSample(sampleDelayBuffer.getDelayedSample(dotWavelength), quantRate), minLenThresh);
+    float dot1b = dotNorm(quantizedCurrentSample, quantizeSample(sampleDelayBuffer.getDelayedSample(2 * dotWavelength), quantRate), minLenThresh);
+#else
+
+#if FIXED_MATH
+    Vector3<predictionValue_t> fixedSampleNow(currentSample);
+    Vector3<predictionValue_t> fixedSampleDelay1(sampleDelayBuffer.getDelayedSample(dotWavelength));
+    Vector3<predictionValue_t> fixedSampleDelay2(sampleDelayBuffer.getDelayedSample(2*dotWavelength));
+    auto dot1a = dotNormFixed(fixedSampleNow, fixedSampleDelay1, 0);
+    auto dot1b = dotNormFixed(fixedSampleNow, fixedSampleDelay2, 0);
+#else
+    float dot1a = dotNorm(currentSample, sampleDelayBuffer.getDelayedSample(dotWavelength), minLenThresh);
+    float dot1b = dotNorm(currentSample, sampleDelayBuffer.getDelayedSample(2 * dotWavelength), minLenThresh);
+#endif
+
+
+#endif
+
+    if (dot1a < 0 && dot1b > 0)
+    {
+        meanDelay.addSample(dot1b - dot1a);
+        delayDotStats.addSample(dot1b - dot1a);
+    }
+    else
+    {
+        meanDelay.addSample(predictionValue_t(0));
+        delayDotStats.addSample(predictionValue_t(0));
+    }
+}
+
+void GestureFeaturePool::addSample(const byteVector3& sample, unsigned requiredFeatures, GestureFeatures& features)
+{
+    features.pool = this;
+    features.rawSample = sample;
+
+    // These look at the window *before* the new sample goes in
+    if (requiredFeatures & GESTURE_FEATURE_VARIANCE)
+    {
+        features.quietVariance = quietWindowStats.getVar();
+    }
+#if USE_SHAKE_GATE
+    if (requiredFeatures & GESTURE_FEATURE_DOT)
+    {
+        features.shakeGateVariance = shakeThreshStats.getVar();
+    }
+#endif
+
+    const filteredSample_t& gravity = gravityFilter.filterSample(filteredSample_t(sample));
+    features.gravity = gravity;
+    
+    byteVector3 currentSample = byteVector3 { clampByte((int)sample.x-(int)gravity.x),
+                                              clampByte((int)sample.y-(int)gravity.y),
+                                              clampByte((int)sample.z-(int)gravity.z) };
+    features.sample = currentSample;
+
+    // TODO: maybe we should somehow associate the stats objects with the delay lines
+    //       then we won't have to remember to add the stats.addSample() lines
+    sampleDelayBuffer.addSample(currentSample); 
+    if (requiredFeatures & GESTURE_FEATURE_VARIANCE)
+    {
+        quietWindowStats.addSample(currentSample);
+        impulseWindowStats.addSample(currentSample);
+    }
+    if (requiredFeatures & GESTURE_FEATURE_IMPULSE)
+    {
+        impulseWindowStatsX.addSample(currentSample);
+        impulseWindowStatsY.addSample(currentSample);
+    }
+    
+    if (requiredFeatures & GESTURE_FEATURE_DOT)
+    {
+#if USE_SHAKE_GATE
+        shakeThreshStats.addSample(currentSample);
+#endif
+
+        // now add val to mean buffer
+        processDotFeature(currentSample, dotWavelength2, dotDelayBuffer2, dot2Stats);
+#if USE_SLOW_SHAKE
+        if(allowSlowGesture)
+        {
+            processDotFeature(currentSample, dotWavelength4, dotDelayBuffer4, dot4Stats);
+        }
+#endif
+    }
+}
+
+float GestureFeaturePool::getImpulseVariance()
+{
+    return impulseWindowStats.getVar();
+}
+
+ImpulseDirection GestureFeaturePool::getImpulseDirection()
+{
+    // Compare energy (sums of squares) rather than variance: an impulse that pushes the
+    // board one way for the whole window has a large mean but hardly any variance
+    // (X and Y are at half scale)
+    int32_t energyX = 4 * impulseWindowStatsX.getSumSq();
+    int32_t energyY = 4 * impulseWindowStatsY.getSumSq();
+    int32_t energyZ = impulseWindowStats.getSumSq();
+
+    if (energyX == 0 && energyY == 0 && energyZ == 0)
+    {
+        return IMPULSE_NONE;
+    }
+    if (energyX >= energyY && energyX >= energyZ)
+    {
+        return impulseWindowStatsX.getSum() >= 0 ? IMPULSE_X_POS : IMPULSE_X_NEG;
+    }
+    if (energyY >= energyZ)
+    {
+        return impulseWindowStatsY.getSum() >= 0 ? IMPULSE_Y_POS : IMPULSE_Y_NEG;
+    }
+    return impulseWindowStats.getSum() >= 0 ? IMPULSE_Z_POS : IMPULSE_Z_NEG;
+}
+
+predictionValue_t GestureFeaturePool::getShakePrediction()
+{    
+#if USE_SLOW_SHAKE
+    if(allowSlowGesture)
+    {
+        return std::max(dot2Stats.getMean(), dot4Stats.getMean());
+    }
+#endif
+    return dot2Stats.getMean();
+}
+
+#if USE_SLOW_SHAKE
+bool GestureFeaturePool::toggleSlowGesture()
+{
+    allowSlowGesture = !allowSlowGesture;
+    return allowSlowGesture;
+}
+#endif
@@ -0,0 +1,290 @@
+#include "Gestures.h"
+#include "GestureFeatures.h"
+#include "EventThresholdFilter.h"
+#include "FastMath.h"
+
+#include <algorithm> // for std::min, std::max
+
+const predictionValue_t shakeGestureThreshold = predictionValue_t(0.5f);
+const int shakeEventCountThreshold = 6;
+const int shakeEventCountLowThreshold = 3;
+
+#if USE_SHAKE_GATE
+const float shakeGateThreshSquared = 40000; //4000000.0f;
+#endif
+
+// Tap stuff
+const int tapGestureThreshold = 200;
+const int tapEventCountThreshold = 1;
+
+//const float tapScaleDenominator = 2.5f;
+const float tapGateThresh1 = 25.0f; // variance of preceeding windown should be less than this
+
+// When the device is anchored to a solid object (like a table), taps are much weaker and
+// the var over the big window is [0,0,0,0,0... ~12, ...]. So we track the long-term noise
+// floor of the quiet window, and the further it is below what a hand-held board sees, the
+// more we boost the tap prediction (up to tapMaxNoiseFloorBoost).
+#if USE_TAP_NOISE_FLOOR
+const float tapHandheldNoiseFloor = 2.0f; // quiet-window variance of a board held still
+const float tapNoiseFloorEpsilon = 1.0f / 8; // one count of the scaled variance
+const float tapMaxNoiseFloorBoost = 4.0f;
+#endif
+
+// Double tap: by default the second tap has to come within this many samples of the first
+// (see DoubleTapGesture::setWindow). The lower limit keeps one long tap (which can fire on
+// consecutive samples) from counting twice.
+const int defaultDoubleTapMinGap = 3;
+const int defaultDoubleTapMaxGap = 25; // ~450ms
+
+// Free-fall: |accel| below ~0.4g (samples are in 1/64 g) for 4 samples (~72ms)
+const int freefallThreshSquared = 25*25;
+const int freefallEventCountThreshold = 4;
+const int freefallEventCountLowThreshold = 2;
+
+// Postures come from the gravity estimate, which already lags by a few hundred ms, so
+// they don't need much more debouncing than that
+const int faceThreshold = 48; // ~0.75g, i.e. within ~40 degrees of flat
+const int tiltThreshold = 24; // ~0.4g, i.e. more than ~22 degrees
+const int postureHoldCount = 5;
+
+const char* getGestureName(int event)
+{
+    switch (event)
+    {
+    case MICROBIT_ACCELEROMETER_SHAKE:
+        return "Shake";
+    case MICROBIT_ACCELEROMETER_TAP:
+        return "Tap";
+    case MICROBIT_ACCELEROMETER_DOUBLE_TAP:
+        return "DoubleTap";
+    case MICROBIT_ACCELEROMETER_FREEFALL:
+        return "Freefall";
+    case MICROBIT_ACCELEROMETER_FACE_UP:
+        return "FaceUp";
+    case MICROBIT_ACCELEROMETER_FACE_DOWN:
+        return "FaceDown";
+    case MICROBIT_ACCELEROMETER_TILT_UP:
+        return "TiltUp";
+    case MICROBIT_ACCELEROMETER_TILT_DOWN:
+        return "TiltDown";
+    case MICROBIT_ACCELEROMETER_TILT_LEFT:
+        return "TiltLeft";
+    case MICROBIT_ACCELEROMETER_TILT_RIGHT:
+        return "TiltRight";
+    default:
+        return "";
+    }
+}
+
+//
+// Tap
+//
+TapGesture::TapGesture() : eventFilter(tapGestureThreshold, tapEventCountThreshold, 0)
+{
+    setThresholds(tapGestureThreshold, tapEventCountThreshold, tapGateThresh1);
+}
+
+void TapGesture::setThresholds(int threshold, int eventCount, float newGateThreshold)
+{
+    eventFilter = EventThresholdFilter<int16_t>(threshold, eventCount, 0);
+    gateThreshold = quietVar_t(std::min(newGateThreshold * quietVarScale, 65535.0f));
+}
+
+float TapGesture::getTapPrediction(const GestureFeatures& features)
+{
+    // If previous quiet window was very very quiet (e.g., 0), then
+    // increase output (when micro:bit is sitting on table, tap
+    // amplitude is diminished)
+
+    float scale = fast_inv_sqrt(1.0 + quietVarDelay.getDelayedSample(tapK) / quietVarScale); 
+#if USE_TAP_NOISE_FLOOR
+    scale *= getNoiseFloorBoost();
+#endif
+    return features.impulseVariance() * scale;
+}
+
+#if USE_TAP_NOISE_FLOOR
+float TapGesture::getNoiseFloorBoost()
+{
+    float floorVar = noiseFloor.getFloorFloat() / quietVarScale;
+    if (floorVar >= tapHandheldNoiseFloor)
+    {
+        return 1.0f;
+    }
+    return std::min(tapMaxNoiseFloorBoost, fast_inv_sqrt((floorVar + tapNoiseFloorEpsilon) / tapHandheldNoiseFloor));
+}
+#endif
+
+int TapGesture::update(const GestureFeatures& features, uint16_t)
+{
+    bool shouldCheckTap = tapCountdown1 > 0;
+
+    // criterion 1: look for N samples worth of quiet
+    auto quietVar = quietVar_t(std::min(features.quietVariance * quietVarScale, 65535.0f));
+    quietVarDelay.addSample(quietVar);
+#if USE_TAP_NOISE_FLOOR
+    noiseFloor.addSample(quietVar);
+#endif
+
+    if (quietVar <= gateThreshold)
+    {
+        tapCountdown1 = tapK;
+    }
+    else if(tapCountdown1 > 0)
+    {
+        tapCountdown1 -= 1;
+    }
+
+    if(shouldCheckTap)
+    {
+        float tapPredVal = getTapPrediction(features);
+        bool foundTap = eventFilter.filterValue(int16_t(std::min(tapPredVal, 32767.0f)));
+        if(foundTap)
+        {
+            direction = features.impulseDirection();
+            return MICROBIT_ACCELEROMETER_TAP;
+        }
+    }
+    return 0;
+}
+
+//
+// Double tap
+//
+DoubleTapGesture::DoubleTapGesture() : eventFilter(1, 1, 0)
+{
+    setWindow(defaultDoubleTapMinGap, defaultDoubleTapMaxGap);
+}
+
+void DoubleTapGesture::setWindow(int newMinGap, int newMaxGap)
+{
+    maxGap = uint8_t(std::max(1, std::min(newMaxGap, noTap - 1)));
+    minGap = uint8_t(std::max(1, std::min(newMinGap, (int)maxGap)));
+}
+
+int DoubleTapGesture::update(const GestureFeatures&, uint16_t firedEvents)
+{
+    bool tapped = (firedEvents & eventBit(MICROBIT_ACCELEROMETER_TAP)) != 0;
+    bool inWindow = tapped && ticksSinceTap >= minGap && ticksSinceTap <= maxGap;
+
+    if (eventFilter.filterValue(inWindow ? 1 : 0))
+    {
+        ticksSinceTap = noTap; // a third tap starts over
+        return MICROBIT_ACCELEROMETER_DOUBLE_TAP;
+    }
+
+    if (tapped && ticksSinceTap >= minGap)
+    {
+        ticksSinceTap = 0;
+    }
+    else if (ticksSinceTap != noTap)
+    {
+        ticksSinceTap++;
+    }
+    return 0;
+}
+
+//
+// Shake
+//
+ShakeGesture::ShakeGesture() : eventFilter(shakeGestureThreshold, shakeEventCountThreshold, shakeEventCountLowThreshold)
+{
+}
+
+void ShakeGesture::setThresholds(predictionValue_t threshold, int eventCount, int lowCount)
+{
+    eventFilter = EventThresholdFilter<predictionValue_t>(threshold, eventCount, lowCount);
+}
+
+int ShakeGesture::update(const GestureFeatures& features, uint16_t)
+{
+#if USE_SHAKE_GATE
+    bool shouldCheckShake = features.shakeGateVariance > shakeGateThreshSquared;
+#else
+    const bool shouldCheckShake = true;
+#endif
+
+    if(shouldCheckShake)
+    {
+        auto shakePredVal = features.shakePrediction();
+        bool foundShake = eventFilter.filterValue(shakePredVal);
+        if(foundShake)
+        {
+            return MICROBIT_ACCELEROMETER_SHAKE;
+        }
+    }
+    else
+    {
+        eventFilter.reset();
+    }
+    return 0;
+}
+
+//
+// Free-fall
+//
+FreefallGesture::FreefallGesture() : eventFilter(1, freefallEventCountThreshold, freefallEventCountLowThreshold)
+{
+}
+
+int FreefallGesture::update(const GestureFeatures& features, uint16_t)
+{
+    const byteVector3& s = features.rawSample;
+    int magSq = s.x*s.x + s.y*s.y + s.z*s.z;
+    bool falling = eventFilter.filterValue(magSq < freefallThreshSquared ? 1 : 0);
+    return falling ? MICROBIT_ACCELEROMETER_FREEFALL : 0;
+}
+
+//
+// Face up / down
+//
+FaceGesture::FaceGesture() : postureFilter(postureHoldCount)
+{
+}
+
+int FaceGesture::update(const GestureFeatures& features, uint16_t)
+{
+    int z = features.gravity.z;
+    int posture = 0;
+    if (z < -faceThreshold)
+    {
+        posture = MICROBIT_ACCELEROMETER_FACE_UP;
+    }
+    else if (z > faceThreshold)
+    {
+        posture = MICROBIT_ACCELEROMETER_FACE_DOWN;
+    }
+    return postureFilter.filterPosture(posture);
+}
+
+//
+// Tilt
+//
+TiltGesture::TiltGesture() : postureFilter(postureHoldCount)
+{
+}
+
+int TiltGesture::update(const GestureFeatures& features, uint16_t)
+{
+    // Same precedence as the DAL: left/right before up/down
+    int x = features.gravity.x;
+    int y = features.gravity.y;
+    int posture = 0;
+    if (x < -tiltThreshold)
+    {
+        posture = MICROBIT_ACCELEROMETER_TILT_LEFT;
+    }
+    else if (x > tiltThreshold)
+    {
+        posture = MICROBIT_ACCELEROMETER_TILT_RIGHT;
+    }
+    else if (y < -tiltThreshold)
+    {
+        posture = MICROBIT_ACCELEROMETER_TILT_DOWN;
+    }
+    else if (y > tiltThreshold)
+    {
+        posture = MICROBIT_ACCELEROMETER_TILT_UP;
+    }
+    return postureFilter.filterPosture(posture);
+}
@@ -1,181 +1,133 @@
 #include "Vector3.h"
-#include "DelayBuffer.h"
-#include "RunningStats.h"
-#include "EventThresholdFilter.h"
-#include "IirFilter.h"
-#include "FixedPt.h"
+#include "GestureFeatures.h"
+#include "Gestures.h"
 #include "MicroBitGestureDetector.h"
 
 #include "MicroBitAccess.h"
-
-#include <algorithm> // for std::max
-
-#define QUANTIZE_SAMPLE 0
+#include "StateBlob.h"
 
 const int sampleRate = 18; // in ms
 
-const filterCoeff_t gravityFilterCoeff = filterCoeff_t(1/32.0);
-
-const float minLenThresh = 1; 
-
-const predictionValue_t shakeGestureThreshold = predictionValue_t(0.5f);
-const int shakeEventCountThreshold = 6;
-const int shakeEventCountLowThreshold = 3;
-
-#if USE_SHAKE_GATE
-const float shakeGateThreshSquared = 40000; //4000000.0f;
-#endif
-
-// Tap stuff
-const int tapGestureThreshold = 200;
-const int tapEventCountThreshold = 1;
-
-//const float tapScaleDenominator = 2.5f;
-const float tapGateThresh1 = 25.0f; // variance of preceeding windown should be less than this
-
-
-
-// TODO:
-// * Maybe modulate the shake output slightly by the amount of energy? --- soft shakes
-//     return a very large prediction value --- often higher than a strong shake
-// * Maybe tune shake frequency by energy? hard shakes are somewhat slower (are they?)
-// * Maybe use max over some window instead of mean for shake pred value? (though this
-//     risks making transitory spikes last longer and be harder to filter out
-
-// TODO: still doesn't detect taps if device is anchored to a solid
-// object (like atable). Then, the var over the big window is
-// [0,0,0,0,0... ~12, ...]  Maybe check if var over an even bigger
-// window is exactly(ish) 0, and lower the threshold even more if so?
-
-MicroBitGestureDetector::MicroBitGestureDetector() : gravityFilter(gravityFilterCoeff),
-                                     tapLargeWindowStats(sampleDelayBuffer),
-                                     tapImpulseWindowStats(sampleDelayBuffer),
-#if USE_SHAKE_GATE
-                                     shakeThreshStats(sampleDelayBuffer),
+// Snapshots start with this. Bump the version whenever the state changes shape; the
+// options catch builds with different #defines.
+struct GestureStateHeader
+{
+    uint8_t version;
+    uint8_t options;
+    uint16_t stateSize; // not including the header
+};
+
+const uint8_t gestureStateVersion = 1;
+const uint8_t gestureStateOptions = (USE_SHAKE_GATE << 0) | (USE_SLOW_SHAKE << 1) | (FIXED_MATH << 2)
+                                  | (USE_TAP_NOISE_FLOOR << 3) | (USE_MEDIAN_PREFILTER << 4);
+
+MicroBitGestureDetector::MicroBitGestureDetector()
+#if USE_MEDIAN_PREFILTER
+    : prefilter(prefilterDelayBuffer)
 #endif
-                                     dot2Stats(dotDelayBuffer2),
-                                     dot4Stats(dotDelayBuffer4),
-    shakeEventFilter(shakeGestureThreshold, shakeEventCountThreshold, shakeEventCountLowThreshold),
-    tapEventFilter(tapGestureThreshold, tapEventCountThreshold, predictionValue_t(0))
 {
     init(); // ?
 }
 
-void MicroBitGestureDetector::init()
+MicroBitGestureDetector::MicroBitGestureDetector(const MicroBitGestureDetector& other) : prevTime(other.prevTime),
+                                                                                          features(other.features),
+                                                                                          gestures(other.gestures),
+#if USE_MEDIAN_PREFILTER
+                                                                                          prefilterDelayBuffer(other.prefilterDelayBuffer),
+                                                                                          prefilter(prefilterDelayBuffer),
+#endif
+                                                                                          firedGestures(other.firedGestures)
+#if GESTURE_DIAGNOSTICS
+                                                                                        , isPrinting(other.isPrinting)
+#endif
 {
-    // init gravity
-    updateAccelerometer();
-    auto sample = getAccelData();
-    filteredSample_t initFilterSample = filteredSample_t(sample);
-    gravity = initFilterSample;
-    filteredSample = initFilterSample;
-    gravityFilter.init(initFilterSample);
+#if USE_MEDIAN_PREFILTER
+    prefilter = other.prefilter;
+#endif
 }
 
-#if QUANTIZE_SAMPLE
-byteVector3 quantizeSample(const byteVector3& b, int factor)
+void MicroBitGestureDetector::init()
 {
-    // TODO: round appropriately, be more efficient
-    return byteVector3(b / float(factor))*factor;
+    updateAccelerometer();
+    init(getAccelData());
 }
-#endif
 
-// For some reason, this kills the micro:bit for a while
-template<typename MeanDelayType, typename MeanStatsType>
-void MicroBitGestureDetector::processDotFeature(const byteVector3& currentSample, int dotWavelength, MeanDelayType& meanDelay, MeanStatsType& delayDotStats)
+void MicroBitGestureDetector::init(const byteVector3& sample)
 {
-#if QUANTIZE_SAMPLE    
-    // TODO: investigate if this really helps like it appears to do in the python version
-    int quantRate = 16;
-    byteVector3 quantizedCurrentSample = quantizeSample(currentSample, quantRate);
-
-    float dot1a = dotNorm(quantizedCurrentSample, quantizeSample(sampleDelayBuffer.getDelayedSample(dotWavelength), quantRate), minLenThresh);
-    float dot1b = dotNorm(quantizedCurrentSample, quantizeSample(sampleDelayBuffer.getDelayedSample(2 * dotWavelength), quantRate), minLenThresh);
-#else
-
-#if FIXED_MATH
-    Vector3<predictionValue_t> fixedSampleNow(currentSample);
-    Vector3<predictionValue_t> fixedSampleDelay1(sampleDelayBuffer.getDelayedSample(dotWavelength));
-    Vector3<predictionValue_t> fixedSampleDelay2(sampleDelayBuffer.getDelayedSample(2*dotWavelength));
-    auto dot1a = dotNormFixed(fixedSampleNow, fixedSampleDelay1, 0);
-    auto dot1b = dotNormFixed(fixedSampleNow, fixedSampleDelay2, 0);
-#else
-    float dot1a = dotNorm(currentSample, sampleDelayBuffer.getDelayedSample(dotWavelength), minLenThresh);
-    float dot1b = dotNorm(currentSample, sampleDelayBuffer.getDelayedSample(2 * dotWavelength), minLenThresh);
+#if USE_MEDIAN_PREFILTER
+    // fill the window, so we don't start out with the median of a bunch of zeros
+    for (int index = 0; index < prefilterWindowSize; index++)
+    {
+        prefilterDelayBuffer.addSample(sample);
+        prefilter.addSample(sample);
+    }
 #endif
 
+    // init gravity
+    features.init(sample);
+}
 
+template <typename Archive>
+void MicroBitGestureDetector::serialize(Archive& ar)
+{
+    features.serialize(ar);
+    gestures.serialize(ar);
+#if USE_MEDIAN_PREFILTER
+    prefilterDelayBuffer.serialize(ar);
+    prefilter.serialize(ar);
 #endif
-
-    if (dot1a < 0 && dot1b > 0)
-    {
-        meanDelay.addSample(dot1b - dot1a);
-        delayDotStats.addSample(dot1b - dot1a);
-    }
-    else
-    {
-        meanDelay.addSample(predictionValue_t(0));
-        delayDotStats.addSample(predictionValue_t(0));
-    }
+    ar.io(firedGestures);
 }
 
-void MicroBitGestureDetector::processSample(byteVector3 sample)
+size_t MicroBitGestureDetector::getStateSize()
 {
-    lastRawSample = sample;
-    gravity = gravityFilter.filterSample(filteredSample_t(sample));
-    
-    byteVector3 currentSample = byteVector3 { clampByte((int)sample.x-(int)gravity.x),
-                                              clampByte((int)sample.y-(int)gravity.y),
-                                              clampByte((int)sample.z-(int)gravity.z) };
-    lastFilteredSample = currentSample;
-
-    // TODO: maybe we should somehow associate the stats objects with the delay lines
-    //       then we won't have to remember to add the stats.addSample() lines
-    sampleDelayBuffer.addSample(currentSample); 
-    tapLargeWindowStats.addSample(currentSample);
-    tapImpulseWindowStats.addSample(currentSample);
-#if USE_SHAKE_GATE
-    shakeThreshStats.addSample(currentSample);
-#endif
-    
-    // now add val to mean buffer
-    processDotFeature(currentSample, dotWavelength2, dotDelayBuffer2, dot2Stats);
-    if(allowSlowGesture)
-    {
-        processDotFeature(currentSample, dotWavelength4, dotDelayBuffer4, dot4Stats);
-    }
+    StateWriter sizer;
+    serialize(sizer);
+    return sizeof(GestureStateHeader) + sizer.size();
 }
 
-predictionValue_t MicroBitGestureDetector::getShakePrediction()
-{    
-    if(allowSlowGesture)
-    {
-        return std::max(dot2Stats.getMean(), dot4Stats.getMean());
-    }
-    else
+size_t MicroBitGestureDetector::saveState(uint8_t* buffer, size_t bufferSize)
+{
+    size_t stateSize = getStateSize();
+    if (bufferSize < stateSize)
     {
-        return dot2Stats.getMean();
+        return 0;
     }
+
+    GestureStateHeader header = { gestureStateVersion, gestureStateOptions, uint16_t(stateSize - sizeof(GestureStateHeader)) };
+    StateWriter writer(buffer, bufferSize);
+    writer.io(header);
+    serialize(writer);
+    return writer.ok() ? writer.size() : 0;
 }
 
-float MicroBitGestureDetector::getTapPrediction()
+bool MicroBitGestureDetector::restoreState(const uint8_t* buffer, size_t bufferSize)
 {
-    // If previous quiet window was very very quiet (e.g., 0), then
-    // increase output (when micro:bit is sitting on table, tap
-    // amplitude is diminished)
+    // check everything up front, so a bad blob can't leave us half-restored
+    GestureStateHeader header;
+    StateReader reader(buffer, bufferSize);
+    reader.io(header);
+    if (!reader.ok() || header.version != gestureStateVersion || header.options != gestureStateOptions
+        || sizeof(GestureStateHeader) + header.stateSize != getStateSize() || bufferSize < getStateSize())
+    {
+        return false;
+    }
 
-    float scale = fast_inv_sqrt(1.0 + quietVarDelay.getDelayedSample(tapK)); 
-    return tapImpulseWindowStats.getVar() * scale;
+    serialize(reader);
+    return reader.ok();
 }
 
+#if GESTURE_DIAGNOSTICS
 void MicroBitGestureDetector::togglePrinting()
 {
     isPrinting = !isPrinting;
 }
+#endif
 
+#if USE_SLOW_SHAKE
 void MicroBitGestureDetector::toggleAlg()
 {
-    allowSlowGesture = !allowSlowGesture;
+    bool allowSlowGesture = features.toggleSlowGesture();
     if(allowSlowGesture)
     {
         showChar('2', 50);
@@ -185,8 +137,9 @@ void MicroBitGestureDetector::toggleAlg()
         showChar('1', 50);
     }
 }
+#endif
 
-void MicroBitGestureDetector::systemTick()
+bool MicroBitGestureDetector::systemTick()
 {
     unsigned long time = systemTime();
 
@@ -194,90 +147,66 @@ void MicroBitGestureDetector::systemTick()
     if ((time-prevTime) >= sampleRate || time < prevTime) 
     {
         prevTime = time;
-        state = detectGesture();
+        detectGesture();
+        return true;
     }
+    return false;
 }
 
 int MicroBitGestureDetector::detectGesture()
 {
     updateAccelerometer();
-    byteVector3 sample = getAccelData();
-    
-    bool shouldCheckTap = tapCountdown1 > 0;
-#if USE_SHAKE_GATE
-    bool shouldCheckShake = shakeThreshStats.getVar() > shakeGateThreshSquared;
+    return processSample(getAccelData());
+}
+
+int MicroBitGestureDetector::processSample(const byteVector3& rawSample)
+{
+#if USE_MEDIAN_PREFILTER
+    prefilterDelayBuffer.addSample(rawSample);
+    prefilter.addSample(rawSample);
+    byteVector3 sample = prefilter.getMedian();
 #else
-    const bool shouldCheckShake = true;
+    const byteVector3& sample = rawSample;
 #endif
 
-    // criterion 1: look for N samples worth of quiet
-    auto quietVariance = tapLargeWindowStats.getVar();
-    quietVarDelay.addSample(quietVariance);
-
-    if (quietVariance <= tapGateThresh1)
-    {
-        tapCountdown1 = tapK;
-    }
-    else if(tapCountdown1 > 0)
-    {
-        tapCountdown1 -= 1;
-    }
-
-    processSample(sample);
+    GestureFeatures sampleFeatures;
+    features.addSample(sample, MicroBitGestureSet::requiredFeatures, sampleFeatures);
 
-    predictionValue_t diagnosticVal = predictionValue_t(0);
-    if(isPrinting) diagnosticVal = getShakePrediction();
-
-    auto& outputSample = lastFilteredSample;
-
-    if(shouldCheckTap)
-    {
-        float tapPredVal = getTapPrediction();
-        bool foundTap = tapEventFilter.filterValue(tapPredVal);
-        if(foundTap)
-        {
-            shakeEventFilter.reset();
-            if(isPrinting)
-            {
-                serialPrintLn("Tap\t", systemTime(), "\t", buttonA(), "\t", buttonB(), "\t", outputSample, "\t", (float)diagnosticVal);
-            }
-            return MICROBIT_ACCELEROMETER_TAP;
-        }
-    }
-
-    if(shouldCheckShake)
-    {
-        auto shakePredVal = getShakePrediction();
-        bool foundShake = shakeEventFilter.filterValue(shakePredVal);
-        if(foundShake)
-        {
-            tapEventFilter.reset();
-            if(isPrinting)
-            {
-                serialPrintLn("Shake\t", systemTime(), "\t", buttonA(), "\t", buttonB(), "\t", outputSample, "\t", (float)diagnosticVal);
-            }
-            return MICROBIT_ACCELEROMETER_SHAKE;
-        }
-    }
-    else
-    {
-        shakeEventFilter.reset();
-    }
+    GestureResult result = gestures.update(sampleFeatures);
+    firedGestures = result.firedEvents;
 
+#if GESTURE_DIAGNOSTICS
     if(isPrinting)
     {
-        serialPrintLn("\t", systemTime(), "\t", buttonA(), "\t", buttonB(), "\t", outputSample, "\t", (float)diagnosticVal);
+        float diagnosticVal = sampleFeatures.shakePrediction();
+        serialPrintLn(getGestureName(result.event), "\t", systemTime(), "\t", buttonA(), "\t", buttonB(), "\t", sampleFeatures.rawSample, "\t", diagnosticVal);
     }
+#endif
 
-    return 0; // none
+    return result.event;
 }
 
 int MicroBitGestureDetector::getCurrentGesture()
 {
-    return state;
+    return MicroBitGestureSet::topEvent(firedGestures);
+}
+
+uint16_t MicroBitGestureDetector::getFiredGestures()
+{
+    return firedGestures;
 }
 
 bool MicroBitGestureDetector::isShaking()
 {
-    return shakeEventFilter.currentValue();
+    return gestures.get<ShakeGesture>().isActive();
+}
+
+ImpulseDirection MicroBitGestureDetector::getTapDirection()
+{
+    return gestures.get<TapGesture>().getDirection();
+}
+
+void MicroBitGestureDetector::setDoubleTapWindow(int minInterval, int maxInterval)
+{
+    gestures.get<DoubleTapGesture>().setWindow(minInterval / sampleRate, maxInterval / sampleRate);
 }
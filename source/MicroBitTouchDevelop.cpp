@@ -1,4 +1,7 @@
 #include "MicroBitTouchDevelop.h"
+#include "FiberTask.h"
+#include "ImageCache.h"
+#include "IntMath.h"
 
 namespace touch_develop {
 
@@ -21,25 +24,13 @@ namespace touch_develop {
   // An adapter for the API expected by the run-time.
   // ---------------------------------------------------------------------------
 
-  map<pair<int, int>, function<void (MicroBitEvent)>> handlersMap;
+  EventHandlerTable<> handlers(MICROBIT_EVT_ANY);
 
   // We have the invariant that if [dispatchEvent] is registered against the DAL
-  // for a given event, then [handlersMap] contains a valid entry for that
-  // event.
+  // for a given event, then [handlers] contains a valid entry for that event
+  // (or for MICROBIT_EVT_ANY, from the same source).
   void dispatchEvent(MicroBitEvent e) {
-    handlersMap[{ e.source, e.value }](e);
-  }
-
-  void registerHandler(pair<int, int> k, function<void(int)> f) {
-    handlersMap[k] = [f] (MicroBitEvent e) {
-      f(e.value);
-    };
-  }
-
-  void registerHandler(pair<int, int> k, function<void()> f) {
-    handlersMap[k] = [f] (MicroBitEvent) {
-      f();
-    };
+    handlers.dispatch(e.source, e.value);
   }
 
   // ---------------------------------------------------------------------------
@@ -62,53 +53,53 @@ namespace touch_develop {
   }
 
   namespace string {
-    bool in_range(ManagedString s, int i) {
+    bool in_range(String s, int i) {
       return i >= 0 && i < s.length();
     }
 
-    ManagedString concat(ManagedString s1, ManagedString s2) {
-      return s1 + s2;
+    String concat(String s1, String s2) {
+      return s1.concat(s2);
     }
 
-    ManagedString _(ManagedString s1, ManagedString s2) {
+    String _(String s1, String s2) {
       return concat(s1, s2);
     }
 
-    ManagedString substring(ManagedString s, int start, int len) {
+    String substring(String s, int start, int len) {
       if (!in_range(s, start) || len < start || len < 0)
-        return ManagedString::EmptyString;
+        return String();
 
       return s.substring(start, len);
     }
 
-    bool equals(ManagedString s1, ManagedString s2) {
-      return s1 == s2;
+    bool equals(String s1, String s2) {
+      return s1.equals(s2);
     }
 
-    int count(ManagedString s) {
+    int count(String s) {
       return s.length();
     }
 
-    ManagedString at(ManagedString s, int i) {
+    String at(String s, int i) {
       if (!in_range(s, i))
-        return ManagedString::EmptyString;
+        return String();
 
       return ManagedString(s.charAt(i));
     }
 
-    int to_character_code(ManagedString s) {
+    int to_character_code(String s) {
       return s.length() > 0 ? s.charAt(0) : '\0';
     }
 
-    int code_at(ManagedString s, int i) {
+    int code_at(String s, int i) {
       return in_range(s, i) ? s.charAt(i) : '\0';
     }
 
-    int to_number(ManagedString s) {
-      return atoi(s.toCharArray());
+    int to_number(String s) {
+      return s.toNumber();
     }
 
-    void post_to_wall(ManagedString s) {
+    void post_to_wall(String s) {
       uBit.serial.printf("%s\r\n", s.toCharArray());
     }
   }
@@ -128,45 +119,42 @@ namespace touch_develop {
   }
 
   namespace math {
-    int max(int x, int y) { return x < y ? y : x; }
-    int min(int x, int y) { return x < y ? x : y; }
+    int max(int x, int y) { return imax(x, y); }
+    int min(int x, int y) { return imin(x, y); }
+
+    // Seeded from the DAL's generator (and so from the hardware's) the first time it's used
+    XorShift32 randomGenerator;
+    bool randomSeeded = false;
+
     int random(int max) {
-      if (max == INT_MIN)
-        return -uBit.random(INT_MAX);
-      else if (max < 0)
-        return -uBit.random(-max);
-      else if (max == 0)
-        return 0;
+      if (!randomSeeded) {
+        randomGenerator.setSeed(uBit.random(INT_MAX));
+        randomSeeded = true;
+      }
+      if (max < 0)
+        return -(int)randomGenerator.nextBelow(0u - (unsigned)max);
       else
-        return uBit.random(max);
+        return randomGenerator.nextBelow(max);
     }
     // Unspecified behavior for int_min
-    int abs(int x) { return x < 0 ? -x : x; }
+    int abs(int x) { return iabs(x); }
     int mod (int x, int y) { return x % y; }
 
+    // Saturates rather than wrapping around
     int pow(int x, int n) {
-      if (n < 0)
-        return 0;
-      int r = 1;
-      while (n) {
-        if (n & 1)
-          r *= x;
-        n >>= 1;
-        x *= x;
-      }
-      return r;
+      return ipow(x, n);
     }
 
     int clamp(int l, int h, int x) {
-      return x < l ? l : x > h ? h : x;
+      return iclamp(x, l, h);
     }
 
     int sqrt(int x) {
-      return ::sqrt(x);
+      return x > 0 ? isqrt(x) : 0;
     }
 
     int sign(int x) {
-      return x > 0 ? 1 : (x == 0 ? 0 : -1);
+      return isign(x);
     }
   }
 
@@ -335,22 +323,27 @@ namespace touch_develop {
       else return 0;
     }
     
+    // (made on first use: the gesture detector is a global too, and reads the sensor from
+    // its constructor, which can run before this file's globals are set up)
+    SensorFrame<MicroBitAccelerometer>& getAccelerometerFrame() {
+        static SensorFrame<MicroBitAccelerometer> frame(uBit.accelerometer);
+        return frame;
+    }
+
     int getAccelerationStrength() {
-        double x = uBit.accelerometer.getX();
-        double y = uBit.accelerometer.getY();
-        double z = uBit.accelerometer.getZ();
-        return (int)sqrt(x*x+y*y+z*z);
+        return getAccelerometerFrame().refresh(uBit.systemTime()).getStrength();
     }
 
     int getAcceleration(int dimension) {
+      const auto& frame = getAccelerometerFrame().refresh(uBit.systemTime());
       if (dimension == 0)
-        return uBit.accelerometer.getX();
+        return frame.getX();
       else if (dimension == 1)
-        return uBit.accelerometer.getY();
+        return frame.getY();
       else if (dimension == 2)
-        return uBit.accelerometer.getZ();
+        return frame.getZ();
       else if (dimension == 3)
-        return getAccelerationStrength();
+        return frame.getStrength();
       // unknown
       else return 0;        
     }
@@ -454,31 +447,33 @@ namespace touch_develop {
     // System
     // -------------------------------------------------------------------------
 
-    void fun_helper(function<void()>* f) {
-      (*f)();
+    // The closures of running fibers sit in a few fixed slots (see FiberTask.h), rather
+    // than in a heap-allocated copy each, which was only there to get them through
+    // create_fiber()'s void*.
+    FiberTaskPool<4> fiberTasks;
+
+    void fiber_task_helper(FiberTask* task) {
+      task->run(uBit.systemTime());
+      while (task->isPeriodic()) {
+        fiber_sleep(task->getSleepTime(uBit.systemTime(), FIBER_TICK_PERIOD_MS)); // (a tick at least, even after an overrun)
+        task->run(uBit.systemTime());
+      }
     }
 
-    void fun_delete_helper(function<void()>* f) {
-      // The fiber is done, so release associated resources and free the
-      // heap-allocated closure.
-      delete f;
+    void fiber_task_delete_helper(FiberTask* task) {
+      // The fiber is done, so release associated resources and the closure.
+      fiberTasks.destroy(task);
       release_fiber();
     }
 
-    void forever_helper(function<void()>* f) {
-      while (true) {
-        (*f)();
-        pause(20);
-      }
+    void launchFiber(function<void()> f, uint32_t period) {
+      auto task = fiberTasks.create(std::move(f), period);
+      create_fiber((void(*)(void*)) fiber_task_helper, (void*) task, (void(*)(void*)) fiber_task_delete_helper);
     }
 
     void runInBackground(function<void()> f) {
       if (f) {
-        // The API provided by the DAL only offers a low-level, C-style,
-        // void*-based callback structure. Therefore, allocate the closure on
-        // the heap to make sure it fits in one word.
-        auto f_allocated = new function<void()>(f);
-        create_fiber((void(*)(void*)) fun_helper, (void*) f_allocated, (void(*)(void*)) fun_delete_helper);
+        launchFiber(std::move(f), 0);
       }
     }
 
@@ -486,10 +481,14 @@ namespace touch_develop {
       uBit.sleep(ms);
     }
 
+    // Every 20 ms, rounded up to the scheduler's ticks (24 ms with 6 ms ticks): the old
+    // loop paused 20 ms after each run, which came to 24 ms for a quick body and more for
+    // a slow one; now the runs are on a fixed schedule.
+    const int foreverPeriod = 20;
+
     void forever(function<void()> f) {
       if (f) {
-        auto f_allocated = new function<void()>(f);
-        create_fiber((void(*)(void*)) forever_helper, (void*) f_allocated, (void(*)(void*)) fun_delete_helper);
+        launchFiber(std::move(f), alignToTick(foreverPeriod, FIBER_TICK_PERIOD_MS));
       }
     }
 
@@ -630,12 +629,17 @@ namespace touch_develop {
       }
     }
 
+    // The LED pictures that showLeds, plotLeds and showAnimation get are constants from
+    // the compiler, so their images only need building once (see ImageCache.h; long
+    // animation strips are still built each time, so they don't stay on the heap)
+    ImageCache<MicroBitImage> ledImages;
+
     void plotImage(MicroBitImage i, int offset) {
       uBit.display.print(i, -offset, 0, 0, 0);
     }
 
     void plotLeds(int w, int h, const uint8_t* bitmap) {
-      plotImage(MicroBitImage(w, h, bitmap), 0);
+      plotImage(ledImages.get(w, h, bitmap), 0);
     }
 
     void showImage(MicroBitImage i, int offset) {
@@ -644,7 +648,7 @@ namespace touch_develop {
 
     // These have their arguments rewritten by the C++ compiler.
     void showLeds(int w, int h, const uint8_t* bitmap, int delay) {
-      uBit.display.print(MicroBitImage(w, h, bitmap), 0, 0, 0, delay);
+      uBit.display.print(ledImages.get(w, h, bitmap), 0, 0, 0, delay);
     }
 
     void scrollImage(MicroBitImage i, int offset, int delay) {
@@ -655,7 +659,7 @@ namespace touch_develop {
     }
 
     void showAnimation(int w, int h, const uint8_t* bitmap, int ms) {
-      uBit.display.animate(MicroBitImage(w, h, bitmap), ms, 5, 0);
+      uBit.display.animate(ledImages.get(w, h, bitmap), ms, 5, 0);
     }
     
     void stopAnimation() {
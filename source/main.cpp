@@ -4,9 +4,26 @@
 
 #include "MicroBitTouchDevelop.h" // Only 1 source file can include this header
 
+// Altitude and vertical speed, from the accelerometer and a BMP085/BMP180 breakout
+#define USE_BAROMETER 0
+#if USE_BAROMETER
+#include "BMP085.h"
+#include "VerticalFilter.h"
+#endif
+
+// Gesture events and a summary of the features, over the radio to a gateway
+#define USE_TELEMETRY 0
+#if USE_TELEMETRY
+#include "TelemetryBatcher.h"
+#endif
+
 // Constants
 const int sampleRate = 18; // in ms
 const int eventDisplayPeriod = 48; // in ms
+#if USE_TELEMETRY
+const int telemetryLatency = 500; // in ms: how long an event can wait for others to share its packet
+const int telemetrySummaryPeriod = 1000; // in ms
+#endif
 
 // Globals
 unsigned long g_turnOffDisplayTime = 0;
@@ -33,20 +50,17 @@ public:
 
 // TODO: put them in a class?
 
+// The detector's reading is the one scripts see too, until the next sample
 void updateAccelerometer()
 {
-    uBit.accelerometer.update();
+    touch_develop::micro_bit::getAccelerometerFrame().update(uBit.systemTime());
 }
 
 byteVector3 getAccelData()
 {
     // Actually, I don't think we need the clampByte here
     // TODO: test if clamp was necessary and display something if so, just to make sure
-    int x = clampByte(uBit.accelerometer.getX() >> 4);
-    int y = clampByte(uBit.accelerometer.getY() >> 4);
-    int z = clampByte(uBit.accelerometer.getZ() >> 4);
-
-    return byteVector3(x, y, z);
+    return touch_develop::micro_bit::getAccelerometerFrame().getSample();
 }
 
 bool buttonA()
@@ -141,6 +155,42 @@ MicroBit& GetMicrobit()
 // Local code
 //
 MicroBitGestureDetector detector;
+
+#if USE_BAROMETER
+VerticalFilter verticalFilter;
+uint32_t g_numBaroMeasurements = 0;
+
+// Runs on every accelerometer tick, with the sample the detector just took
+void updateVertical()
+{
+    uint32_t numMeasurements = bmp085::getNumMeasurements();
+    if (numMeasurements != g_numBaroMeasurements)
+    {
+        g_numBaroMeasurements = numMeasurements;
+        verticalFilter.setBaroAltitude(bmp085::getAltitude());
+    }
+    verticalFilter.addSample(getAccelData(), detector.getGravity());
+}
+#endif
+
+#if USE_TELEMETRY
+TelemetryBatcher<MicroBitRadioDatagram> telemetryBatcher(uBit.radio.datagram, telemetryLatency);
+unsigned long g_nextSummaryTime = 0;
+
+// Gravity (±2 g) and the shake prediction (±2, 128 to the unit), a byte each
+void addTelemetrySummary(unsigned long time)
+{
+    const filteredSample_t& gravity = detector.getGravity();
+    uint8_t values[] = {
+        telemetry::quantize(int(gravity.x), -128, 128),
+        telemetry::quantize(int(gravity.y), -128, 128),
+        telemetry::quantize(int(gravity.z), -128, 128),
+        telemetry::quantize(detector.getShakePrediction().value_, -256, 256),
+    };
+    telemetryBatcher.addSummary(time, values, 4);
+}
+#endif
+
 void accelerometer_poll()
 {
     // try scheduling the component thing here
@@ -149,7 +199,12 @@ void accelerometer_poll()
 
     while(true)
     {
-        detector.systemTick();
+        if (detector.systemTick())
+        {
+#if USE_BAROMETER
+            updateVertical();
+#endif
+        }
 
         unsigned long time = uBit.systemTime();
         // If enough time has elapsed or the timer rolls over, do something
@@ -160,14 +215,32 @@ void accelerometer_poll()
                 uBit.display.clear();
             }
 
-            int detectedGesture = detector.getCurrentGesture();
-            if(detectedGesture != 0)
+            uint16_t firedGestures = detector.getFiredGestures();
+            if(firedGestures != 0)
             {
                 g_turnOffDisplayTime = time + eventDisplayPeriod;
 
-                // The event constructor has the side-effect of dispatching the event onto the message bus
-                MicroBitEvent(MICROBIT_ID_ACCELEROMETER, detectedGesture);
+                // Raise every gesture that fired, not just the highest-priority one
+                for(int event = MICROBIT_ACCELEROMETER_SHAKE; event <= MICROBIT_ACCELEROMETER_TILT_RIGHT; event++)
+                {
+                    if(firedGestures & eventBit(event))
+                    {
+                        // The event constructor has the side-effect of dispatching the event onto the message bus
+                        MicroBitEvent(MICROBIT_ID_ACCELEROMETER, event);
+#if USE_TELEMETRY
+                        telemetryBatcher.addEvent(time, uint8_t(event - MICROBIT_ACCELEROMETER_SHAKE));
+#endif
+                    }
+                }
+            }
+#if USE_TELEMETRY
+            if (int(time - g_nextSummaryTime) >= 0)
+            {
+                addTelemetrySummary(time);
+                g_nextSummaryTime = time + telemetrySummaryPeriod;
             }
+            telemetryBatcher.poll(time);
+#endif
             g_prevTime = time;
         }
         uBit.sleep(1);
@@ -182,24 +255,63 @@ void onShake(MicroBitEvent)
 
 void onTap(MicroBitEvent)
 {
-    uBit.display.print('.');
+    switch(detector.getTapDirection())
+    {
+    case IMPULSE_X_POS:
+        uBit.display.print('>');
+        break;
+    case IMPULSE_X_NEG:
+        uBit.display.print('<');
+        break;
+    case IMPULSE_Y_POS:
+        uBit.display.print('v');
+        break;
+    case IMPULSE_Y_NEG:
+        uBit.display.print('^');
+        break;
+    default:
+        uBit.display.print('.');
+        break;
+    }
+}
+
+void onDoubleTap(MicroBitEvent)
+{
+    uBit.display.print(':');
+}
+
+void onFreefall(MicroBitEvent)
+{
+    uBit.display.print('!');
 }
 
+#if GESTURE_DIAGNOSTICS
 void onButtonA(MicroBitEvent)
 {
     detector.togglePrinting();
 }
+#endif
 
+#if USE_SLOW_SHAKE
 void onButtonB(MicroBitEvent)
 {
     detector.toggleAlg();
 }
+#endif
 
 void app_main()
 {
     //    uBit.addIdleComponent(&test); // argh! this causes the micro:bit to die
     //    initClassifiers();
     detector.init();
+#if USE_BAROMETER
+    bmp085::begin(bmp085::BMP085_MODE_ULTRAHIGHRES);
+    bmp085::startSampling(bmp085::BMP085_MODE_ULTRAHIGHRES, 100);
+    verticalFilter.init();
+#endif
+#if USE_TELEMETRY
+    uBit.radio.enable();
+#endif
 
     // create background worker that polls for shake events
     create_fiber(accelerometer_poll);
@@ -207,6 +319,12 @@ void app_main()
     // ... and listen for them
     uBit.MessageBus.listen(MICROBIT_ID_ACCELEROMETER, MICROBIT_ACCELEROMETER_SHAKE, onShake);
     uBit.MessageBus.listen(MICROBIT_ID_ACCELEROMETER, MICROBIT_ACCELEROMETER_TAP, onTap);
+    uBit.MessageBus.listen(MICROBIT_ID_ACCELEROMETER, MICROBIT_ACCELEROMETER_DOUBLE_TAP, onDoubleTap);
+    uBit.MessageBus.listen(MICROBIT_ID_ACCELEROMETER, MICROBIT_ACCELEROMETER_FREEFALL, onFreefall);
+#if GESTURE_DIAGNOSTICS
     uBit.MessageBus.listen(MICROBIT_ID_BUTTON_A, MICROBIT_BUTTON_EVT_CLICK, onButtonA);
+#endif
+#if USE_SLOW_SHAKE
     uBit.MessageBus.listen(MICROBIT_ID_BUTTON_B, MICROBIT_BUTTON_EVT_CLICK, onButtonB);
+#endif
 }